@@ -21,6 +21,7 @@ BUILD_DIR=Linux_$BUILD_TYPE
 echo Usage: ./cmake_linux_clang_gcc.sh [Configuration] [Compiler]
 echo "Possible configurations: Debug (default), Release, Distribution"
 echo "Possible compilers: clang++, clang++-XX, g++, g++-XX where XX is the version"
+echo "Extra arguments go to cmake, e.g. -DJOLT_SERVICE_PROFILING=ON for a profiling build (Chrome trace captures)"
 echo Generating Makefile for build type \"$BUILD_TYPE\" and compiler \"$COMPILER\" in folder \"$BUILD_DIR\"
 
 cmake -S . -B $BUILD_DIR -G "Unix Makefiles" -DCMAKE_PREFIX_PATH=$MY_INSTALL_DIR -DCMAKE_BUILD_TYPE=$BUILD_TYPE -DCMAKE_CXX_STANDARD=17 -DCMAKE_CXX_COMPILER=$COMPILER "${@}"
@@ -0,0 +1,115 @@
+#include "../PhysicsSimulation/PhysicsServiceImpl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// "1000,5000" -> 1000 5000
+	std::vector<int> ParseCountList(const char* countList)
+	{
+		std::vector<int> counts;
+		std::stringstream countStream(countList);
+		std::string count;
+		while(std::getline(countStream, count, ','))
+		{
+			counts.push_back(std::atoi(count.c_str()));
+		}
+		return counts;
+	}
+
+	// Actors in a grid above the floor, close enough to pile up and keep the solver busy
+	std::vector<ActorInitializationInfo> CreateActorGrid(int actorCount)
+	{
+		const int actorsPerRow = 50;
+		std::vector<ActorInitializationInfo> actors(actorCount);
+		for(int i = 0; i < actorCount; ++i)
+		{
+			actors[i].ActorId = i + 1;
+			actors[i].InitialPosX = (i % actorsPerRow - actorsPerRow / 2) * 110.0;
+			actors[i].InitialPosY = (i / actorsPerRow % actorsPerRow - actorsPerRow / 2) * 110.0;
+			actors[i].InitialPosZ = 200.0 + (i / (actorsPerRow * actorsPerRow)) * 120.0;
+		}
+		return actors;
+	}
+
+	// Milliseconds per PhysicsSystem::Update, after a warm up
+	double MeasureStepTime(const std::vector<ActorInitializationInfo>& actors, const JobSystemSettings& jobSystemSettings, int stepCount)
+	{
+		PhysicsServiceImpl physicsService;
+		physicsService.SetJobSystemSettings(jobSystemSettings);
+		physicsService.InitPhysicsSystem(actors);
+
+		const auto stepWorld = [&physicsService]()
+		{
+			physicsService.physics_system->Update(1.0f / 60.f, 1, 1, physicsService.temp_allocator, physicsService.job_system);
+		};
+
+		for(int i = 0; i < 10; ++i)
+		{
+			stepWorld();
+		}
+
+		const auto startTime = std::chrono::steady_clock::now();
+		for(int i = 0; i < stepCount; ++i)
+		{
+			stepWorld();
+		}
+		const std::chrono::duration<double, std::milli> elapsedTime = std::chrono::steady_clock::now() - startTime;
+		return elapsedTime.count() / std::max(stepCount, 1);
+	}
+}
+
+// Compares WorkStealingJobSystem against JobSystemThreadPool on the service's world across body and worker counts.
+// Usage: JobSystemBenchmark [body counts, e.g. 1000,5000,20000] [worker counts, e.g. 1,3,7] [steps] [pin=on|off]
+int main(int argc, char** argv)
+{
+	const int hardwareWorkerCount = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+
+	const std::vector<int> bodyCounts = ParseCountList(argc > 1 ? argv[1] : "1000,5000,20000");
+	std::vector<int> workerCounts = argc > 2 ? ParseCountList(argv[2]) : std::vector<int>();
+	if(workerCounts.empty())
+	{
+		for(int workerCount = 1; workerCount < hardwareWorkerCount; workerCount *= 2)
+		{
+			workerCounts.push_back(workerCount);
+		}
+		workerCounts.push_back(hardwareWorkerCount);
+	}
+	const int stepCount = argc > 3 ? std::atoi(argv[3]) : 300;
+	const bool bPinWorkers = argc > 4 && std::string(argv[4]) == "pin=on";
+
+	PhysicsServiceImpl::InitializeJoltRuntime();
+
+	std::vector<std::string> resultLines;
+	for(int bodyCount : bodyCounts)
+	{
+		const std::vector<ActorInitializationInfo> actors = CreateActorGrid(bodyCount);
+		for(int workerCount : workerCounts)
+		{
+			const double threadPoolStepTime = MeasureStepTime(actors, { EJobSystemType::ThreadPool, workerCount, false }, stepCount);
+			const double workStealingStepTime = MeasureStepTime(actors, { EJobSystemType::WorkStealing, workerCount, bPinWorkers }, stepCount);
+
+			char resultLine[128];
+			snprintf(resultLine, sizeof(resultLine), "%8d %8d %14.3f %14.3f %8.2fx", bodyCount, workerCount, threadPoolStepTime, workStealingStepTime, threadPoolStepTime / workStealingStepTime);
+			resultLines.push_back(resultLine);
+		}
+	}
+
+	PhysicsServiceImpl::ShutdownJoltRuntime();
+
+	// After the run: Init logs would be interleaved with the table otherwise
+	printf("\n%d steps per run, work stealing workers %s\n", stepCount, bPinWorkers ? "pinned" : "not pinned");
+	printf("%8s %8s %14s %14s %9s\n", "bodies", "workers", "pool ms/step", "steal ms/step", "speedup");
+	for(const std::string& resultLine : resultLines)
+	{
+		printf("%s\n", resultLine.c_str());
+	}
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include "../PhysicsSimulation/RotationConversion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Times ConvertRotationsToEulerAngles against the scalar fallback on random rotations and reports the largest difference.
+// Usage: RotationConversionBenchmark [rotation count] [iterations]
+int main(int argc, char** argv)
+{
+	const size_t rotationCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+	const size_t iterationCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+
+	std::mt19937 randomGenerator(1234);
+	std::uniform_real_distribution<float> randomComponent(-1.f, 1.f);
+
+	std::vector<Quat> rotations(rotationCount);
+	for(Quat& rotation : rotations)
+	{
+		rotation = Quat(randomComponent(randomGenerator), randomComponent(randomGenerator), randomComponent(randomGenerator), randomComponent(randomGenerator)).Normalized();
+	}
+
+	std::vector<float> scalarX(rotationCount), scalarY(rotationCount), scalarZ(rotationCount);
+	std::vector<float> vectorX(rotationCount), vectorY(rotationCount), vectorZ(rotationCount);
+
+	const auto timeConversion = [&](auto convertRotations)
+	{
+		const auto startTime = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < iterationCount; ++i)
+		{
+			convertRotations();
+		}
+		const auto elapsedTime = std::chrono::steady_clock::now() - startTime;
+		return std::chrono::duration<double, std::nano>(elapsedTime).count() / double(std::max<size_t>(rotationCount * iterationCount, 1));
+	};
+
+	const double scalarTime = timeConversion([&]() { ConvertRotationsToEulerAnglesScalar(rotations.data(), rotationCount, scalarX.data(), scalarY.data(), scalarZ.data()); });
+	const double vectorTime = timeConversion([&]() { ConvertRotationsToEulerAngles(rotations.data(), rotationCount, vectorX.data(), vectorY.data(), vectorZ.data()); });
+
+	// Angles near +-pi may come out on the other side of the wrap around, compare them modulo 2 pi
+	float maxError = 0.f;
+	for(size_t i = 0; i < rotationCount; ++i)
+	{
+		const float errors[3] = { scalarX[i] - vectorX[i], scalarY[i] - vectorY[i], scalarZ[i] - vectorZ[i] };
+		for(float error : errors)
+		{
+			error = std::abs(error);
+			maxError = std::max(maxError, std::min(error, std::abs(error - 2.f * JPH_PI)));
+		}
+	}
+
+	printf("Rotations: %zu, iterations: %zu, vectorized: %s\n", rotationCount, iterationCount, IsRotationConversionVectorized() ? "yes" : "no");
+	printf("Scalar:     %.3f ns / rotation\n", scalarTime);
+	printf("Vectorized: %.3f ns / rotation (%.2fx)\n", vectorTime, scalarTime / vectorTime);
+	printf("Max difference: %g rad\n", maxError);
+
+	return 0;
+}
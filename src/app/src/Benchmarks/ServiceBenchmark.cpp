@@ -0,0 +1,416 @@
+#include "../PhysicsSimulation/PhysicsServiceImpl.h"
+#include "../Communication/LatencyHistogram.h"
+#include "../Communication/PhysicsServiceProtocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+namespace
+{
+	// Every operator new of the process (the service's containers, the job system and pipeline threads). Jolt's own
+	// allocations go through JPH::Allocate and aren't counted.
+	std::atomic<uint64_t> AllocationCount { 0 };
+
+	void* AllocateCounted(std::size_t size)
+	{
+		AllocationCount.fetch_add(1, std::memory_order_relaxed);
+		if(void* memory = std::malloc(size > 0 ? size : 1))
+		{
+			return memory;
+		}
+		throw std::bad_alloc();
+	}
+
+	void* AllocateCountedAligned(std::size_t size, std::align_val_t alignment)
+	{
+		AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+		// aligned_alloc wants a multiple of the alignment
+		const std::size_t alignmentBytes = static_cast<std::size_t>(alignment);
+		const std::size_t alignedSize = std::max((size + alignmentBytes - 1) / alignmentBytes * alignmentBytes, alignmentBytes);
+		if(void* memory = std::aligned_alloc(alignmentBytes, alignedSize))
+		{
+			return memory;
+		}
+		throw std::bad_alloc();
+	}
+}
+
+// Counting replacements of the global allocation functions, so a run can check that a warmed up step doesn't allocate
+void* operator new(std::size_t size) { return AllocateCounted(size); }
+void* operator new[](std::size_t size) { return AllocateCounted(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return AllocateCountedAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return AllocateCountedAligned(size, alignment); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace
+{
+	enum class EActorLayout
+	{
+		// Evenly spaced, a layer of 50 x 50 actors over another
+		Grid,
+
+		// Towers of 10 actors, falling over onto each other
+		Piles,
+
+		// Random positions in a box that grows with the actor count
+		Scattered
+	};
+
+	struct BenchmarkConfig
+	{
+		std::vector<int> BodyCounts = { 1000, 5000, 20000 };
+
+		// -1 = hardware threads - 1 (see JobSystemSettings::WorkerCount)
+		std::vector<int> WorkerCounts = { -1 };
+
+		std::vector<EActorLayout> Layouts = { EActorLayout::Grid };
+		int StepCount = 600;
+		int WarmUpStepCount = 10;
+		EJobSystemType JobSystemType = EJobSystemType::WorkStealing;
+		bool bPipelinedStepping = false;
+		EStepEncoding StepEncoding = EStepEncoding::Float;
+		EStepResponseMode StepResponseMode = EStepResponseMode::Full;
+
+		// CSV goes to stdout (after the runs) when empty
+		std::string OutputFilePath;
+	};
+
+	const char* GetLayoutName(EActorLayout layout)
+	{
+		switch(layout)
+		{
+			case EActorLayout::Grid: return "grid";
+			case EActorLayout::Piles: return "piles";
+			case EActorLayout::Scattered: return "scattered";
+		}
+		return "unknown";
+	}
+
+	// "1000,5000" -> 1000 5000
+	std::vector<std::string> SplitList(const std::string& list)
+	{
+		std::vector<std::string> items;
+		std::stringstream listStream(list);
+		std::string item;
+		while(std::getline(listStream, item, ','))
+		{
+			items.push_back(item);
+		}
+		return items;
+	}
+
+	// --option=value arguments, returns false on an unknown option or value
+	bool ParseArguments(int argc, char** argv, BenchmarkConfig& outConfig)
+	{
+		for(int i = 1; i < argc; ++i)
+		{
+			const std::string argument = argv[i];
+			const size_t equalsPosition = argument.find('=');
+			if(argument.rfind("--", 0) != 0 || equalsPosition == std::string::npos)
+			{
+				printf("Unknown argument \"%s\" (expected --option=value)\n", argument.c_str());
+				return false;
+			}
+
+			const std::string optionName = argument.substr(2, equalsPosition - 2);
+			const std::string optionValue = argument.substr(equalsPosition + 1);
+			if(optionName == "bodies" || optionName == "workers")
+			{
+				std::vector<int>& counts = optionName == "bodies" ? outConfig.BodyCounts : outConfig.WorkerCounts;
+				counts.clear();
+				for(const std::string& count : SplitList(optionValue))
+				{
+					counts.push_back(std::atoi(count.c_str()));
+				}
+			}
+			else if(optionName == "layout")
+			{
+				outConfig.Layouts.clear();
+				for(const std::string& layoutName : SplitList(optionValue))
+				{
+					if(layoutName != "grid" && layoutName != "piles" && layoutName != "scattered")
+					{
+						printf("Unknown layout \"%s\"\n", layoutName.c_str());
+						return false;
+					}
+					outConfig.Layouts.push_back(layoutName == "grid" ? EActorLayout::Grid : layoutName == "piles" ? EActorLayout::Piles : EActorLayout::Scattered);
+				}
+			}
+			else if(optionName == "steps")
+			{
+				outConfig.StepCount = std::max(std::atoi(optionValue.c_str()), 1);
+			}
+			else if(optionName == "warmup")
+			{
+				outConfig.WarmUpStepCount = std::max(std::atoi(optionValue.c_str()), 0);
+			}
+			else if(optionName == "job-system" && (optionValue == "stealing" || optionValue == "pool"))
+			{
+				outConfig.JobSystemType = optionValue == "stealing" ? EJobSystemType::WorkStealing : EJobSystemType::ThreadPool;
+			}
+			else if(optionName == "pipelined" && (optionValue == "on" || optionValue == "off"))
+			{
+				outConfig.bPipelinedStepping = optionValue == "on";
+			}
+			else if(optionName == "encoding" && (optionValue == "float" || optionValue == "quantized"))
+			{
+				outConfig.StepEncoding = optionValue == "float" ? EStepEncoding::Float : EStepEncoding::Quantized;
+			}
+			else if(optionName == "mode" && (optionValue == "full" || optionValue == "delta"))
+			{
+				outConfig.StepResponseMode = optionValue == "full" ? EStepResponseMode::Full : EStepResponseMode::Delta;
+			}
+			else if(optionName == "output")
+			{
+				outConfig.OutputFilePath = optionValue;
+			}
+			else
+			{
+				printf("Invalid argument \"%s\"\n", argument.c_str());
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Binary Init payload (see PhysicsServiceProtocol::EOpcode::Init) of actorCount spheres placed by layout. Same seed every run.
+	std::vector<char> CreateInitPayload(EActorLayout layout, int actorCount)
+	{
+		using namespace PhysicsServiceProtocol;
+
+		std::vector<char> initPayload;
+		AppendLittleEndian<uint32_t>(initPayload, (uint32_t)actorCount);
+
+		std::mt19937 randomGenerator(1234);
+		std::uniform_real_distribution<float> unitRandom(0.f, 1.f);
+
+		const int actorsPerRow = 50;
+		const int actorsPerPile = 10;
+		const int pilesPerRow = std::max((int)std::ceil(std::sqrt(actorCount / (float)actorsPerPile)), 1);
+		const float scatterExtent = std::sqrt((float)actorCount) * 150.f;
+
+		for(int i = 0; i < actorCount; ++i)
+		{
+			float position[3] = { 0.f, 0.f, 0.f };
+			switch(layout)
+			{
+				case EActorLayout::Grid:
+					position[0] = (i % actorsPerRow - actorsPerRow / 2) * 110.f;
+					position[1] = (i / actorsPerRow % actorsPerRow - actorsPerRow / 2) * 110.f;
+					position[2] = 200.f + (i / (actorsPerRow * actorsPerRow)) * 120.f;
+					break;
+
+				case EActorLayout::Piles:
+				{
+					// Slightly off center, so the piles topple
+					const int pileIndex = i / actorsPerPile;
+					position[0] = (pileIndex % pilesPerRow - pilesPerRow / 2) * 300.f + unitRandom(randomGenerator) * 10.f;
+					position[1] = (pileIndex / pilesPerRow - pilesPerRow / 2) * 300.f + unitRandom(randomGenerator) * 10.f;
+					position[2] = 60.f + (i % actorsPerPile) * 101.f;
+					break;
+				}
+
+				case EActorLayout::Scattered:
+					position[0] = (unitRandom(randomGenerator) - 0.5f) * scatterExtent;
+					position[1] = (unitRandom(randomGenerator) - 0.5f) * scatterExtent;
+					position[2] = 100.f + unitRandom(randomGenerator) * 2000.f;
+					break;
+			}
+
+			AppendLittleEndian<int32_t>(initPayload, i + 1);
+			for(float coordinate : position)
+			{
+				AppendLittleEndian<float>(initPayload, coordinate);
+			}
+		}
+
+		return initPayload;
+	}
+
+	// Starts a new peak RSS measure. Returns false if the kernel doesn't allow it: the peak is then the one of the process.
+	bool ResetPeakResidentSetSize()
+	{
+		std::ofstream clearRefsFile("/proc/self/clear_refs");
+		clearRefsFile << "5";
+		clearRefsFile.flush();
+		return clearRefsFile.good();
+	}
+
+	// Peak RSS in KB since ResetPeakResidentSetSize (VmHWM)
+	long GetPeakResidentSetSize()
+	{
+		std::ifstream statusFile("/proc/self/status");
+		std::string statusLine;
+		while(std::getline(statusFile, statusLine))
+		{
+			if(statusLine.rfind("VmHWM:", 0) == 0)
+			{
+				return std::atol(statusLine.c_str() + 6);
+			}
+		}
+
+		rusage resourceUsage;
+		getrusage(RUSAGE_SELF, &resourceUsage);
+		return resourceUsage.ru_maxrss;
+	}
+
+	double ToMicroseconds(std::chrono::steady_clock::duration duration)
+	{
+		return std::chrono::duration<double, std::micro>(duration).count();
+	}
+
+	// One CSV line for the run. outSteadyAllocationCount is the amount of operator new during the measured steps (after the warm-up).
+	std::string RunBenchmark(const BenchmarkConfig& config, EActorLayout layout, int bodyCount, int workerCount, uint64_t& outSteadyAllocationCount)
+	{
+		ResetPeakResidentSetSize();
+
+		const std::vector<char> initPayload = CreateInitPayload(layout, bodyCount);
+
+		PhysicsServiceImpl physicsService;
+		physicsService.SetJobSystemSettings({ config.JobSystemType, workerCount, false });
+		physicsService.SetPipelinedStepping(config.bPipelinedStepping);
+		physicsService.SetStepResponseMode(config.StepResponseMode, 0.1f, 0.005f);
+		physicsService.SetStepEncoding(config.StepEncoding, TransformQuantizationSettings());
+
+		const auto preInitTime = std::chrono::steady_clock::now();
+		physicsService.InitPhysicsSystemFromBinary(initPayload.data(), (uint32)initPayload.size());
+		const double initMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - preInitTime).count();
+
+		std::vector<char> stepResponse;
+		for(int i = 0; i < config.WarmUpStepCount; ++i)
+		{
+			stepResponse.clear();
+			physicsService.StepPhysicsSimulationBinary(stepResponse);
+		}
+
+		LatencyHistogram stepLatency;
+		std::chrono::steady_clock::duration updateTime = std::chrono::steady_clock::duration::zero();
+		std::chrono::steady_clock::duration snapshotTime = std::chrono::steady_clock::duration::zero();
+		std::chrono::steady_clock::duration serializeTime = std::chrono::steady_clock::duration::zero();
+		size_t responseBytes = 0;
+
+		const uint64_t preStepsAllocationCount = AllocationCount.load(std::memory_order_relaxed);
+		const auto startTime = std::chrono::steady_clock::now();
+		for(int i = 0; i < config.StepCount; ++i)
+		{
+			// Like a session: the response buffer is reused
+			stepResponse.clear();
+
+			const auto preStepTime = std::chrono::steady_clock::now();
+			physicsService.StepPhysicsSimulationBinary(stepResponse);
+			stepLatency.Record(std::chrono::steady_clock::now() - preStepTime);
+
+			const StepPhaseDurations& stepPhaseDurations = physicsService.GetLastStepPhaseDurations();
+			updateTime += stepPhaseDurations.Update;
+			snapshotTime += stepPhaseDurations.Snapshot;
+			serializeTime += stepPhaseDurations.Serialize;
+			responseBytes += stepResponse.size();
+		}
+		const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		outSteadyAllocationCount = AllocationCount.load(std::memory_order_relaxed) - preStepsAllocationCount;
+
+		char resultLine[512];
+		snprintf(resultLine, sizeof(resultLine), "%s,%d,%d,%s,%s,%s,%s,%d,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%zu,%ld,%llu",
+			GetLayoutName(layout), bodyCount, workerCount >= 0 ? workerCount : std::max((int)std::thread::hardware_concurrency() - 1, 0),
+			config.JobSystemType == EJobSystemType::WorkStealing ? "stealing" : "pool", config.bPipelinedStepping ? "on" : "off",
+			config.StepEncoding == EStepEncoding::Float ? "float" : "quantized", config.StepResponseMode == EStepResponseMode::Full ? "full" : "delta",
+			config.StepCount, initMilliseconds, config.StepCount / elapsedSeconds,
+			stepLatency.GetMeanValue() / 1000.0, stepLatency.GetValueAtPercentile(50.0) / 1000.0, stepLatency.GetValueAtPercentile(99.0) / 1000.0,
+			stepLatency.GetMaxValue() / 1000.0, ToMicroseconds(updateTime) / config.StepCount, ToMicroseconds(snapshotTime) / config.StepCount,
+			ToMicroseconds(serializeTime) / config.StepCount, responseBytes / (size_t)config.StepCount, GetPeakResidentSetSize(),
+			(unsigned long long)outSteadyAllocationCount);
+		return resultLine;
+	}
+}
+
+// Runs the service's world in-process (no socket, no client) on synthetic scenes: binary Init, then binary Steps.
+// Prints one CSV line per layout, body count and worker count, to compare builds and machines.
+// Usage: ServiceBenchmark [--bodies=1000,5000] [--workers=1,3,7] [--layout=grid,piles,scattered] [--steps=600] [--warmup=10]
+//     [--job-system=stealing|pool] [--pipelined=on|off] [--encoding=float|quantized] [--mode=full|delta] [--output=results.csv]
+// Update, snapshot and serialize are the step phases of PhysicsServiceImpl (see StepPhaseDurations), in microseconds per step.
+// Peak RSS is measured per run where the kernel allows to reset it (/proc/self/clear_refs), for the process otherwise.
+// steady_allocs counts the operator new calls during the measured steps: a warmed up step shouldn't allocate,
+// so the benchmark fails (exit code 2) if a run did. Raise --warmup if the responses still grow after it.
+int main(int argc, char** argv)
+{
+	BenchmarkConfig config;
+	if(!ParseArguments(argc, argv, config))
+	{
+		return 1;
+	}
+
+	PhysicsServiceImpl::InitializeJoltRuntime();
+
+	std::vector<std::string> resultLines;
+	std::vector<std::string> allocatingRuns;
+	for(EActorLayout layout : config.Layouts)
+	{
+		for(int bodyCount : config.BodyCounts)
+		{
+			for(int workerCount : config.WorkerCounts)
+			{
+				uint64_t steadyAllocationCount = 0;
+				resultLines.push_back(RunBenchmark(config, layout, bodyCount, workerCount, steadyAllocationCount));
+				if(steadyAllocationCount > 0)
+				{
+					char allocatingRun[128];
+					snprintf(allocatingRun, sizeof(allocatingRun), "%s, %d bodies, %d workers: %llu allocations",
+						GetLayoutName(layout), bodyCount, workerCount, (unsigned long long)steadyAllocationCount);
+					allocatingRuns.push_back(allocatingRun);
+				}
+			}
+		}
+	}
+
+	PhysicsServiceImpl::ShutdownJoltRuntime();
+
+	// After the run: Init logs would be interleaved with the results otherwise
+	std::string results = "layout,bodies,workers,job_system,pipelined,encoding,mode,steps,init_ms,steps_per_s,step_mean_us,step_p50_us,step_p99_us,"
+		"step_max_us,update_us,snapshot_us,serialize_us,response_bytes,peak_rss_kb,steady_allocs\n";
+	for(const std::string& resultLine : resultLines)
+	{
+		results += resultLine + "\n";
+	}
+
+	if(config.OutputFilePath.empty())
+	{
+		printf("\n%s", results.c_str());
+	}
+	else
+	{
+		std::ofstream outputFile(config.OutputFilePath);
+		outputFile << results;
+		if(!outputFile.good())
+		{
+			printf("Could not write %s\n", config.OutputFilePath.c_str());
+			return 1;
+		}
+		printf("Results written to %s\n", config.OutputFilePath.c_str());
+	}
+
+	for(const std::string& allocatingRun : allocatingRuns)
+	{
+		printf("Steps allocated after the warm-up (%s)\n", allocatingRun.c_str());
+	}
+	return allocatingRuns.empty() ? 0 : 2;
+}
@@ -0,0 +1,98 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <cmath>
+
+void LatencyHistogram::RecordValue(uint64_t valueNanoseconds)
+{
+    ++BucketCounts[GetBucketIndex(valueNanoseconds)];
+    ++TotalCount;
+    MinValue = std::min(MinValue, valueNanoseconds);
+    MaxValue = std::max(MaxValue, valueNanoseconds);
+    ValueSum += valueNanoseconds;
+}
+
+void LatencyHistogram::Record(std::chrono::steady_clock::duration duration)
+{
+    const int64_t durationNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    RecordValue(durationNanoseconds > 0 ? (uint64_t)durationNanoseconds : 0);
+}
+
+uint64_t LatencyHistogram::GetValueAtPercentile(double percentile) const
+{
+    if(TotalCount == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value we look for, the first value for percentile 0
+    const double clampedPercentile = std::min(std::max(percentile, 0.0), 100.0);
+    const uint64_t targetCount = std::max<uint64_t>((uint64_t)std::ceil(clampedPercentile / 100.0 * TotalCount), 1);
+
+    uint64_t accumulatedCount = 0;
+    for(size_t bucketIndex = 0; bucketIndex < BucketCount; ++bucketIndex)
+    {
+        accumulatedCount += BucketCounts[bucketIndex];
+        if(accumulatedCount >= targetCount)
+        {
+            return std::min(GetBucketUpperBound(bucketIndex), MaxValue);
+        }
+    }
+
+    return MaxValue;
+}
+
+void LatencyHistogram::Reset()
+{
+    BucketCounts.fill(0);
+    TotalCount = 0;
+    MinValue = UINT64_MAX;
+    MaxValue = 0;
+    ValueSum = 0;
+}
+
+size_t LatencyHistogram::GetBucketIndex(uint64_t valueNanoseconds)
+{
+    if(valueNanoseconds < SubBucketCount)
+    {
+        return (size_t)valueNanoseconds;
+    }
+
+    const uint64_t clampedValue = std::min(valueNanoseconds, (uint64_t(1) << MaxValueBits) - 1);
+
+    // Power of two of the value, and its top SubBucketBits - 1 bits below the leading one
+    const int valueMagnitude = 63 - __builtin_clzll(clampedValue);
+    const int subBucketShift = valueMagnitude - (SubBucketBits - 1);
+    const size_t subBucketIndex = (size_t)(clampedValue >> subBucketShift) - SubBucketHalfCount;
+
+    return SubBucketCount + (valueMagnitude - SubBucketBits) * SubBucketHalfCount + subBucketIndex;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucketIndex)
+{
+    if(bucketIndex < SubBucketCount)
+    {
+        return bucketIndex;
+    }
+
+    const size_t logBucketIndex = bucketIndex - SubBucketCount;
+    const int valueMagnitude = (int)(logBucketIndex / SubBucketHalfCount) + SubBucketBits;
+    const int subBucketShift = valueMagnitude - (SubBucketBits - 1);
+    const uint64_t bucketLowerBound = (uint64_t)(logBucketIndex % SubBucketHalfCount + SubBucketHalfCount) << subBucketShift;
+
+    return bucketLowerBound + (uint64_t(1) << subBucketShift) - 1;
+}
+
+const char* GetLatencyPhaseName(ELatencyPhase phase)
+{
+    switch(phase)
+    {
+        case ELatencyPhase::Receive: return "Receive";
+        case ELatencyPhase::Parse: return "Parse";
+        case ELatencyPhase::Update: return "Update";
+        case ELatencyPhase::Snapshot: return "Snapshot";
+        case ELatencyPhase::Serialize: return "Serialize";
+        case ELatencyPhase::Send: return "Send";
+        case ELatencyPhase::Step: return "Step";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+* Fixed memory latency histogram (HDR-style log-linear buckets): the values below 128 ns are counted exactly,
+* above that every power of two is split into 64 buckets, so a percentile is within 1 / 64 (1.6%) of the measured value.
+* Values of 2^40 ns (about 18 minutes) and above are counted in the last bucket. About 18 KB, whatever the amount of values.
+*/
+class LatencyHistogram
+{
+public:
+    void RecordValue(uint64_t valueNanoseconds);
+    void Record(std::chrono::steady_clock::duration duration);
+
+    /**
+    * Value below which percentile % of the recorded values are (upper bound of its bucket), 0 if nothing was recorded.
+    */
+    uint64_t GetValueAtPercentile(double percentile) const;
+
+    uint64_t GetTotalCount() const { return TotalCount; }
+    uint64_t GetMinValue() const { return TotalCount > 0 ? MinValue : 0; }
+    uint64_t GetMaxValue() const { return MaxValue; }
+    double GetMeanValue() const { return TotalCount > 0 ? (double)ValueSum / TotalCount : 0.0; }
+
+    /**
+    * Calls bucketVisitor(bucket upper bound in ns, count) for every bucket with values, in ascending order.
+    */
+    template <class BucketVisitor>
+    void ForEachRecordedBucket(const BucketVisitor& bucketVisitor) const
+    {
+        for(size_t bucketIndex = 0; bucketIndex < BucketCount; ++bucketIndex)
+        {
+            if(BucketCounts[bucketIndex] > 0)
+            {
+                bucketVisitor(GetBucketUpperBound(bucketIndex), BucketCounts[bucketIndex]);
+            }
+        }
+    }
+
+    void Reset();
+
+private:
+    static constexpr int SubBucketBits = 7;
+    static constexpr size_t SubBucketCount = size_t(1) << SubBucketBits;
+    static constexpr size_t SubBucketHalfCount = SubBucketCount / 2;
+    static constexpr int MaxValueBits = 40;
+    static constexpr size_t BucketCount = SubBucketCount + (MaxValueBits - SubBucketBits) * SubBucketHalfCount;
+
+    static size_t GetBucketIndex(uint64_t valueNanoseconds);
+    static uint64_t GetBucketUpperBound(size_t bucketIndex);
+
+private:
+    std::array<uint64_t, BucketCount> BucketCounts {};
+    uint64_t TotalCount = 0;
+    uint64_t MinValue = UINT64_MAX;
+    uint64_t MaxValue = 0;
+    uint64_t ValueSum = 0;
+};
+
+/**
+* Phases of serving the client, each with its own latency histogram.
+*/
+enum class ELatencyPhase : uint8_t
+{
+    // Reading the request bytes (recv / copying out of the shared memory command ring)
+    Receive = 0,
+
+    // Handling the received messages, except the steps below (Init messages included)
+    Parse = 1,
+
+    // PhysicsSystem::Update. With pipelined stepping, the step simulated ahead of the request.
+    Update = 2,
+
+    // Copying the body state into the step response snapshot
+    Snapshot = 3,
+
+    // Writing the step response
+    Serialize = 4,
+
+    // Handing the responses to the transport (send / copying into the shared memory snapshot buffer)
+    Send = 5,
+
+    // Whole Step / MultiStep request, without communication
+    Step = 6,
+
+    Count = 7
+};
+
+const char* GetLatencyPhaseName(ELatencyPhase phase);
+
+#endif
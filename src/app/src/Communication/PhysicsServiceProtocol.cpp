@@ -0,0 +1,56 @@
+#include "PhysicsServiceProtocol.h"
+
+namespace PhysicsServiceProtocol
+{
+    void WriteMessageHeader(char* dest, const MessageHeader& header)
+    {
+        WriteLittleEndian<uint16_t>(dest, header.Opcode);
+        WriteLittleEndian<uint16_t>(dest + 2, header.Flags);
+        WriteLittleEndian<uint32_t>(dest + 4, header.SequenceNumber);
+        WriteLittleEndian<uint32_t>(dest + 8, header.PayloadLength);
+    }
+
+    MessageHeader ReadMessageHeader(const char* src)
+    {
+        MessageHeader header;
+        header.Opcode = ReadLittleEndian<uint16_t>(src);
+        header.Flags = ReadLittleEndian<uint16_t>(src + 2);
+        header.SequenceNumber = ReadLittleEndian<uint32_t>(src + 4);
+        header.PayloadLength = ReadLittleEndian<uint32_t>(src + 8);
+        return header;
+    }
+
+    void WriteHandshake(char* dest, uint16_t version, EProtocolMode mode)
+    {
+        std::memcpy(dest, HandshakeMagic, sizeof(HandshakeMagic));
+        WriteLittleEndian<uint16_t>(dest + 4, version);
+        dest[6] = static_cast<char>(mode);
+        dest[7] = 0;
+    }
+
+    bool StartsWithHandshakeMagic(const char* src, size_t srcLength)
+    {
+        if(srcLength < sizeof(HandshakeMagic))
+        {
+            return false;
+        }
+
+        return std::memcmp(src, HandshakeMagic, sizeof(HandshakeMagic)) == 0;
+    }
+
+    void BuildMessage(std::vector<char>& outMessage, uint16_t opcode, uint32_t sequenceNumber, const char* payload, uint32_t payloadLength)
+    {
+        MessageHeader header;
+        header.Opcode = opcode;
+        header.SequenceNumber = sequenceNumber;
+        header.PayloadLength = payloadLength;
+
+        outMessage.resize(MessageHeaderSize + payloadLength);
+        WriteMessageHeader(outMessage.data(), header);
+
+        if(payloadLength > 0)
+        {
+            std::memcpy(outMessage.data() + MessageHeaderSize, payload, payloadLength);
+        }
+    }
+}
@@ -0,0 +1,300 @@
+#ifndef PHYSICSSERVICEPROTOCOL_H
+#define PHYSICSSERVICEPROTOCOL_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+
+/**
+* Binary wire protocol spoken between the game (client) and the physics service.
+*
+* A connection starts in text mode (the legacy "Init ... EndMessage" / "Step" protocol).
+* A client that wants the binary protocol sends a handshake as its very first bytes. The server
+* answers with a handshake carrying the version it accepted and, from then on, every message on the
+* connection is a fixed MessageHeader followed by PayloadLength bytes of payload.
+*
+* All multi-byte values are little-endian. Floats are IEEE-754 single precision.
+*/
+namespace PhysicsServiceProtocol
+{
+    // Handshake magic: "JPSB" (Jolt Physics Service Binary)
+    constexpr char HandshakeMagic[4] = { 'J', 'P', 'S', 'B' };
+
+    // Current protocol version. Bump whenever a payload layout changes.
+    constexpr uint16_t ProtocolVersion = 1;
+
+    // Handshake: magic (4) + version (2) + mode (1) + reserved (1)
+    constexpr size_t HandshakeSize = 8;
+
+    // Header: opcode (2) + flags (2) + sequence number (4) + payload length (4)
+    constexpr size_t MessageHeaderSize = 12;
+
+    // Upper bound for a single payload, used to reject corrupted headers early
+    constexpr uint32_t MaxPayloadLength = 256u * 1024u * 1024u;
+
+    // Response opcodes are the request opcode with this bit set
+    constexpr uint16_t ResponseOpcodeBit = 0x8000;
+
+    enum class EProtocolMode : uint8_t
+    {
+        Text = 0,
+        Binary = 1
+    };
+
+    enum class EOpcode : uint16_t
+    {
+        // Payload: uint32 actorCount, then actorCount * InitActorRecord
+        Init = 1,
+
+        // Payload: empty
+        // Response (float encoding): uint32 bodyCount, bodyCount * BodyTransformRecord, uint32 eventCount, eventCount * ActivationEventRecord
+        // Response (quantized encoding): uint32 bodyCount, float measuredMaxPositionError, float measuredMaxRotationError,
+        //     bodyCount * (uint32 id, positionBytes, rotationBytes), uint32 eventCount, eventCount * ActivationEventRecord
+        // Both followed, once contact events were enabled (SetContactEvents), by uint32 contactEventCount, uint32 droppedContactEventCount,
+        //     contactEventCount * ContactEventRecord
+        Step = 2,
+
+        // Payload: uint8 EStepResponseMode, float positionThreshold, float rotationThreshold (radians)
+        // Response: empty
+        SetStepResponseMode = 3,
+
+        // Payload: uint8 EStepEncoding, float worldBoundsMin[3], float worldBoundsMax[3], uint8 positionBits, uint8 rotationBits
+        // Response: uint8 positionBytes, uint8 rotationBytes, float maxPositionError, float maxRotationError (radians)
+        SetStepEncoding = 4,
+
+        // Payload: uint8 enable (0 = sequential, 1 = pipelined stepping, see PhysicsServiceImpl::SetPipelinedStepping)
+        // Response: empty
+        SetPipelinedStepping = 5,
+
+        // Payload: uint16 shapeNameCount, shapeNameCount * (uint16 length, UTF-8 name), uint32 actorCount, actorCount * InitDescribedActorRecord
+        // Response: uint32 created body count (same as Init)
+        InitDescribed = 6,
+
+        // Registers a convex hull or static triangle mesh for the session, for InitDescribed actors to reference by name.
+        // Sent once per level: the shape is kept for every later Init of the session until it is redefined. Other sessions don't see it,
+        //     and it takes precedence over a shape of the same name in the shape cache file.
+        // Payload: uint16 nameLength, UTF-8 name, uint8 EShapeDefinitionType, uint8 indexBytes (2 or 4, triangle meshes only),
+        //     uint32 vertexCount, uint32 triangleCount (0 for convex hulls), vertexCount * float[3], triangleCount * 3 indices of indexBytes each
+        // Response: uint32 memory of the built shape in bytes
+        DefineShape = 7,
+
+        // Several steps in one message, see PhysicsServiceImpl::StepPhysicsSimulationMulti
+        // Payload: float deltaTime, uint32 stepCount, uint8 collisionSteps (0 = one per 1/60 s), uint8 integrationSubSteps,
+        //     uint16 frameInterval (0 = only the state after the last step)
+        // Response: uint32 frameCount, then per frame uint32 completed step count followed by a Step response
+        StepMulti = 8,
+
+        // Latency percentiles of the session (see ELatencyPhase)
+        // Payload: empty
+        // Response: uint8 phaseCount, phaseCount * LatencyStatsRecord
+        GetStats = 9,
+
+        // Captures the next frameCount steps into a Chrome trace_event JSON file on the service host (profiling builds only)
+        // Payload: uint32 frameCount
+        // Response: UTF-8 path of the trace file, written once the frames were captured
+        CaptureProfile = 10,
+
+        // Saves the world into a slot (see PhysicsServiceImpl::SaveWorldState), e.g. at the start of a round
+        // Payload: uint8 slot (0 - 3)
+        // Response: uint32 saved state size in bytes
+        SaveState = 11,
+
+        // Rewinds the world to the state saved into a slot. The next Step response contains every body.
+        // Payload: uint8 slot (0 - 3)
+        // Response: empty
+        RestoreState = 12,
+
+        // Selects the contact events the following Step responses end with (see PhysicsServiceImpl::SetContactEventSettings)
+        // Payload: uint8 enable, uint8 event types (bit 0 = added, bit 1 = persisted, bit 2 = removed), float minImpactImpulse,
+        //     uint32 maxEventsPerStep, uint32 filterBodyCount (0 = every body), filterBodyCount * uint32 body id
+        // Response: empty
+        SetContactEvents = 13,
+
+        // Subscribes the following Step responses to the bodies inside the regions (see PhysicsServiceImpl::SetInterestRegions).
+        // 0 regions ends the subscription.
+        // Payload: uint8 regionCount (0 - 16), regionCount * InterestRegionRecord
+        // Response: empty
+        SetInterestRegions = 14,
+
+        // Batch of raycasts, shape casts and overlaps run against the world, spread over the job system
+        // (see PhysicsServiceImpl::RunSceneQueries). Sent right after a Step, the hits come back in the same round-trip.
+        // Payload: uint32 queryCount (up to 4096), queryCount * SceneQueryRecord
+        // Response: uint32 queryCount, then per query uint8 hitCount followed by hitCount * SceneQueryHitRecord
+        SceneQueries = 15,
+
+        // Spawns actors during the match (see PhysicsServiceImpl::QueueSpawnBodies). Like the following body commands, the spawns
+        // are queued and applied in one batch when the next Step / StepMulti simulates.
+        // Payload: same as InitDescribed, an actor id of -1 lets the service pick a free one (ids of despawned actors are recycled)
+        // Response: uint32 actorCount, actorCount * int32 actor id
+        SpawnBodies = 16,
+
+        // Payload: uint32 actorCount, actorCount * uint32 actor id
+        // Response: empty
+        DespawnBodies = 17,
+
+        // Payload: uint32 commandCount, commandCount * BodyVelocityRecord
+        // Response: empty
+        SetBodyVelocities = 18,
+
+        // Payload: uint32 commandCount, commandCount * BodyImpulseRecord
+        // Response: empty
+        AddBodyImpulses = 19,
+
+        // Payload: UTF-8 error description
+        Error = 0x7FFF
+    };
+
+    // Init request record: int32 id, float x, float y, float z
+    constexpr size_t InitActorRecordSize = 16;
+
+    // InitDescribed record: int32 id, float x, float y, float z, uint8 EActorShapeType, uint8 EActorMotionType,
+    // uint16 shape name index (EActorShapeType::Cached), float shapeParameters[3], float friction, float restitution, float mass
+    // (see ActorInitializationInfo)
+    constexpr size_t InitDescribedActorRecordSize = 44;
+
+    enum class EShapeDefinitionType : uint8_t
+    {
+        ConvexHull = 0,
+
+        // Static only, built into a bounding volume hierarchy (MeshShape)
+        TriangleMesh = 1
+    };
+
+    // Step response record: uint32 id, float position[3], float rotation quaternion[4] (x, y, z, w)
+    constexpr size_t BodyTransformRecordSize = 32;
+
+    // Step response activation event: uint32 id, uint8 type (0 = woke up, 1 = went to sleep, 2 = entered the interest regions, 3 = left them)
+    constexpr size_t ActivationEventRecordSize = 5;
+
+    // SetInterestRegions record: uint8 EInterestRegionShape, float values[6]
+    // (box: min x, y, z, max x, y, z; sphere: center x, y, z, radius, 2 unused)
+    constexpr size_t InterestRegionRecordSize = 25;
+
+    // Step response contact event: uint32 id1, uint32 id2 (id1 < id2), uint8 type (0 = added, 1 = persisted, 2 = removed),
+    // float impactImpulse, float position[3], float normal[3] (from id1 to id2). Impulse, position and normal are 0 for removed contacts.
+    constexpr size_t ContactEventRecordSize = 37;
+
+    // SetContactEvents request, up to the filter body ids
+    constexpr size_t SetContactEventsPayloadSize = 14;
+
+    // SceneQueries request record: uint8 ESceneQueryType, uint8 maxHits (overlaps, 1 - 64), float origin[3], float direction[3]
+    // (rays and casts: origin to end), float extents[3] (spheres: radius, 2 unused; boxes: half extents; rays: unused)
+    constexpr size_t SceneQueryRecordSize = 38;
+
+    // SceneQueries response hit: uint32 id, float fraction (rays and casts, 0 for overlaps), float position[3], float normal[3]
+    // (surface normal of the hit body)
+    constexpr size_t SceneQueryHitRecordSize = 32;
+
+    // SetBodyVelocities record: uint32 id, float linearVelocity[3], float angularVelocity[3] (radians per second)
+    constexpr size_t BodyVelocityRecordSize = 28;
+
+    // AddBodyImpulses record: uint32 id, float impulse[3] (applied at the center of mass), float angularImpulse[3]
+    constexpr size_t BodyImpulseRecordSize = 28;
+
+    // SetStepResponseMode request: uint8 mode, float positionThreshold, float rotationThreshold
+    constexpr size_t SetStepResponseModePayloadSize = 9;
+
+    // GetStats response record: uint8 ELatencyPhase, uint64 count, float mean, p50, p90, p99, p99.9, max (microseconds)
+    constexpr size_t LatencyStatsRecordSize = 33;
+
+    // StepMulti request size
+    constexpr size_t StepMultiPayloadSize = 12;
+
+    // SetStepEncoding request / response sizes
+    constexpr size_t SetStepEncodingPayloadSize = 27;
+    constexpr size_t SetStepEncodingResponseSize = 10;
+
+    struct MessageHeader
+    {
+        uint16_t Opcode = 0;
+        uint16_t Flags = 0;
+        uint32_t SequenceNumber = 0;
+        uint32_t PayloadLength = 0;
+    };
+
+    inline constexpr uint16_t GetResponseOpcode(EOpcode requestOpcode)
+    {
+        return static_cast<uint16_t>(requestOpcode) | ResponseOpcodeBit;
+    }
+
+    /**
+    * Writes a trivially copyable value (integer or float) in little-endian byte order to dest.
+    */
+    template<typename T>
+    inline void WriteLittleEndian(char* dest, T value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be serialized");
+
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        for(size_t i = 0; i < sizeof(T); ++i)
+        {
+            dest[i] = bytes[sizeof(T) - 1 - i];
+        }
+#else
+        std::memcpy(dest, bytes, sizeof(T));
+#endif
+    }
+
+    /**
+    * Reads a little-endian value of type T from src.
+    */
+    template<typename T>
+    inline T ReadLittleEndian(const char* src)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be deserialized");
+
+        char bytes[sizeof(T)];
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        for(size_t i = 0; i < sizeof(T); ++i)
+        {
+            bytes[i] = src[sizeof(T) - 1 - i];
+        }
+#else
+        std::memcpy(bytes, src, sizeof(T));
+#endif
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    /**
+    * Appends a little-endian value to the end of buffer.
+    */
+    template<typename T>
+    inline void AppendLittleEndian(std::vector<char>& buffer, T value)
+    {
+        const size_t writeOffset = buffer.size();
+        buffer.resize(writeOffset + sizeof(T));
+        WriteLittleEndian<T>(buffer.data() + writeOffset, value);
+    }
+
+    /**
+    * Serializes a message header into dest (must have room for MessageHeaderSize bytes).
+    */
+    void WriteMessageHeader(char* dest, const MessageHeader& header);
+
+    /**
+    * Deserializes a message header from src (must hold at least MessageHeaderSize bytes).
+    */
+    MessageHeader ReadMessageHeader(const char* src);
+
+    /**
+    * Serializes a handshake into dest (must have room for HandshakeSize bytes).
+    */
+    void WriteHandshake(char* dest, uint16_t version, EProtocolMode mode);
+
+    /**
+    * Checks whether the given bytes start with the handshake magic. Needs at least 4 bytes.
+    */
+    bool StartsWithHandshakeMagic(const char* src, size_t srcLength);
+
+    /**
+    * Builds a full message (header + payload) ready to be sent.
+    */
+    void BuildMessage(std::vector<char>& outMessage, uint16_t opcode, uint32_t sequenceNumber, const char* payload, uint32_t payloadLength);
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include "PhysicsServiceServerConfig.h"
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+namespace
+{
+    bool ParseUInt32(const std::string& value, uint32_t& outValue)
+    {
+        char* parseEnd = nullptr;
+        const unsigned long long parsedValue = std::strtoull(value.c_str(), &parseEnd, 10);
+        if(value.empty() || *parseEnd != '\0' || parsedValue > UINT32_MAX)
+        {
+            return false;
+        }
+
+        outValue = (uint32_t)parsedValue;
+        return true;
+    }
+
+    // Applies a single option, returns false if the option or its value is unknown
+    bool ApplyOption(PhysicsServiceServerConfig& config, const std::string& optionName, const std::string& optionValue)
+    {
+        if(optionName == "transport")
+        {
+            if(optionValue == "socket")
+            {
+                config.Transport = EPhysicsServiceTransport::Socket;
+                return true;
+            }
+            if(optionValue == "shm")
+            {
+                config.Transport = EPhysicsServiceTransport::SharedMemory;
+                return true;
+            }
+            return false;
+        }
+
+        if(optionName == "shm-name")
+        {
+            // POSIX shared memory names must start with a single '/'
+            config.SharedMemoryName = (!optionValue.empty() && optionValue[0] == '/') ? optionValue : "/" + optionValue;
+            return true;
+        }
+
+        if(optionName == "shm-command-ring-size")
+        {
+            return ParseUInt32(optionValue, config.SharedMemoryCommandRingSize);
+        }
+
+        if(optionName == "shm-snapshot-size")
+        {
+            return ParseUInt32(optionValue, config.SharedMemorySnapshotSize);
+        }
+
+        if(optionName == "pipelined-stepping")
+        {
+            if(optionValue != "on" && optionValue != "off")
+            {
+                return false;
+            }
+            config.bPipelinedStepping = optionValue == "on";
+            return true;
+        }
+
+        if(optionName == "job-system")
+        {
+            if(optionValue != "stealing" && optionValue != "pool")
+            {
+                return false;
+            }
+            config.bWorkStealingJobSystem = optionValue == "stealing";
+            return true;
+        }
+
+        if(optionName == "job-workers")
+        {
+            uint32_t jobWorkerCount = 0;
+            if(!ParseUInt32(optionValue, jobWorkerCount) || jobWorkerCount > 1024)
+            {
+                return false;
+            }
+            config.JobWorkerCount = (int32_t)jobWorkerCount;
+            return true;
+        }
+
+        if(optionName == "pin-job-workers")
+        {
+            if(optionValue != "on" && optionValue != "off")
+            {
+                return false;
+            }
+            config.bPinJobWorkers = optionValue == "on";
+            return true;
+        }
+
+        if(optionName == "shape-cache-file")
+        {
+            config.ShapeCacheFile = optionValue;
+            return true;
+        }
+
+        if(optionName == "stats-interval")
+        {
+            return ParseUInt32(optionValue, config.StatsDumpInterval);
+        }
+
+        if(optionName == "record-dir")
+        {
+            config.RecordDirectory = optionValue;
+            return true;
+        }
+
+        return false;
+    }
+
+    // "shm-name" -> "JOLT_SERVICE_SHM_NAME"
+    std::string GetEnvironmentVariableName(const char* optionName)
+    {
+        std::string environmentVariableName = "JOLT_SERVICE_";
+        for(const char* optionChar = optionName; *optionChar != '\0'; ++optionChar)
+        {
+            environmentVariableName += (*optionChar == '-') ? '_' : (char)std::toupper((unsigned char)*optionChar);
+        }
+        return environmentVariableName;
+    }
+}
+
+PhysicsServiceServerConfig PhysicsServiceServerConfig::FromCommandLine(int argc, char** argv)
+{
+    PhysicsServiceServerConfig config;
+
+    // Environment first, so the command line can override it
+    const char* optionNames[] = { "transport", "shm-name", "shm-command-ring-size", "shm-snapshot-size", "pipelined-stepping", "job-system", "job-workers", "pin-job-workers", "shape-cache-file", "stats-interval", "record-dir" };
+    for(const char* optionName : optionNames)
+    {
+        const std::string environmentVariableName = GetEnvironmentVariableName(optionName);
+        const char* environmentValue = std::getenv(environmentVariableName.c_str());
+        if(environmentValue && !ApplyOption(config, optionName, environmentValue))
+        {
+            printf("Ignoring invalid value \"%s\" of %s\n", environmentValue, environmentVariableName.c_str());
+        }
+    }
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const size_t equalsPosition = argument.find('=');
+        if(argument.rfind("--", 0) != 0 || equalsPosition == std::string::npos)
+        {
+            printf("Ignoring unknown argument \"%s\" (expected --option=value)\n", argument.c_str());
+            continue;
+        }
+
+        const std::string optionName = argument.substr(2, equalsPosition - 2);
+        const std::string optionValue = argument.substr(equalsPosition + 1);
+        if(!ApplyOption(config, optionName, optionValue))
+        {
+            printf("Ignoring invalid argument \"%s\"\n", argument.c_str());
+        }
+    }
+
+    return config;
+}
+
+std::string PhysicsServiceServerConfig::GetSessionRecordingPath(int sessionId) const
+{
+    std::error_code directoryError;
+    std::filesystem::create_directories(RecordDirectory, directoryError);
+
+    const long long startTime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return RecordDirectory + "/Session_" + std::to_string(sessionId) + "_" + std::to_string(startTime) + ".jsrec";
+}
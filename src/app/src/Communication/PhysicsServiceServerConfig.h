@@ -0,0 +1,72 @@
+#ifndef PHYSICSSERVICESERVERCONFIG_H
+#define PHYSICSSERVICESERVERCONFIG_H
+
+#include <cstdint>
+#include <string>
+
+/**
+* How the game talks to the service.
+*/
+enum class EPhysicsServiceTransport : uint8_t
+{
+    // TCP on SERVER_PORT, any number of sessions (default)
+    Socket = 0,
+
+    // mmap'd shared memory segment, for a game running on the same host (see SharedMemoryTransport.h)
+    SharedMemory = 1
+};
+
+/**
+* Startup configuration of the service.
+* Every option can be given on the command line (--option=value) or through an environment
+* variable (JOLT_SERVICE_OPTION=value). The command line wins.
+*/
+struct PhysicsServiceServerConfig
+{
+    // --transport=socket|shm, JOLT_SERVICE_TRANSPORT
+    EPhysicsServiceTransport Transport = EPhysicsServiceTransport::Socket;
+
+    // --shm-name=/name, JOLT_SERVICE_SHM_NAME. Name of the POSIX shared memory object.
+    std::string SharedMemoryName = "/JoltService";
+
+    // --shm-command-ring-size=bytes, JOLT_SERVICE_SHM_COMMAND_RING_SIZE. Size of the command ring buffer.
+    uint32_t SharedMemoryCommandRingSize = 16u * 1024u * 1024u;
+
+    // --shm-snapshot-size=bytes, JOLT_SERVICE_SHM_SNAPSHOT_SIZE. Size of each of the two response (snapshot) buffers.
+    uint32_t SharedMemorySnapshotSize = 8u * 1024u * 1024u;
+
+    // --pipelined-stepping=on|off, JOLT_SERVICE_PIPELINED_STEPPING. Default of new sessions, see PhysicsServiceImpl::SetPipelinedStepping.
+    bool bPipelinedStepping = false;
+
+    // --job-system=stealing|pool, JOLT_SERVICE_JOB_SYSTEM. Work stealing job system or Jolt's JobSystemThreadPool (see WorkStealingJobSystem).
+    bool bWorkStealingJobSystem = true;
+
+    // --job-workers=count, JOLT_SERVICE_JOB_WORKERS. Physics worker threads per session, -1 (default) = hardware threads - 1.
+    int32_t JobWorkerCount = -1;
+
+    // --pin-job-workers=on|off, JOLT_SERVICE_PIN_JOB_WORKERS. Pins the work stealing workers to CPUs, NUMA node of the session first.
+    bool bPinJobWorkers = false;
+
+    // --shape-cache-file=path, JOLT_SERVICE_SHAPE_CACHE_FILE. Cooked shapes preloaded into the shape cache (see ShapeCache::LoadNamedShapes).
+    std::string ShapeCacheFile;
+
+    // --stats-interval=seconds, JOLT_SERVICE_STATS_INTERVAL. How often sessions dump their latency percentiles, 0 = only when they close.
+    uint32_t StatsDumpInterval = 60;
+
+    // --record-dir=path, JOLT_SERVICE_RECORD_DIR. Records every session into this directory, for SessionReplay (see SessionRecording.h). Empty (default) = off.
+    std::string RecordDirectory;
+
+    /**
+    * Builds the configuration from the environment and the command line.
+    * Unknown or malformed options are reported and ignored.
+    */
+    static PhysicsServiceServerConfig FromCommandLine(int argc, char** argv);
+
+    /**
+    * Recording file of a new session in RecordDirectory (created if needed). Named after the session and the time it started,
+    * so a restarted service doesn't overwrite the recordings of the previous run.
+    */
+    std::string GetSessionRecordingPath(int sessionId) const;
+};
+
+#endif
@@ -0,0 +1,1649 @@
+#include "PhysicsServiceSession.h"
+#include "../PhysicsSimulation/TraceProfiler.h"
+#include "TextFieldReader.h"
+#include <Jolt/Core/Profiler.h>
+#include <cstdlib>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+PhysicsServiceSession::PhysicsServiceSession(int newSessionId)
+    : SessionId(newSessionId)
+{
+    PhysicsServiceImplementation = new PhysicsServiceImpl();
+}
+
+PhysicsServiceSession::~PhysicsServiceSession()
+{
+    delete PhysicsServiceImplementation;
+}
+
+void PhysicsServiceSession::ProcessReceivedData(const char* receivedData, size_t receivedDataLength)
+{
+    const std::chrono::steady_clock::time_point preReceiveTime = std::chrono::steady_clock::now();
+    std::memcpy(GetReceiveBuffer(receivedDataLength), receivedData, receivedDataLength);
+    RecordLatency(ELatencyPhase::Receive, std::chrono::steady_clock::now() - preReceiveTime);
+
+    CommitReceivedData(receivedDataLength);
+}
+
+char* PhysicsServiceSession::GetReceiveBuffer(size_t minimumSize)
+{
+    // Everything was handled, start over from the beginning of the buffer
+    if(ReceivedDataReadOffset == ReceivedDataEnd)
+    {
+        ReceivedDataReadOffset = 0;
+        ReceivedDataEnd = 0;
+
+        // Don't keep the memory of a huge Init around for the rest of the session
+        if(ReceivedData.size() > MaxRetainedReceiveBufferSize)
+        {
+            std::vector<char>().swap(ReceivedData);
+        }
+    }
+
+    if(ReceivedData.size() - ReceivedDataEnd < minimumSize)
+    {
+        // Move the partial message to the front first, grow only if that's not enough.
+        // Compacting only when we run out of room keeps large messages from being moved on every receive.
+        if(ReceivedDataReadOffset > 0)
+        {
+            std::memmove(ReceivedData.data(), ReceivedData.data() + ReceivedDataReadOffset, ReceivedDataEnd - ReceivedDataReadOffset);
+            ReceivedDataEnd -= ReceivedDataReadOffset;
+            ReceivedDataReadOffset = 0;
+        }
+
+        if(ReceivedData.size() - ReceivedDataEnd < minimumSize)
+        {
+            ReceivedData.resize(std::max(ReceivedDataEnd + minimumSize, 2 * ReceivedData.size()));
+        }
+    }
+
+    return ReceivedData.data() + ReceivedDataEnd;
+}
+
+void PhysicsServiceSession::CommitReceivedData(size_t receivedDataLength)
+{
+    ReceivedDataEnd += receivedDataLength;
+
+    if(!Recorder)
+    {
+        HandleReceivedData();
+        return;
+    }
+
+    // The responses to these bytes are the ones appended to the pending output while handling them
+    Recorder->RecordInput(std::chrono::steady_clock::now(), ReceivedData.data() + ReceivedDataEnd - receivedDataLength, receivedDataLength);
+    const size_t preHandleOutputSize = PendingOutput.size();
+    bIsOutputTimingDependent = false;
+
+    HandleReceivedData();
+
+    Recorder->RecordOutput(PendingOutput.data() + preHandleOutputSize, PendingOutput.size() - preHandleOutputSize, bIsOutputTimingDependent);
+}
+
+void PhysicsServiceSession::HandleReceivedData()
+{
+    // The first bytes of the connection decide between the text and the binary protocol
+    if(!bIsProtocolModeNegotiated && !NegotiateProtocolMode())
+    {
+        return;
+    }
+
+    JPH_PROFILE("ProcessMessages");
+
+    const std::chrono::steady_clock::time_point preParseTime = std::chrono::steady_clock::now();
+    const size_t preParseReadOffset = ReceivedDataReadOffset;
+    const std::chrono::steady_clock::duration preParseStepHandlingTime = StepHandlingTime;
+
+    if(ProtocolMode == PhysicsServiceProtocol::EProtocolMode::Binary)
+    {
+        ProcessBinaryMessages();
+    }
+    else
+    {
+        ProcessTextMessages();
+    }
+
+    // The steps handled on the way have their own phases
+    if(ReceivedDataReadOffset != preParseReadOffset)
+    {
+        RecordLatency(ELatencyPhase::Parse, std::chrono::steady_clock::now() - preParseTime - (StepHandlingTime - preParseStepHandlingTime));
+    }
+}
+
+size_t PhysicsServiceSession::GetPendingOutputSize() const
+{
+    return SendingOutput.size() - SendingOutputReadOffset + PendingOutput.size();
+}
+
+int PhysicsServiceSession::GetPendingOutputSegments(iovec outSegments[2]) const
+{
+    // Oldest bytes first: the rest of what was being sent, then what was queued since
+    int segmentCount = 0;
+    if(SendingOutputReadOffset < SendingOutput.size())
+    {
+        outSegments[segmentCount].iov_base = const_cast<char*>(SendingOutput.data() + SendingOutputReadOffset);
+        outSegments[segmentCount].iov_len = SendingOutput.size() - SendingOutputReadOffset;
+        ++segmentCount;
+    }
+    if(!PendingOutput.empty())
+    {
+        outSegments[segmentCount].iov_base = const_cast<char*>(PendingOutput.data());
+        outSegments[segmentCount].iov_len = PendingOutput.size();
+        ++segmentCount;
+    }
+    return segmentCount;
+}
+
+void PhysicsServiceSession::ConsumePendingOutput(size_t sentBytes)
+{
+    const size_t sentSendingBytes = std::min(sentBytes, SendingOutput.size() - SendingOutputReadOffset);
+    SendingOutputReadOffset += sentSendingBytes;
+    sentBytes -= sentSendingBytes;
+
+    if(SendingOutputReadOffset < SendingOutput.size())
+    {
+        return;
+    }
+
+    // Everything that was being sent is out: the queued responses are sent next. Swapping (instead of
+    // moving the bytes) keeps the memory of both buffers, so queueing doesn't allocate in steady state.
+    SendingOutput.swap(PendingOutput);
+    PendingOutput.clear();
+    SendingOutputReadOffset = sentBytes;
+
+    if(SendingOutputReadOffset >= SendingOutput.size())
+    {
+        SendingOutput.clear();
+        SendingOutputReadOffset = 0;
+    }
+}
+
+void PhysicsServiceSession::SetProtocolMode(PhysicsServiceProtocol::EProtocolMode protocolMode)
+{
+    ProtocolMode = protocolMode;
+    bIsProtocolModeNegotiated = true;
+}
+
+void PhysicsServiceSession::SetPipelinedStepping(bool bEnablePipelinedStepping)
+{
+    if(!PhysicsServiceImplementation)
+    {
+        return;
+    }
+
+    PhysicsServiceImplementation->SetPipelinedStepping(bEnablePipelinedStepping);
+    printf("Session %d: pipelined stepping %s\n", SessionId, bEnablePipelinedStepping ? "on" : "off");
+}
+
+void PhysicsServiceSession::SetJobSystemSettings(const JobSystemSettings& jobSystemSettings)
+{
+    if(!PhysicsServiceImplementation)
+    {
+        return;
+    }
+
+    PhysicsServiceImplementation->SetJobSystemSettings(jobSystemSettings);
+}
+
+bool PhysicsServiceSession::StartRecording(const std::string& filePath)
+{
+    SessionRecording::FileHeader recordingHeader;
+    recordingHeader.ProtocolMode = ProtocolMode;
+    recordingHeader.bIsProtocolModeNegotiated = bIsProtocolModeNegotiated;
+    recordingHeader.SessionId = SessionId;
+    recordingHeader.bPipelinedStepping = PhysicsServiceImplementation && PhysicsServiceImplementation->IsPipelinedStepping();
+    if(PhysicsServiceImplementation)
+    {
+        recordingHeader.JobSettings = PhysicsServiceImplementation->GetJobSystemSettings();
+    }
+    recordingHeader.StartTime = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::unique_ptr<SessionRecorder> newRecorder = std::make_unique<SessionRecorder>();
+    if(!newRecorder->Open(filePath, recordingHeader))
+    {
+        return false;
+    }
+
+    Recorder = std::move(newRecorder);
+    printf("Session %d: recording into %s\n", SessionId, filePath.c_str());
+    return true;
+}
+
+void PhysicsServiceSession::CloseSession()
+{
+    printf("Closing session %d...\n", SessionId);
+
+    if(Recorder)
+    {
+        Recorder->Close();
+    }
+
+    // A capture still running ends with the frames it has
+    TraceProfiler::StopCapture(this);
+
+    const std::string stepThroughputReport = GetStepThroughputReport();
+    printf("%s", stepThroughputReport.c_str());
+
+    // Save step physics measurement to file
+    SaveStepPhysicsMeasureToFile();
+}
+
+void PhysicsServiceSession::QueueMessageToClient(const char* messageBuffer)
+{
+    QueueMessageToClient(messageBuffer, strlen(messageBuffer));
+}
+
+void PhysicsServiceSession::QueueMessageToClient(const char* messageBuffer, size_t messageLength)
+{
+    PendingOutput.insert(PendingOutput.end(), messageBuffer, messageBuffer + messageLength);
+}
+
+void PhysicsServiceSession::QueueBinaryMessageToClient(uint16_t opcode, uint32_t sequenceNumber, const char* payload, uint32_t payloadLength)
+{
+    // Write the header and the payload straight into the pending output
+    const size_t messageOffset = BeginBinaryMessageToClient();
+    PendingOutput.insert(PendingOutput.end(), payload, payload + payloadLength);
+    EndBinaryMessageToClient(messageOffset, opcode, sequenceNumber);
+}
+
+size_t PhysicsServiceSession::BeginBinaryMessageToClient()
+{
+    // Room for the header, which is written once the payload size is known
+    const size_t messageOffset = PendingOutput.size();
+    PendingOutput.resize(messageOffset + PhysicsServiceProtocol::MessageHeaderSize);
+    return messageOffset;
+}
+
+void PhysicsServiceSession::EndBinaryMessageToClient(size_t messageOffset, uint16_t opcode, uint32_t sequenceNumber)
+{
+    using namespace PhysicsServiceProtocol;
+
+    MessageHeader header;
+    header.Opcode = opcode;
+    header.SequenceNumber = sequenceNumber;
+    header.PayloadLength = (uint32_t)(PendingOutput.size() - messageOffset - MessageHeaderSize);
+    WriteMessageHeader(PendingOutput.data() + messageOffset, header);
+}
+
+bool PhysicsServiceSession::NegotiateProtocolMode()
+{
+    using namespace PhysicsServiceProtocol;
+
+    // Wait until we have enough bytes to tell whether this is a handshake
+    const size_t magicLength = sizeof(HandshakeMagic);
+    const char* receivedData = ReceivedData.data() + ReceivedDataReadOffset;
+    const size_t receivedDataSize = ReceivedDataEnd - ReceivedDataReadOffset;
+    const size_t comparableLength = std::min(receivedDataSize, magicLength);
+    const bool bCouldBeHandshake = std::memcmp(receivedData, HandshakeMagic, comparableLength) == 0;
+
+    if(!bCouldBeHandshake)
+    {
+        // Legacy client: no handshake, text protocol
+        ProtocolMode = EProtocolMode::Text;
+        bIsProtocolModeNegotiated = true;
+        return true;
+    }
+
+    if(receivedDataSize < HandshakeSize)
+    {
+        return false;
+    }
+
+    const uint16_t requestedVersion = ReadLittleEndian<uint16_t>(receivedData + 4);
+    const EProtocolMode requestedMode = static_cast<EProtocolMode>(receivedData[6]);
+    ReceivedDataReadOffset += HandshakeSize;
+
+    // We only speak our own version. Answer with it so the client can tell if it should disconnect.
+    const uint16_t acceptedVersion = (requestedVersion == ProtocolVersion) ? ProtocolVersion : 0;
+    ProtocolMode = (acceptedVersion != 0 && requestedMode == EProtocolMode::Binary) ? EProtocolMode::Binary : EProtocolMode::Text;
+    bIsProtocolModeNegotiated = true;
+
+    printf("Protocol handshake: client version %u, mode %s\n", requestedVersion,
+        ProtocolMode == EProtocolMode::Binary ? "binary" : "text");
+
+    char handshakeResponse[HandshakeSize];
+    WriteHandshake(handshakeResponse, acceptedVersion, ProtocolMode);
+    QueueMessageToClient(handshakeResponse, HandshakeSize);
+
+    return true;
+}
+
+void PhysicsServiceSession::ProcessTextMessages()
+{
+    // Handle every complete message we have, the client may send several at once (e.g. batched Steps).
+    // A partial message stays in the buffer until the rest arrives.
+    while(ReceivedDataReadOffset < ReceivedDataEnd)
+    {
+        const char* message = ReceivedData.data() + ReceivedDataReadOffset;
+        const size_t receivedDataSize = ReceivedDataEnd - ReceivedDataReadOffset;
+
+        // An Init message can be megabytes long: parse its lines as they arrive instead of waiting for "EndMessage"
+        if(bIsReceivingInitMessage)
+        {
+            // Only the trailing partial line stays buffered
+            ReceivedDataReadOffset += InitializationParser.ParseLines(message, receivedDataSize);
+            if(!InitializationParser.IsComplete())
+            {
+                return;
+            }
+
+            bIsReceivingInitMessage = false;
+            InitializePhysicsSystem(InitializationParser.GetActors());
+            QueueMessageToClient("OK");
+            continue;
+        }
+
+        // Line breaks between messages
+        if(*message == '\n' || *message == '\r')
+        {
+            ++ReceivedDataReadOffset;
+            continue;
+        }
+
+        const ETextPrefixMatch initMatch = MatchTextPrefix(message, receivedDataSize, "Init");
+        const ETextPrefixMatch stepMatch = MatchTextPrefix(message, receivedDataSize, "Step");
+        if(initMatch == ETextPrefixMatch::NeedMoreData || stepMatch == ETextPrefixMatch::NeedMoreData)
+        {
+            return;
+        }
+
+        if(initMatch == ETextPrefixMatch::Match)
+        {
+            bIsReceivingInitMessage = true;
+            InitializationParser.Reset();
+            continue;
+        }
+
+        // "Step" is a complete message on its own, the client doesn't need to end it with a line break
+        if(stepMatch == ETextPrefixMatch::Match)
+        {
+            ReceivedDataReadOffset += 4;
+            HandleTextStep();
+            continue;
+        }
+
+        // Every other message is a single line
+        const char* lineEnd = static_cast<const char*>(std::memchr(message, '\n', receivedDataSize));
+        if(!lineEnd)
+        {
+            if(receivedDataSize > MaxTextLineLength)
+            {
+                ReportUnknownTextMessage(message, receivedDataSize);
+                ReceivedDataReadOffset = ReceivedDataEnd;
+            }
+            return;
+        }
+
+        // The handlers read the line in place (see TextFieldReader), it is only valid until the receive buffer changes
+        const std::string_view line(message, lineEnd - message);
+        ReceivedDataReadOffset += line.size() + 1;
+
+        // "ResponseMode;Full" or "ResponseMode;Delta;<positionThreshold>;<rotationThreshold>"
+        if(line.rfind("ResponseMode;", 0) == 0)
+        {
+            if(!SetStepResponseMode(line))
+            {
+                QueueMessageToClient("Error;Invalid ResponseMode\n");
+                continue;
+            }
+
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "MultiStep;<stepCount>;<deltaTime>[;<frameInterval>[;<collisionSteps>;<integrationSubSteps>]]"
+        if(line.rfind("MultiStep;", 0) == 0)
+        {
+            HandleTextMultiStep(line);
+            continue;
+        }
+
+        // Latency percentiles of this session, one "Stats;..." line per phase (see GetLatencyStatsReport)
+        if(line == "Stats" || line == "Stats\r")
+        {
+            bIsOutputTimingDependent = true;
+            const std::string latencyStatsReport = GetLatencyStatsReport();
+            QueueMessageToClient(latencyStatsReport.data(), latencyStatsReport.size());
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "Profile;<frameCount>" (1 - MaxProfileFrameCount): answers "Profile;<trace file>" once the capture started (profiling builds only)
+        if(line.rfind("Profile;", 0) == 0)
+        {
+            TextFieldReader profileReader(line);
+            profileReader.ReadExpectedField("Profile");
+
+            uint32_t profileFrameCount = 0;
+            if(profileReader.GetRemainingFieldCount() != 1 || !profileReader.ReadNumber(profileFrameCount)
+                || profileFrameCount == 0 || profileFrameCount > MaxProfileFrameCount)
+            {
+                QueueMessageToClient("Error;Invalid Profile frame count\n");
+                continue;
+            }
+
+            // Whether a capture is already running depends on the other sessions
+            bIsOutputTimingDependent = true;
+
+            std::string traceFilePath;
+            if(!StartProfileCapture(profileFrameCount, traceFilePath))
+            {
+                QueueMessageToClient("Error;Profiling not available or already capturing\n");
+                continue;
+            }
+
+            const std::string profileResponse = "Profile;" + traceFilePath + "\n";
+            QueueMessageToClient(profileResponse.data(), profileResponse.size());
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "SaveState;<slot>" / "RestoreState;<slot>": saves the world / rewinds it to a saved state
+        if(line.rfind("SaveState;", 0) == 0 || line.rfind("RestoreState;", 0) == 0)
+        {
+            const bool bIsSave = line[0] == 'S';
+            TextFieldReader stateSlotReader(line);
+            stateSlotReader.ReadExpectedField(bIsSave ? "SaveState" : "RestoreState");
+
+            // The slot is the whole rest of the line: "SaveState;foo" must not become slot 0
+            uint32_t stateSlot = 0;
+            const bool bIsStateSlotValid = stateSlotReader.GetRemainingFieldCount() == 1 && stateSlotReader.ReadNumber(stateSlot);
+            if(!bIsStateSlotValid || (bIsSave ? !SaveWorldState(stateSlot) : !RestoreWorldState(stateSlot)))
+            {
+                QueueMessageToClient(bIsSave ? "Error;Invalid SaveState\n" : "Error;Invalid RestoreState\n");
+                continue;
+            }
+
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "ContactEvents;Off" or "ContactEvents;On;<minImpactImpulse>[;<eventTypes>[;<maxEventsPerStep>[;<bodyId>...]]]"
+        if(line.rfind("ContactEvents;", 0) == 0)
+        {
+            if(!SetContactEvents(line))
+            {
+                QueueMessageToClient("Error;Invalid ContactEvents\n");
+                continue;
+            }
+
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "InterestRegions;Off" or "InterestRegions;<Box;minX;minY;minZ;maxX;maxY;maxZ|Sphere;x;y;z;radius>..."
+        if(line.rfind("InterestRegions;", 0) == 0)
+        {
+            if(!SetInterestRegions(line))
+            {
+                QueueMessageToClient("Error;Invalid InterestRegions\n");
+                continue;
+            }
+
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "SceneQueries;<query>..." (see ParseTextSceneQueries): one "Hit;..." line per hit, then "OK"
+        if(line.rfind("SceneQueries;", 0) == 0)
+        {
+            if(!PhysicsServiceImplementation || !ParseTextSceneQueries(line, ReceivedSceneQueries)
+                || !PhysicsServiceImplementation->RunSceneQueries(ReceivedSceneQueries, PendingOutput))
+            {
+                QueueMessageToClient("Error;Invalid SceneQueries\n");
+                continue;
+            }
+
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "Spawn;<id>;x;y;z[;key=value...]" (an Init actor line, id -1 = picked by the service): answers "Spawned;<id>", then "OK".
+        // Like the body commands below, the spawn is applied when the next Step simulates (see PhysicsServiceImpl::QueueSpawnBodies).
+        if(line.rfind("Spawn;", 0) == 0)
+        {
+            const char* spawnLineEnd = line.data() + line.size() - (line.back() == '\r' ? 1 : 0);
+            ReceivedSpawnActors.assign(1, ActorInitializationInfo());
+            if(!PhysicsServiceImplementation || ActorInitializationParser::ParseActorLine(line.data() + 6, spawnLineEnd, ReceivedSpawnActors[0])
+                || !PhysicsServiceImplementation->QueueSpawnBodies(ReceivedSpawnActors))
+            {
+                QueueMessageToClient("Error;Invalid Spawn\n");
+                continue;
+            }
+
+            const std::string spawnResponse = "Spawned;" + std::to_string(ReceivedSpawnActors[0].ActorId) + "\n";
+            QueueMessageToClient(spawnResponse.data(), spawnResponse.size());
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "Despawn;<id>[;<id>...]", "Velocity;<id>;x;y;z[;angularX;angularY;angularZ]" or "Impulse;<id>;x;y;z[;angularX;angularY;angularZ]"
+        if(line.rfind("Despawn;", 0) == 0 || line.rfind("Velocity;", 0) == 0 || line.rfind("Impulse;", 0) == 0)
+        {
+            if(!QueueBodyCommand(line))
+            {
+                QueueMessageToClient("Error;Invalid body command\n");
+                continue;
+            }
+
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        // "Pipeline;On" or "Pipeline;Off"
+        if(line.rfind("Pipeline;", 0) == 0)
+        {
+            if(!SetPipelinedSteppingFromMessage(line))
+            {
+                QueueMessageToClient("Error;Invalid Pipeline\n");
+                continue;
+            }
+
+            QueueMessageToClient("OK\n", 3);
+            continue;
+        }
+
+        ReportUnknownTextMessage(line.data(), line.size());
+    }
+}
+
+PhysicsServiceSession::ETextPrefixMatch PhysicsServiceSession::MatchTextPrefix(const char* message, size_t messageLength, const char* prefix)
+{
+    const size_t prefixLength = strlen(prefix);
+    const size_t comparableLength = std::min(messageLength, prefixLength);
+    if(std::memcmp(message, prefix, comparableLength) != 0)
+    {
+        return ETextPrefixMatch::NoMatch;
+    }
+
+    return comparableLength == prefixLength ? ETextPrefixMatch::Match : ETextPrefixMatch::NeedMoreData;
+}
+
+void PhysicsServiceSession::HandleTextStep()
+{
+    if(!PhysicsServiceImplementation)
+    {
+        std::cout << "No physics service implementation valid to step physics simulation.\n";
+        return;
+    }
+
+    // There's no world to step yet
+    if(!PhysicsServiceImplementation->bIsInitialized)
+    {
+        QueueMessageToClient("Error;Step before Init\n");
+        return;
+    }
+
+    // Get pre step physics time
+    std::chrono::steady_clock::time_point preStepPhysicsTime = std::chrono::steady_clock::now();
+
+    // The step result is written straight into the pending output
+    PhysicsServiceImplementation->StepPhysicsSimulation(PendingOutput);
+    QueueMessageToClient("OK\n", 3);
+
+    // Get post physics communication time
+    std::chrono::steady_clock::time_point postStepPhysicsTime = std::chrono::steady_clock::now();
+
+    // Append the delta time to the current step measurement
+    RecordStepMeasure(preStepPhysicsTime, postStepPhysicsTime);
+}
+
+void PhysicsServiceSession::HandleTextMultiStep(std::string_view multiStepMessage)
+{
+    if(!PhysicsServiceImplementation)
+    {
+        std::cout << "No physics service implementation valid to step physics simulation.\n";
+        return;
+    }
+
+    // Every given field must be a number, out of range values are rejected by StepCommand::IsValid
+    TextFieldReader multiStepReader(multiStepMessage);
+    multiStepReader.ReadExpectedField("MultiStep");
+
+    StepCommand stepCommand;
+    const size_t multiStepFieldCount = multiStepReader.GetRemainingFieldCount();
+    bool bIsMultiStepValid = (multiStepFieldCount >= 2 && multiStepFieldCount <= 3) || multiStepFieldCount == 5;
+    bIsMultiStepValid = bIsMultiStepValid && multiStepReader.ReadNumber(stepCommand.StepCount) && multiStepReader.ReadNumber(stepCommand.DeltaTime);
+    if(bIsMultiStepValid && multiStepFieldCount >= 3)
+    {
+        bIsMultiStepValid = multiStepReader.ReadNumber(stepCommand.FrameInterval);
+    }
+    if(bIsMultiStepValid && multiStepFieldCount == 5)
+    {
+        bIsMultiStepValid = multiStepReader.ReadNumber(stepCommand.CollisionSteps) && multiStepReader.ReadNumber(stepCommand.IntegrationSubSteps);
+    }
+
+    // Get pre step physics time
+    std::chrono::steady_clock::time_point preStepPhysicsTime = std::chrono::steady_clock::now();
+
+    // The frames are written straight into the pending output
+    if(!bIsMultiStepValid || !PhysicsServiceImplementation->StepPhysicsSimulationMulti(stepCommand, PendingOutput))
+    {
+        printf("Session %d: invalid MultiStep \"%.*s\"\n", SessionId, (int)std::min<size_t>(multiStepMessage.size(), 80), multiStepMessage.data());
+        QueueMessageToClient("Error;Invalid MultiStep\n");
+        return;
+    }
+    QueueMessageToClient("OK\n", 3);
+
+    // Get post physics communication time
+    std::chrono::steady_clock::time_point postStepPhysicsTime = std::chrono::steady_clock::now();
+    RecordStepMeasure(preStepPhysicsTime, postStepPhysicsTime);
+}
+
+void PhysicsServiceSession::ReportUnknownTextMessage(const char* message, size_t messageLength)
+{
+    // Only the first ones: a misbehaving client must not turn the log into the bottleneck
+    ++UnknownTextMessageCount;
+    if(UnknownTextMessageCount <= MaxReportedUnknownTextMessages)
+    {
+        printf("Session %d: unknown message \"%.*s\"%s\n", SessionId, (int)std::min<size_t>(messageLength, 80), message,
+            UnknownTextMessageCount == MaxReportedUnknownTextMessages ? " (not reporting further unknown messages)" : "");
+    }
+}
+
+void PhysicsServiceSession::ProcessBinaryMessages()
+{
+    using namespace PhysicsServiceProtocol;
+
+    // Handle every complete message we have. A partial message stays in the buffer until the rest arrives.
+    while(ReceivedDataEnd - ReceivedDataReadOffset >= MessageHeaderSize)
+    {
+        const char* message = ReceivedData.data() + ReceivedDataReadOffset;
+        const MessageHeader messageHeader = ReadMessageHeader(message);
+        if(messageHeader.PayloadLength > MaxPayloadLength)
+        {
+            printf("Binary message with invalid payload length %u. Dropping buffered data.\n", messageHeader.PayloadLength);
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, "Invalid payload length", 22);
+            ReceivedDataReadOffset = ReceivedDataEnd;
+            return;
+        }
+
+        const size_t messageLength = MessageHeaderSize + messageHeader.PayloadLength;
+        if(ReceivedDataEnd - ReceivedDataReadOffset < messageLength)
+        {
+            return;
+        }
+
+        // Consume the message before handling it, the handler may not touch the receive buffer
+        ReceivedDataReadOffset += messageLength;
+        HandleBinaryMessage(messageHeader, message + MessageHeaderSize);
+    }
+}
+
+void PhysicsServiceSession::HandleBinaryMessage(const PhysicsServiceProtocol::MessageHeader& messageHeader, const char* messagePayload)
+{
+    using namespace PhysicsServiceProtocol;
+
+    switch(static_cast<EOpcode>(messageHeader.Opcode))
+    {
+        case EOpcode::Init:
+        {
+            if(!PhysicsServiceImplementation || !PhysicsServiceImplementation->InitPhysicsSystemFromBinary(messagePayload, messageHeader.PayloadLength))
+            {
+                const char* errorMessage = "Invalid Init payload";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            // Reply with the amount of created bodies
+            char initResultPayload[sizeof(uint32_t)];
+            WriteLittleEndian<uint32_t>(initResultPayload, (uint32_t)PhysicsServiceImplementation->BodyIdList.size());
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Init), messageHeader.SequenceNumber, initResultPayload, sizeof(initResultPayload));
+            return;
+        }
+
+        case EOpcode::InitDescribed:
+        {
+            if(!PhysicsServiceImplementation || !PhysicsServiceImplementation->InitPhysicsSystemFromDescribedBinary(messagePayload, messageHeader.PayloadLength))
+            {
+                const char* errorMessage = "Invalid InitDescribed payload";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            // Reply with the amount of created bodies
+            char initResultPayload[sizeof(uint32_t)];
+            WriteLittleEndian<uint32_t>(initResultPayload, (uint32_t)PhysicsServiceImplementation->BodyIdList.size());
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::InitDescribed), messageHeader.SequenceNumber, initResultPayload, sizeof(initResultPayload));
+            return;
+        }
+
+        case EOpcode::DefineShape:
+        {
+            uint32_t shapeMemorySize = 0;
+            if(!PhysicsServiceImplementation || !PhysicsServiceImplementation->DefineShapeFromBinary(messagePayload, messageHeader.PayloadLength, shapeMemorySize))
+            {
+                const char* errorMessage = "Invalid DefineShape payload";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            char defineShapeResultPayload[sizeof(uint32_t)];
+            WriteLittleEndian<uint32_t>(defineShapeResultPayload, shapeMemorySize);
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::DefineShape), messageHeader.SequenceNumber, defineShapeResultPayload, sizeof(defineShapeResultPayload));
+            return;
+        }
+
+        case EOpcode::Step:
+        {
+            if(!PhysicsServiceImplementation || !PhysicsServiceImplementation->bIsInitialized)
+            {
+                const char* errorMessage = "Step before Init";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            // Get pre step physics time
+            std::chrono::steady_clock::time_point preStepPhysicsTime = std::chrono::steady_clock::now();
+
+            // The step result is written straight into the pending output, after the header
+            const size_t messageOffset = BeginBinaryMessageToClient();
+            PhysicsServiceImplementation->StepPhysicsSimulationBinary(PendingOutput);
+            EndBinaryMessageToClient(messageOffset, GetResponseOpcode(EOpcode::Step), messageHeader.SequenceNumber);
+
+            // Get post physics time
+            std::chrono::steady_clock::time_point postStepPhysicsTime = std::chrono::steady_clock::now();
+            RecordStepMeasure(preStepPhysicsTime, postStepPhysicsTime);
+            return;
+        }
+
+        case EOpcode::StepMulti:
+        {
+            StepCommand stepCommand;
+            if(messageHeader.PayloadLength == StepMultiPayloadSize)
+            {
+                stepCommand.DeltaTime = ReadLittleEndian<float>(messagePayload);
+                stepCommand.StepCount = ReadLittleEndian<uint32_t>(messagePayload + 4);
+                stepCommand.CollisionSteps = (uint8_t)messagePayload[8];
+                stepCommand.IntegrationSubSteps = (uint8_t)messagePayload[9];
+                stepCommand.FrameInterval = ReadLittleEndian<uint16_t>(messagePayload + 10);
+            }
+
+            if(!PhysicsServiceImplementation || !PhysicsServiceImplementation->bIsInitialized || messageHeader.PayloadLength != StepMultiPayloadSize || !stepCommand.IsValid())
+            {
+                const char* errorMessage = "Invalid StepMulti payload or StepMulti before Init";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            // Get pre step physics time
+            std::chrono::steady_clock::time_point preStepPhysicsTime = std::chrono::steady_clock::now();
+
+            // The frames are written straight into the pending output, after the header
+            const size_t messageOffset = BeginBinaryMessageToClient();
+            PhysicsServiceImplementation->StepPhysicsSimulationMultiBinary(stepCommand, PendingOutput);
+            EndBinaryMessageToClient(messageOffset, GetResponseOpcode(EOpcode::StepMulti), messageHeader.SequenceNumber);
+
+            // Get post physics time
+            std::chrono::steady_clock::time_point postStepPhysicsTime = std::chrono::steady_clock::now();
+            RecordStepMeasure(preStepPhysicsTime, postStepPhysicsTime);
+            return;
+        }
+
+        case EOpcode::SetStepResponseMode:
+        {
+            if(!PhysicsServiceImplementation || messageHeader.PayloadLength != SetStepResponseModePayloadSize || (uint8_t)messagePayload[0] > (uint8_t)EStepResponseMode::Delta)
+            {
+                const char* errorMessage = "Invalid SetStepResponseMode payload";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            const EStepResponseMode newStepResponseMode = static_cast<EStepResponseMode>(messagePayload[0]);
+            const float positionThreshold = ReadLittleEndian<float>(messagePayload + 1);
+            const float rotationThreshold = ReadLittleEndian<float>(messagePayload + 5);
+            if(!PhysicsServiceImplementation->SetStepResponseMode(newStepResponseMode, positionThreshold, rotationThreshold))
+            {
+                const char* errorMessage = "Invalid SetStepResponseMode thresholds";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::SetStepResponseMode), messageHeader.SequenceNumber, nullptr, 0);
+            return;
+        }
+
+        case EOpcode::SetStepEncoding:
+        {
+            bool bWasEncodingSet = false;
+            if(PhysicsServiceImplementation && messageHeader.PayloadLength == SetStepEncodingPayloadSize && (uint8_t)messagePayload[0] <= (uint8_t)EStepEncoding::Quantized)
+            {
+                TransformQuantizationSettings quantizationSettings;
+                for(int axis = 0; axis < 3; ++axis)
+                {
+                    quantizationSettings.WorldBoundsMin[axis] = ReadLittleEndian<float>(messagePayload + 1 + axis * sizeof(float));
+                    quantizationSettings.WorldBoundsMax[axis] = ReadLittleEndian<float>(messagePayload + 13 + axis * sizeof(float));
+                }
+                quantizationSettings.PositionBits = (uint8_t)messagePayload[25];
+                quantizationSettings.RotationBits = (uint8_t)messagePayload[26];
+
+                bWasEncodingSet = PhysicsServiceImplementation->SetStepEncoding(static_cast<EStepEncoding>(messagePayload[0]), quantizationSettings);
+            }
+
+            if(!bWasEncodingSet)
+            {
+                const char* errorMessage = "Invalid SetStepEncoding payload";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            // Reply with the record layout and the worst case error, so the client can pick a precision per scene
+            const TransformQuantizer& transformQuantizer = PhysicsServiceImplementation->GetTransformQuantizer();
+            char encodingResponsePayload[SetStepEncodingResponseSize];
+            encodingResponsePayload[0] = (char)transformQuantizer.GetPositionBytes();
+            encodingResponsePayload[1] = (char)transformQuantizer.GetRotationBytes();
+            WriteLittleEndian<float>(encodingResponsePayload + 2, transformQuantizer.GetMaxPositionError());
+            WriteLittleEndian<float>(encodingResponsePayload + 6, transformQuantizer.GetMaxRotationError());
+
+            printf("Step encoding set. Max position error: %f, max rotation error: %f rad\n", 
+                transformQuantizer.GetMaxPositionError(), transformQuantizer.GetMaxRotationError());
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::SetStepEncoding), messageHeader.SequenceNumber, encodingResponsePayload, sizeof(encodingResponsePayload));
+            return;
+        }
+
+        case EOpcode::SetPipelinedStepping:
+        {
+            if(messageHeader.PayloadLength != 1 || (uint8_t)messagePayload[0] > 1)
+            {
+                const char* errorMessage = "Invalid SetPipelinedStepping payload";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            SetPipelinedStepping(messagePayload[0] == 1);
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::SetPipelinedStepping), messageHeader.SequenceNumber, nullptr, 0);
+            return;
+        }
+
+        case EOpcode::GetStats:
+        {
+            bIsOutputTimingDependent = true;
+
+            char statsPayload[1 + (size_t)ELatencyPhase::Count * LatencyStatsRecordSize];
+            statsPayload[0] = (char)ELatencyPhase::Count;
+
+            char* latencyStatsRecord = statsPayload + 1;
+            for(size_t phaseIndex = 0; phaseIndex < (size_t)ELatencyPhase::Count; ++phaseIndex)
+            {
+                const LatencyHistogram& latencyHistogram = LatencyHistograms[phaseIndex];
+                latencyStatsRecord[0] = (char)phaseIndex;
+                WriteLittleEndian<uint64_t>(latencyStatsRecord + 1, latencyHistogram.GetTotalCount());
+                WriteLittleEndian<float>(latencyStatsRecord + 9, (float)(latencyHistogram.GetMeanValue() / 1000.0));
+
+                const double percentiles[5] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+                for(int i = 0; i < 5; ++i)
+                {
+                    WriteLittleEndian<float>(latencyStatsRecord + 13 + i * sizeof(float), (float)(latencyHistogram.GetValueAtPercentile(percentiles[i]) / 1000.0));
+                }
+
+                latencyStatsRecord += LatencyStatsRecordSize;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::GetStats), messageHeader.SequenceNumber, statsPayload, sizeof(statsPayload));
+            return;
+        }
+
+        case EOpcode::CaptureProfile:
+        {
+            bIsOutputTimingDependent = true;
+
+            std::string traceFilePath;
+            if(messageHeader.PayloadLength != sizeof(uint32_t) || !StartProfileCapture(ReadLittleEndian<uint32_t>(messagePayload), traceFilePath))
+            {
+                const char* errorMessage = "Invalid CaptureProfile payload, profiling not available or already capturing";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::CaptureProfile), messageHeader.SequenceNumber, traceFilePath.data(), (uint32_t)traceFilePath.size());
+            return;
+        }
+
+        case EOpcode::SaveState:
+        {
+            if(messageHeader.PayloadLength != 1 || !SaveWorldState((uint8_t)messagePayload[0]))
+            {
+                const char* errorMessage = "Invalid SaveState payload or SaveState before Init";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            char saveStateResultPayload[sizeof(uint32_t)];
+            WriteLittleEndian<uint32_t>(saveStateResultPayload, (uint32_t)PhysicsServiceImplementation->GetSavedWorldStateSize((uint8_t)messagePayload[0]));
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::SaveState), messageHeader.SequenceNumber, saveStateResultPayload, sizeof(saveStateResultPayload));
+            return;
+        }
+
+        case EOpcode::RestoreState:
+        {
+            if(messageHeader.PayloadLength != 1 || !RestoreWorldState((uint8_t)messagePayload[0]))
+            {
+                const char* errorMessage = "Invalid RestoreState payload or nothing saved into the slot";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::RestoreState), messageHeader.SequenceNumber, nullptr, 0);
+            return;
+        }
+
+        case EOpcode::SetContactEvents:
+        {
+            ContactEventSettings contactEventSettings;
+            bool bIsPayloadValid = messageHeader.PayloadLength >= SetContactEventsPayloadSize && (uint8_t)messagePayload[0] <= 1;
+            if(bIsPayloadValid)
+            {
+                contactEventSettings.bIsEnabled = messagePayload[0] == 1;
+                contactEventSettings.EventTypes = (uint8_t)messagePayload[1];
+                contactEventSettings.MinImpactImpulse = ReadLittleEndian<float>(messagePayload + 2);
+                contactEventSettings.MaxEventsPerStep = ReadLittleEndian<uint32_t>(messagePayload + 6);
+
+                const uint32_t filterBodyCount = ReadLittleEndian<uint32_t>(messagePayload + 10);
+                bIsPayloadValid = (messageHeader.PayloadLength - SetContactEventsPayloadSize) / sizeof(uint32_t) == filterBodyCount
+                    && (messageHeader.PayloadLength - SetContactEventsPayloadSize) % sizeof(uint32_t) == 0;
+                for(uint32_t i = 0; bIsPayloadValid && i < filterBodyCount; ++i)
+                {
+                    contactEventSettings.BodyFilter.push_back(ReadLittleEndian<uint32_t>(messagePayload + SetContactEventsPayloadSize + i * sizeof(uint32_t)));
+                }
+            }
+
+            if(!PhysicsServiceImplementation || !bIsPayloadValid || !PhysicsServiceImplementation->SetContactEventSettings(contactEventSettings))
+            {
+                const char* errorMessage = "Invalid SetContactEvents payload";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::SetContactEvents), messageHeader.SequenceNumber, nullptr, 0);
+            return;
+        }
+
+        case EOpcode::SetInterestRegions:
+        {
+            std::vector<InterestRegion> interestRegions;
+            const uint32_t regionCount = messageHeader.PayloadLength >= 1 ? (uint8_t)messagePayload[0] : 0;
+            const bool bIsPayloadValid = messageHeader.PayloadLength == 1 + regionCount * InterestRegionRecordSize;
+            for(uint32_t i = 0; bIsPayloadValid && i < regionCount; ++i)
+            {
+                const char* interestRegionRecord = messagePayload + 1 + i * InterestRegionRecordSize;
+                InterestRegion& interestRegion = interestRegions.emplace_back();
+                interestRegion.Shape = static_cast<EInterestRegionShape>(interestRegionRecord[0]);
+                for(int axis = 0; axis < 3; ++axis)
+                {
+                    const float minValue = ReadLittleEndian<float>(interestRegionRecord + 1 + axis * sizeof(float));
+                    interestRegion.BoxMin[axis] = minValue;
+                    interestRegion.SphereCenter[axis] = minValue;
+                    interestRegion.BoxMax[axis] = ReadLittleEndian<float>(interestRegionRecord + 13 + axis * sizeof(float));
+                }
+                interestRegion.SphereRadius = interestRegion.BoxMax[0];
+            }
+
+            if(!PhysicsServiceImplementation || !bIsPayloadValid || !PhysicsServiceImplementation->SetInterestRegions(interestRegions))
+            {
+                const char* errorMessage = "Invalid SetInterestRegions payload";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::SetInterestRegions), messageHeader.SequenceNumber, nullptr, 0);
+            return;
+        }
+
+        case EOpcode::SceneQueries:
+        {
+            const uint32_t queryCount = messageHeader.PayloadLength >= sizeof(uint32_t) ? ReadLittleEndian<uint32_t>(messagePayload) : 0;
+            bool bIsPayloadValid = queryCount <= PhysicsServiceImpl::cMaxSceneQueries
+                && messageHeader.PayloadLength == sizeof(uint32_t) + queryCount * SceneQueryRecordSize;
+
+            ReceivedSceneQueries.resize(bIsPayloadValid ? queryCount : 0);
+            for(uint32_t i = 0; i < ReceivedSceneQueries.size(); ++i)
+            {
+                const char* sceneQueryRecord = messagePayload + sizeof(uint32_t) + i * SceneQueryRecordSize;
+                SceneQuery& sceneQuery = ReceivedSceneQueries[i];
+                sceneQuery.Type = static_cast<ESceneQueryType>(sceneQueryRecord[0]);
+                sceneQuery.MaxHits = (uint8_t)sceneQueryRecord[1];
+                for(int axis = 0; axis < 3; ++axis)
+                {
+                    sceneQuery.Origin[axis] = ReadLittleEndian<float>(sceneQueryRecord + 2 + axis * sizeof(float));
+                    sceneQuery.Direction[axis] = ReadLittleEndian<float>(sceneQueryRecord + 14 + axis * sizeof(float));
+                    sceneQuery.Extents[axis] = ReadLittleEndian<float>(sceneQueryRecord + 26 + axis * sizeof(float));
+                }
+            }
+
+            // The hits are written straight into the pending output, after the header
+            const size_t messageOffset = BeginBinaryMessageToClient();
+            if(!PhysicsServiceImplementation || !bIsPayloadValid || !PhysicsServiceImplementation->RunSceneQueriesBinary(ReceivedSceneQueries, PendingOutput))
+            {
+                PendingOutput.resize(messageOffset);
+
+                const char* errorMessage = "Invalid SceneQueries payload or SceneQueries before Init";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+            EndBinaryMessageToClient(messageOffset, GetResponseOpcode(EOpcode::SceneQueries), messageHeader.SequenceNumber);
+            return;
+        }
+
+        case EOpcode::SpawnBodies:
+        {
+            if(!PhysicsServiceImplementation || !PhysicsServiceImpl::ParseDescribedActorsFromBinary(messagePayload, messageHeader.PayloadLength, ReceivedSpawnActors)
+                || !PhysicsServiceImplementation->QueueSpawnBodies(ReceivedSpawnActors))
+            {
+                const char* errorMessage = "Invalid SpawnBodies payload, taken actor id or SpawnBodies before Init";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            // The id of every actor, the ones the service picked included
+            const size_t messageOffset = BeginBinaryMessageToClient();
+            AppendLittleEndian<uint32_t>(PendingOutput, (uint32_t)ReceivedSpawnActors.size());
+            for(const ActorInitializationInfo& spawnActor : ReceivedSpawnActors)
+            {
+                AppendLittleEndian<int32_t>(PendingOutput, spawnActor.ActorId);
+            }
+            EndBinaryMessageToClient(messageOffset, GetResponseOpcode(EOpcode::SpawnBodies), messageHeader.SequenceNumber);
+            return;
+        }
+
+        case EOpcode::DespawnBodies:
+        {
+            const uint32_t actorCount = messageHeader.PayloadLength >= sizeof(uint32_t) ? ReadLittleEndian<uint32_t>(messagePayload) : 0;
+            const bool bIsPayloadValid = messageHeader.PayloadLength == sizeof(uint32_t) + (uint64_t)actorCount * sizeof(uint32_t);
+
+            ReceivedDespawnActorIds.resize(bIsPayloadValid ? actorCount : 0);
+            for(uint32_t i = 0; i < ReceivedDespawnActorIds.size(); ++i)
+            {
+                ReceivedDespawnActorIds[i] = ReadLittleEndian<uint32_t>(messagePayload + sizeof(uint32_t) + i * sizeof(uint32_t));
+            }
+
+            if(!PhysicsServiceImplementation || !bIsPayloadValid || !PhysicsServiceImplementation->QueueDespawnBodies(ReceivedDespawnActorIds))
+            {
+                const char* errorMessage = "Invalid DespawnBodies payload, unknown actor id or DespawnBodies before Init";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::DespawnBodies), messageHeader.SequenceNumber, nullptr, 0);
+            return;
+        }
+
+        case EOpcode::SetBodyVelocities:
+        {
+            const uint32_t commandCount = messageHeader.PayloadLength >= sizeof(uint32_t) ? ReadLittleEndian<uint32_t>(messagePayload) : 0;
+            const bool bIsPayloadValid = messageHeader.PayloadLength == sizeof(uint32_t) + (uint64_t)commandCount * BodyVelocityRecordSize;
+
+            ReceivedVelocityCommands.resize(bIsPayloadValid ? commandCount : 0);
+            for(uint32_t i = 0; i < ReceivedVelocityCommands.size(); ++i)
+            {
+                const char* bodyVelocityRecord = messagePayload + sizeof(uint32_t) + i * BodyVelocityRecordSize;
+                BodyVelocityCommand& velocityCommand = ReceivedVelocityCommands[i];
+                velocityCommand.ActorId = ReadLittleEndian<uint32_t>(bodyVelocityRecord);
+                for(int axis = 0; axis < 3; ++axis)
+                {
+                    velocityCommand.LinearVelocity[axis] = ReadLittleEndian<float>(bodyVelocityRecord + 4 + axis * sizeof(float));
+                    velocityCommand.AngularVelocity[axis] = ReadLittleEndian<float>(bodyVelocityRecord + 16 + axis * sizeof(float));
+                }
+            }
+
+            if(!PhysicsServiceImplementation || !bIsPayloadValid || !PhysicsServiceImplementation->QueueSetBodyVelocities(ReceivedVelocityCommands))
+            {
+                const char* errorMessage = "Invalid SetBodyVelocities payload, unknown actor id or SetBodyVelocities before Init";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::SetBodyVelocities), messageHeader.SequenceNumber, nullptr, 0);
+            return;
+        }
+
+        case EOpcode::AddBodyImpulses:
+        {
+            const uint32_t commandCount = messageHeader.PayloadLength >= sizeof(uint32_t) ? ReadLittleEndian<uint32_t>(messagePayload) : 0;
+            const bool bIsPayloadValid = messageHeader.PayloadLength == sizeof(uint32_t) + (uint64_t)commandCount * BodyImpulseRecordSize;
+
+            ReceivedImpulseCommands.resize(bIsPayloadValid ? commandCount : 0);
+            for(uint32_t i = 0; i < ReceivedImpulseCommands.size(); ++i)
+            {
+                const char* bodyImpulseRecord = messagePayload + sizeof(uint32_t) + i * BodyImpulseRecordSize;
+                BodyImpulseCommand& impulseCommand = ReceivedImpulseCommands[i];
+                impulseCommand.ActorId = ReadLittleEndian<uint32_t>(bodyImpulseRecord);
+                for(int axis = 0; axis < 3; ++axis)
+                {
+                    impulseCommand.Impulse[axis] = ReadLittleEndian<float>(bodyImpulseRecord + 4 + axis * sizeof(float));
+                    impulseCommand.AngularImpulse[axis] = ReadLittleEndian<float>(bodyImpulseRecord + 16 + axis * sizeof(float));
+                }
+            }
+
+            if(!PhysicsServiceImplementation || !bIsPayloadValid || !PhysicsServiceImplementation->QueueAddBodyImpulses(ReceivedImpulseCommands))
+            {
+                const char* errorMessage = "Invalid AddBodyImpulses payload, unknown actor id or AddBodyImpulses before Init";
+                QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+                return;
+            }
+
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::AddBodyImpulses), messageHeader.SequenceNumber, nullptr, 0);
+            return;
+        }
+
+        default:
+        {
+            printf("Unknown binary opcode %u\n", messageHeader.Opcode);
+            const char* errorMessage = "Unknown opcode";
+            QueueBinaryMessageToClient(GetResponseOpcode(EOpcode::Error), messageHeader.SequenceNumber, errorMessage, strlen(errorMessage));
+            return;
+        }
+    }
+}
+
+bool PhysicsServiceSession::SaveWorldState(uint32_t stateSlot)
+{
+    const std::chrono::steady_clock::time_point preSaveTime = std::chrono::steady_clock::now();
+    if(!PhysicsServiceImplementation || !PhysicsServiceImplementation->SaveWorldState(stateSlot))
+    {
+        return false;
+    }
+
+    const std::chrono::duration<double, std::milli> saveDuration = std::chrono::steady_clock::now() - preSaveTime;
+    printf("Session %d: world state saved into slot %u (%zu bytes) in %.2f ms\n", SessionId, stateSlot,
+        PhysicsServiceImplementation->GetSavedWorldStateSize(stateSlot), saveDuration.count());
+    return true;
+}
+
+bool PhysicsServiceSession::RestoreWorldState(uint32_t stateSlot)
+{
+    const std::chrono::steady_clock::time_point preRestoreTime = std::chrono::steady_clock::now();
+    if(!PhysicsServiceImplementation || !PhysicsServiceImplementation->RestoreWorldState(stateSlot))
+    {
+        return false;
+    }
+
+    const std::chrono::duration<double, std::milli> restoreDuration = std::chrono::steady_clock::now() - preRestoreTime;
+    printf("Session %d: world state of slot %u restored in %.2f ms\n", SessionId, stateSlot, restoreDuration.count());
+    return true;
+}
+
+void PhysicsServiceSession::InitializePhysicsSystem(const std::vector<ActorInitializationInfo>& initializationActors)
+{
+    if(!PhysicsServiceImplementation)
+    {
+        std::cout << "No physics service implementation valid to init physics system.\n";
+        return;
+    }
+
+    PhysicsServiceImplementation->InitPhysicsSystem(initializationActors);
+}
+
+bool PhysicsServiceSession::SetStepResponseMode(std::string_view responseModeMessage)
+{
+    if(!PhysicsServiceImplementation)
+    {
+        std::cout << "No physics service implementation valid to set the step response mode.\n";
+        return false;
+    }
+
+    TextFieldReader responseModeReader(responseModeMessage);
+    responseModeReader.ReadExpectedField("ResponseMode");
+
+    const bool bIsDeltaMode = responseModeReader.ReadExpectedField("Delta");
+    if(!bIsDeltaMode && !responseModeReader.ReadExpectedField("Full"))
+    {
+        return false;
+    }
+
+    // Thresholds the message leaves out keep their default (range checked by PhysicsServiceImpl::SetStepResponseMode)
+    float responseModeThresholds[2] = { 0.1f, 0.005f };
+    for(float& responseModeThreshold : responseModeThresholds)
+    {
+        if(responseModeReader.HasMoreFields() && !responseModeReader.ReadNumber(responseModeThreshold))
+        {
+            return false;
+        }
+    }
+    if(responseModeReader.HasMoreFields())
+    {
+        return false;
+    }
+
+    return PhysicsServiceImplementation->SetStepResponseMode(bIsDeltaMode ? EStepResponseMode::Delta : EStepResponseMode::Full,
+        responseModeThresholds[0], responseModeThresholds[1]);
+}
+
+bool PhysicsServiceSession::SetContactEvents(std::string_view contactEventsMessage)
+{
+    if(!PhysicsServiceImplementation)
+    {
+        std::cout << "No physics service implementation valid to set the contact events.\n";
+        return false;
+    }
+
+    TextFieldReader contactEventsReader(contactEventsMessage);
+    contactEventsReader.ReadExpectedField("ContactEvents");
+
+    // "Off" takes no fields, "On" at least the impulse threshold
+    ContactEventSettings contactEventSettings;
+    if(contactEventsReader.ReadExpectedField("Off"))
+    {
+        return !contactEventsReader.HasMoreFields() && PhysicsServiceImplementation->SetContactEventSettings(contactEventSettings);
+    }
+    if(!contactEventsReader.ReadExpectedField("On") || !contactEventsReader.ReadNumber(contactEventSettings.MinImpactImpulse))
+    {
+        return false;
+    }
+    contactEventSettings.bIsEnabled = true;
+
+    // The event types are range checked before they're narrowed (see ContactEventSettings::IsValid)
+    uint32_t eventTypes = contactEventSettings.EventTypes;
+    if(contactEventsReader.HasMoreFields() && (!contactEventsReader.ReadNumber(eventTypes) || eventTypes > ContactEventSettings::cAllEventTypes))
+    {
+        return false;
+    }
+    contactEventSettings.EventTypes = (uint8_t)eventTypes;
+
+    if(contactEventsReader.HasMoreFields() && !contactEventsReader.ReadNumber(contactEventSettings.MaxEventsPerStep))
+    {
+        return false;
+    }
+
+    while(contactEventsReader.HasMoreFields())
+    {
+        uint32_t filterBodyId = 0;
+        if(!contactEventsReader.ReadNumber(filterBodyId))
+        {
+            return false;
+        }
+        contactEventSettings.BodyFilter.push_back(filterBodyId);
+    }
+
+    return PhysicsServiceImplementation->SetContactEventSettings(contactEventSettings);
+}
+
+bool PhysicsServiceSession::SetInterestRegions(std::string_view interestRegionsMessage)
+{
+    if(!PhysicsServiceImplementation)
+    {
+        std::cout << "No physics service implementation valid to set the interest regions.\n";
+        return false;
+    }
+
+    TextFieldReader interestRegionsReader(interestRegionsMessage);
+    interestRegionsReader.ReadExpectedField("InterestRegions");
+
+    // "Off" alone clears the regions, otherwise a region is its shape followed by 6 (box) or 4 (sphere) numbers
+    std::vector<InterestRegion> interestRegions;
+    if(interestRegionsReader.GetRemainingFieldCount() == 1 && interestRegionsReader.ReadExpectedField("Off"))
+    {
+        return PhysicsServiceImplementation->SetInterestRegions(interestRegions);
+    }
+
+    while(interestRegionsReader.HasMoreFields())
+    {
+        const bool bIsSphere = interestRegionsReader.ReadExpectedField("Sphere");
+        if(!bIsSphere && !interestRegionsReader.ReadExpectedField("Box"))
+        {
+            return false;
+        }
+
+        float regionValues[6];
+        const size_t valueCount = bIsSphere ? 4 : 6;
+        for(size_t i = 0; i < valueCount; ++i)
+        {
+            if(!interestRegionsReader.ReadNumber(regionValues[i]))
+            {
+                return false;
+            }
+        }
+
+        InterestRegion& interestRegion = interestRegions.emplace_back();
+        interestRegion.Shape = bIsSphere ? EInterestRegionShape::Sphere : EInterestRegionShape::Box;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            interestRegion.BoxMin[axis] = regionValues[axis];
+            interestRegion.SphereCenter[axis] = regionValues[axis];
+            interestRegion.BoxMax[axis] = bIsSphere ? 0.f : regionValues[3 + axis];
+        }
+        interestRegion.SphereRadius = bIsSphere ? regionValues[3] : 0.f;
+    }
+
+    return PhysicsServiceImplementation->SetInterestRegions(interestRegions);
+}
+
+bool PhysicsServiceSession::ParseTextSceneQueries(std::string_view sceneQueriesMessage, std::vector<SceneQuery>& outSceneQueries)
+{
+    TextFieldReader sceneQueriesReader(sceneQueriesMessage);
+    sceneQueriesReader.ReadExpectedField("SceneQueries");
+
+    // Each query is its type followed by its values:
+    // "Ray;ox;oy;oz;dx;dy;dz", "SphereCast;ox;oy;oz;dx;dy;dz;radius", "BoxCast;ox;oy;oz;dx;dy;dz;hx;hy;hz",
+    // "SphereOverlap;x;y;z;radius;maxHits", "BoxOverlap;x;y;z;hx;hy;hz;maxHits"
+    outSceneQueries.clear();
+    while(sceneQueriesReader.HasMoreFields())
+    {
+        SceneQuery& sceneQuery = outSceneQueries.emplace_back();
+        std::string_view sceneQueryTypeName;
+        sceneQueriesReader.ReadField(sceneQueryTypeName);
+
+        size_t valueCount = 0;
+        if(sceneQueryTypeName == "Ray")
+        {
+            sceneQuery.Type = ESceneQueryType::RayCast;
+            valueCount = 6;
+        }
+        else if(sceneQueryTypeName == "SphereCast")
+        {
+            sceneQuery.Type = ESceneQueryType::SphereCast;
+            valueCount = 7;
+        }
+        else if(sceneQueryTypeName == "BoxCast")
+        {
+            sceneQuery.Type = ESceneQueryType::BoxCast;
+            valueCount = 9;
+        }
+        else if(sceneQueryTypeName == "SphereOverlap")
+        {
+            sceneQuery.Type = ESceneQueryType::SphereOverlap;
+            valueCount = 4;
+        }
+        else if(sceneQueryTypeName == "BoxOverlap")
+        {
+            sceneQuery.Type = ESceneQueryType::BoxOverlap;
+            valueCount = 6;
+        }
+        else
+        {
+            return false;
+        }
+
+        float sceneQueryValues[9];
+        for(size_t i = 0; i < valueCount; ++i)
+        {
+            if(!sceneQueriesReader.ReadNumber(sceneQueryValues[i]))
+            {
+                return false;
+            }
+        }
+
+        // Overlaps end with the most bodies they report
+        const bool bIsOverlap = sceneQuery.Type == ESceneQueryType::SphereOverlap || sceneQuery.Type == ESceneQueryType::BoxOverlap;
+        uint32_t maxHits = 1;
+        if(bIsOverlap && (!sceneQueriesReader.ReadNumber(maxHits) || maxHits < 1 || maxHits > SceneQuery::cMaxHits))
+        {
+            return false;
+        }
+        sceneQuery.MaxHits = maxHits;
+
+        const float* extentValues = sceneQueryValues + (bIsOverlap ? 3 : 6);
+        const size_t extentCount = valueCount - (bIsOverlap ? 3 : 6);
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            sceneQuery.Origin[axis] = sceneQueryValues[axis];
+            sceneQuery.Direction[axis] = bIsOverlap ? 0.f : sceneQueryValues[3 + axis];
+            sceneQuery.Extents[axis] = (size_t)axis < extentCount ? extentValues[axis] : 0.f;
+        }
+    }
+
+    return !outSceneQueries.empty();
+}
+
+bool PhysicsServiceSession::QueueBodyCommand(std::string_view bodyCommandMessage)
+{
+    if(!PhysicsServiceImplementation)
+    {
+        std::cout << "No physics service implementation valid to queue the body command.\n";
+        return false;
+    }
+
+    TextFieldReader bodyCommandReader(bodyCommandMessage);
+    std::string_view bodyCommandName;
+    bodyCommandReader.ReadField(bodyCommandName);
+    if(!bodyCommandReader.HasMoreFields())
+    {
+        return false;
+    }
+
+    // "Despawn;<id>[;<id>...]"
+    if(bodyCommandName == "Despawn")
+    {
+        ReceivedDespawnActorIds.clear();
+        while(bodyCommandReader.HasMoreFields())
+        {
+            uint32_t actorId = 0;
+            if(!bodyCommandReader.ReadNumber(actorId))
+            {
+                return false;
+            }
+            ReceivedDespawnActorIds.push_back(actorId);
+        }
+
+        return PhysicsServiceImplementation->QueueDespawnBodies(ReceivedDespawnActorIds);
+    }
+
+    // "<Velocity|Impulse>;<id>;x;y;z[;angularX;angularY;angularZ]", the angular part defaults to 0
+    const size_t bodyCommandFieldCount = bodyCommandReader.GetRemainingFieldCount();
+    uint32_t actorId = 0;
+    if((bodyCommandFieldCount != 4 && bodyCommandFieldCount != 7) || !bodyCommandReader.ReadNumber(actorId))
+    {
+        return false;
+    }
+
+    float bodyCommandValues[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+    for(size_t i = 0; i + 1 < bodyCommandFieldCount; ++i)
+    {
+        if(!bodyCommandReader.ReadNumber(bodyCommandValues[i]))
+        {
+            return false;
+        }
+    }
+
+    if(bodyCommandName == "Velocity")
+    {
+        ReceivedVelocityCommands.resize(1);
+        BodyVelocityCommand& velocityCommand = ReceivedVelocityCommands[0];
+        velocityCommand.ActorId = actorId;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            velocityCommand.LinearVelocity[axis] = bodyCommandValues[axis];
+            velocityCommand.AngularVelocity[axis] = bodyCommandValues[3 + axis];
+        }
+        return PhysicsServiceImplementation->QueueSetBodyVelocities(ReceivedVelocityCommands);
+    }
+
+    ReceivedImpulseCommands.resize(1);
+    BodyImpulseCommand& impulseCommand = ReceivedImpulseCommands[0];
+    impulseCommand.ActorId = actorId;
+    for(int axis = 0; axis < 3; ++axis)
+    {
+        impulseCommand.Impulse[axis] = bodyCommandValues[axis];
+        impulseCommand.AngularImpulse[axis] = bodyCommandValues[3 + axis];
+    }
+    return PhysicsServiceImplementation->QueueAddBodyImpulses(ReceivedImpulseCommands);
+}
+
+bool PhysicsServiceSession::SetPipelinedSteppingFromMessage(std::string_view pipelineMessage)
+{
+    TextFieldReader pipelineReader(pipelineMessage);
+    pipelineReader.ReadExpectedField("Pipeline");
+
+    const bool bEnablePipelinedStepping = pipelineReader.ReadExpectedField("On");
+    if((!bEnablePipelinedStepping && !pipelineReader.ReadExpectedField("Off")) || pipelineReader.HasMoreFields())
+    {
+        return false;
+    }
+
+    SetPipelinedStepping(bEnablePipelinedStepping);
+    return true;
+}
+
+void PhysicsServiceSession::RecordLatency(ELatencyPhase phase, std::chrono::steady_clock::duration duration)
+{
+    LatencyHistograms[(size_t)phase].Record(duration);
+}
+
+void PhysicsServiceSession::RecordStepMeasure(std::chrono::steady_clock::time_point preStepPhysicsTime, std::chrono::steady_clock::time_point postStepPhysicsTime)
+{
+    // Time the step took (without communication), and the phases of the world it went through
+    RecordLatency(ELatencyPhase::Step, postStepPhysicsTime - preStepPhysicsTime);
+    StepHandlingTime += postStepPhysicsTime - preStepPhysicsTime;
+
+    if(PhysicsServiceImplementation)
+    {
+        const StepPhaseDurations& stepPhaseDurations = PhysicsServiceImplementation->GetLastStepPhaseDurations();
+        RecordLatency(ELatencyPhase::Update, stepPhaseDurations.Update);
+        RecordLatency(ELatencyPhase::Snapshot, stepPhaseDurations.Snapshot);
+        RecordLatency(ELatencyPhase::Serialize, stepPhaseDurations.Serialize);
+    }
+
+    // Every step request is a frame of the profile capture
+    TraceProfiler::NextFrame(this);
+
+    if(StatsDumpInterval > std::chrono::seconds::zero() && postStepPhysicsTime - LastStatsDumpTime >= StatsDumpInterval)
+    {
+        LastStatsDumpTime = postStepPhysicsTime;
+        DumpLatencyStats();
+    }
+
+    const bool bIsPipelinedStepping = PhysicsServiceImplementation && PhysicsServiceImplementation->IsPipelinedStepping();
+    StepThroughputMeasure& stepThroughput = StepThroughput[bIsPipelinedStepping ? 1 : 0];
+
+    if(stepThroughput.StepCount == 0)
+    {
+        stepThroughput.FirstStepTime = preStepPhysicsTime;
+    }
+    stepThroughput.LastStepTime = postStepPhysicsTime;
+    stepThroughput.StepHandlingTime += postStepPhysicsTime - preStepPhysicsTime;
+    ++stepThroughput.StepCount;
+}
+
+std::string PhysicsServiceSession::GetStepThroughputReport() const
+{
+    std::string stepThroughputReport;
+
+    const char* steppingModeNames[2] = { "sequential", "pipelined" };
+    for(int steppingMode = 0; steppingMode < 2; ++steppingMode)
+    {
+        const StepThroughputMeasure& stepThroughput = StepThroughput[steppingMode];
+        if(stepThroughput.StepCount == 0)
+        {
+            continue;
+        }
+
+        // Steps per second as seen by the game (includes the time between requests), and the time
+        // the service spent on each Step request (what pipelining shortens)
+        const double elapsedSeconds = std::chrono::duration<double>(stepThroughput.LastStepTime - stepThroughput.FirstStepTime).count();
+        const double stepsPerSecond = elapsedSeconds > 0.0 ? stepThroughput.StepCount / elapsedSeconds : 0.0;
+        const double handlingMicrosecondsPerStep = std::chrono::duration<double, std::micro>(stepThroughput.StepHandlingTime).count() / stepThroughput.StepCount;
+
+        char reportLine[256];
+        snprintf(reportLine, sizeof(reportLine), "Session %d %s stepping: %llu steps, %.1f steps/s, %.1f us handling per step\n",
+            SessionId, steppingModeNames[steppingMode], (unsigned long long)stepThroughput.StepCount, stepsPerSecond, handlingMicrosecondsPerStep);
+        stepThroughputReport += reportLine;
+    }
+
+    return stepThroughputReport;
+}
+
+bool PhysicsServiceSession::StartProfileCapture(uint32_t frameCount, std::string& outTraceFilePath)
+{
+    if(frameCount == 0 || frameCount > MaxProfileFrameCount)
+    {
+        return false;
+    }
+
+    std::string directoryName = "StepPhysicsMeasure";
+    fs::create_directory(directoryName);
+
+    const std::string traceFilePath = directoryName + "/Trace_Remote_Spheres_" + std::to_string(SessionId) + "_" + std::to_string(ProfileCaptureCount + 1) + ".json";
+    if(!TraceProfiler::StartCapture(this, frameCount, traceFilePath))
+    {
+        return false;
+    }
+
+    ++ProfileCaptureCount;
+    outTraceFilePath = traceFilePath;
+    printf("Session %d: capturing a profile of %u frames into %s\n", SessionId, frameCount, traceFilePath.c_str());
+    return true;
+}
+
+std::string PhysicsServiceSession::GetLatencyStatsReport() const
+{
+    std::string latencyStatsReport;
+
+    for(size_t phaseIndex = 0; phaseIndex < (size_t)ELatencyPhase::Count; ++phaseIndex)
+    {
+        const LatencyHistogram& latencyHistogram = LatencyHistograms[phaseIndex];
+        if(latencyHistogram.GetTotalCount() == 0)
+        {
+            continue;
+        }
+
+        char reportLine[256];
+        snprintf(reportLine, sizeof(reportLine), "Stats;%s;%llu;%.1f;%.1f;%.1f;%.1f;%.1f;%.1f\n",
+            GetLatencyPhaseName((ELatencyPhase)phaseIndex), (unsigned long long)latencyHistogram.GetTotalCount(), latencyHistogram.GetMeanValue() / 1000.0,
+            latencyHistogram.GetValueAtPercentile(50.0) / 1000.0, latencyHistogram.GetValueAtPercentile(90.0) / 1000.0,
+            latencyHistogram.GetValueAtPercentile(99.0) / 1000.0, latencyHistogram.GetValueAtPercentile(99.9) / 1000.0,
+            latencyHistogram.GetMaxValue() / 1000.0);
+        latencyStatsReport += reportLine;
+    }
+
+    return latencyStatsReport;
+}
+
+void PhysicsServiceSession::DumpLatencyStats()
+{
+    const LatencyHistogram& stepLatencyHistogram = LatencyHistograms[(size_t)ELatencyPhase::Step];
+    printf("Session %d: %llu steps, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", SessionId,
+        (unsigned long long)stepLatencyHistogram.GetTotalCount(), stepLatencyHistogram.GetValueAtPercentile(50.0) / 1000.0,
+        stepLatencyHistogram.GetValueAtPercentile(99.0) / 1000.0, stepLatencyHistogram.GetValueAtPercentile(99.9) / 1000.0,
+        stepLatencyHistogram.GetMaxValue() / 1000.0);
+
+    // Overwritten on every dump: the histograms cover the whole session
+    std::string directoryName = "StepPhysicsMeasure";
+    fs::create_directory(directoryName);
+
+    std::ofstream latencyStatsFile(directoryName + "/LatencyStats_Remote_Spheres_" + std::to_string(SessionId) + ".txt");
+    if(latencyStatsFile.is_open())
+    {
+        latencyStatsFile << "Stats;phase;count;mean us;p50 us;p90 us;p99 us;p99.9 us;max us\n";
+        latencyStatsFile << GetLatencyStatsReport();
+    }
+}
+
+void PhysicsServiceSession::SaveStepPhysicsMeasureToFile()
+{
+    std::string directoryName = "StepPhysicsMeasure";
+
+    // Create the directory
+    fs::create_directory(directoryName);
+
+    std::string fileName = "/StepPhysicsMeasureWithoutCommsOverhead_Remote_Spheres_" + std::to_string(SessionId) + ".txt";
+    std::string fullPath = directoryName + "/" + fileName;
+
+    // Open the file in output mode
+    std::ofstream file(fullPath);
+
+    if (file.is_open()) { // Check if the file was opened successfully
+        // Step time distribution: one "<bucket upper bound in microseconds> <step count>" per line
+        LatencyHistograms[(size_t)ELatencyPhase::Step].ForEachRecordedBucket([&file](uint64_t bucketUpperBound, uint64_t bucketCount)
+        {
+            file << bucketUpperBound / 1000.0 << " " << bucketCount << "\n";
+        });
+        file.close(); // Close the file
+        std::cout << "Data written to file successfully." << std::endl;
+    } else {
+        std::cout << "Failed to open the file." << std::endl;
+    }
+
+    // Throughput with / without pipelining goes to its own file, the file above only holds the step time buckets
+    std::ofstream throughputFile(directoryName + "/StepThroughput_Remote_Spheres_" + std::to_string(SessionId) + ".txt");
+    if(throughputFile.is_open())
+    {
+        throughputFile << GetStepThroughputReport();
+    }
+
+    DumpLatencyStats();
+}
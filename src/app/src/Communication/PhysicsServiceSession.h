@@ -0,0 +1,309 @@
+#ifndef PHYSICSSERVICESESSION_H
+#define PHYSICSSERVICESESSION_H
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/uio.h>
+#include "../PhysicsSimulation/PhysicsServiceImpl.h"
+#include "LatencyHistogram.h"
+#include "PhysicsServiceProtocol.h"
+#include "SessionRecording.h"
+
+/**
+* State of one connected game instance: its own physics world, the protocol it speaks and
+* the bytes received from / waiting to be sent to it.
+* The session doesn't do any I/O itself. The transport feeds it the received bytes and sends its pending output.
+*/
+class PhysicsServiceSession
+{
+public:
+    explicit PhysicsServiceSession(int newSessionId);
+    ~PhysicsServiceSession();
+
+    /**
+    * Handles the bytes received from the client. Responses are appended to the pending output.
+    */
+    void ProcessReceivedData(const char* receivedData, size_t receivedDataLength);
+
+    /**
+    * Lets the transport receive straight into the session's buffer, without an intermediate copy:
+    * returns room for at least minimumSize bytes (GetReceiveBufferSize tells how much there is in total).
+    * Call CommitReceivedData with the amount of bytes written to handle them.
+    */
+    char* GetReceiveBuffer(size_t minimumSize);
+    size_t GetReceiveBufferSize() const { return ReceivedData.size() - ReceivedDataEnd; }
+    void CommitReceivedData(size_t receivedDataLength);
+
+    /**
+    * Bytes waiting to be sent to the client, in at most two segments (for writev). Returns the segment count.
+    */
+    int GetPendingOutputSegments(iovec outSegments[2]) const;
+    size_t GetPendingOutputSize() const;
+
+    /**
+    * Marks the first sentBytes of the pending output as sent. Partial sends are fine.
+    */
+    void ConsumePendingOutput(size_t sentBytes);
+
+    /**
+    * Called when the client disconnected. Saves the session measurements.
+    */
+    void CloseSession();
+
+    /**
+    * Skips the handshake and uses protocolMode right away. For transports that only speak one protocol.
+    */
+    void SetProtocolMode(PhysicsServiceProtocol::EProtocolMode protocolMode);
+
+    /**
+    * Enables or disables pipelined stepping of this session's world (see PhysicsServiceImpl::SetPipelinedStepping).
+    */
+    void SetPipelinedStepping(bool bEnablePipelinedStepping);
+
+    /**
+    * Job system of the worlds this session creates from now on (see PhysicsServiceImpl::SetJobSystemSettings).
+    */
+    void SetJobSystemSettings(const JobSystemSettings& jobSystemSettings);
+
+    /**
+    * Adds a measure to the latency histogram of a phase. For the phases the transport runs (Receive, Send).
+    */
+    void RecordLatency(ELatencyPhase phase, std::chrono::steady_clock::duration duration);
+
+    /**
+    * Writes the latency percentiles to the measure directory every statsDumpInterval (checked on each step). Zero disables it.
+    */
+    void SetStatsDumpInterval(std::chrono::seconds statsDumpInterval) { StatsDumpInterval = statsDumpInterval; }
+
+    /**
+    * Records everything the session receives from now on into filePath, with a digest of its responses (see SessionRecording.h).
+    * Call once the transport configured the session: the recording starts from its current settings. Returns false if the file can't be created.
+    */
+    bool StartRecording(const std::string& filePath);
+
+    int GetSessionId() const { return SessionId; }
+
+private:
+    enum class ETextPrefixMatch
+    {
+        NoMatch,
+        Match,
+
+        // The received bytes are a prefix of the text we look for
+        NeedMoreData
+    };
+
+    /**
+    * Steps served with / without pipelining, to compare their throughput.
+    */
+    struct StepThroughputMeasure
+    {
+        uint64_t StepCount = 0;
+
+        // Time spent handling Step requests (simulation + serialization)
+        std::chrono::steady_clock::duration StepHandlingTime = std::chrono::steady_clock::duration::zero();
+
+        // First and last Step request, for the steps per second the game actually got
+        std::chrono::steady_clock::time_point FirstStepTime;
+        std::chrono::steady_clock::time_point LastStepTime;
+    };
+
+private:
+    /**
+    * Checks whether the client opened the connection with a binary protocol handshake.
+    * Clients that don't send a handshake keep using the text protocol.
+    * Returns false if more bytes are needed to decide.
+    */
+    bool NegotiateProtocolMode();
+
+    /**
+    * Handles the complete messages of the receive buffer (CommitReceivedData without the recording).
+    */
+    void HandleReceivedData();
+
+    /**
+    * Handles every complete text message in the receive buffer.
+    */
+    void ProcessTextMessages();
+
+    static ETextPrefixMatch MatchTextPrefix(const char* message, size_t messageLength, const char* prefix);
+
+    void HandleTextStep();
+
+    /**
+    * Runs several steps with the given delta time and queues the final state (or every frameInterval-th state).
+    */
+    void HandleTextMultiStep(std::string_view multiStepMessage);
+
+    /**
+    * Logs the first unknown text messages of the session.
+    */
+    void ReportUnknownTextMessage(const char* message, size_t messageLength);
+
+    /**
+    * Handles every complete binary message (header + payload) in the receive buffer.
+    */
+    void ProcessBinaryMessages();
+
+    /**
+    * Executes a single binary message and queues its response.
+    */
+    void HandleBinaryMessage(const PhysicsServiceProtocol::MessageHeader& messageHeader, const char* messagePayload);
+
+    /**
+    * Appends messageLength bytes of messageBuffer to the pending output.
+    */
+    void QueueMessageToClient(const char* messageBuffer, size_t messageLength);
+    void QueueMessageToClient(const char* messageBuffer);
+
+    /**
+    * Appends a binary message (header + payload) to the pending output.
+    */
+    void QueueBinaryMessageToClient(uint16_t opcode, uint32_t sequenceNumber, const char* payload, uint32_t payloadLength);
+
+    /**
+    * To write a binary payload straight into the pending output: Begin reserves the header and returns the message
+    * offset, the payload is then appended to PendingOutput and End writes the header.
+    */
+    size_t BeginBinaryMessageToClient();
+    void EndBinaryMessageToClient(size_t messageOffset, uint16_t opcode, uint32_t sequenceNumber);
+
+    void SaveStepPhysicsMeasureToFile();
+
+    /**
+    * Captures the next frameCount steps of the process into a Chrome trace file (see TraceProfiler), named after the session.
+    * Returns false if profiling isn't available (non profiling build) or a capture is already running.
+    */
+    bool StartProfileCapture(uint32_t frameCount, std::string& outTraceFilePath);
+
+    /**
+    * One line per latency phase with measures: "Stats;<phase>;<count>;<mean>;<p50>;<p90>;<p99>;<p99.9>;<max>", in microseconds.
+    */
+    std::string GetLatencyStatsReport() const;
+
+    /**
+    * Writes the latency stats report to the measure directory and logs the step percentiles.
+    */
+    void DumpLatencyStats();
+
+    /**
+    * Adds a handled Step request to the latency histograms and to the throughput measure of the current stepping mode.
+    */
+    void RecordStepMeasure(std::chrono::steady_clock::time_point preStepPhysicsTime, std::chrono::steady_clock::time_point postStepPhysicsTime);
+
+    /**
+    * One line per stepping mode that served steps: step count, steps per second and handling time per step.
+    */
+    std::string GetStepThroughputReport() const;
+
+    /**
+    * Saves / restores the world through PhysicsServiceImpl::SaveWorldState / RestoreWorldState and logs how long it took.
+    * Return false if the world couldn't be saved / restored.
+    */
+    bool SaveWorldState(uint32_t stateSlot);
+    bool RestoreWorldState(uint32_t stateSlot);
+
+    void InitializePhysicsSystem(const std::vector<ActorInitializationInfo>& initializationActors);
+
+    /**
+    * Parses a "ResponseMode;..." text message (see ProcessTextMessages). Returns false if it's malformed or out of range.
+    */
+    bool SetStepResponseMode(std::string_view responseModeMessage);
+
+    /**
+    * Parses a "Pipeline;On" / "Pipeline;Off" text message. Returns false (leaving the stepping mode as it is) if it's anything else.
+    */
+    bool SetPipelinedSteppingFromMessage(std::string_view pipelineMessage);
+
+    /**
+    * Parses a "ContactEvents;..." text message (see ProcessTextMessages). Returns false if it's malformed or out of range.
+    */
+    bool SetContactEvents(std::string_view contactEventsMessage);
+
+    /**
+    * Parses an "InterestRegions;..." text message (see ProcessTextMessages). Returns false if it's malformed or out of range.
+    */
+    bool SetInterestRegions(std::string_view interestRegionsMessage);
+
+    /**
+    * Parses a "SceneQueries;..." text message (see ProcessTextMessages) into outSceneQueries. Returns false if it's malformed.
+    */
+    static bool ParseTextSceneQueries(std::string_view sceneQueriesMessage, std::vector<SceneQuery>& outSceneQueries);
+
+    /**
+    * Parses a "Despawn;...", "Velocity;..." or "Impulse;..." text message (see ProcessTextMessages) and queues its body command.
+    * Returns false if it's malformed or the command is invalid.
+    */
+    bool QueueBodyCommand(std::string_view bodyCommandMessage);
+
+private:
+    int SessionId = 0;
+
+    PhysicsServiceImpl* PhysicsServiceImplementation = nullptr;
+
+    // One histogram per ELatencyPhase: fixed memory, however long the session runs
+    std::array<LatencyHistogram, (size_t)ELatencyPhase::Count> LatencyHistograms;
+
+    // Time spent in steps, to leave it out of the Parse phase
+    std::chrono::steady_clock::duration StepHandlingTime = std::chrono::steady_clock::duration::zero();
+
+    static constexpr uint32_t MaxProfileFrameCount = 10000;
+    uint32_t ProfileCaptureCount = 0;
+
+    // Scene queries of the last SceneQueries message, reused between messages
+    std::vector<SceneQuery> ReceivedSceneQueries;
+
+    // Body commands of the last spawn / despawn / velocity / impulse message, reused between messages
+    std::vector<ActorInitializationInfo> ReceivedSpawnActors;
+    std::vector<uint32_t> ReceivedDespawnActorIds;
+    std::vector<BodyVelocityCommand> ReceivedVelocityCommands;
+    std::vector<BodyImpulseCommand> ReceivedImpulseCommands;
+
+    // Set while the session is recorded
+    std::unique_ptr<SessionRecorder> Recorder;
+
+    // Set by the handlers whose responses carry measures (Stats, GetStats, ...): a replay can't reproduce them
+    bool bIsOutputTimingDependent = false;
+
+    std::chrono::seconds StatsDumpInterval = std::chrono::seconds::zero();
+    std::chrono::steady_clock::time_point LastStatsDumpTime = std::chrono::steady_clock::now();
+
+    // Received bytes. [ReceivedDataReadOffset, ReceivedDataEnd) weren't handled yet, the rest of the vector is free room.
+    std::vector<char> ReceivedData;
+    size_t ReceivedDataReadOffset = 0;
+    size_t ReceivedDataEnd = 0;
+
+    // Above this size the receive buffer is released once it's empty
+    static constexpr size_t MaxRetainedReceiveBufferSize = 4 * 1024 * 1024;
+
+    // A text message without a line break after this many bytes is dropped
+    static constexpr size_t MaxTextLineLength = 64 * 1024;
+
+    static constexpr uint32_t MaxReportedUnknownTextMessages = 10;
+    uint32_t UnknownTextMessageCount = 0;
+
+    // Text Init messages are parsed line by line as they arrive
+    ActorInitializationParser InitializationParser;
+    bool bIsReceivingInitMessage = false;
+
+    // Protocol spoken on this connection. Decided by the first bytes the client sends.
+    PhysicsServiceProtocol::EProtocolMode ProtocolMode = PhysicsServiceProtocol::EProtocolMode::Text;
+    bool bIsProtocolModeNegotiated = false;
+
+    // [0] = sequential, [1] = pipelined stepping
+    StepThroughputMeasure StepThroughput[2];
+
+    // Responses being sent. The bytes before SendingOutputReadOffset were already sent.
+    std::vector<char> SendingOutput;
+    size_t SendingOutputReadOffset = 0;
+
+    // Responses queued while SendingOutput is out. Both buffers are reused, so queueing a response doesn't allocate in steady state.
+    std::vector<char> PendingOutput;
+};
+
+#endif
@@ -1,10 +1,52 @@
 #include "PhysicsServiceSocketServer.h"
-#include <sstream>
-#include <chrono>
-#include <fstream>
-#include <filesystem>
+#include "SharedMemoryTransport.h"
+#include "../PhysicsSimulation/TraceProfiler.h"
+#include <Jolt/Core/Profiler.h>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+namespace
+{
+    // Set from the signal handler to leave the event loop
+    volatile std::sig_atomic_t bStopRequested = 0;
+
+    void RequestStop(int signalNumber)
+    {
+        bStopRequested = 1;
+    }
+
+    constexpr int MaxEpollEvents = 64;
+}
 
-namespace fs = std::filesystem;
+PhysicsServiceSocketServer::PhysicsServiceSocketServer(const PhysicsServiceServerConfig& serverConfig)
+    : ServerConfig(serverConfig)
+{
+}
+
+bool PhysicsServiceSocketServer::RunServer()
+{
+    // A client disconnecting while we send must not kill the process, and we want to
+    // close the sessions cleanly (saving their measurements) when asked to stop
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, RequestStop);
+    signal(SIGTERM, RequestStop);
+
+    if(ServerConfig.Transport == EPhysicsServiceTransport::SharedMemory)
+    {
+        SharedMemoryTransport sharedMemoryTransport(ServerConfig);
+        if(!sharedMemoryTransport.OpenSharedMemory())
+        {
+            return false;
+        }
+
+        sharedMemoryTransport.RunEventLoop(bStopRequested);
+        return true;
+    }
+
+    return OpenServerSocket();
+}
 
 bool PhysicsServiceSocketServer::OpenServerSocket()
 {
@@ -23,10 +65,10 @@ bool PhysicsServiceSocketServer::OpenServerSocket()
         printf("getaddrinfo failed with error: %s\n", gai_strerror(getAddrInfoReturnValue));
         return false;
     }
-    
+
     // Create a socket for the server to listen for client connections.
     int serverListenSocket = CreateListenSocket(addrInfoResult);
-    if (serverListenSocket == -1) 
+    if (serverListenSocket == -1)
     {
         freeaddrinfo(addrInfoResult);
         return false;
@@ -42,123 +84,74 @@ bool PhysicsServiceSocketServer::OpenServerSocket()
     // Free addrinfo as we don't need it anymore
     freeaddrinfo(addrInfoResult);
 
-    /*PhysicsServiceImplementation = new PhysicsServiceImpl();
-    const std::string test = "Init\n1;0;0;0;0;0;0\n2;0;0;0;0;0;0\n";
-    InitializePhysicsSystem(test);*/
-
-    // Await for the client connection on the listening socket
-    int clientSocket = AwaitClientConnection(serverListenSocket);
-    if (clientSocket == -1) 
+    if(!StartListening(serverListenSocket))
     {
         return false;
     }
 
-    // Once the connection has been established, close the listening socket as we 
-    // won't need it anymore (the communication is done via the new client socket)
-    close(serverListenSocket);
-
-    PhysicsServiceImplementation = new PhysicsServiceImpl();
-    CurrentPhysicsStepSimulationWithoutCommsTimeMeasure = "";
-
-    // Receive until the peer shuts down the connection
-    ssize_t messageReceivalReturnValue = 0;
-    do 
+    // Create the epoll instance and watch the listening socket for new connections
+    EpollFileDescriptor = epoll_create1(0);
+    if(EpollFileDescriptor == -1)
     {
-        // Will stall this process thread until receives a new message from client
-        // The message will be passed on the buffer and the amount of received bytes is the return value
-        // @note Passing a default buffer len. For bigger messages, this should be increased
-        char receivingBuffer[DEFAULT_BUFLEN];
-        messageReceivalReturnValue = ReceiveMessageFromClient(clientSocket, receivingBuffer, DEFAULT_BUFLEN);
-        if(messageReceivalReturnValue <= 0)
-        {
-            break;
-        }
-
-        // Debug: Print received message
-        if(messageReceivalReturnValue > 0)
-        {
-            //  (DEBUG) Print received message
-            decodedMessage += std::string(receivingBuffer, receivingBuffer + messageReceivalReturnValue);
-            std::cout << "Decoded message:" << decodedMessage << "\n=======\n";
-
-            if((decodedMessage.find("Init") != std::string::npos) && (decodedMessage.find("EndMessage") != std::string::npos))
-            {
-                InitializePhysicsSystem(decodedMessage);
-                SendMessageToClient(clientSocket, "OK");
-                decodedMessage = "";
-                continue;
-            }
-
-            if(decodedMessage.find("Step") != std::string::npos)
-            {
-                // Get pre step physics time
-                std::chrono::steady_clock::time_point preStepPhysicsTime = std::chrono::steady_clock::now();
-
-                std::string stepSimulationResult = StepPhysicsSimulation();
-                stepSimulationResult += "OK\n";
-
-                // Get post physics communication time
-                std::chrono::steady_clock::time_point postStepPhysicsTime = std::chrono::steady_clock::now();
-
-                // Calculate the microsseconds all step physics simulation
-                // (considering communication )took
-                std::stringstream ss;
-                ss << std::chrono::duration_cast<std::chrono::microseconds>(postStepPhysicsTime - preStepPhysicsTime).count();
-                const std::string elapsedTime = ss.str();
-
-                // Append the delta time to the current step measurement
-                CurrentPhysicsStepSimulationWithoutCommsTimeMeasure += elapsedTime + "\n";
+        printf("epoll_create1 failed with error: %s\n", strerror(errno));
+        close(serverListenSocket);
+        return false;
+    }
 
-                SendMessageToClient(clientSocket, stepSimulationResult.c_str());
-                decodedMessage = "";
-                continue;
-            }
-            //std::cout << "Unknown message: " << decodedMessage << std::endl;
-            //SendMessageToClient(clientSocket, "Unkown message error");
-        }
-    } while (messageReceivalReturnValue > 0);
+    epoll_event listenSocketEvent;
+    std::memset(&listenSocketEvent, 0, sizeof(listenSocketEvent));
+    listenSocketEvent.events = EPOLLIN;
+    listenSocketEvent.data.fd = serverListenSocket;
+    if(epoll_ctl(EpollFileDescriptor, EPOLL_CTL_ADD, serverListenSocket, &listenSocketEvent) == -1)
+    {
+        printf("epoll_ctl failed with error: %s\n", strerror(errno));
+        close(EpollFileDescriptor);
+        close(serverListenSocket);
+        return false;
+    }
 
-    // Save step physics measurement to file
-    SaveStepPhysicsMeasureToFile();
+    RunEventLoop(serverListenSocket);
 
-    // shutdown the connection since we're done
-    const int shutdownResult = shutdown(clientSocket, SHUT_RDWR);
-    if (shutdownResult == -1) 
+    // Finished work, clean up every session that is still connected
+    while(!ClientConnections.empty())
     {
-        printf("Shutdown failed with error: %s\n", strerror(errno));
-        close(clientSocket);
-        return false;
+        CloseClientConnection(ClientConnections.begin()->first);
     }
 
-    // Finished work, clean up
-    close(clientSocket);
+    close(EpollFileDescriptor);
+    EpollFileDescriptor = -1;
+    close(serverListenSocket);
 
     return true;
 }
 
 int PhysicsServiceSocketServer::CreateListenSocket(addrinfo* listenSocketAddrInfo)
 {
-    // Create a new socket using the addr info 
-    int newListenSocket = socket(listenSocketAddrInfo->ai_family, listenSocketAddrInfo->ai_socktype, listenSocketAddrInfo->ai_protocol);
+    // Create a new (non-blocking) socket using the addr info
+    int newListenSocket = socket(listenSocketAddrInfo->ai_family, listenSocketAddrInfo->ai_socktype | SOCK_NONBLOCK, listenSocketAddrInfo->ai_protocol);
 
     // Check if creation was successful
-    if (newListenSocket == -1) 
+    if (newListenSocket == -1)
     {
         printf("Socket failed with error: %s\n", strerror(errno));
         return -1;
     }
 
+    // Allow restarting the service right away, without waiting for the old connections to time out
+    const int reuseAddress = 1;
+    setsockopt(newListenSocket, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
     return newListenSocket;
 }
 
 bool PhysicsServiceSocketServer::BindListenSocket(int listenSocketToSetup, addrinfo* listenSocketAddrInfo)
 {
     // Bind the listen socket to the addrinfo
-    const int bindReturnValue = 
+    const int bindReturnValue =
         bind(listenSocketToSetup, listenSocketAddrInfo->ai_addr, listenSocketAddrInfo->ai_addrlen);
 
     // Check for errors
-    if (bindReturnValue == -1) 
+    if (bindReturnValue == -1)
     {
         printf("Bind failed with error: %s\n", strerror(errno));
         close(listenSocketToSetup);
@@ -168,38 +161,168 @@ bool PhysicsServiceSocketServer::BindListenSocket(int listenSocketToSetup, addri
     return true;
 }
 
-int PhysicsServiceSocketServer::AwaitClientConnection(int listenSocket)
+bool PhysicsServiceSocketServer::StartListening(int listenSocket)
 {
-    const int listenReturnValue = 
+    const int listenReturnValue =
         listen(listenSocket, SOMAXCONN);
 
-    if (listenReturnValue == -1) 
+    if (listenReturnValue == -1)
     {
         printf("Listen failed with error: %s\n", strerror(errno));
         close(listenSocket);
-        return -1;
+        return false;
     }
 
-    // Await a client connection to the listening socket
-    printf("Awaiting client connection...\n");
+    printf("Awaiting client connections on port %s...\n", SERVER_PORT);
+    return true;
+}
+
+void PhysicsServiceSocketServer::RunEventLoop(int listenSocket)
+{
+    TraceProfiler::SetThreadName("Socket Server");
 
-    // Once connection is done, the library will create a new socket for it
-    int connectedClientSocket = accept(listenSocket, NULL, NULL);
+    epoll_event socketEvents[MaxEpollEvents];
 
-    // Check for errors on the client socket creation
-    if (connectedClientSocket == -1) 
+    while(!bStopRequested)
     {
-        printf("Socket accept failed with error: %s\n", strerror(errno));
-        close(listenSocket);
-        return -1;
+        const int readySocketAmount = epoll_wait(EpollFileDescriptor, socketEvents, MaxEpollEvents, -1);
+        if(readySocketAmount == -1)
+        {
+            // Interrupted by a signal, check if we were asked to stop
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            printf("epoll_wait failed with error: %s\n", strerror(errno));
+            return;
+        }
+
+        for(int i = 0; i < readySocketAmount; ++i)
+        {
+            const int readySocket = socketEvents[i].data.fd;
+            const uint32_t readySocketEvents = socketEvents[i].events;
+
+            if(readySocket == listenSocket)
+            {
+                AcceptClientConnections(listenSocket);
+                continue;
+            }
+
+            // The connection may have been closed by a previous event of this batch
+            auto clientConnectionIt = ClientConnections.find(readySocket);
+            if(clientConnectionIt == ClientConnections.end())
+            {
+                continue;
+            }
+            ClientConnection& clientConnection = clientConnectionIt->second;
+
+            if(readySocketEvents & EPOLLERR)
+            {
+                CloseClientConnection(readySocket);
+                continue;
+            }
+
+            // On hang up, read what is left: recv returns 0 once everything was read
+            if((readySocketEvents & (EPOLLIN | EPOLLHUP)) && !ReceiveMessagesFromClient(readySocket, clientConnection))
+            {
+                CloseClientConnection(readySocket);
+                continue;
+            }
+
+            // Send the responses (also resumes a send that was waiting for EPOLLOUT)
+            if(!SendPendingMessagesToClient(readySocket, clientConnection))
+            {
+                CloseClientConnection(readySocket);
+                continue;
+            }
+        }
     }
 
-    return connectedClientSocket;
+    printf("Stop requested. Shutting down the server...\n");
+}
+
+void PhysicsServiceSocketServer::AcceptClientConnections(int listenSocket)
+{
+    // Accept every connection that is waiting, instead of one per epoll_wait
+    while(true)
+    {
+        // Once connection is done, the library will create a new socket for it
+        int connectedClientSocket = accept4(listenSocket, NULL, NULL, SOCK_NONBLOCK);
+
+        // Check for errors on the client socket creation
+        if (connectedClientSocket == -1)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                printf("Socket accept failed with error: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        epoll_event clientSocketEvent;
+        std::memset(&clientSocketEvent, 0, sizeof(clientSocketEvent));
+        clientSocketEvent.events = EPOLLIN;
+        clientSocketEvent.data.fd = connectedClientSocket;
+        if(epoll_ctl(EpollFileDescriptor, EPOLL_CTL_ADD, connectedClientSocket, &clientSocketEvent) == -1)
+        {
+            printf("epoll_ctl failed with error: %s\n", strerror(errno));
+            close(connectedClientSocket);
+            continue;
+        }
+
+        const int newSessionId = NextSessionId++;
+        ClientConnections[connectedClientSocket].Session = std::make_unique<PhysicsServiceSession>(newSessionId);
+        ClientConnections[connectedClientSocket].Session->SetPipelinedStepping(ServerConfig.bPipelinedStepping);
+        ClientConnections[connectedClientSocket].Session->SetStatsDumpInterval(std::chrono::seconds(ServerConfig.StatsDumpInterval));
+        ClientConnections[connectedClientSocket].Session->SetJobSystemSettings({ ServerConfig.bWorkStealingJobSystem ? EJobSystemType::WorkStealing : EJobSystemType::ThreadPool, ServerConfig.JobWorkerCount, ServerConfig.bPinJobWorkers });
+
+        // Recorded from its first byte: the replay negotiates the protocol like the client did
+        if(!ServerConfig.RecordDirectory.empty())
+        {
+            ClientConnections[connectedClientSocket].Session->StartRecording(ServerConfig.GetSessionRecordingPath(newSessionId));
+        }
+
+        printf("Client connected. Session %d (%zu active)\n", newSessionId, ClientConnections.size());
+    }
+}
+
+bool PhysicsServiceSocketServer::ReceiveMessagesFromClient(int clientSocket, ClientConnection& clientConnection)
+{
+    PhysicsServiceSession& clientSession = *clientConnection.Session;
+
+    // Read until the socket has no more data for us. The bytes go straight into the session's receive buffer,
+    // which keeps partial messages between reads and grows for messages bigger than DEFAULT_BUFLEN.
+    while(true)
+    {
+        char* receivingBuffer = clientSession.GetReceiveBuffer(DEFAULT_BUFLEN);
+        const int receivingBufferLength = (int)std::min<size_t>(clientSession.GetReceiveBufferSize(), INT_MAX);
+
+        const std::chrono::steady_clock::time_point preReceiveTime = std::chrono::steady_clock::now();
+        ssize_t messageReceivalReturnValue = 0;
+        {
+            JPH_PROFILE("Receive");
+            messageReceivalReturnValue = ReceiveMessageFromClient(clientSocket, receivingBuffer, receivingBufferLength);
+        }
+        if(messageReceivalReturnValue > 0)
+        {
+            clientSession.RecordLatency(ELatencyPhase::Receive, std::chrono::steady_clock::now() - preReceiveTime);
+            clientSession.CommitReceivedData(messageReceivalReturnValue);
+            continue;
+        }
+
+        if(messageReceivalReturnValue == 0)
+        {
+            return false;
+        }
+
+        // Nothing more to read for now
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
 }
 
 ssize_t PhysicsServiceSocketServer::ReceiveMessageFromClient(int clientSocket, char* receivingBuffer, int receivingBufferLength)
 {
-    // This call will stall this process thread until we receive a message from the client (game)
     // The message received will be on "receivingBuffer", given the buffer length
     // The returning value will be the amount of bytes on the received message
     const ssize_t bytesReceivedAmount =
@@ -209,83 +332,111 @@ ssize_t PhysicsServiceSocketServer::ReceiveMessageFromClient(int clientSocket, c
     if(bytesReceivedAmount == 0)
     {
         printf("Received a close connection message (0 bytes)\n");
-        printf("Closing connection...\n");
         return 0;
     }
 
     // If received a value > 0, we have a valid message from the client
     if(bytesReceivedAmount > 0)
     {
-        //printf("Received bytes amount: %ld\n", bytesReceivedAmount);
-
         // return the amount of received bytes
         return bytesReceivedAmount;
     }
 
-    // If received value is < 0, we have an error. Let's close the connection
-    printf("recv failed with error: %s\n", strerror(errno));
-    close(clientSocket);
+    // If received value is < 0, we either have no data yet (non-blocking socket) or an error
+    if(errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        printf("recv failed with error: %s\n", strerror(errno));
+    }
 
     return -1;
 }
 
-bool PhysicsServiceSocketServer::SendMessageToClient(int clientSocket, const char* messageBuffer)
+bool PhysicsServiceSocketServer::SendPendingMessagesToClient(int clientSocket, ClientConnection& clientConnection)
 {
-    // Send the given message to the client
-    const ssize_t sendReturnValue = send(clientSocket, messageBuffer, strlen(messageBuffer), 0);
+    PhysicsServiceSession& clientSession = *clientConnection.Session;
+
+    JPH_PROFILE("Send");
+
+    const std::chrono::steady_clock::time_point preSendTime = std::chrono::steady_clock::now();
+    const bool bHasPendingOutput = clientSession.GetPendingOutputSize() > 0;
 
-    // Check for sending error
-    if (sendReturnValue == -1) 
+    iovec pendingOutputSegments[2];
+    while(clientSession.GetPendingOutputSize() > 0)
     {
-        printf("send failed with error: %s\n", strerror(errno));
-        close(clientSocket);
-        return false;
+        // Send the pending messages to the client. Both output segments go in a single call, and the
+        // socket may take only part of them: whatever is left is sent in the next iteration.
+        msghdr pendingOutputMessage;
+        std::memset(&pendingOutputMessage, 0, sizeof(pendingOutputMessage));
+        pendingOutputMessage.msg_iov = pendingOutputSegments;
+        pendingOutputMessage.msg_iovlen = clientSession.GetPendingOutputSegments(pendingOutputSegments);
+
+        // sendmsg is writev with flags: MSG_NOSIGNAL keeps a closed connection from raising SIGPIPE
+        const ssize_t sendReturnValue = sendmsg(clientSocket, &pendingOutputMessage, MSG_NOSIGNAL);
+
+        if(sendReturnValue == -1)
+        {
+            // The socket buffer is full. Continue once epoll tells us there's room again.
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if(!clientConnection.bIsWaitingToSend)
+                {
+                    clientConnection.bIsWaitingToSend = true;
+                    return SetClientSocketEvents(clientSocket, EPOLLIN | EPOLLOUT);
+                }
+                return true;
+            }
+
+            // Check for sending error
+            printf("send failed with error: %s\n", strerror(errno));
+            return false;
+        }
+
+        clientSession.ConsumePendingOutput(sendReturnValue);
     }
 
-    //printf("Bytes sent: %ld\n", sendReturnValue);
-    return true;
-}
+    if(bHasPendingOutput)
+    {
+        clientSession.RecordLatency(ELatencyPhase::Send, std::chrono::steady_clock::now() - preSendTime);
+    }
 
-void PhysicsServiceSocketServer::InitializePhysicsSystem(const std::string initializationActorsInfo)
-{
-    if(!PhysicsServiceImplementation)
+    // Everything was sent, stop waiting for EPOLLOUT
+    if(clientConnection.bIsWaitingToSend)
     {
-        std::cout << "No physics service implementation valid to init physics system.\n";
-        return;
+        clientConnection.bIsWaitingToSend = false;
+        return SetClientSocketEvents(clientSocket, EPOLLIN);
     }
 
-    PhysicsServiceImplementation->InitPhysicsSystem(initializationActorsInfo);
+    return true;
 }
 
-std::string PhysicsServiceSocketServer::StepPhysicsSimulation()
+bool PhysicsServiceSocketServer::SetClientSocketEvents(int clientSocket, uint32_t socketEvents)
 {
-    if(!PhysicsServiceImplementation)
+    epoll_event clientSocketEvent;
+    std::memset(&clientSocketEvent, 0, sizeof(clientSocketEvent));
+    clientSocketEvent.events = socketEvents;
+    clientSocketEvent.data.fd = clientSocket;
+
+    if(epoll_ctl(EpollFileDescriptor, EPOLL_CTL_MOD, clientSocket, &clientSocketEvent) == -1)
     {
-        std::cout << "No physics service implementation valid to step physics simulation.\n";
-        return "";
+        printf("epoll_ctl failed with error: %s\n", strerror(errno));
+        return false;
     }
 
-    return PhysicsServiceImplementation->StepPhysicsSimulation();
+    return true;
 }
 
-void PhysicsServiceSocketServer::SaveStepPhysicsMeasureToFile()
+void PhysicsServiceSocketServer::CloseClientConnection(int clientSocket)
 {
-    std::string directoryName = "StepPhysicsMeasure";
-
-    // Create the directory
-    fs::create_directory(directoryName);
-
-    std::string fileName = "/StepPhysicsMeasureWithoutCommsOverhead_Remote_Spheres_.txt";
-    std::string fullPath = directoryName + "/" + fileName;
+    auto clientConnectionIt = ClientConnections.find(clientSocket);
+    if(clientConnectionIt != ClientConnections.end())
+    {
+        clientConnectionIt->second.Session->CloseSession();
+        ClientConnections.erase(clientConnectionIt);
+    }
 
-    // Open the file in output mode
-    std::ofstream file(fullPath);
+    // Closing the socket also removes it from the epoll set
+    shutdown(clientSocket, SHUT_RDWR);
+    close(clientSocket);
 
-    if (file.is_open()) { // Check if the file was opened successfully
-        file << CurrentPhysicsStepSimulationWithoutCommsTimeMeasure; // Write the string to the file
-        file.close(); // Close the file
-        std::cout << "Data written to file successfully." << std::endl;
-    } else {
-        std::cout << "Failed to open the file." << std::endl;
-    }
+    printf("Client disconnected (%zu active)\n", ClientConnections.size());
 }
@@ -1,65 +1,115 @@
 #ifndef SOCKERSERVER_H
 #define SOCKERSERVER_H
 
+#include <algorithm>
+#include <climits>
 #include <iostream>
 #include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <netdb.h>
 #include <unistd.h>
 #include <errno.h>
-#include "../PhysicsSimulation/PhysicsServiceImpl.h"
+#include "PhysicsServiceServerConfig.h"
+#include "PhysicsServiceSession.h"
 
-#define DEFAULT_BUFLEN 1048576
+// Minimum room in a session's receive buffer for each recv
+#define DEFAULT_BUFLEN 65536
 #define SERVER_PORT "27015"
 
-/** 
-* 
+/**
+* TCP server for the physics service. Serves any number of game instances from a single process:
+* each connection gets its own PhysicsServiceSession (and physics world), and connections come and go
+* without restarting the service. All sockets are non-blocking and driven by a single epoll loop.
 */
 class PhysicsServiceSocketServer
 {
+private:
+    struct ClientConnection
+    {
+        std::unique_ptr<PhysicsServiceSession> Session;
+
+        // True while the socket buffer is full and we wait for EPOLLOUT to send the rest
+        bool bIsWaitingToSend = false;
+    };
+
 public:
-    /** 
-    * 
+    explicit PhysicsServiceSocketServer(const PhysicsServiceServerConfig& serverConfig);
+
+    /**
+    * Serves clients over the transport chosen in the server configuration until the process is asked
+    * to stop (SIGINT / SIGTERM). Returns false if the transport couldn't be set up.
+    */
+    bool RunServer();
+
+    /**
+    * Opens the listening socket and serves clients until the process is asked to stop (SIGINT / SIGTERM).
+    * Returns false if the server socket couldn't be set up.
     */
     bool OpenServerSocket();
 
 private:
-    /** 
-    * 
+    /**
+    *
     */
     int CreateListenSocket(addrinfo* listenSocketAddrInfo);
-    
-    /** 
-    * 
+
+    /**
+    *
     */
     bool BindListenSocket(int listenSocketToSetup, addrinfo* listenSocketAddrInfo);
-    
-    /** 
-    * 
+
+    /**
+    * Starts listening for client connections on the (non-blocking) listen socket.
+    */
+    bool StartListening(int listenSocket);
+
+    /**
+    * Waits for socket events and dispatches them until a stop is requested.
+    */
+    void RunEventLoop(int listenSocket);
+
+    /**
+    * Accepts every pending connection and creates a session for each.
+    */
+    void AcceptClientConnections(int listenSocket);
+
+    /**
+    * Reads everything available on the client socket and lets the session handle it.
+    * Returns false if the connection was closed.
     */
-    int AwaitClientConnection(int listenSocket);
+    bool ReceiveMessagesFromClient(int clientSocket, ClientConnection& clientConnection);
 
-    /** 
-    * 
+    /**
+    *
     */
     ssize_t ReceiveMessageFromClient(int clientSocket, char* receivingBuffer, int receivingBufferLength);
-    
-    /** 
-    * 
+
+    /**
+    * Sends as much of the session's pending output as the socket accepts. Waits for EPOLLOUT when the
+    * socket buffer is full. Returns false if the connection failed.
     */
-    bool SendMessageToClient(int clientSocket, const char* messageBuffer);
+    bool SendPendingMessagesToClient(int clientSocket, ClientConnection& clientConnection);
 
-    void SaveStepPhysicsMeasureToFile();
+    /**
+    * Closes the client socket and destroys its session.
+    */
+    void CloseClientConnection(int clientSocket);
 
-public:
-    void InitializePhysicsSystem(const std::string initializationActorsInfo);
-    std::string StepPhysicsSimulation();
+    /**
+    * Updates which events epoll reports for the client socket.
+    */
+    bool SetClientSocketEvents(int clientSocket, uint32_t socketEvents);
 
 private:
-    PhysicsServiceImpl* PhysicsServiceImplementation = nullptr;
+    PhysicsServiceServerConfig ServerConfig;
 
-	std::string CurrentPhysicsStepSimulationWithoutCommsTimeMeasure = "";
+    int EpollFileDescriptor = -1;
 
-    std::string decodedMessage = "";
+    // One connection (and session) per connected client, keyed by its socket
+    std::unordered_map<int, ClientConnection> ClientConnections;
+    int NextSessionId = 1;
 };
 
 #endif
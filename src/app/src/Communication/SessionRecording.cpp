@@ -0,0 +1,292 @@
+#include "SessionRecording.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace SessionRecording
+{
+    uint64_t ComputeOutputDigest(const char* output, size_t outputLength)
+    {
+        constexpr uint64_t DigestMultiplier = 0xff51afd7ed558ccdull;
+
+        uint64_t outputDigest = 0x9e3779b97f4a7c15ull ^ outputLength;
+        size_t outputOffset = 0;
+        for(; outputOffset + sizeof(uint64_t) <= outputLength; outputOffset += sizeof(uint64_t))
+        {
+            uint64_t outputWord;
+            std::memcpy(&outputWord, output + outputOffset, sizeof(outputWord));
+            outputDigest = (outputDigest ^ outputWord) * DigestMultiplier;
+            outputDigest ^= outputDigest >> 32;
+        }
+
+        // Last bytes, zero padded
+        if(outputOffset < outputLength)
+        {
+            uint64_t outputWord = 0;
+            std::memcpy(&outputWord, output + outputOffset, outputLength - outputOffset);
+            outputDigest = (outputDigest ^ outputWord) * DigestMultiplier;
+        }
+
+        // Final avalanche (murmur3 fmix64)
+        outputDigest ^= outputDigest >> 33;
+        outputDigest *= DigestMultiplier;
+        outputDigest ^= outputDigest >> 33;
+        outputDigest *= 0xc4ceb9fe1a85ec53ull;
+        outputDigest ^= outputDigest >> 33;
+        return outputDigest;
+    }
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    Close();
+}
+
+bool SessionRecorder::Open(const std::string& filePath, const SessionRecording::FileHeader& fileHeader)
+{
+    using namespace PhysicsServiceProtocol;
+    using namespace SessionRecording;
+
+    Close();
+
+    FileDescriptor = open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(FileDescriptor == -1)
+    {
+        printf("Can't create the session recording %s: %s\n", filePath.c_str(), strerror(errno));
+        return false;
+    }
+
+    FilePath = filePath;
+    StartTime = std::chrono::steady_clock::now();
+    RecordCount = 0;
+    WriteBuffer.clear();
+    WriteBuffer.reserve(WriteBufferSize);
+
+    char fileHeaderBytes[FileHeaderSize] = {};
+    std::memcpy(fileHeaderBytes, FileMagic, sizeof(FileMagic));
+    WriteLittleEndian<uint16_t>(fileHeaderBytes + 4, FileVersion);
+    fileHeaderBytes[6] = (char)fileHeader.ProtocolMode;
+    fileHeaderBytes[7] = fileHeader.bIsProtocolModeNegotiated ? 1 : 0;
+    WriteLittleEndian<int32_t>(fileHeaderBytes + 8, fileHeader.SessionId);
+    fileHeaderBytes[12] = fileHeader.bPipelinedStepping ? 1 : 0;
+    fileHeaderBytes[13] = (char)fileHeader.JobSettings.Type;
+    fileHeaderBytes[14] = fileHeader.JobSettings.bPinWorkers ? 1 : 0;
+    WriteLittleEndian<int32_t>(fileHeaderBytes + 16, fileHeader.JobSettings.WorkerCount);
+    WriteLittleEndian<uint64_t>(fileHeaderBytes + 24, fileHeader.StartTime);
+    WriteBuffer.insert(WriteBuffer.end(), fileHeaderBytes, fileHeaderBytes + FileHeaderSize);
+
+    // The header goes out right away, so even a session killed early leaves a valid recording
+    FlushWriteBuffer();
+    return IsOpen();
+}
+
+void SessionRecorder::RecordInput(std::chrono::steady_clock::time_point receiveTime, const char* receivedData, size_t receivedDataLength)
+{
+    if(!IsOpen() || receivedDataLength == 0)
+    {
+        return;
+    }
+
+    SessionRecording::RecordHeader recordHeader;
+    recordHeader.Type = SessionRecording::ERecordType::Input;
+    recordHeader.PayloadLength = (uint32_t)receivedDataLength;
+    recordHeader.Time = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(receiveTime - StartTime).count();
+    AppendRecordHeader(recordHeader);
+
+    // Large inputs (Init) skip the buffer
+    if(receivedDataLength >= WriteBufferSize)
+    {
+        FlushWriteBuffer();
+        WriteToFile(receivedData, receivedDataLength);
+        return;
+    }
+
+    WriteBuffer.insert(WriteBuffer.end(), receivedData, receivedData + receivedDataLength);
+    if(WriteBuffer.size() >= WriteBufferSize)
+    {
+        FlushWriteBuffer();
+    }
+}
+
+void SessionRecorder::RecordOutput(const char* output, size_t outputLength, bool bIsTimingDependent)
+{
+    using namespace PhysicsServiceProtocol;
+    using namespace SessionRecording;
+
+    if(!IsOpen())
+    {
+        return;
+    }
+
+    RecordHeader recordHeader;
+    recordHeader.Type = ERecordType::Output;
+    recordHeader.Flags = bIsTimingDependent ? OutputTimingDependentFlag : 0;
+    recordHeader.PayloadLength = OutputRecordPayloadSize;
+    recordHeader.Time = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - StartTime).count();
+    AppendRecordHeader(recordHeader);
+
+    AppendLittleEndian<uint64_t>(WriteBuffer, (uint64_t)outputLength);
+    AppendLittleEndian<uint64_t>(WriteBuffer, ComputeOutputDigest(output, outputLength));
+    if(WriteBuffer.size() >= WriteBufferSize)
+    {
+        FlushWriteBuffer();
+    }
+}
+
+void SessionRecorder::Close()
+{
+    if(!IsOpen())
+    {
+        return;
+    }
+
+    FlushWriteBuffer();
+    if(IsOpen())
+    {
+        close(FileDescriptor);
+        FileDescriptor = -1;
+        printf("Session recording %s closed (%llu records)\n", FilePath.c_str(), (unsigned long long)RecordCount);
+    }
+}
+
+void SessionRecorder::AppendRecordHeader(const SessionRecording::RecordHeader& recordHeader)
+{
+    using namespace PhysicsServiceProtocol;
+
+    const size_t recordOffset = WriteBuffer.size();
+    WriteBuffer.resize(recordOffset + SessionRecording::RecordHeaderSize, 0);
+    WriteBuffer[recordOffset] = (char)recordHeader.Type;
+    WriteBuffer[recordOffset + 1] = (char)recordHeader.Flags;
+    WriteLittleEndian<uint32_t>(WriteBuffer.data() + recordOffset + 4, recordHeader.PayloadLength);
+    WriteLittleEndian<uint64_t>(WriteBuffer.data() + recordOffset + 8, recordHeader.Time);
+    ++RecordCount;
+}
+
+void SessionRecorder::WriteToFile(const char* data, size_t length)
+{
+    while(length > 0 && IsOpen())
+    {
+        const ssize_t writtenBytes = write(FileDescriptor, data, length);
+        if(writtenBytes == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            // Out of disk space or similar: stop recording, the session keeps running
+            printf("Session recording %s stopped, write failed with error: %s\n", FilePath.c_str(), strerror(errno));
+            close(FileDescriptor);
+            FileDescriptor = -1;
+            return;
+        }
+
+        data += writtenBytes;
+        length -= (size_t)writtenBytes;
+    }
+}
+
+void SessionRecorder::FlushWriteBuffer()
+{
+    WriteToFile(WriteBuffer.data(), WriteBuffer.size());
+    WriteBuffer.clear();
+}
+
+SessionRecordingReader::~SessionRecordingReader()
+{
+    if(MappedData)
+    {
+        munmap(const_cast<char*>(MappedData), MappedSize);
+    }
+}
+
+bool SessionRecordingReader::Open(const std::string& filePath)
+{
+    using namespace PhysicsServiceProtocol;
+    using namespace SessionRecording;
+
+    const int fileDescriptor = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fileDescriptor == -1)
+    {
+        printf("Can't open the session recording %s: %s\n", filePath.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat fileStatus;
+    if(fstat(fileDescriptor, &fileStatus) == -1 || (size_t)fileStatus.st_size < FileHeaderSize)
+    {
+        printf("%s is not a session recording (too small)\n", filePath.c_str());
+        close(fileDescriptor);
+        return false;
+    }
+
+    // The mapping stays valid once the file is closed
+    void* mapping = mmap(nullptr, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    close(fileDescriptor);
+    if(mapping == MAP_FAILED)
+    {
+        printf("mmap of %s failed with error: %s\n", filePath.c_str(), strerror(errno));
+        return false;
+    }
+
+    // Read once, front to back
+    madvise(mapping, (size_t)fileStatus.st_size, MADV_SEQUENTIAL);
+    MappedData = static_cast<const char*>(mapping);
+    MappedSize = (size_t)fileStatus.st_size;
+
+    const uint16_t fileVersion = ReadLittleEndian<uint16_t>(MappedData + 4);
+    if(std::memcmp(MappedData, FileMagic, sizeof(FileMagic)) != 0 || fileVersion != FileVersion)
+    {
+        printf("%s is not a session recording of version %u\n", filePath.c_str(), FileVersion);
+        return false;
+    }
+
+    Header.ProtocolMode = static_cast<EProtocolMode>(MappedData[6]);
+    Header.bIsProtocolModeNegotiated = MappedData[7] != 0;
+    Header.SessionId = ReadLittleEndian<int32_t>(MappedData + 8);
+    Header.bPipelinedStepping = MappedData[12] != 0;
+    Header.JobSettings.Type = static_cast<EJobSystemType>(MappedData[13]);
+    Header.JobSettings.bPinWorkers = MappedData[14] != 0;
+    Header.JobSettings.WorkerCount = ReadLittleEndian<int32_t>(MappedData + 16);
+    Header.StartTime = ReadLittleEndian<uint64_t>(MappedData + 24);
+
+    ReadOffset = FileHeaderSize;
+    return true;
+}
+
+bool SessionRecordingReader::ReadNextRecord(SessionRecording::RecordHeader& outRecordHeader, const char*& outPayload)
+{
+    using namespace PhysicsServiceProtocol;
+    using namespace SessionRecording;
+
+    if(!MappedData || ReadOffset >= MappedSize)
+    {
+        return false;
+    }
+
+    if(MappedSize - ReadOffset < RecordHeaderSize)
+    {
+        bIsTruncated = true;
+        return false;
+    }
+
+    const char* recordData = MappedData + ReadOffset;
+    outRecordHeader.Type = static_cast<ERecordType>(recordData[0]);
+    outRecordHeader.Flags = (uint8_t)recordData[1];
+    outRecordHeader.PayloadLength = ReadLittleEndian<uint32_t>(recordData + 4);
+    outRecordHeader.Time = ReadLittleEndian<uint64_t>(recordData + 8);
+
+    if(MappedSize - ReadOffset - RecordHeaderSize < outRecordHeader.PayloadLength)
+    {
+        bIsTruncated = true;
+        return false;
+    }
+
+    outPayload = recordData + RecordHeaderSize;
+    ReadOffset += RecordHeaderSize + outRecordHeader.PayloadLength;
+    return true;
+}
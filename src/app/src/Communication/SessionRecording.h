@@ -0,0 +1,168 @@
+#ifndef SESSIONRECORDING_H
+#define SESSIONRECORDING_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../PhysicsSimulation/WorkStealingJobSystem.h"
+#include "PhysicsServiceProtocol.h"
+
+/**
+* Append-only log of a session: every chunk of bytes the transport handed to the session, with the time it arrived,
+* followed by a digest of the responses the session produced for it. Replaying the inputs through a new session
+* (see SessionReplay) reproduces the session offline, and the digests tell whether the world computed the same
+* results: the worlds run with mDeterministicSimulation.
+*
+* File: FileHeader, then records (RecordHeader + payload) until the end of the file. All values are little-endian.
+* A file cut short (the service was killed) ends at the last complete record.
+*/
+namespace SessionRecording
+{
+    // File magic: "JSRC" (Jolt Service ReCording)
+    constexpr char FileMagic[4] = { 'J', 'S', 'R', 'C' };
+
+    // Bump whenever the layout of the file changes
+    constexpr uint16_t FileVersion = 1;
+
+    // magic (4) + version (2) + protocol mode (1) + protocol negotiated (1) + session id (4) + pipelined stepping (1)
+    // + job system type (1) + pin workers (1) + reserved (1) + worker count (4) + reserved (4) + start time (8)
+    constexpr size_t FileHeaderSize = 32;
+
+    // type (1) + flags (1) + reserved (2) + payload length (4) + time (8)
+    constexpr size_t RecordHeaderSize = 16;
+
+    // Output record payload: uint64 response size, uint64 response digest
+    constexpr uint32_t OutputRecordPayloadSize = 16;
+
+    enum class ERecordType : uint8_t
+    {
+        // Payload: the received bytes
+        Input = 1,
+
+        // Payload: size and digest of the responses to the previous Input
+        Output = 2
+    };
+
+    // Output record flag: the responses carry measures (e.g. Stats), a replay can't produce the same bytes
+    constexpr uint8_t OutputTimingDependentFlag = 1;
+
+    /**
+    * State of the session when the recording started. Everything after that is in the recorded inputs.
+    */
+    struct FileHeader
+    {
+        PhysicsServiceProtocol::EProtocolMode ProtocolMode = PhysicsServiceProtocol::EProtocolMode::Text;
+
+        // False if the session negotiated the protocol with its first bytes (socket), true if the transport set it (shared memory)
+        bool bIsProtocolModeNegotiated = false;
+
+        int32_t SessionId = 0;
+        bool bPipelinedStepping = false;
+        JobSystemSettings JobSettings;
+
+        // Wall clock time the recording started at (nanoseconds since the Unix epoch), to match it with the service logs
+        uint64_t StartTime = 0;
+    };
+
+    struct RecordHeader
+    {
+        ERecordType Type = ERecordType::Input;
+        uint8_t Flags = 0;
+        uint32_t PayloadLength = 0;
+
+        // Nanoseconds since the recording started
+        uint64_t Time = 0;
+    };
+
+    /**
+    * 64 bit digest of a session's responses. Not cryptographic: 8 bytes per multiply, so it keeps up with large step responses.
+    */
+    uint64_t ComputeOutputDigest(const char* output, size_t outputLength);
+}
+
+/**
+* Writes the recording of a session. Records are buffered and written in large blocks, the file is complete once closed.
+* A write error ends the recording, the session keeps running.
+*/
+class SessionRecorder
+{
+public:
+    ~SessionRecorder();
+
+    /**
+    * Creates (truncates) the recording file and writes its header. Returns false if the file can't be written.
+    */
+    bool Open(const std::string& filePath, const SessionRecording::FileHeader& fileHeader);
+
+    /**
+    * Records the bytes the session received at receiveTime.
+    */
+    void RecordInput(std::chrono::steady_clock::time_point receiveTime, const char* receivedData, size_t receivedDataLength);
+
+    /**
+    * Records the digest of the responses to the last input.
+    */
+    void RecordOutput(const char* output, size_t outputLength, bool bIsTimingDependent);
+
+    /**
+    * Writes what is buffered and closes the file.
+    */
+    void Close();
+
+    bool IsOpen() const { return FileDescriptor != -1; }
+    const std::string& GetFilePath() const { return FilePath; }
+
+private:
+    void AppendRecordHeader(const SessionRecording::RecordHeader& recordHeader);
+
+    /**
+    * Writes length bytes to the file, closing the recording on error.
+    */
+    void WriteToFile(const char* data, size_t length);
+    void FlushWriteBuffer();
+
+private:
+    // Above this many buffered bytes, the buffer is written to the file
+    static constexpr size_t WriteBufferSize = 1024 * 1024;
+
+    int FileDescriptor = -1;
+    std::string FilePath;
+    std::chrono::steady_clock::time_point StartTime;
+    std::vector<char> WriteBuffer;
+    uint64_t RecordCount = 0;
+};
+
+/**
+* Reads a recording through a read-only memory mapping: the records point into the mapping, nothing is copied.
+*/
+class SessionRecordingReader
+{
+public:
+    ~SessionRecordingReader();
+
+    /**
+    * Maps the recording and checks its header. Returns false if the file can't be mapped or isn't a recording.
+    */
+    bool Open(const std::string& filePath);
+
+    const SessionRecording::FileHeader& GetFileHeader() const { return Header; }
+
+    /**
+    * Reads the next record. outPayload points into the mapping, valid until the reader is destroyed.
+    * Returns false at the end of the recording (IsTruncated tells whether the last record was cut short).
+    */
+    bool ReadNextRecord(SessionRecording::RecordHeader& outRecordHeader, const char*& outPayload);
+
+    bool IsTruncated() const { return bIsTruncated; }
+    size_t GetFileSize() const { return MappedSize; }
+
+private:
+    const char* MappedData = nullptr;
+    size_t MappedSize = 0;
+    size_t ReadOffset = 0;
+    bool bIsTruncated = false;
+    SessionRecording::FileHeader Header;
+};
+
+#endif
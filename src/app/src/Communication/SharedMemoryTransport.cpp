@@ -0,0 +1,295 @@
+#include "SharedMemoryTransport.h"
+#include "../PhysicsSimulation/TraceProfiler.h"
+#include <Jolt/Core/Profiler.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    // Wake up regularly to check for stop requests and games that went away
+    constexpr long FutexWaitTimeoutNanoseconds = 100 * 1000 * 1000;
+
+    // Waits until the futex word no longer holds expectedValue (or the timeout / a signal wakes us up)
+    void FutexWait(std::atomic<uint32_t>& futexWord, uint32_t expectedValue)
+    {
+        timespec waitTimeout;
+        waitTimeout.tv_sec = 0;
+        waitTimeout.tv_nsec = FutexWaitTimeoutNanoseconds;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&futexWord), FUTEX_WAIT, expectedValue, &waitTimeout, nullptr, 0);
+    }
+
+    void FutexWake(std::atomic<uint32_t>& futexWord)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&futexWord), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+}
+
+SharedMemoryTransport::SharedMemoryTransport(const PhysicsServiceServerConfig& serverConfig)
+    : ServerConfig(serverConfig)
+{
+}
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+    CloseSession();
+    CloseSharedMemory();
+}
+
+bool SharedMemoryTransport::OpenSharedMemory()
+{
+    using namespace SharedMemoryLayout;
+
+    if(ServerConfig.SharedMemoryCommandRingSize == 0 || ServerConfig.SharedMemorySnapshotSize == 0)
+    {
+        printf("Shared memory command ring and snapshot sizes must not be 0\n");
+        return false;
+    }
+
+    // Round the regions up so every one of them starts on its own cache line
+    const size_t commandRingCapacity = (ServerConfig.SharedMemoryCommandRingSize + CacheLineSize - 1) / CacheLineSize * CacheLineSize;
+    const size_t responseBufferCapacity = (ServerConfig.SharedMemorySnapshotSize + CacheLineSize - 1) / CacheLineSize * CacheLineSize;
+    SharedMemorySize = sizeof(SharedMemoryHeader) + commandRingCapacity + 2 * responseBufferCapacity;
+
+    // A previous run that crashed may have left the object behind
+    shm_unlink(ServerConfig.SharedMemoryName.c_str());
+
+    SharedMemoryFileDescriptor = shm_open(ServerConfig.SharedMemoryName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if(SharedMemoryFileDescriptor == -1)
+    {
+        printf("shm_open failed with error: %s\n", strerror(errno));
+        return false;
+    }
+
+    if(ftruncate(SharedMemoryFileDescriptor, (off_t)SharedMemorySize) == -1)
+    {
+        printf("ftruncate failed with error: %s\n", strerror(errno));
+        CloseSharedMemory();
+        return false;
+    }
+
+    void* mappedMemory = mmap(nullptr, SharedMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED, SharedMemoryFileDescriptor, 0);
+    if(mappedMemory == MAP_FAILED)
+    {
+        printf("mmap failed with error: %s\n", strerror(errno));
+        CloseSharedMemory();
+        return false;
+    }
+
+    // The new object is zero filled, construct the header in place
+    SharedHeader = new (mappedMemory) SharedMemoryHeader();
+    std::memcpy(SharedHeader->Magic, SegmentMagic, sizeof(SegmentMagic));
+    SharedHeader->Version = SegmentVersion;
+    SharedHeader->HeaderSize = sizeof(SharedMemoryHeader);
+    SharedHeader->CommandRingCapacity = (uint32_t)commandRingCapacity;
+    SharedHeader->ResponseBufferCapacity = (uint32_t)responseBufferCapacity;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    printf("Awaiting a client on shared memory %s (%zu bytes)...\n", ServerConfig.SharedMemoryName.c_str(), SharedMemorySize);
+    return true;
+}
+
+void SharedMemoryTransport::RunEventLoop(const volatile std::sig_atomic_t& bStopRequested)
+{
+    TraceProfiler::SetThreadName("Shared Memory Transport");
+
+    while(!bStopRequested)
+    {
+        // Read the signal before checking for work, so a command published in between wakes the wait right away
+        const uint32_t commandSignal = SharedHeader->CommandSignal.load(std::memory_order_acquire);
+
+        HandleClientAttach();
+
+        if(Session && ReceiveCommands())
+        {
+            // If the game detaches while we wait for it, its session is replaced on the next iteration anyway
+            if(Session->GetPendingOutputSize() > 0)
+            {
+                PublishResponses(bStopRequested);
+            }
+            continue;
+        }
+
+        FutexWait(SharedHeader->CommandSignal, commandSignal);
+    }
+
+    printf("Stop requested. Shutting down the server...\n");
+}
+
+void SharedMemoryTransport::HandleClientAttach()
+{
+    const uint32_t clientGeneration = SharedHeader->ClientGeneration.load(std::memory_order_acquire);
+    if(clientGeneration == AttachedClientGeneration)
+    {
+        return;
+    }
+
+    // A (new) game attached: drop the previous game's world and its unread commands
+    CloseSession();
+
+    SharedHeader->CommandReadOffset.store(SharedHeader->CommandWriteOffset.load(std::memory_order_acquire), std::memory_order_release);
+    SharedHeader->ResponseAckSequence.store(SharedHeader->ResponseSequence.load(std::memory_order_relaxed), std::memory_order_release);
+
+    Session = std::make_unique<PhysicsServiceSession>(NextSessionId++);
+    Session->SetProtocolMode(PhysicsServiceProtocol::EProtocolMode::Binary);
+    Session->SetPipelinedStepping(ServerConfig.bPipelinedStepping);
+    Session->SetStatsDumpInterval(std::chrono::seconds(ServerConfig.StatsDumpInterval));
+    Session->SetJobSystemSettings({ ServerConfig.bWorkStealingJobSystem ? EJobSystemType::WorkStealing : EJobSystemType::ThreadPool, ServerConfig.JobWorkerCount, ServerConfig.bPinJobWorkers });
+    if(!ServerConfig.RecordDirectory.empty())
+    {
+        Session->StartRecording(ServerConfig.GetSessionRecordingPath(Session->GetSessionId()));
+    }
+    AttachedClientGeneration = clientGeneration;
+
+    SharedHeader->ServerGeneration.store(clientGeneration, std::memory_order_release);
+    FutexWake(SharedHeader->ServerGeneration);
+
+    printf("Client attached. Session %d\n", Session->GetSessionId());
+}
+
+bool SharedMemoryTransport::ReceiveCommands()
+{
+    const uint64_t commandWriteOffset = SharedHeader->CommandWriteOffset.load(std::memory_order_acquire);
+    const uint64_t commandReadOffset = SharedHeader->CommandReadOffset.load(std::memory_order_relaxed);
+    if(commandWriteOffset == commandReadOffset)
+    {
+        return false;
+    }
+
+    const uint64_t commandRingCapacity = SharedHeader->CommandRingCapacity;
+    const uint64_t availableBytes = commandWriteOffset - commandReadOffset;
+    if(availableBytes > commandRingCapacity)
+    {
+        printf("Invalid command ring offsets (%zu bytes written, ring of %zu bytes). Dropping the commands.\n",
+            (size_t)availableBytes, (size_t)commandRingCapacity);
+        SharedHeader->CommandReadOffset.store(commandWriteOffset, std::memory_order_release);
+        return false;
+    }
+
+    // The commands may wrap around the end of the ring
+    const char* commandRing = GetCommandRing();
+    const uint64_t ringStart = commandReadOffset % commandRingCapacity;
+    const uint64_t firstSpanLength = std::min(availableBytes, commandRingCapacity - ringStart);
+
+    Session->ProcessReceivedData(commandRing + ringStart, (size_t)firstSpanLength);
+    if(availableBytes > firstSpanLength)
+    {
+        Session->ProcessReceivedData(commandRing, (size_t)(availableBytes - firstSpanLength));
+    }
+
+    // Give the space back to the game
+    SharedHeader->CommandReadOffset.store(commandWriteOffset, std::memory_order_release);
+    SharedHeader->CommandSpaceSignal.fetch_add(1, std::memory_order_release);
+    FutexWake(SharedHeader->CommandSpaceSignal);
+
+    return true;
+}
+
+bool SharedMemoryTransport::PublishResponses(const volatile std::sig_atomic_t& bStopRequested)
+{
+    using namespace PhysicsServiceProtocol;
+
+    const uint32_t nextResponseSequence = SharedHeader->ResponseSequence.load(std::memory_order_relaxed) + 1;
+    const uint32_t responseBufferIndex = nextResponseSequence % 2;
+
+    // The buffer we are about to write holds the response before the current one. Wait until the game is done with it.
+    while((int32_t)(SharedHeader->ResponseAckSequence.load(std::memory_order_acquire) - (nextResponseSequence - 2)) < 0)
+    {
+        if(bStopRequested || SharedHeader->ClientGeneration.load(std::memory_order_acquire) != AttachedClientGeneration)
+        {
+            return false;
+        }
+
+        const uint32_t responseAckSequence = SharedHeader->ResponseAckSequence.load(std::memory_order_acquire);
+        if((int32_t)(responseAckSequence - (nextResponseSequence - 2)) < 0)
+        {
+            FutexWait(SharedHeader->ResponseAckSequence, responseAckSequence);
+        }
+    }
+
+    // Time spent waiting for the game above isn't ours
+    JPH_PROFILE("Send");
+    const std::chrono::steady_clock::time_point prePublishTime = std::chrono::steady_clock::now();
+
+    iovec responseSegments[2];
+    int responseSegmentCount = Session->GetPendingOutputSegments(responseSegments);
+    size_t responseSize = Session->GetPendingOutputSize();
+
+    // Too big for the buffer: tell the game instead of sending half the messages
+    std::vector<char> errorMessage;
+    if(responseSize > SharedHeader->ResponseBufferCapacity)
+    {
+        printf("Responses of %zu bytes don't fit in the %u bytes shared memory snapshot buffer. Increase --shm-snapshot-size.\n",
+            responseSize, SharedHeader->ResponseBufferCapacity);
+
+        const char errorText[] = "Response doesn't fit in the shared memory snapshot buffer";
+        BuildMessage(errorMessage, GetResponseOpcode(EOpcode::Error), 0, errorText, sizeof(errorText) - 1);
+        responseSegments[0].iov_base = errorMessage.data();
+        responseSegments[0].iov_len = errorMessage.size();
+        responseSegmentCount = 1;
+        responseSize = errorMessage.size();
+    }
+
+    SharedMemoryLayout::ResponseBufferHeader& responseBufferHeader = SharedHeader->ResponseBuffers[responseBufferIndex];
+    char* responseBuffer = GetResponseBuffer(responseBufferIndex);
+    for(int i = 0; i < responseSegmentCount; ++i)
+    {
+        std::memcpy(responseBuffer, responseSegments[i].iov_base, responseSegments[i].iov_len);
+        responseBuffer += responseSegments[i].iov_len;
+    }
+    responseBufferHeader.Size.store((uint32_t)responseSize, std::memory_order_relaxed);
+    responseBufferHeader.Sequence.store(nextResponseSequence, std::memory_order_relaxed);
+
+    // Publishing the sequence makes the buffer contents visible to the game
+    SharedHeader->ResponseSequence.store(nextResponseSequence, std::memory_order_release);
+    FutexWake(SharedHeader->ResponseSequence);
+
+    Session->ConsumePendingOutput(Session->GetPendingOutputSize());
+    Session->RecordLatency(ELatencyPhase::Send, std::chrono::steady_clock::now() - prePublishTime);
+    return true;
+}
+
+void SharedMemoryTransport::CloseSession()
+{
+    if(!Session)
+    {
+        return;
+    }
+
+    Session->CloseSession();
+    printf("Client detached. Session %d\n", Session->GetSessionId());
+    Session.reset();
+}
+
+void SharedMemoryTransport::CloseSharedMemory()
+{
+    if(SharedHeader)
+    {
+        SharedHeader->~SharedMemoryHeader();
+        munmap(SharedHeader, SharedMemorySize);
+        SharedHeader = nullptr;
+    }
+
+    if(SharedMemoryFileDescriptor != -1)
+    {
+        close(SharedMemoryFileDescriptor);
+        shm_unlink(ServerConfig.SharedMemoryName.c_str());
+        SharedMemoryFileDescriptor = -1;
+    }
+}
+
+char* SharedMemoryTransport::GetCommandRing() const
+{
+    return reinterpret_cast<char*>(SharedHeader) + SharedHeader->HeaderSize;
+}
+
+char* SharedMemoryTransport::GetResponseBuffer(uint32_t bufferIndex) const
+{
+    return GetCommandRing() + SharedHeader->CommandRingCapacity + (size_t)bufferIndex * SharedHeader->ResponseBufferCapacity;
+}
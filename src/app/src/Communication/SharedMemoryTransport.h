@@ -0,0 +1,139 @@
+#ifndef SHAREDMEMORYTRANSPORT_H
+#define SHAREDMEMORYTRANSPORT_H
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "PhysicsServiceServerConfig.h"
+#include "PhysicsServiceSession.h"
+
+/**
+* Layout of the shared memory segment. The game maps the same object (PhysicsServiceServerConfig::SharedMemoryName)
+* and must mirror this layout. The segment is created by the service:
+*
+*   [SharedMemoryHeader][command ring: CommandRingCapacity bytes][response buffer 0][response buffer 1]
+*
+* Commands: the game writes binary protocol messages (header + payload, see PhysicsServiceProtocol.h, no handshake)
+* into the command ring at CommandWriteOffset % CommandRingCapacity, wrapping around the end of the ring, then
+* publishes them by storing the new CommandWriteOffset (release) and incrementing + waking CommandSignal.
+* It may only write while CommandWriteOffset - CommandReadOffset + length <= CommandRingCapacity; when the ring is
+* full it waits on CommandSpaceSignal. Offsets only ever grow.
+*
+* Responses: after handling the commands, the service copies every response message into response buffer
+* (ResponseSequence % 2), fills its ResponseBufferHeader and then increments ResponseSequence (release) and wakes it.
+* The game reads the messages from that buffer and stores the sequence it is done with in ResponseAckSequence
+* (and wakes it). The service never overwrites a buffer the game hasn't acknowledged, so the game can read the
+* latest step result in place while the next step runs.
+*
+* Attaching: a game increments ClientGeneration (and wakes CommandSignal), then waits until ServerGeneration equals it.
+* The service closes the previous session, drops the unread commands and starts a new physics world before
+* acknowledging, so a game can restart without restarting the service.
+*
+* Signal words are 32 bit so they can be waited on with futex (FUTEX_WAIT / FUTEX_WAKE, not private).
+*/
+namespace SharedMemoryLayout
+{
+    constexpr char SegmentMagic[4] = { 'J', 'P', 'S', 'M' };
+    constexpr uint32_t SegmentVersion = 1;
+
+    // Keep the words written by different processes on different cache lines
+    constexpr size_t CacheLineSize = 64;
+
+    struct alignas(CacheLineSize) ResponseBufferHeader
+    {
+        // Response sequence this buffer holds and the size of its messages
+        std::atomic<uint32_t> Sequence;
+        std::atomic<uint32_t> Size;
+    };
+
+    struct SharedMemoryHeader
+    {
+        // Written once by the service
+        char Magic[4];
+        uint32_t Version;
+        uint32_t HeaderSize;
+        uint32_t CommandRingCapacity;
+        uint32_t ResponseBufferCapacity;
+
+        // Game -> service
+        alignas(CacheLineSize) std::atomic<uint64_t> CommandWriteOffset;
+        alignas(CacheLineSize) std::atomic<uint32_t> CommandSignal;
+        alignas(CacheLineSize) std::atomic<uint32_t> ResponseAckSequence;
+        alignas(CacheLineSize) std::atomic<uint32_t> ClientGeneration;
+
+        // Service -> game
+        alignas(CacheLineSize) std::atomic<uint64_t> CommandReadOffset;
+        alignas(CacheLineSize) std::atomic<uint32_t> CommandSpaceSignal;
+        alignas(CacheLineSize) std::atomic<uint32_t> ResponseSequence;
+        alignas(CacheLineSize) std::atomic<uint32_t> ServerGeneration;
+
+        ResponseBufferHeader ResponseBuffers[2];
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+        "Atomics shared between processes must be lock free");
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex words must be plain 32 bit integers");
+}
+
+/**
+* Transport for a game running on the same host: commands and step results go through a shared memory segment
+* instead of a socket, so a step round trip costs no system calls besides the futex wake-ups.
+* Serves one game at a time (a game that attaches replaces the previous one) with the same session semantics
+* as the socket server.
+*/
+class SharedMemoryTransport
+{
+public:
+    explicit SharedMemoryTransport(const PhysicsServiceServerConfig& serverConfig);
+    ~SharedMemoryTransport();
+
+    /**
+    * Creates and maps the shared memory segment. Returns false if it couldn't be created.
+    */
+    bool OpenSharedMemory();
+
+    /**
+    * Serves the attached game until bStopRequested is set.
+    */
+    void RunEventLoop(const volatile std::sig_atomic_t& bStopRequested);
+
+private:
+    /**
+    * Starts a new session if a game (re)attached since the last check.
+    */
+    void HandleClientAttach();
+
+    /**
+    * Feeds every command written to the ring since the last call to the session.
+    * Returns false if there was nothing to read.
+    */
+    bool ReceiveCommands();
+
+    /**
+    * Copies the session's pending output into the next response buffer and publishes it.
+    * Returns false if the game went away while we waited for it to release the buffer.
+    */
+    bool PublishResponses(const volatile std::sig_atomic_t& bStopRequested);
+
+    void CloseSession();
+    void CloseSharedMemory();
+
+    char* GetCommandRing() const;
+    char* GetResponseBuffer(uint32_t bufferIndex) const;
+
+private:
+    PhysicsServiceServerConfig ServerConfig;
+
+    int SharedMemoryFileDescriptor = -1;
+    size_t SharedMemorySize = 0;
+    SharedMemoryLayout::SharedMemoryHeader* SharedHeader = nullptr;
+
+    // Session of the attached game, if any
+    std::unique_ptr<PhysicsServiceSession> Session;
+    int NextSessionId = 1;
+    uint32_t AttachedClientGeneration = 0;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "TextFieldReader.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+TextFieldReader::TextFieldReader(std::string_view line)
+    : FieldBegin(line.data())
+    , LineEnd(line.data() + line.size())
+    , bHasMoreFields(true)
+{
+    // Windows line breaks
+    if(LineEnd > FieldBegin && LineEnd[-1] == '\r')
+    {
+        --LineEnd;
+    }
+}
+
+size_t TextFieldReader::GetRemainingFieldCount() const
+{
+    return bHasMoreFields ? 1 + std::count(FieldBegin, LineEnd, ';') : 0;
+}
+
+bool TextFieldReader::ReadField(std::string_view& outField)
+{
+    if(!bHasMoreFields)
+    {
+        return false;
+    }
+
+    outField = PeekField();
+    SkipField(outField);
+    return true;
+}
+
+bool TextFieldReader::ReadExpectedField(std::string_view expectedField)
+{
+    if(!bHasMoreFields || PeekField() != expectedField)
+    {
+        return false;
+    }
+
+    SkipField(expectedField);
+    return true;
+}
+
+bool TextFieldReader::ReadNumber(uint32_t& outValue)
+{
+    return ReadIntegerField(outValue);
+}
+
+bool TextFieldReader::ReadNumber(int32_t& outValue)
+{
+    return ReadIntegerField(outValue);
+}
+
+bool TextFieldReader::ReadNumber(float& outValue)
+{
+    if(!bHasMoreFields)
+    {
+        return false;
+    }
+
+    const std::string_view field = PeekField();
+    float value = 0.f;
+    const std::from_chars_result parseResult = std::from_chars(field.data(), field.data() + field.size(), value);
+    if(parseResult.ec != std::errc() || parseResult.ptr != field.data() + field.size() || !std::isfinite(value))
+    {
+        return false;
+    }
+
+    outValue = value;
+    SkipField(field);
+    return true;
+}
+
+std::string_view TextFieldReader::PeekField() const
+{
+    if(FieldBegin == LineEnd)
+    {
+        return std::string_view();
+    }
+
+    const char* fieldEnd = static_cast<const char*>(std::memchr(FieldBegin, ';', LineEnd - FieldBegin));
+    return std::string_view(FieldBegin, (fieldEnd ? fieldEnd : LineEnd) - FieldBegin);
+}
+
+void TextFieldReader::SkipField(std::string_view field)
+{
+    FieldBegin += field.size();
+    if(FieldBegin < LineEnd)
+    {
+        // Past the separator
+        ++FieldBegin;
+    }
+    else
+    {
+        bHasMoreFields = false;
+    }
+}
+
+template <typename T>
+bool TextFieldReader::ReadIntegerField(T& outValue)
+{
+    if(!bHasMoreFields)
+    {
+        return false;
+    }
+
+    const std::string_view field = PeekField();
+    T value = 0;
+    const std::from_chars_result parseResult = std::from_chars(field.data(), field.data() + field.size(), value);
+    if(parseResult.ec != std::errc() || parseResult.ptr != field.data() + field.size())
+    {
+        return false;
+    }
+
+    outValue = value;
+    SkipField(field);
+    return true;
+}
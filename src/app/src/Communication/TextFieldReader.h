@@ -0,0 +1,61 @@
+#ifndef TEXTFIELDREADER_H
+#define TEXTFIELDREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+* Reads the ';' separated fields of a text message line in place, without copying nor allocating:
+* "MultiStep;10;0.016" is the fields "MultiStep", "10" and "0.016". A trailing '\r' isn't part of the last field.
+* Numbers are parsed with std::from_chars and must span their whole field ("10abc", "" and "-1" aren't unsigned numbers).
+* A field that doesn't parse isn't consumed, so the caller can try another type or report it.
+*/
+class TextFieldReader
+{
+public:
+    explicit TextFieldReader(std::string_view line);
+
+    bool HasMoreFields() const { return bHasMoreFields; }
+
+    /**
+    * Fields left to read, the empty ones included ("A;;B" has 3 fields).
+    */
+    size_t GetRemainingFieldCount() const;
+
+    /**
+    * Reads the next field as text. Returns false if there's none left.
+    */
+    bool ReadField(std::string_view& outField);
+
+    /**
+    * Reads the next field if it is expectedField. Returns false (without consuming it) otherwise.
+    */
+    bool ReadExpectedField(std::string_view expectedField);
+
+    /**
+    * Read the next field as a number. Returns false (without consuming it) if there's none left or it isn't a number of the type.
+    * Floats must be finite.
+    */
+    bool ReadNumber(uint32_t& outValue);
+    bool ReadNumber(int32_t& outValue);
+    bool ReadNumber(float& outValue);
+
+private:
+    /**
+    * Next field, without consuming it
+    */
+    std::string_view PeekField() const;
+
+    void SkipField(std::string_view field);
+
+    template <typename T>
+    bool ReadIntegerField(T& outValue);
+
+private:
+    const char* FieldBegin = nullptr;
+    const char* LineEnd = nullptr;
+    bool bHasMoreFields = false;
+};
+
+#endif
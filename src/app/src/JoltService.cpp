@@ -2,25 +2,38 @@
 
 int main(int argc, char** argv) 
 {
+    // Transport and its options, from the command line / environment
+    const PhysicsServiceServerConfig ServerConfig = PhysicsServiceServerConfig::FromCommandLine(argc, argv);
+
+    // Jolt's allocator, factory and types are shared by every session
+    PhysicsServiceImpl::InitializeJoltRuntime();
+
+    // Cooked shapes, so they aren't rebuilt on every Init. The service still runs without them.
+    if(!ServerConfig.ShapeCacheFile.empty())
+    {
+        PhysicsServiceImpl::GetShapeCache().LoadNamedShapes(ServerConfig.ShapeCacheFile);
+    }
+
     // Open socket acting as a server socket
     // The proxy will await for the game's connection on him
-    PhysicsServiceSocketServer* PhysicsServiceServer = new PhysicsServiceSocketServer();
+    PhysicsServiceSocketServer* PhysicsServiceServer = new PhysicsServiceSocketServer(ServerConfig);
     if(!PhysicsServiceServer)
     {
         printf("Error when creating socket server.\n");
         return 0;
     }
     
-    // Open server socket to listen for client's (game) connection
-    const bool bWasSocketConnectionSuccess = PhysicsServiceServer->OpenServerSocket();
+    // Open the server transport and serve clients (game instances) until the process is asked to stop
+    const bool bWasSocketConnectionSuccess = PhysicsServiceServer->RunServer();
 
     // Check for errors
     if(!bWasSocketConnectionSuccess)
     {
-        printf("Could not open socket connection. Check logs.\n");
-        return 0;
+        printf("Could not open server connection. Check logs.\n");
     }
 
+    delete PhysicsServiceServer;
+    PhysicsServiceImpl::ShutdownJoltRuntime();
 
     return 0;
 }
@@ -0,0 +1,348 @@
+#include "ActorInitializationParser.h"
+
+// STL includes
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// Only the first malformed lines are printed, a broken client could send thousands of them
+	constexpr size_t MaxReportedMalformedLines = 20;
+
+	bool IsLine(const char* lineBegin, const char* lineEnd, const char* expectedLine)
+	{
+		const size_t expectedLineLength = std::strlen(expectedLine);
+		return (size_t)(lineEnd - lineBegin) == expectedLineLength && std::memcmp(lineBegin, expectedLine, expectedLineLength) == 0;
+	}
+
+	// Parses the number starting at fieldBegin (after optional spaces and '+', like std::stod did) and moves fieldBegin past it
+	template<typename T>
+	bool ParseField(const char*& fieldBegin, const char* lineEnd, T& outValue)
+	{
+		while(fieldBegin < lineEnd && *fieldBegin == ' ')
+		{
+			++fieldBegin;
+		}
+		if(fieldBegin < lineEnd && *fieldBegin == '+')
+		{
+			++fieldBegin;
+		}
+
+		const std::from_chars_result parseResult = std::from_chars(fieldBegin, lineEnd, outValue);
+		if(parseResult.ec != std::errc())
+		{
+			return false;
+		}
+
+		fieldBegin = parseResult.ptr;
+		while(fieldBegin < lineEnd && *fieldBegin == ' ')
+		{
+			++fieldBegin;
+		}
+		return true;
+	}
+
+	// Moves fieldBegin past the separator that ends the current field. Returns false if the field isn't followed by one.
+	bool SkipSeparator(const char*& fieldBegin, const char* lineEnd, char separator = ';')
+	{
+		if(fieldBegin >= lineEnd || *fieldBegin != separator)
+		{
+			return false;
+		}
+
+		++fieldBegin;
+		return true;
+	}
+
+	// Parses "value:value:..." (exactly valueCount positive floats, the whole range)
+	bool ParsePositiveValues(const char* valuesBegin, const char* valuesEnd, float* outValues, int valueCount)
+	{
+		for(int i = 0; i < valueCount; ++i)
+		{
+			if(!ParseField(valuesBegin, valuesEnd, outValues[i]) || !(outValues[i] > 0.f))
+			{
+				return false;
+			}
+			if(i + 1 < valueCount && !SkipSeparator(valuesBegin, valuesEnd, ':'))
+			{
+				return false;
+			}
+		}
+		return valuesBegin == valuesEnd;
+	}
+
+	// "shape=<prefix>..." -> true and valuesBegin after the prefix
+	bool StartsWith(const char*& valuesBegin, const char* valuesEnd, const char* prefix)
+	{
+		const size_t prefixLength = std::strlen(prefix);
+		if((size_t)(valuesEnd - valuesBegin) < prefixLength || std::memcmp(valuesBegin, prefix, prefixLength) != 0)
+		{
+			return false;
+		}
+
+		valuesBegin += prefixLength;
+		return true;
+	}
+}
+
+void ActorInitializationParser::Reset()
+{
+	Actors.clear();
+	LineNumber = 0;
+	MalformedLineCount = 0;
+	bIsComplete = false;
+}
+
+size_t ActorInitializationParser::ParseLines(const char* chunk, size_t chunkLength)
+{
+	const char* chunkEnd = chunk + chunkLength;
+	const char* lineBegin = chunk;
+
+	while(!bIsComplete)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(lineBegin, '\n', chunkEnd - lineBegin));
+		if(!lineEnd)
+		{
+			break;
+		}
+
+		ParseLine(lineBegin, lineEnd);
+		lineBegin = lineEnd + 1;
+	}
+
+	// The message may end with "EndMessage" without a line break
+	if(!bIsComplete)
+	{
+		const char* partialLineEnd = (chunkEnd > lineBegin && chunkEnd[-1] == '\r') ? chunkEnd - 1 : chunkEnd;
+		if(IsLine(lineBegin, partialLineEnd, "EndMessage"))
+		{
+			ParseLine(lineBegin, chunkEnd);
+			lineBegin = chunkEnd;
+		}
+	}
+
+	return lineBegin - chunk;
+}
+
+void ActorInitializationParser::ParseLine(const char* lineBegin, const char* lineEnd)
+{
+	++LineNumber;
+
+	// Windows line breaks
+	if(lineEnd > lineBegin && lineEnd[-1] == '\r')
+	{
+		--lineEnd;
+	}
+
+	if(lineBegin == lineEnd || IsLine(lineBegin, lineEnd, "Init"))
+	{
+		return;
+	}
+
+	if(IsLine(lineBegin, lineEnd, "EndMessage"))
+	{
+		bIsComplete = true;
+
+		if(MalformedLineCount > MaxReportedMalformedLines)
+		{
+			printf("Init: %zu malformed lines in total, %zu actors parsed\n", MalformedLineCount, Actors.size());
+		}
+		return;
+	}
+
+	ActorInitializationInfo actorInfo;
+	const char* malformedReason = ParseActorLine(lineBegin, lineEnd, actorInfo);
+	if(malformedReason)
+	{
+		ReportMalformedLine(lineBegin, lineEnd, malformedReason);
+		return;
+	}
+
+	Actors.push_back(actorInfo);
+}
+
+const char* ActorInitializationParser::ParseActorLine(const char* lineBegin, const char* lineEnd, ActorInitializationInfo& outActorInfo)
+{
+	const char* field = lineBegin;
+
+	if(!ParseField(field, lineEnd, outActorInfo.ActorId))
+	{
+		return "invalid actor id";
+	}
+	if(!SkipSeparator(field, lineEnd))
+	{
+		return "expected 4 fields (id;x;y;z)";
+	}
+
+	double* positionFields[3] = { &outActorInfo.InitialPosX, &outActorInfo.InitialPosY, &outActorInfo.InitialPosZ };
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		if(!ParseField(field, lineEnd, *positionFields[axis]))
+		{
+			return axis == 0 ? "invalid x position" : (axis == 1 ? "invalid y position" : "invalid z position");
+		}
+
+		// The last position may be followed by optional fields
+		if(axis < 2 ? !SkipSeparator(field, lineEnd) : (field != lineEnd && *field != ';'))
+		{
+			return axis < 2 ? "expected 4 fields (id;x;y;z)" : "unexpected characters after the z position";
+		}
+	}
+
+	while(SkipSeparator(field, lineEnd))
+	{
+		const char* fieldEnd = static_cast<const char*>(std::memchr(field, ';', lineEnd - field));
+		if(!fieldEnd)
+		{
+			fieldEnd = lineEnd;
+		}
+
+		const char* malformedReason = ParseActorField(field, fieldEnd, outActorInfo);
+		if(malformedReason)
+		{
+			return malformedReason;
+		}
+		field = fieldEnd;
+	}
+
+	// from_chars also reads "inf" and "nan"
+	return ValidateActor(outActorInfo);
+}
+
+const char* ActorInitializationParser::ValidateActor(const ActorInitializationInfo& actorInfo)
+{
+	if(!std::isfinite(actorInfo.InitialPosX) || !std::isfinite(actorInfo.InitialPosY) || !std::isfinite(actorInfo.InitialPosZ))
+	{
+		return "invalid position";
+	}
+
+	int shapeParameterCount = 0;
+	switch(actorInfo.ShapeType)
+	{
+		case EActorShapeType::Sphere:
+			shapeParameterCount = 1;
+			break;
+		case EActorShapeType::Box:
+			shapeParameterCount = 3;
+			break;
+		case EActorShapeType::Capsule:
+			shapeParameterCount = 2;
+			break;
+		case EActorShapeType::Cached:
+			break;
+	}
+	for(int i = 0; i < shapeParameterCount; ++i)
+	{
+		if(!std::isfinite(actorInfo.ShapeParameters[i]) || !(actorInfo.ShapeParameters[i] > 0.f))
+		{
+			return "invalid shape dimensions";
+		}
+	}
+
+	const float bodyValues[3] = { actorInfo.Friction, actorInfo.Restitution, actorInfo.Mass };
+	for(float bodyValue : bodyValues)
+	{
+		if(!std::isfinite(bodyValue) || !(bodyValue >= 0.f))
+		{
+			return "invalid friction, restitution or mass";
+		}
+	}
+
+	return nullptr;
+}
+
+const char* ActorInitializationParser::ParseActorField(const char* fieldBegin, const char* fieldEnd, ActorInitializationInfo& ioActorInfo)
+{
+	const char* valueBegin = static_cast<const char*>(std::memchr(fieldBegin, '=', fieldEnd - fieldBegin));
+	if(!valueBegin)
+	{
+		return nullptr;
+	}
+
+	const char* keyEnd = valueBegin++;
+	if(IsLine(fieldBegin, keyEnd, "shape"))
+	{
+		if(StartsWith(valueBegin, fieldEnd, "sphere:"))
+		{
+			ioActorInfo.ShapeType = EActorShapeType::Sphere;
+			return ParsePositiveValues(valueBegin, fieldEnd, ioActorInfo.ShapeParameters, 1) ? nullptr : "expected shape=sphere:radius";
+		}
+		if(StartsWith(valueBegin, fieldEnd, "box:"))
+		{
+			ioActorInfo.ShapeType = EActorShapeType::Box;
+			return ParsePositiveValues(valueBegin, fieldEnd, ioActorInfo.ShapeParameters, 3) ? nullptr : "expected shape=box:hx:hy:hz";
+		}
+		if(StartsWith(valueBegin, fieldEnd, "capsule:"))
+		{
+			ioActorInfo.ShapeType = EActorShapeType::Capsule;
+			return ParsePositiveValues(valueBegin, fieldEnd, ioActorInfo.ShapeParameters, 2) ? nullptr : "expected shape=capsule:halfHeight:radius";
+		}
+		if(StartsWith(valueBegin, fieldEnd, "cached:") && valueBegin < fieldEnd)
+		{
+			ioActorInfo.ShapeType = EActorShapeType::Cached;
+			ioActorInfo.ShapeName.assign(valueBegin, fieldEnd);
+			return nullptr;
+		}
+		return "unknown shape";
+	}
+
+	if(IsLine(fieldBegin, keyEnd, "motion"))
+	{
+		if(IsLine(valueBegin, fieldEnd, "dynamic"))
+		{
+			ioActorInfo.MotionType = EActorMotionType::Dynamic;
+			return nullptr;
+		}
+		if(IsLine(valueBegin, fieldEnd, "kinematic"))
+		{
+			ioActorInfo.MotionType = EActorMotionType::Kinematic;
+			return nullptr;
+		}
+		if(IsLine(valueBegin, fieldEnd, "static"))
+		{
+			ioActorInfo.MotionType = EActorMotionType::Static;
+			return nullptr;
+		}
+		return "unknown motion type";
+	}
+
+	float* valueField = nullptr;
+	if(IsLine(fieldBegin, keyEnd, "friction"))
+	{
+		valueField = &ioActorInfo.Friction;
+	}
+	else if(IsLine(fieldBegin, keyEnd, "restitution"))
+	{
+		valueField = &ioActorInfo.Restitution;
+	}
+	else if(IsLine(fieldBegin, keyEnd, "mass"))
+	{
+		valueField = &ioActorInfo.Mass;
+	}
+	else
+	{
+		return "unknown field";
+	}
+
+	if(!ParseField(valueBegin, fieldEnd, *valueField) || valueBegin != fieldEnd || !(*valueField >= 0.f))
+	{
+		return "invalid friction, restitution or mass";
+	}
+	return nullptr;
+}
+
+void ActorInitializationParser::ReportMalformedLine(const char* lineBegin, const char* lineEnd, const char* reason)
+{
+	++MalformedLineCount;
+	if(MalformedLineCount > MaxReportedMalformedLines)
+	{
+		return;
+	}
+
+	// Don't flood the log with a huge line
+	const int printedLineLength = (int)std::min<size_t>(lineEnd - lineBegin, 80);
+	printf("Init line %zu is malformed (%s), skipping it: \"%.*s\"\n", LineNumber, reason, printedLineLength, lineBegin);
+}
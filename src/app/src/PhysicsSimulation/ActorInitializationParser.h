@@ -0,0 +1,107 @@
+#ifndef ACTORINITIALIZATIONPARSER_H
+#define ACTORINITIALIZATIONPARSER_H
+
+// STL includes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Collision shape of an actor
+enum class EActorShapeType : uint8_t
+{
+	// ShapeParameters[0] = radius
+	Sphere = 0,
+
+	// ShapeParameters = half extent (x, y, z)
+	Box = 1,
+
+	// ShapeParameters[0] = half height of the cylinder part, ShapeParameters[1] = radius
+	Capsule = 2,
+
+	// Convex hull / triangle mesh registered under ShapeName by a DefineShape message of the session, or in the cooked shape file.
+	// Bodies with a triangle mesh are always static.
+	Cached = 3
+};
+
+enum class EActorMotionType : uint8_t
+{
+	Dynamic = 0,
+	Kinematic = 1,
+	Static = 2
+};
+
+// Initial state of an actor, as sent by the game on Init. The defaults are the legacy actor: a dynamic radius 50 sphere with restitution 1.
+struct ActorInitializationInfo
+{
+	int ActorId = 0;
+	double InitialPosX = 0.0;
+	double InitialPosY = 0.0;
+	double InitialPosZ = 0.0;
+
+	EActorShapeType ShapeType = EActorShapeType::Sphere;
+	float ShapeParameters[3] = { 50.f, 0.f, 0.f };
+	std::string ShapeName;
+
+	EActorMotionType MotionType = EActorMotionType::Dynamic;
+	float Friction = 0.2f;
+	float Restitution = 1.f;
+
+	// 0 = computed from the shape's volume (density 1000)
+	float Mass = 0.f;
+};
+
+// Single pass parser of the text Init message: an "Init" line, one "id;x;y;z" line per actor and a final "EndMessage" line.
+// An actor line can describe its body with optional "key=value" fields after z:
+//   shape=sphere:radius | shape=box:hx:hy:hz | shape=capsule:halfHeight:radius | shape=cached:name
+//   motion=dynamic|kinematic|static, friction=f, restitution=f, mass=f
+// e.g. "7;0;0;500;shape=box:50:50:25;friction=0.5;mass=20". Fields without '=' are ignored, as before.
+// The message can be fed as it arrives: ParseLines consumes the complete lines of a chunk and leaves the trailing partial
+// line to the caller, who passes it again followed by the next bytes. Numbers are parsed in place with std::from_chars,
+// so no memory is allocated per actor besides the growth of the actor list.
+// Malformed lines are skipped and reported with their line number (the "Init" line is line 1).
+class ActorInitializationParser
+{
+public:
+	// Forgets the actors and errors of the previous message
+	void Reset();
+
+	// Parses every complete line of the chunk. Returns the amount of bytes consumed: the partial line after the
+	// last '\n' isn't consumed, unless it is the final "EndMessage" (which may come without a line break).
+	// Nothing is consumed once the message is complete.
+	size_t ParseLines(const char* chunk, size_t chunkLength);
+
+	// True once the "EndMessage" line was parsed
+	bool IsComplete() const { return bIsComplete; }
+
+	const std::vector<ActorInitializationInfo>& GetActors() const { return Actors; }
+
+	size_t GetMalformedLineCount() const { return MalformedLineCount; }
+
+	// Parses "id;x;y;z" followed by the optional fields (an actor line without its line break, also the actor of a Spawn message).
+	// Returns the reason if the line is malformed, nullptr otherwise.
+	static const char* ParseActorLine(const char* lineBegin, const char* lineEnd, ActorInitializationInfo& outActorInfo);
+
+	// Checks the values of an actor, however it was received (text line or binary record): a finite position, finite and
+	// positive dimensions for its shape, a finite and non negative friction, restitution and mass.
+	// Returns the reason if the actor is invalid, nullptr otherwise.
+	static const char* ValidateActor(const ActorInitializationInfo& actorInfo);
+
+private:
+	// Parses a single line (without its line break)
+	void ParseLine(const char* lineBegin, const char* lineEnd);
+
+	// Parses a single "key=value" field. Returns the reason if the field is malformed, nullptr otherwise.
+	static const char* ParseActorField(const char* fieldBegin, const char* fieldEnd, ActorInitializationInfo& ioActorInfo);
+
+	void ReportMalformedLine(const char* lineBegin, const char* lineEnd, const char* reason);
+
+private:
+	std::vector<ActorInitializationInfo> Actors;
+
+	size_t LineNumber = 0;
+	size_t MalformedLineCount = 0;
+	bool bIsComplete = false;
+};
+
+#endif
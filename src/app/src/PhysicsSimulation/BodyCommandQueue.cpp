@@ -0,0 +1,250 @@
+#include "BodyCommandQueue.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	bool IsFinite(const float (&inValues)[3])
+	{
+		return std::isfinite(inValues[0]) && std::isfinite(inValues[1]) && std::isfinite(inValues[2]);
+	}
+}
+
+bool BodyVelocityCommand::IsValid() const
+{
+	return IsFinite(LinearVelocity) && IsFinite(AngularVelocity);
+}
+
+bool BodyImpulseCommand::IsValid() const
+{
+	return IsFinite(Impulse) && IsFinite(AngularImpulse);
+}
+
+void BodyCommandQueue::Reset(uint32 inMaxBodyCount)
+{
+	ActorIdStates.assign(inMaxBodyCount, EActorIdState::Free);
+	FreeActorIds.clear();
+	NextActorId = 0;
+
+	Spawns.clear();
+	Despawns.clear();
+	Velocities.clear();
+	Impulses.clear();
+}
+
+void BodyCommandQueue::MarkActorId(const BodyID& inBodyID)
+{
+	if(inBodyID.GetIndex() < ActorIdStates.size())
+	{
+		ActorIdStates[inBodyID.GetIndex()] = EActorIdState::Actor;
+	}
+}
+
+void BodyCommandQueue::MarkNonActorId(const BodyID& inBodyID)
+{
+	if(inBodyID.GetIndex() < ActorIdStates.size())
+	{
+		ActorIdStates[inBodyID.GetIndex()] = EActorIdState::NonActor;
+	}
+}
+
+bool BodyCommandQueue::QueueSpawns(std::vector<ActorInitializationInfo>& ioActors)
+{
+	if(Spawns.size() + ioActors.size() > cMaxQueuedCommands)
+	{
+		return false;
+	}
+
+	// Reserve the ids one by one (so the batch can't use an id twice), giving them back if an actor is rejected
+	size_t reservedActorCount = 0;
+	bool bIsEveryActorValid = true;
+	std::vector<bool> bIsAutoActorId(ioActors.size(), false);
+	for(; reservedActorCount < ioActors.size(); ++reservedActorCount)
+	{
+		ActorInitializationInfo& actorInfo = ioActors[reservedActorCount];
+		if(!std::isfinite(actorInfo.InitialPosX) || !std::isfinite(actorInfo.InitialPosY) || !std::isfinite(actorInfo.InitialPosZ))
+		{
+			bIsEveryActorValid = false;
+			break;
+		}
+
+		if(actorInfo.ActorId == cAutoActorId)
+		{
+			actorInfo.ActorId = TakeFreeActorId();
+			bIsAutoActorId[reservedActorCount] = true;
+		}
+		if(actorInfo.ActorId < 0 || (size_t)actorInfo.ActorId >= ActorIdStates.size() || ActorIdStates[actorInfo.ActorId] != EActorIdState::Free)
+		{
+			bIsEveryActorValid = false;
+			break;
+		}
+
+		ActorIdStates[actorInfo.ActorId] = EActorIdState::Spawning;
+	}
+
+	if(!bIsEveryActorValid)
+	{
+		for(size_t i = 0; i < reservedActorCount; ++i)
+		{
+			ActorInitializationInfo& actorInfo = ioActors[i];
+			ActorIdStates[actorInfo.ActorId] = EActorIdState::Free;
+			if(bIsAutoActorId[i])
+			{
+				FreeActorIds.push_back((uint32)actorInfo.ActorId);
+				actorInfo.ActorId = cAutoActorId;
+			}
+		}
+		return false;
+	}
+
+	Spawns.insert(Spawns.end(), ioActors.begin(), ioActors.end());
+	return true;
+}
+
+bool BodyCommandQueue::QueueDespawns(const std::vector<uint32>& inActorIds)
+{
+	if(Despawns.size() + inActorIds.size() > cMaxQueuedCommands)
+	{
+		return false;
+	}
+
+	size_t reservedActorCount = 0;
+	for(; reservedActorCount < inActorIds.size(); ++reservedActorCount)
+	{
+		const uint32 actorId = inActorIds[reservedActorCount];
+		if(actorId >= ActorIdStates.size() || ActorIdStates[actorId] != EActorIdState::Actor)
+		{
+			break;
+		}
+		ActorIdStates[actorId] = EActorIdState::Despawning;
+	}
+
+	if(reservedActorCount < inActorIds.size())
+	{
+		for(size_t i = 0; i < reservedActorCount; ++i)
+		{
+			ActorIdStates[inActorIds[i]] = EActorIdState::Actor;
+		}
+		return false;
+	}
+
+	for(uint32 actorId : inActorIds)
+	{
+		Despawns.push_back(BodyID(actorId));
+	}
+
+	// Despawns are applied first, these commands would target bodies that are gone
+	DropOrphanedCommands();
+	return true;
+}
+
+bool BodyCommandQueue::QueueVelocities(const std::vector<BodyVelocityCommand>& inVelocityCommands)
+{
+	if(Velocities.size() + inVelocityCommands.size() > cMaxQueuedCommands)
+	{
+		return false;
+	}
+
+	for(const BodyVelocityCommand& velocityCommand : inVelocityCommands)
+	{
+		if(!velocityCommand.IsValid() || !IsActorId(velocityCommand.ActorId))
+		{
+			return false;
+		}
+	}
+
+	Velocities.insert(Velocities.end(), inVelocityCommands.begin(), inVelocityCommands.end());
+	return true;
+}
+
+bool BodyCommandQueue::QueueImpulses(const std::vector<BodyImpulseCommand>& inImpulseCommands)
+{
+	if(Impulses.size() + inImpulseCommands.size() > cMaxQueuedCommands)
+	{
+		return false;
+	}
+
+	for(const BodyImpulseCommand& impulseCommand : inImpulseCommands)
+	{
+		if(!impulseCommand.IsValid() || !IsActorId(impulseCommand.ActorId))
+		{
+			return false;
+		}
+	}
+
+	Impulses.insert(Impulses.end(), inImpulseCommands.begin(), inImpulseCommands.end());
+	return true;
+}
+
+void BodyCommandQueue::ReleaseFailedSpawn(int inActorId)
+{
+	if(inActorId >= 0 && (size_t)inActorId < ActorIdStates.size() && ActorIdStates[inActorId] == EActorIdState::Spawning)
+	{
+		ActorIdStates[inActorId] = EActorIdState::Free;
+		FreeActorIds.push_back((uint32)inActorId);
+	}
+}
+
+void BodyCommandQueue::DropOrphanedCommands()
+{
+	Velocities.erase(
+		std::remove_if(Velocities.begin(), Velocities.end(), [this](const BodyVelocityCommand& velocityCommand) { return !IsActorId(velocityCommand.ActorId); }),
+		Velocities.end());
+	Impulses.erase(
+		std::remove_if(Impulses.begin(), Impulses.end(), [this](const BodyImpulseCommand& impulseCommand) { return !IsActorId(impulseCommand.ActorId); }),
+		Impulses.end());
+}
+
+void BodyCommandQueue::EndBatch()
+{
+	for(const ActorInitializationInfo& actorInfo : Spawns)
+	{
+		if(ActorIdStates[actorInfo.ActorId] == EActorIdState::Spawning)
+		{
+			ActorIdStates[actorInfo.ActorId] = EActorIdState::Actor;
+		}
+	}
+
+	// The ids are only recycled now: a response never mixes up a despawned actor with a new one
+	for(const BodyID& bodyId : Despawns)
+	{
+		ActorIdStates[bodyId.GetIndex()] = EActorIdState::Free;
+		FreeActorIds.push_back(bodyId.GetIndex());
+	}
+
+	Spawns.clear();
+	Despawns.clear();
+	Velocities.clear();
+	Impulses.clear();
+}
+
+bool BodyCommandQueue::IsActorId(uint32 inActorId) const
+{
+	return inActorId < ActorIdStates.size() && (ActorIdStates[inActorId] == EActorIdState::Actor || ActorIdStates[inActorId] == EActorIdState::Spawning);
+}
+
+int BodyCommandQueue::TakeFreeActorId()
+{
+	while(!FreeActorIds.empty())
+	{
+		const uint32 actorId = FreeActorIds.back();
+		FreeActorIds.pop_back();
+		if(ActorIdStates[actorId] == EActorIdState::Free)
+		{
+			return (int)actorId;
+		}
+	}
+
+	while(NextActorId < ActorIdStates.size())
+	{
+		const uint32 actorId = NextActorId++;
+		if(ActorIdStates[actorId] == EActorIdState::Free)
+		{
+			return (int)actorId;
+		}
+	}
+
+	return cAutoActorId;
+}
@@ -0,0 +1,121 @@
+#ifndef BODYCOMMANDQUEUE_H
+#define BODYCOMMANDQUEUE_H
+
+// The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
+// You can use Jolt.h in your precompiled header to speed up compilation.
+#include <Jolt/Jolt.h>
+
+// Jolt includes
+#include <Jolt/Physics/Body/BodyID.h>
+
+#include "ActorInitializationParser.h"
+
+// STL includes
+#include <vector>
+
+// All Jolt symbols are in the JPH namespace
+using namespace JPH;
+
+// New velocity of an actor, e.g. a jump pad launching it
+struct BodyVelocityCommand
+{
+	uint32 ActorId = 0;
+	float LinearVelocity[3] = { 0.f, 0.f, 0.f };
+	float AngularVelocity[3] = { 0.f, 0.f, 0.f };
+
+	bool IsValid() const;
+};
+
+// Impulse applied to the center of mass of an actor, e.g. an explosion or a bullet hit
+struct BodyImpulseCommand
+{
+	uint32 ActorId = 0;
+	float Impulse[3] = { 0.f, 0.f, 0.f };
+	float AngularImpulse[3] = { 0.f, 0.f, 0.f };
+
+	bool IsValid() const;
+};
+
+// Changes the game makes to the world between two steps: validated when they are queued, applied in one batch at the
+// next step boundary (see PhysicsServiceImpl::ApplyBodyCommands), kind by kind: despawns, spawns, velocities, then impulses.
+// The queue also hands out the actor ids. An id is free, taken, or reserved by a queued spawn / despawn until the batch
+// was applied, so a batch never spawns two bodies with the same id nor gives the id of a body it despawns to another.
+// The ids of despawned actors are recycled by the spawns of the following batches.
+class BodyCommandQueue
+{
+public:
+	// Spawns with this id get a free one
+	static constexpr int cAutoActorId = -1;
+
+	// Commands of each kind per batch
+	static constexpr size_t cMaxQueuedCommands = 65536;
+
+	// Drops the queued commands and frees every id below inMaxBodyCount (the body capacity of the physics system)
+	void Reset(uint32 inMaxBodyCount);
+
+	// Marks the id of a body that was created without the queue: an actor (e.g. of the Init) or a body that isn't one (the floor),
+	// which can't be despawned nor moved by commands
+	void MarkActorId(const BodyID& inBodyID);
+	void MarkNonActorId(const BodyID& inBodyID);
+
+	// Queues the spawns of every actor of ioActors, or of none of them. The actors with cAutoActorId get a free id.
+	// Returns false if an id is out of range or taken, or the batch is full.
+	bool QueueSpawns(std::vector<ActorInitializationInfo>& ioActors);
+
+	// Queues the despawns of every actor of inActorIds, or of none of them. Returns false if an id isn't an actor
+	// (or is already despawned by this batch) or the batch is full. The velocities and impulses queued for them are dropped.
+	bool QueueDespawns(const std::vector<uint32>& inActorIds);
+
+	// Queue every command or none of them. Returns false if a command is invalid, targets an id that isn't an actor
+	// (spawns of the same batch count) or the batch is full.
+	bool QueueVelocities(const std::vector<BodyVelocityCommand>& inVelocityCommands);
+	bool QueueImpulses(const std::vector<BodyImpulseCommand>& inImpulseCommands);
+
+	bool IsEmpty() const { return Spawns.empty() && Despawns.empty() && Velocities.empty() && Impulses.empty(); }
+
+	const std::vector<ActorInitializationInfo>& GetSpawns() const { return Spawns; }
+	const std::vector<BodyID>& GetDespawns() const { return Despawns; }
+	const std::vector<BodyVelocityCommand>& GetVelocities() const { return Velocities; }
+	const std::vector<BodyImpulseCommand>& GetImpulses() const { return Impulses; }
+
+	// Frees the id of a queued spawn whose body couldn't be created. Call DropOrphanedCommands once the failed spawns were released.
+	void ReleaseFailedSpawn(int inActorId);
+
+	// Drops the queued velocities and impulses whose id isn't an actor anymore (despawned, or its spawn failed)
+	void DropOrphanedCommands();
+
+	// Clears the applied batch: the spawned ids are taken, the despawned ones free
+	void EndBatch();
+
+private:
+	enum class EActorIdState : uint8
+	{
+		Free,
+		Actor,
+		NonActor,
+		Spawning,
+		Despawning
+	};
+
+	bool IsActorId(uint32 inActorId) const;
+
+	// A free id: recycled if there is one, the lowest one never used otherwise. cAutoActorId if every id is taken.
+	int TakeFreeActorId();
+
+private:
+	// Indexed by actor id (BodyID::GetIndex())
+	std::vector<EActorIdState> ActorIdStates;
+
+	// Ids of despawned actors, some may have been taken again by an explicit spawn since (checked when they're taken)
+	std::vector<uint32> FreeActorIds;
+
+	// The ids from here on were never handed out by TakeFreeActorId
+	uint32 NextActorId = 0;
+
+	std::vector<ActorInitializationInfo> Spawns;
+	std::vector<BodyID> Despawns;
+	std::vector<BodyVelocityCommand> Velocities;
+	std::vector<BodyImpulseCommand> Impulses;
+};
+
+#endif
@@ -2,10 +2,27 @@
 
 void MyBodyActivationListener::OnBodyActivated(const BodyID &inBodyID, uint64 inBodyUserData)
 {
-	cout << "A body got activated" << endl;
+	std::lock_guard<std::mutex> lock(ActivationEventsMutex);
+	PendingActivationEvents.push_back({ inBodyID, EBodyActivationEventType::Wake });
 }
 
 void MyBodyActivationListener::OnBodyDeactivated(const BodyID &inBodyID, uint64 inBodyUserData)
 {
-	cout << "A body went to sleep" << endl;
+	std::lock_guard<std::mutex> lock(ActivationEventsMutex);
+	PendingActivationEvents.push_back({ inBodyID, EBodyActivationEventType::Sleep });
+}
+
+void MyBodyActivationListener::ConsumeActivationEvents(std::vector<BodyActivationEvent>& outActivationEvents)
+{
+	outActivationEvents.clear();
+
+	// Swap so both vectors keep their capacity between steps
+	std::lock_guard<std::mutex> lock(ActivationEventsMutex);
+	outActivationEvents.swap(PendingActivationEvents);
+}
+
+void MyBodyActivationListener::ClearActivationEvents()
+{
+	std::lock_guard<std::mutex> lock(ActivationEventsMutex);
+	PendingActivationEvents.clear();
 }
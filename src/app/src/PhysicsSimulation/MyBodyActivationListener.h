@@ -11,6 +11,8 @@
 
 // STL includes
 #include <iostream>
+#include <mutex>
+#include <vector>
 
 // All Jolt symbols are in the JPH namespace
 using namespace JPH;
@@ -21,13 +23,42 @@ using namespace JPH::literals;
 // We're also using STL classes in this example
 using namespace std;
 
-// An example activation listener
+enum class EBodyActivationEventType : uint8
+{
+	Wake = 0,
+	Sleep = 1,
+
+	// Not recorded by the listener: added to the step response while the game subscribed to interest regions
+	// (see PhysicsServiceImpl::SetInterestRegions)
+	EnterInterestRegion = 2,
+	LeaveInterestRegion = 3
+};
+
+// A body that woke up or went to sleep during a physics update
+struct BodyActivationEvent
+{
+	BodyID Body;
+	EBodyActivationEventType Type;
+};
+
+// Activation listener that records sleep / wake events so they can be forwarded to the game with the step response
 class MyBodyActivationListener : public BodyActivationListener
 {
 public:
+	// Called from the physics jobs, so these need to be thread safe
 	virtual void OnBodyActivated(const BodyID &inBodyID, uint64 inBodyUserData) override;
 
 	virtual void OnBodyDeactivated(const BodyID &inBodyID, uint64 inBodyUserData) override;
+
+	// Moves the events recorded since the last call to outActivationEvents (which is cleared first)
+	void ConsumeActivationEvents(std::vector<BodyActivationEvent>& outActivationEvents);
+
+	// Drops every recorded event (e.g. the wake events triggered by adding the bodies on Init)
+	void ClearActivationEvents();
+
+private:
+	std::mutex ActivationEventsMutex;
+	std::vector<BodyActivationEvent> PendingActivationEvents;
 };
 
 #endif
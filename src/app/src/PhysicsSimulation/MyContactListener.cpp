@@ -1,5 +1,36 @@
 #include "MyContactListener.h"
 
+// STL includes
+#include <algorithm>
+#include <tuple>
+
+std::atomic<uint64> MyContactListener::NextThreadEventsGeneration { 1 };
+
+namespace
+{
+	// Buffer the current thread claimed, valid while Generation matches the listener's
+	struct ThreadContactEventsClaim
+	{
+		uint64 Generation = 0;
+		uint32 BufferIndex = 0;
+	};
+
+	thread_local ThreadContactEventsClaim tContactEventsClaim;
+
+	float GetBodyInverseMass(const Body &inBody)
+	{
+		// Static and kinematic bodies don't give way, as if their mass was infinite
+		return inBody.IsDynamic() ? inBody.GetMotionProperties()->GetInverseMass() : 0.f;
+	}
+
+	// Order of the events in a response: by body pair, then sub shapes and type
+	bool IsContactEventOrderedBefore(const ContactEvent& a, const ContactEvent& b)
+	{
+		return std::make_tuple(a.Body1.GetIndexAndSequenceNumber(), a.Body2.GetIndexAndSequenceNumber(), a.SubShape1.GetValue(), a.SubShape2.GetValue(), a.Type)
+			< std::make_tuple(b.Body1.GetIndexAndSequenceNumber(), b.Body2.GetIndexAndSequenceNumber(), b.SubShape1.GetValue(), b.SubShape2.GetValue(), b.Type);
+	}
+}
+
 ValidateResult MyContactListener::OnContactValidate(const Body &inBody1, const Body &inBody2, RVec3Arg inBaseOffset, const CollideShapeResult &inCollisionResult)
 {
 	//cout << "Contact validate callback" << endl;
@@ -10,15 +41,199 @@ ValidateResult MyContactListener::OnContactValidate(const Body &inBody1, const B
 
 void MyContactListener::OnContactAdded(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold, ContactSettings &ioSettings)
 {
-	//cout << "A contact was added" << endl;
+	AddManifoldEvent(EContactEventType::Added, inBody1, inBody2, inManifold);
 }
 
 void MyContactListener::OnContactPersisted(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold, ContactSettings &ioSettings)
 {
-	//cout << "A contact was persisted" << endl;
+	AddManifoldEvent(EContactEventType::Persisted, inBody1, inBody2, inManifold);
 }
 
 void MyContactListener::OnContactRemoved(const SubShapeIDPair &inSubShapePair)
-{ 
-	//cout << "A contact was removed" << endl;
+{
+	if(!(Settings.EventTypes & GetContactEventTypeBit(EContactEventType::Removed)) || !IsReportedBodyPair(inSubShapePair.GetBody1ID(), inSubShapePair.GetBody2ID()))
+	{
+		return;
+	}
+
+	ContactEvent contactEvent;
+	contactEvent.Type = EContactEventType::Removed;
+	contactEvent.Body1 = inSubShapePair.GetBody1ID();
+	contactEvent.Body2 = inSubShapePair.GetBody2ID();
+	contactEvent.SubShape1 = inSubShapePair.GetSubShapeID1();
+	contactEvent.SubShape2 = inSubShapePair.GetSubShapeID2();
+	if(contactEvent.Body2.GetIndex() < contactEvent.Body1.GetIndex())
+	{
+		std::swap(contactEvent.Body1, contactEvent.Body2);
+		std::swap(contactEvent.SubShape1, contactEvent.SubShape2);
+	}
+
+	AddContactEvent(contactEvent);
+}
+
+void MyContactListener::AddManifoldEvent(EContactEventType inType, const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold)
+{
+	if(!(Settings.EventTypes & GetContactEventTypeBit(inType)) || !IsReportedBodyPair(inBody1.GetID(), inBody2.GetID()))
+	{
+		return;
+	}
+
+	// Average of the contact points on body 1
+	Vec3 relativeContactPosition = Vec3::sZero();
+	for(const Vec3& relativeContactPoint : inManifold.mRelativeContactPointsOn1)
+	{
+		relativeContactPosition += relativeContactPoint;
+	}
+	if(!inManifold.mRelativeContactPointsOn1.empty())
+	{
+		relativeContactPosition /= float(inManifold.mRelativeContactPointsOn1.size());
+	}
+	const RVec3 contactPosition = inManifold.mBaseOffset + relativeContactPosition;
+
+	// The normal points from body 1 to body 2, so the bodies approach each other when their relative velocity points against it
+	const Vec3 relativeVelocity = inBody2.GetPointVelocity(contactPosition) - inBody1.GetPointVelocity(contactPosition);
+	const float approachSpeed = std::max(-relativeVelocity.Dot(inManifold.mWorldSpaceNormal), 0.f);
+	const float inverseMassSum = GetBodyInverseMass(inBody1) + GetBodyInverseMass(inBody2);
+	const float impactImpulse = inverseMassSum > 0.f ? approachSpeed / inverseMassSum : 0.f;
+	if(impactImpulse < Settings.MinImpactImpulse)
+	{
+		return;
+	}
+
+	ContactEvent contactEvent;
+	contactEvent.Type = inType;
+	contactEvent.Body1 = inBody1.GetID();
+	contactEvent.Body2 = inBody2.GetID();
+	contactEvent.SubShape1 = inManifold.mSubShapeID1;
+	contactEvent.SubShape2 = inManifold.mSubShapeID2;
+	contactEvent.ImpactImpulse = impactImpulse;
+	contactEvent.Position = contactPosition;
+	contactEvent.Normal = inManifold.mWorldSpaceNormal;
+	if(contactEvent.Body2.GetIndex() < contactEvent.Body1.GetIndex())
+	{
+		std::swap(contactEvent.Body1, contactEvent.Body2);
+		std::swap(contactEvent.SubShape1, contactEvent.SubShape2);
+		contactEvent.Normal = -contactEvent.Normal;
+	}
+
+	AddContactEvent(contactEvent);
+}
+
+bool MyContactListener::IsReportedBodyPair(const BodyID& inBodyID1, const BodyID& inBodyID2) const
+{
+	if(ReportedBodies.empty())
+	{
+		return true;
+	}
+
+	const uint32 bodyIndex1 = inBodyID1.GetIndex();
+	const uint32 bodyIndex2 = inBodyID2.GetIndex();
+	return (bodyIndex1 < ReportedBodies.size() && ReportedBodies[bodyIndex1]) || (bodyIndex2 < ReportedBodies.size() && ReportedBodies[bodyIndex2]);
+}
+
+MyContactListener::ThreadContactEvents* MyContactListener::GetThreadContactEvents()
+{
+	// One atomic increment per thread and step, after that the thread only touches its own buffer
+	if(tContactEventsClaim.Generation != ThreadEventsGeneration)
+	{
+		tContactEventsClaim.Generation = ThreadEventsGeneration;
+		tContactEventsClaim.BufferIndex = ClaimedThreadEventsCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return tContactEventsClaim.BufferIndex < ThreadEvents.size() ? &ThreadEvents[tContactEventsClaim.BufferIndex] : nullptr;
+}
+
+void MyContactListener::AddContactEvent(const ContactEvent& inContactEvent)
+{
+	ThreadContactEvents* threadContactEvents = GetThreadContactEvents();
+	if(!threadContactEvents)
+	{
+		UnbufferedEventCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	if(threadContactEvents->Events.size() == threadContactEvents->Events.capacity())
+	{
+		++threadContactEvents->DroppedEventCount;
+		return;
+	}
+
+	threadContactEvents->Events.push_back(inContactEvent);
+}
+
+void MyContactListener::Configure(const ContactEventSettings& inSettings, uint inMaxThreadCount)
+{
+	Settings = inSettings;
+
+	ReportedBodies.clear();
+	for(uint32 bodyIndex : Settings.BodyFilter)
+	{
+		if(bodyIndex >= ReportedBodies.size())
+		{
+			ReportedBodies.resize(bodyIndex + 1, 0);
+		}
+		ReportedBodies[bodyIndex] = 1;
+	}
+
+	// A thread alone may record every event of a step
+	ThreadEvents.resize(inMaxThreadCount);
+	for(ThreadContactEvents& threadContactEvents : ThreadEvents)
+	{
+		threadContactEvents.Events.clear();
+		threadContactEvents.Events.shrink_to_fit();
+		if(Settings.bIsEnabled)
+		{
+			threadContactEvents.Events.reserve(Settings.MaxEventsPerStep);
+		}
+	}
+
+	ResetThreadContactEvents();
+}
+
+void MyContactListener::ConsumeContactEvents(std::vector<ContactEvent>& outContactEvents, uint32& outDroppedEventCount)
+{
+	outContactEvents.clear();
+	outDroppedEventCount = UnbufferedEventCount.load(std::memory_order_relaxed);
+
+	const size_t claimedThreadEventsCount = std::min<size_t>(ClaimedThreadEventsCount.load(std::memory_order_relaxed), ThreadEvents.size());
+	for(size_t i = 0; i < claimedThreadEventsCount; ++i)
+	{
+		outContactEvents.insert(outContactEvents.end(), ThreadEvents[i].Events.begin(), ThreadEvents[i].Events.end());
+		outDroppedEventCount += ThreadEvents[i].DroppedEventCount;
+	}
+	ResetThreadContactEvents();
+
+	// Keep the strongest impacts (removed contacts last), breaking ties by the response order so the choice is deterministic
+	if(outContactEvents.size() > Settings.MaxEventsPerStep)
+	{
+		std::nth_element(outContactEvents.begin(), outContactEvents.begin() + Settings.MaxEventsPerStep, outContactEvents.end(), [](const ContactEvent& a, const ContactEvent& b)
+		{
+			if(a.ImpactImpulse != b.ImpactImpulse)
+			{
+				return a.ImpactImpulse > b.ImpactImpulse;
+			}
+			return IsContactEventOrderedBefore(a, b);
+		});
+		outDroppedEventCount += uint32(outContactEvents.size() - Settings.MaxEventsPerStep);
+		outContactEvents.resize(Settings.MaxEventsPerStep);
+	}
+
+	std::sort(outContactEvents.begin(), outContactEvents.end(), IsContactEventOrderedBefore);
+}
+
+void MyContactListener::ClearContactEvents()
+{
+	ResetThreadContactEvents();
+}
+
+void MyContactListener::ResetThreadContactEvents()
+{
+	for(ThreadContactEvents& threadContactEvents : ThreadEvents)
+	{
+		threadContactEvents.Events.clear();
+		threadContactEvents.DroppedEventCount = 0;
+	}
+	ClaimedThreadEventsCount.store(0, std::memory_order_relaxed);
+	UnbufferedEventCount.store(0, std::memory_order_relaxed);
+	ThreadEventsGeneration = NextThreadEventsGeneration.fetch_add(1, std::memory_order_relaxed);
 }
@@ -1,5 +1,5 @@
-#ifndef MYCONTACTLISTENER_H 
-#define MYCONTACTLISTENER_H 
+#ifndef MYCONTACTLISTENER_H
+#define MYCONTACTLISTENER_H
 
 // The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
 // You can use Jolt.h in your precompiled header to speed up compilation.
@@ -9,7 +9,9 @@
 #include <Jolt/Physics/PhysicsSystem.h>
 
 // STL includes
+#include <atomic>
 #include <iostream>
+#include <vector>
 
 // All Jolt symbols are in the JPH namespace
 using namespace JPH;
@@ -20,7 +22,71 @@ using namespace JPH::literals;
 // We're also using STL classes in this example
 using namespace std;
 
-// An example contact listener
+enum class EContactEventType : uint8
+{
+	Added = 0,
+	Persisted = 1,
+	Removed = 2
+};
+
+// Bit of a contact event type in ContactEventSettings::EventTypes
+constexpr uint8 GetContactEventTypeBit(EContactEventType inType) { return uint8(1u << uint(inType)); }
+
+// Two bodies that started touching, kept touching or separated during a physics update
+struct ContactEvent
+{
+	// Body1 has the lower index
+	BodyID Body1;
+	BodyID Body2;
+
+	// Sub shapes of the contact, only used to order the events of a body pair
+	SubShapeID SubShape1;
+	SubShapeID SubShape2;
+
+	EContactEventType Type = EContactEventType::Added;
+
+	// Estimated impulse of the impact: approach speed along the normal times the reduced mass of the bodies, measured
+	// before the solver ran (restitution not included). 0 for removed contacts.
+	float ImpactImpulse = 0.f;
+
+	// Average contact point and normal (pointing from Body1 to Body2). Zero for removed contacts.
+	RVec3 Position = RVec3::sZero();
+	Vec3 Normal = Vec3::sZero();
+};
+
+// Which contacts are reported with the step responses
+struct ContactEventSettings
+{
+	// Off by default: without it the contact listener isn't registered at all
+	bool bIsEnabled = false;
+
+	// EContactEventType bits (see GetContactEventTypeBit)
+	uint8 EventTypes = GetContactEventTypeBit(EContactEventType::Added) | GetContactEventTypeBit(EContactEventType::Removed);
+
+	// Added / persisted contacts with a lower ImpactImpulse are dropped (removed contacts have no impulse and always pass)
+	float MinImpactImpulse = 0.f;
+
+	// Events per step response, the strongest impacts are kept when there are more
+	uint32 MaxEventsPerStep = 1024;
+
+	// Only contacts involving one of these bodies (BodyID indices) are reported. Empty = every body.
+	std::vector<uint32> BodyFilter;
+
+	static constexpr uint32 cMaxEventsPerStep = 65536;
+
+	// Every EContactEventType bit
+	static constexpr uint8 cAllEventTypes = GetContactEventTypeBit(EContactEventType::Added) | GetContactEventTypeBit(EContactEventType::Persisted)
+		| GetContactEventTypeBit(EContactEventType::Removed);
+
+	bool IsValid() const
+	{
+		return MaxEventsPerStep >= 1 && MaxEventsPerStep <= cMaxEventsPerStep && MinImpactImpulse >= 0.f && (EventTypes & ~cAllEventTypes) == 0;
+	}
+};
+
+// Contact listener that records contact events so they can be forwarded to the game with the step response.
+// The callbacks run on the physics jobs while the solver waits for them, so they never lock or allocate: every thread
+// appends to its own preallocated buffer, and the buffers are merged by ConsumeContactEvents once the update finished.
 class MyContactListener : public ContactListener
 {
 public:
@@ -32,6 +98,58 @@ public:
 	virtual void OnContactPersisted(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold, ContactSettings &ioSettings) override;
 
 	virtual void OnContactRemoved(const SubShapeIDPair &inSubShapePair) override;
+
+	// Applies inSettings and makes room for inMaxThreadCount threads calling the callbacks between two ConsumeContactEvents.
+	// Drops the recorded events. Only call while the physics system isn't updating.
+	void Configure(const ContactEventSettings& inSettings, uint inMaxThreadCount);
+
+	const ContactEventSettings& GetSettings() const { return Settings; }
+
+	// Moves the events recorded since the last call to outContactEvents (which is cleared first): at most
+	// MaxEventsPerStep, sorted by body pair so the response doesn't depend on job scheduling.
+	// outDroppedEventCount receives the number of events that didn't fit.
+	void ConsumeContactEvents(std::vector<ContactEvent>& outContactEvents, uint32& outDroppedEventCount);
+
+	// Drops every recorded event (e.g. the ones of rewound steps)
+	void ClearContactEvents();
+
+private:
+	// Events of one thread. Aligned so two threads never write to the same cache line.
+	struct alignas(JPH_CACHE_LINE_SIZE) ThreadContactEvents
+	{
+		// Capacity reserved by Configure, never grows in the callbacks
+		std::vector<ContactEvent> Events;
+		uint32 DroppedEventCount = 0;
+	};
+
+	// Buffer of the calling thread, claimed by its first event since the last consume. nullptr if every buffer was claimed.
+	ThreadContactEvents* GetThreadContactEvents();
+
+	void AddContactEvent(const ContactEvent& inContactEvent);
+	void AddManifoldEvent(EContactEventType inType, const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold);
+
+	// True if the contacts of the pair pass the body filter
+	bool IsReportedBodyPair(const BodyID& inBodyID1, const BodyID& inBodyID2) const;
+
+	// Empties the buffers and makes the threads claim one again
+	void ResetThreadContactEvents();
+
+private:
+	ContactEventSettings Settings;
+
+	// Indexed by BodyID::GetIndex(), 1 = in the body filter. Empty = every body.
+	std::vector<uint8> ReportedBodies;
+
+	std::vector<ThreadContactEvents> ThreadEvents;
+	std::atomic<uint32> ClaimedThreadEventsCount { 0 };
+
+	// Events of threads that found no free buffer
+	std::atomic<uint32> UnbufferedEventCount { 0 };
+
+	// Changes whenever the buffers are reset: a thread claims a buffer again when it doesn't match the generation it claimed one in.
+	// Unique across listeners, so a thread serving several worlds can't mistake one listener's claim for another's.
+	uint64 ThreadEventsGeneration = 0;
+	static std::atomic<uint64> NextThreadEventsGeneration;
 };
 
 #endif
@@ -1,15 +1,41 @@
 #include "PhysicsServiceImpl.h"
+#include "../Communication/PhysicsServiceProtocol.h"
 
-void PhysicsServiceImpl::InitPhysicsSystem(const std::string initializationActorsInfo)
+#include <Jolt/Core/Profiler.h>
+#include <Jolt/Physics/Collision/BroadPhase/BroadPhaseQuery.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+ShapeCache* PhysicsServiceImpl::SharedShapeCache = nullptr;
+
+namespace
 {
-    std::cout << "Initializing physics system...\n";
-    //std::cout << initializationActorsInfo << "\n";
+	// Broadphase query collector appending the hits to a vector that is reused between queries
+	class BodyIdVectorCollector final : public CollideShapeBodyCollector
+	{
+	public:
+		explicit BodyIdVectorCollector(std::vector<BodyID>& outBodyIds) : BodyIds(outBodyIds) {}
 
-	if(bIsInitialized)
+		virtual void AddHit(const BodyID& inBodyID) override { BodyIds.push_back(inBodyID); }
+
+	private:
+		std::vector<BodyID>& BodyIds;
+	};
+
+	bool IsBodyIndexLess(const BodyID& a, const BodyID& b)
 	{
-		ClearPhysicsSystem();
+		return a.GetIndex() < b.GetIndex();
 	}
+}
 
+void PhysicsServiceImpl::InitializeJoltRuntime()
+{
 	// Register allocation hook
 	RegisterDefaultAllocator();
 
@@ -23,17 +49,311 @@ void PhysicsServiceImpl::InitPhysicsSystem(const std::string initializationActor
 	// Register all Jolt physics types
 	RegisterTypes();
 
+	SharedShapeCache = new ShapeCache();
+}
+
+void PhysicsServiceImpl::ShutdownJoltRuntime()
+{
+	// Release the cached shapes before the default material and the factory they depend on
+	delete SharedShapeCache;
+	SharedShapeCache = nullptr;
+
+	// Unregisters all types with the factory and cleans up the default material
+	UnregisterTypes();
+
+	// Destroy the factory
+	delete Factory::sInstance;
+	Factory::sInstance = nullptr;
+}
+
+PhysicsServiceImpl::~PhysicsServiceImpl()
+{
+	if(bIsInitialized)
+	{
+		ClearPhysicsSystem();
+	}
+
+	delete job_system;
+	delete temp_allocator;
+	delete body_activation_listener;
+	delete contact_listener;
+}
+
+void PhysicsServiceImpl::InitPhysicsSystem(const std::string& initializationActorsInfo)
+{
+	ActorInitializationParser initializationParser;
+	initializationParser.ParseLines(initializationActorsInfo.data(), initializationActorsInfo.size());
+
+	if(!initializationParser.IsComplete())
+	{
+		std::cout << "Error on parsing initialization actor info: missing EndMessage\n";
+	}
+
+	InitPhysicsSystem(initializationParser.GetActors());
+}
+
+bool PhysicsServiceImpl::InitPhysicsSystemFromBinary(const char* initializationPayload, uint32 initializationPayloadLength)
+{
+	using namespace PhysicsServiceProtocol;
+
+	// Check for errors: we need at least the actor count
+	if(initializationPayloadLength < sizeof(uint32_t))
+	{
+		std::cout << "Error on parsing binary initialization: payload too small\n";
+		return false;
+	}
+
+	const uint32_t actorCount = ReadLittleEndian<uint32_t>(initializationPayload);
+	const uint64_t expectedPayloadLength = sizeof(uint32_t) + (uint64_t)actorCount * InitActorRecordSize;
+	if(initializationPayloadLength != expectedPayloadLength)
+	{
+		std::cout << "Error on parsing binary initialization: expected " << expectedPayloadLength << " bytes for " << actorCount << " actors, got " << initializationPayloadLength << "\n";
+		return false;
+	}
+
+	std::vector<ActorInitializationInfo> initializationActors(actorCount);
+
+	const char* actorRecord = initializationPayload + sizeof(uint32_t);
+	for(uint32_t i = 0; i < actorCount; ++i, actorRecord += InitActorRecordSize)
+	{
+		ActorInitializationInfo& actorInfo = initializationActors[i];
+		actorInfo.ActorId = ReadLittleEndian<int32_t>(actorRecord);
+		actorInfo.InitialPosX = ReadLittleEndian<float>(actorRecord + 4);
+		actorInfo.InitialPosY = ReadLittleEndian<float>(actorRecord + 8);
+		actorInfo.InitialPosZ = ReadLittleEndian<float>(actorRecord + 12);
+
+		if(const char* invalidReason = ActorInitializationParser::ValidateActor(actorInfo))
+		{
+			std::cout << "Error on parsing binary initialization: " << invalidReason << " of actor " << actorInfo.ActorId << "\n";
+			return false;
+		}
+	}
+
+	InitPhysicsSystem(initializationActors);
+	return true;
+}
+
+bool PhysicsServiceImpl::InitPhysicsSystemFromDescribedBinary(const char* initializationPayload, uint32 initializationPayloadLength)
+{
+	std::vector<ActorInitializationInfo> initializationActors;
+	if(!ParseDescribedActorsFromBinary(initializationPayload, initializationPayloadLength, initializationActors))
+	{
+		return false;
+	}
+
+	InitPhysicsSystem(initializationActors);
+	return true;
+}
+
+bool PhysicsServiceImpl::ParseDescribedActorsFromBinary(const char* actorsPayload, uint32 actorsPayloadLength, std::vector<ActorInitializationInfo>& outActors)
+{
+	using namespace PhysicsServiceProtocol;
+
+	const char* const payloadEnd = actorsPayload + actorsPayloadLength;
+	const char* payloadField = actorsPayload;
+
+	// Shape name table, referenced by the actors with a cached shape
+	if(payloadEnd - payloadField < (ptrdiff_t)sizeof(uint16_t))
+	{
+		std::cout << "Error on parsing described binary actors: payload too small\n";
+		return false;
+	}
+	std::vector<std::string> shapeNames(ReadLittleEndian<uint16_t>(payloadField));
+	payloadField += sizeof(uint16_t);
+
+	for(std::string& shapeName : shapeNames)
+	{
+		if(payloadEnd - payloadField < (ptrdiff_t)sizeof(uint16_t) || (size_t)(payloadEnd - payloadField) - sizeof(uint16_t) < (size_t)ReadLittleEndian<uint16_t>(payloadField))
+		{
+			std::cout << "Error on parsing described binary actors: truncated shape name table\n";
+			return false;
+		}
+		const uint16_t shapeNameLength = ReadLittleEndian<uint16_t>(payloadField);
+		shapeName.assign(payloadField + sizeof(uint16_t), shapeNameLength);
+		payloadField += sizeof(uint16_t) + shapeNameLength;
+	}
+
+	if(payloadEnd - payloadField < (ptrdiff_t)sizeof(uint32_t))
+	{
+		std::cout << "Error on parsing described binary actors: missing actor count\n";
+		return false;
+	}
+	const uint32_t actorCount = ReadLittleEndian<uint32_t>(payloadField);
+	payloadField += sizeof(uint32_t);
+
+	const uint64_t expectedRecordsLength = (uint64_t)actorCount * InitDescribedActorRecordSize;
+	if((uint64_t)(payloadEnd - payloadField) != expectedRecordsLength)
+	{
+		std::cout << "Error on parsing described binary actors: expected " << expectedRecordsLength << " bytes for " << actorCount << " actors, got " << (payloadEnd - payloadField) << "\n";
+		return false;
+	}
+
+	outActors.clear();
+	outActors.resize(actorCount);
+
+	const char* actorRecord = payloadField;
+	for(uint32_t i = 0; i < actorCount; ++i, actorRecord += InitDescribedActorRecordSize)
+	{
+		ActorInitializationInfo& actorInfo = outActors[i];
+		actorInfo.ActorId = ReadLittleEndian<int32_t>(actorRecord);
+		actorInfo.InitialPosX = ReadLittleEndian<float>(actorRecord + 4);
+		actorInfo.InitialPosY = ReadLittleEndian<float>(actorRecord + 8);
+		actorInfo.InitialPosZ = ReadLittleEndian<float>(actorRecord + 12);
+
+		const uint8_t shapeType = (uint8_t)actorRecord[16];
+		const uint8_t motionType = (uint8_t)actorRecord[17];
+		const uint16_t shapeNameIndex = ReadLittleEndian<uint16_t>(actorRecord + 18);
+		if(shapeType > (uint8_t)EActorShapeType::Cached || motionType > (uint8_t)EActorMotionType::Static
+			|| (shapeType == (uint8_t)EActorShapeType::Cached && (size_t)shapeNameIndex >= shapeNames.size()))
+		{
+			std::cout << "Error on parsing described binary actors: invalid shape or motion type of actor " << actorInfo.ActorId << "\n";
+			return false;
+		}
+
+		actorInfo.ShapeType = static_cast<EActorShapeType>(shapeType);
+		actorInfo.MotionType = static_cast<EActorMotionType>(motionType);
+		if(actorInfo.ShapeType == EActorShapeType::Cached)
+		{
+			actorInfo.ShapeName = shapeNames[shapeNameIndex];
+		}
+		for(int parameter = 0; parameter < 3; ++parameter)
+		{
+			actorInfo.ShapeParameters[parameter] = ReadLittleEndian<float>(actorRecord + 20 + parameter * sizeof(float));
+		}
+		actorInfo.Friction = ReadLittleEndian<float>(actorRecord + 32);
+		actorInfo.Restitution = ReadLittleEndian<float>(actorRecord + 36);
+		actorInfo.Mass = ReadLittleEndian<float>(actorRecord + 40);
+
+		// Same checks as the text actors
+		if(const char* invalidReason = ActorInitializationParser::ValidateActor(actorInfo))
+		{
+			std::cout << "Error on parsing described binary actors: " << invalidReason << " of actor " << actorInfo.ActorId << "\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool PhysicsServiceImpl::DefineShapeFromBinary(const char* shapePayload, uint32 shapePayloadLength, uint32& outShapeMemorySize)
+{
+	using namespace PhysicsServiceProtocol;
+
+	// Name length (2) + definition type (1) + index bytes (1) + vertex count (4) + triangle count (4), after the name
+	constexpr size_t shapeHeaderSize = sizeof(uint16_t) + 2 + 2 * sizeof(uint32_t);
+	if(shapePayloadLength < shapeHeaderSize || shapePayloadLength < shapeHeaderSize + ReadLittleEndian<uint16_t>(shapePayload))
+	{
+		std::cout << "Error on parsing shape definition: payload too small\n";
+		return false;
+	}
+
+	const uint16_t shapeNameLength = ReadLittleEndian<uint16_t>(shapePayload);
+	const std::string shapeName(shapePayload + sizeof(uint16_t), shapeNameLength);
+	const char* shapeHeader = shapePayload + sizeof(uint16_t) + shapeNameLength;
+
+	const uint8_t definitionType = (uint8_t)shapeHeader[0];
+	const uint8_t indexBytes = (uint8_t)shapeHeader[1];
+	const uint32_t vertexCount = ReadLittleEndian<uint32_t>(shapeHeader + 2);
+	const uint32_t triangleCount = ReadLittleEndian<uint32_t>(shapeHeader + 6);
+	const bool bIsTriangleMesh = definitionType == (uint8_t)EShapeDefinitionType::TriangleMesh;
+
+	const uint64_t expectedPayloadLength = shapeHeaderSize + shapeNameLength + (uint64_t)vertexCount * 3 * sizeof(float) + (uint64_t)triangleCount * 3 * indexBytes;
+	if(shapeName.empty() || definitionType > (uint8_t)EShapeDefinitionType::TriangleMesh || (bIsTriangleMesh ? (indexBytes != 2 && indexBytes != 4) : triangleCount != 0)
+		|| shapePayloadLength != expectedPayloadLength)
+	{
+		std::cout << "Error on parsing shape definition \"" << shapeName << "\": invalid header or expected " << expectedPayloadLength << " bytes, got " << shapePayloadLength << "\n";
+		return false;
+	}
+
+	const char* vertexRecord = shapeHeader + 10;
+	VertexList shapeVertices(vertexCount);
+	for(Float3& shapeVertex : shapeVertices)
+	{
+		shapeVertex = Float3(ReadLittleEndian<float>(vertexRecord), ReadLittleEndian<float>(vertexRecord + 4), ReadLittleEndian<float>(vertexRecord + 8));
+		vertexRecord += 3 * sizeof(float);
+	}
+
+	ShapeSettings::ShapeResult shapeResult;
+	if(bIsTriangleMesh)
+	{
+		const char* indexRecord = vertexRecord;
+		IndexedTriangleList shapeTriangles(triangleCount);
+		for(IndexedTriangle& shapeTriangle : shapeTriangles)
+		{
+			for(int corner = 0; corner < 3; ++corner, indexRecord += indexBytes)
+			{
+				shapeTriangle.mIdx[corner] = indexBytes == 2 ? ReadLittleEndian<uint16_t>(indexRecord) : ReadLittleEndian<uint32_t>(indexRecord);
+				if(shapeTriangle.mIdx[corner] >= vertexCount)
+				{
+					std::cout << "Error on parsing shape definition \"" << shapeName << "\": vertex index out of range\n";
+					return false;
+				}
+			}
+		}
+
+		// Builds the bounding volume hierarchy of the mesh, once
+		shapeResult = MeshShapeSettings(shapeVertices, shapeTriangles).Create();
+	}
+	else
+	{
+		Array<Vec3> hullPoints(vertexCount);
+		for(uint32_t i = 0; i < vertexCount; ++i)
+		{
+			hullPoints[i] = Vec3(shapeVertices[i]);
+		}
+		shapeResult = ConvexHullShapeSettings(hullPoints).Create();
+	}
+
+	if(shapeResult.HasError())
+	{
+		std::cout << "Error on building shape \"" << shapeName << "\": " << shapeResult.GetError() << "\n";
+		return false;
+	}
+
+	Shape::VisitedShapes visitedShapes;
+	outShapeMemorySize = (uint32)shapeResult.Get()->GetStatsRecursive(visitedShapes).mSizeBytes;
+
+	{
+		std::lock_guard<std::mutex> definedShapesLock(DefinedShapesMutex);
+		DefinedShapes[shapeName] = shapeResult.Get();
+	}
+	std::cout << "Defined shape \"" << shapeName << "\": " << vertexCount << " vertices, " << triangleCount << " triangles, " << outShapeMemorySize << " bytes\n";
+	return true;
+}
+
+void PhysicsServiceImpl::InitPhysicsSystem(const std::vector<ActorInitializationInfo>& initializationActors)
+{
+    std::cout << "Initializing physics system...\n";
+
+	const auto initStartTime = std::chrono::steady_clock::now();
+
+	if(bIsInitialized)
+	{
+		ClearPhysicsSystem();
+	}
+
 	// We need a temp allocator for temporary allocations during the physics update. We're
 	// pre-allocating 10 MB to avoid having to do allocations during the physics update. 
 	// B.t.w. 10 MB is way too much for this example but it is a typical value you can use.
 	// If you don't want to pre-allocate you can also use TempAllocatorMalloc to fall back to
 	// malloc / free.
-	temp_allocator = new TempAllocatorImpl(10 * 1024 * 1024);
+	// The allocator and the job system outlive re-Inits.
+	if(!temp_allocator)
+	{
+		temp_allocator = new TempAllocatorImpl(10 * 1024 * 1024);
+	}
 
-	// We need a job system that will execute physics jobs on multiple threads. Typically
-	// you would implement the JobSystem interface yourself and let Jolt Physics run on top
-	// of your own job scheduler. JobSystemThreadPool is an example implementation.
-	job_system = new JobSystemThreadPool(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
+	// We need a job system that will execute physics jobs on multiple threads (see SetJobSystemSettings)
+	if(bIsJobSystemOutdated)
+	{
+		delete job_system;
+		job_system = nullptr;
+		bIsJobSystemOutdated = false;
+	}
+	if(!job_system)
+	{
+		job_system = CreateJobSystem();
+	}
 
 	// This is the max amount of rigid bodies that you can add to the physics system. If you try to add more you'll get an error.
 	// Note: This value is low because this is a simple test. For a real project use something in the order of 65536.
@@ -84,27 +404,30 @@ void PhysicsServiceImpl::InitPhysicsSystem(const std::string initializationActor
 	// A body activation listener gets notified when bodies activate and go to sleep
 	// Note that this is called from a job so whatever you do here needs to be thread safe.
 	// Registering one is entirely optional.
-	//MyBodyActivationListener body_activation_listener;
+	// The listener records sleep / wake events so they can be sent with the step response. It outlives re-Inits.
+	if(!body_activation_listener)
+	{
+		body_activation_listener = new MyBodyActivationListener();
+	}
 	physics_system->SetBodyActivationListener(body_activation_listener);
 
 	// A contact listener gets notified when bodies (are about to) collide, and when they separate again.
 	// Note that this is called from a job so whatever you do here needs to be thread safe.
 	// Registering one is entirely optional.
-	//contact_listener = new MyContactListener();
-	physics_system->SetContactListener(contact_listener);
+	// The listener records the contact events of the step responses (only registered while they are enabled). It outlives re-Inits.
+	if(!contact_listener)
+	{
+		contact_listener = new MyContactListener();
+	}
+	ConfigureContactListener();
 
 	// The main way to interact with the bodies in the physics system is through the body interface. There is a locking and a non-locking
 	// variant of this. We're going to use the locking version (even though we're not planning to access bodies from multiple threads)
 	body_interface = &physics_system->GetBodyInterface();
 
 	// Next we can create a rigid body to serve as the floor, we make a large box
-	// Create the settings for the collision volume (the shape). 
-	// Note that for simple shapes (like boxes) you can also directly construct a BoxShape.
-	BoxShapeSettings floor_shape_settings(Vec3(1000.0f, 1000.f, 100.0f));
-
-	// Create the shape
-	ShapeSettings::ShapeResult floor_shape_result = floor_shape_settings.Create();
-	ShapeRefC floor_shape = floor_shape_result.Get(); // We don't expect an error here, but you can check floor_shape_result for HasError() / GetError()
+	// The shape is shared with the floor of every other session (and every re-Init)
+	ShapeRefC floor_shape = GetShapeCache().GetBox(Vec3(1000.0f, 1000.f, 100.0f)); // We don't expect an error here, the cache logs it otherwise
 
 	// Create the settings for the body itself. Note that here you can also set other properties like the restitution / friction.
 	BodyCreationSettings floor_settings(floor_shape, RVec3(0.0_r, 0.0_r, 0.0_r), Quat::sIdentity(), EMotionType::Static, Layers::NON_MOVING);
@@ -119,138 +442,1390 @@ void PhysicsServiceImpl::InitPhysicsSystem(const std::string initializationActor
 	// Add it to the world
 	body_interface->AddBody(floor->GetID(), EActivation::DontActivate);
 
-	// Split actors info from initialization into lines
-	std::stringstream initializationStringStream(initializationActorsInfo);
-    std::vector<std::string> initializationActorsInfoLines;
+	// Create one sphere body per actor (with the actor's ID) and add them to the world in batches
+	AddActorBodies(initializationActors);
+
+	// Before starting the physics simulation we optimize the broad phase, once, now that every body was inserted.
+	// You should definitely not call this every frame or when e.g. streaming in a new level section as it is an expensive operation.
+	physics_system->OptimizeBroadPhase();
+
+	// Track which bodies are actors (the floor isn't sent to the game) and forget what was sent before.
+	// The body commands queued for the previous world are dropped, the ids of this one are handed out from now on.
+	LastSentBodyTransforms.clear();
+	BodyCommands.Reset(physics_system->GetMaxBodies());
+	BodyCommands.MarkNonActorId(floor_id);
+	for(const BodyID& bodyId : BodyIdList)
+	{
+		if(bodyId.GetIndex() >= LastSentBodyTransforms.size())
+		{
+			LastSentBodyTransforms.resize(bodyId.GetIndex() + 1);
+		}
+		LastSentBodyTransforms[bodyId.GetIndex()].bIsActor = true;
+		BodyCommands.MarkActorId(bodyId);
+	}
+	SpawnedActorBodyIds.clear();
+	bNeedsFullStepResponse = true;
+
+	// The interest regions are kept, the game is told about the bodies inside them like the bodies of a new subscription
+	InterestRegionBodyIds.clear();
 
-	std::string line;
-    while (std::getline(initializationStringStream, line)) 
+	// The saved states belong to the previous world. Their buffers are kept for the states of this one.
+	for(SavedWorldState& savedWorldState : SavedWorldStates)
 	{
-        initializationActorsInfoLines.push_back(line);
-    }
+		savedWorldState.bIsValid = false;
+	}
+
+	// Adding the bodies woke them up. The game already knows they start awake.
+	body_activation_listener->ClearActivationEvents();
+	StepResponseContactEvents.clear();
+	StepResponseDroppedContactEventCount = 0;
+
+	bIsInitialized = true;
+
+	const std::chrono::duration<double, std::milli> initDuration = std::chrono::steady_clock::now() - initStartTime;
+	std::cout << "Physics system is up and running: " << BodyIdList.size() << " actors in " << initDuration.count() << " ms, "
+		<< GetShapeCache().GetShapeCount() << " cached shapes (" << GetShapeCache().GetShapeMemorySize() << " bytes).\n";
+}
 
-	// for each line (begin from 1 as first is only "Init"), create a box boddy with it's ID
-	for(int i = 1;i < initializationActorsInfoLines.size() - 1; i++)
+JobSystem* PhysicsServiceImpl::CreateJobSystem() const
+{
+	const int workerCount = JobSystemConfiguration.WorkerCount >= 0 ? JobSystemConfiguration.WorkerCount : std::max((int)thread::hardware_concurrency() - 1, 0);
+
+	if(JobSystemConfiguration.Type == EJobSystemType::ThreadPool)
 	{
-		// Split info with ";" delimiter
-		std::stringstream actorInfoStringStream(initializationActorsInfoLines[i]);
-		std::vector<std::string> actorInfoList;
+		std::cout << "Job system: JobSystemThreadPool with " << workerCount << " workers\n";
+		return new JobSystemThreadPool(cMaxPhysicsJobs, cMaxPhysicsBarriers, workerCount);
+	}
 
-		std::string actorInfoData;
-		while (std::getline(actorInfoStringStream, actorInfoData, ';')) 
+	WorkStealingJobSystem* workStealingJobSystem = new WorkStealingJobSystem(cMaxPhysicsJobs, cMaxPhysicsBarriers, JobSystemConfiguration);
+	std::cout << "Job system: work stealing with " << workerCount << " workers";
+	if(JobSystemConfiguration.bPinWorkers)
+	{
+		std::cout << ", pinned to CPUs";
+		for(int workerCpu : workStealingJobSystem->GetWorkerCpus())
 		{
-			actorInfoList.push_back(actorInfoData);
+			std::cout << " " << workerCpu;
 		}
+	}
+	std::cout << "\n";
+	return workStealingJobSystem;
+}
+
+void PhysicsServiceImpl::SetJobSystemSettings(const JobSystemSettings& newJobSystemSettings)
+{
+	// The current world keeps using its job system, the next Init recreates it with the new settings
+	JobSystemConfiguration = newJobSystemSettings;
+	bIsJobSystemOutdated = true;
+}
+
+void PhysicsServiceImpl::AddActorBodies(const std::vector<ActorInitializationInfo>& initializationActors)
+{
+	// One batch of actors per job. Bodies can be created and prepared for insertion from multiple threads,
+	// only the final insertion (AddBodiesFinalize) takes the broad phase lock.
+	struct ActorBodyBatch
+	{
+		size_t FirstActorIndex = 0;
+		size_t EndActorIndex = 0;
+		BodyIDVector CreatedBodyIds;
+		BodyInterface::AddState AddState = nullptr;
+	};
+
+	const size_t actorCount = initializationActors.size();
+	const size_t batchCount = std::clamp<size_t>((actorCount + cMinActorsPerCreationJob - 1) / cMinActorsPerCreationJob, 1, (size_t)job_system->GetMaxConcurrency() * 4);
+	const size_t actorsPerBatch = (actorCount + batchCount - 1) / batchCount;
+
+	std::vector<ActorBodyBatch> actorBodyBatches(batchCount);
+
+	// Index of every actor's body in BodyIdList order, invalid if its creation failed
+	std::vector<BodyID> actorBodyIds(actorCount);
+
+	JobSystem::Barrier* creationBarrier = job_system->CreateBarrier();
+	for(size_t batchIndex = 0; batchIndex < batchCount; ++batchIndex)
+	{
+		ActorBodyBatch& actorBodyBatch = actorBodyBatches[batchIndex];
+		actorBodyBatch.FirstActorIndex = std::min(batchIndex * actorsPerBatch, actorCount);
+		actorBodyBatch.EndActorIndex = std::min(actorBodyBatch.FirstActorIndex + actorsPerBatch, actorCount);
+
+		JobSystem::JobHandle creationJob = job_system->CreateJob("CreateActorBodies", Color::sGreen, [this, &actorBodyBatch, &initializationActors, &actorBodyIds]()
+		{
+			actorBodyBatch.CreatedBodyIds.reserve(actorBodyBatch.EndActorIndex - actorBodyBatch.FirstActorIndex);
+
+			// Actors usually come in runs of the same shape: only go through the (locked) shape cache when it changes
+			const ActorInitializationInfo* previousActorInfo = nullptr;
+			ShapeRefC actorShape;
+
+			for(size_t actorIndex = actorBodyBatch.FirstActorIndex; actorIndex < actorBodyBatch.EndActorIndex; ++actorIndex)
+			{
+				const ActorInitializationInfo& actorInfo = initializationActors[actorIndex];
+
+				if(!previousActorInfo || !HasSameShape(*previousActorInfo, actorInfo))
+				{
+					actorShape = GetActorShape(actorInfo);
+					previousActorInfo = &actorInfo;
+				}
+				if(!actorShape)
+				{
+					std::cout << "Fail in creation of body " << actorInfo.ActorId << ": invalid shape" << std::endl;
+					continue;
+				}
+
+				// Triangle meshes have no volume to simulate: they are static level geometry
+				EMotionType actorMotionType = actorInfo.MotionType == EActorMotionType::Static ? EMotionType::Static : (actorInfo.MotionType == EActorMotionType::Kinematic ? EMotionType::Kinematic : EMotionType::Dynamic);
+				if(actorShape->GetSubType() == EShapeSubType::Mesh)
+				{
+					actorMotionType = EMotionType::Static;
+				}
+
+				// Create the settings for the body itself
+				BodyCreationSettings actor_settings(actorShape, RVec3(actorInfo.InitialPosX, actorInfo.InitialPosY, actorInfo.InitialPosZ), Quat::sIdentity(), actorMotionType,
+					actorMotionType == EMotionType::Static ? Layers::NON_MOVING : Layers::MOVING);
+				actor_settings.mFriction = actorInfo.Friction;
+				actor_settings.mRestitution = actorInfo.Restitution;
+				if(actorInfo.Mass > 0.f && actorMotionType == EMotionType::Dynamic)
+				{
+					actor_settings.mOverrideMassProperties = EOverrideMassProperties::CalculateInertia;
+					actor_settings.mMassPropertiesOverride.mMass = actorInfo.Mass;
+				}
 
-		// Check for errors
-		if(actorInfoList.size() < 4)
+				// Create the actual rigid body with the actor's ID
+				Body* newActorBody = body_interface->CreateBodyWithID(BodyID(actorInfo.ActorId), actor_settings); // Note that if we run out of bodies this can return nullptr
+				if(!newActorBody)
+				{
+					std::cout << "Fail in creation of body " << actorInfo.ActorId << std::endl;
+					continue;
+				}
+
+				actorBodyIds[actorIndex] = newActorBody->GetID();
+				actorBodyBatch.CreatedBodyIds.push_back(newActorBody->GetID());
+			}
+
+			// Builds the broad phase nodes of the batch without touching the broad phase itself (may reorder the ids)
+			if(!actorBodyBatch.CreatedBodyIds.empty())
+			{
+				actorBodyBatch.AddState = body_interface->AddBodiesPrepare(actorBodyBatch.CreatedBodyIds.data(), (int)actorBodyBatch.CreatedBodyIds.size());
+			}
+		});
+		creationBarrier->AddJob(creationJob);
+	}
+	job_system->WaitForJobs(creationBarrier);
+	job_system->DestroyBarrier(creationBarrier);
+
+	// Insert the prepared batches
+	for(ActorBodyBatch& actorBodyBatch : actorBodyBatches)
+	{
+		if(!actorBodyBatch.CreatedBodyIds.empty())
 		{
-			std::cout << "Error on parsing initialization actor info. Less than 4 params\n";
-			return;
+			body_interface->AddBodiesFinalize(actorBodyBatch.CreatedBodyIds.data(), (int)actorBodyBatch.CreatedBodyIds.size(), actorBodyBatch.AddState, EActivation::Activate);
 		}
+	}
 
-		// Get actor initial pos
-		const double initialPosX = std::stod(actorInfoList[1]);
-		const double initialPosY = std::stod(actorInfoList[2]);
-		const double initialPosZ = std::stod(actorInfoList[3]);
+	// Keep the actors' order, without the bodies that couldn't be created
+	BodyIdList.reserve(BodyIdList.size() + actorCount);
+	for(const BodyID& actorBodyId : actorBodyIds)
+	{
+		if(!actorBodyId.IsInvalid())
+		{
+			BodyIdList.push_back(actorBodyId);
+		}
+	}
+}
 
-		// Create the settings for the body itself. Note that here you can also set other properties like the restitution / friction.
-		Vec3Arg boxHalfSize(0.5f, 0.5f, 0.5f);
-		BodyCreationSettings box_settings(new SphereShape(50.f), RVec3(initialPosX, initialPosY, initialPosZ), Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
-		box_settings.mRestitution = 1.f;
+bool PhysicsServiceImpl::HasSameShape(const ActorInitializationInfo& actorInfo, const ActorInitializationInfo& otherActorInfo)
+{
+	return actorInfo.ShapeType == otherActorInfo.ShapeType
+		&& std::equal(std::begin(actorInfo.ShapeParameters), std::end(actorInfo.ShapeParameters), std::begin(otherActorInfo.ShapeParameters))
+		&& actorInfo.ShapeName == otherActorInfo.ShapeName;
+}
 
-		// Get the actor ID and create a BodyID
-		const int actorId = std::stoi(actorInfoList[0]);
-		const BodyID newActorBodyID(actorId);
-		BodyIdList.push_back(newActorBodyID);
+ShapeRefC PhysicsServiceImpl::GetActorShape(const ActorInitializationInfo& actorInfo)
+{
+	switch(actorInfo.ShapeType)
+	{
+		case EActorShapeType::Sphere:
+			return GetShapeCache().GetSphere(actorInfo.ShapeParameters[0]);
 
-		// Create the actual rigid body
-		Body* newActorBody = body_interface->CreateBodyWithID(newActorBodyID, box_settings); // Note that if we run out of bodies this can return nullptr
-		if(!newActorBody)
+		case EActorShapeType::Box:
 		{
-			std::cout << "Fail in creation of body " << actorId << std::endl;
-			continue;
+			// The convex radius can't exceed the box
+			const Vec3 halfExtent(actorInfo.ShapeParameters[0], actorInfo.ShapeParameters[1], actorInfo.ShapeParameters[2]);
+			return GetShapeCache().GetBox(halfExtent, std::min(cDefaultConvexRadius, halfExtent.ReduceMin()));
 		}
 
-		// Add it to the world
-		body_interface->AddBody(newActorBody->GetID(), EActivation::Activate);
+		case EActorShapeType::Capsule:
+			return GetShapeCache().GetCapsule(actorInfo.ShapeParameters[0], actorInfo.ShapeParameters[1]);
+
+		case EActorShapeType::Cached:
+		{
+			std::unique_lock<std::mutex> definedShapesLock(DefinedShapesMutex);
+			const auto definedShape = DefinedShapes.find(actorInfo.ShapeName);
+			if(definedShape != DefinedShapes.end())
+			{
+				return definedShape->second;
+			}
+			definedShapesLock.unlock();
+
+			return GetShapeCache().FindNamedShape(actorInfo.ShapeName);
+		}
 	}
 
-	// Optional step: Before starting the physics simulation you can optimize the broad phase. This improves collision detection performance (it's pointless here because we only have 2 bodies).
-	// You should definitely not call this every frame or when e.g. streaming in a new level section as it is an expensive operation.
-	// Instead insert all new objects in batches instead of 1 at a time to keep the broad phase efficient.
-	//physics_system->OptimizeBroadPhase();
+	return nullptr;
+}
 
-	bIsInitialized = true;
+bool StepCommand::IsValid() const
+{
+	return DeltaTime > 0.f && DeltaTime <= cMaxDeltaTime && StepCount >= 1 && StepCount <= cMaxStepCount
+		&& CollisionSteps <= cMaxCollisionSteps && IntegrationSubSteps >= 1 && IntegrationSubSteps <= cMaxIntegrationSubSteps;
+}
 
-    std::cout << "Physics system is up and running.\n";
+uint32 StepCommand::GetFrameCount() const
+{
+	return FrameInterval > 0 ? StepCount / FrameInterval + (StepCount % FrameInterval != 0 ? 1 : 0) : 1;
 }
 
-std::string PhysicsServiceImpl::StepPhysicsSimulation()
+void PhysicsServiceImpl::UpdatePhysicsWorld(const StepCommand& stepCommand)
 {
+	JPH_PROFILE_FUNCTION();
+
 	// If you take larger steps than 1 / 60th of a second you need to do multiple collision steps in order to keep the simulation stable. Do 1 collision step per 1 / 60th of a second (round up).
-	const int cCollisionSteps = 1;
+	const int collisionSteps = stepCommand.CollisionSteps > 0 ? (int)stepCommand.CollisionSteps : std::max((int)std::ceil(stepCommand.DeltaTime * 60.f - 1.e-3f), 1);
 
 	// If you want more accurate step results you can do multiple sub steps within a collision step. Usually you would set this to 1.
-	const int cIntegrationSubSteps = 1;
-
-	// We simulate the physics world in discrete time steps. 60 Hz is a good rate to update the physics system.
-	const float cDeltaTime = 1.0f / 60.f;
+	const int integrationSubSteps = (int)stepCommand.IntegrationSubSteps;
 
 	// Step the world
-	physics_system->Update(cDeltaTime, cCollisionSteps, cIntegrationSubSteps, temp_allocator, job_system);
+	const std::chrono::steady_clock::time_point preUpdateTime = std::chrono::steady_clock::now();
+	physics_system->Update(stepCommand.DeltaTime, collisionSteps, integrationSubSteps, temp_allocator, job_system);
+	LastUpdateDuration = std::chrono::steady_clock::now() - preUpdateTime;
+}
+
+void PhysicsServiceImpl::AdvanceStep()
+{
+	// With pipelined stepping, the step of this response was already simulated while the previous response was sent
+	const bool bIsStepSimulated = TakePipelinedStep(StepCommand());
 
-	// response string
-	std::string stepPhysicsResponse = "";
+	// The body commands queued since the last step go in before it is simulated (or on top of the step simulated ahead)
+	ApplyBodyCommands();
 
-	// Foreach body:
-	for(auto& bodyId : BodyIdList)
+	if(!bIsStepSimulated)
 	{
-		// Output current position of the sphere
-		RVec3 position = body_interface->GetCenterOfMassPosition(bodyId);
+		UpdatePhysicsWorld();
+	}
 
-		const std::string actorStepPhysicsPositionResult = std::to_string(position.GetX()) + ";" + std::to_string(position.GetY()) + ";" + std::to_string(position.GetZ());
-		stepPhysicsResponse += std::to_string(bodyId.GetIndex()) + ";" + actorStepPhysicsPositionResult + ";";
-		
-		// Output current rotation of the sphere
-		RVec3 rotation = body_interface->GetRotation(bodyId).GetEulerAngles();
+	LastStepPhaseDurations = StepPhaseDurations();
+	LastStepPhaseDurations.Update = LastUpdateDuration;
+
+	const std::chrono::steady_clock::time_point preSnapshotTime = std::chrono::steady_clock::now();
+	GatherStepResponseBodies();
+	LastStepPhaseDurations.Snapshot = std::chrono::steady_clock::now() - preSnapshotTime;
 
-		const std::string actorStepPhysicsRotationResult = std::to_string(rotation.GetX()) + ";" + std::to_string(rotation.GetY()) + ";" + std::to_string(rotation.GetZ());
-		stepPhysicsResponse += actorStepPhysicsRotationResult + "\n";
+	// The response only reads the snapshot, so the next step can run while it is serialized and sent
+	if(bIsPipelinedStepping)
+	{
+		StartPipelinedStep(StepCommand());
 	}
+}
 
-	//std::cout << "StepPhysics response:\n" << stepPhysicsResponse << std::endl;
-	return stepPhysicsResponse;
+void PhysicsServiceImpl::FinishPipelinedStep()
+{
+	StepPipeline.WaitForStep();
 }
 
-void PhysicsServiceImpl::ClearPhysicsSystem()
+void PhysicsServiceImpl::StartPipelinedStep(const StepCommand& stepCommand)
 {
-    std::cout << "Cleaing physics system...\n";
+	PipelinedStepSettings = stepCommand;
+	StepPipeline.StartStep();
+	bIsNextStepSimulated = true;
+}
 
-	for(auto& bodyId : BodyIdList)
+void PhysicsServiceImpl::SimulatePipelinedStep()
+{
+	// On the pipeline thread, off the critical path of the request. The buffer is kept, so this doesn't allocate once it has grown.
+	PipelinedStepStartState.BeginWrite();
+	PipelinedStepStartState.Reserve((BodyIdList.size() + 1) * cEstimatedStateBytesPerBody);
+	physics_system->SaveState(PipelinedStepStartState);
+
+	UpdatePhysicsWorld(PipelinedStepSettings);
+}
+
+bool PhysicsServiceImpl::TakePipelinedStep(const StepCommand& stepCommand)
+{
+	if(!bIsNextStepSimulated)
 	{
-    	// Remove the sphere from the physics system. Note that the sphere itself keeps all of its state and can be re-added at any time.
-		body_interface->RemoveBody(bodyId);
+		return false;
+	}
 
-		// Destroy the sphere. After this the sphere ID is no longer valid.
-		body_interface->DestroyBody(bodyId);
+	StepPipeline.WaitForStep();
+	bIsNextStepSimulated = false;
+
+	if(stepCommand.DeltaTime == PipelinedStepSettings.DeltaTime && stepCommand.CollisionSteps == PipelinedStepSettings.CollisionSteps
+		&& stepCommand.IntegrationSubSteps == PipelinedStepSettings.IntegrationSubSteps)
+	{
+		return true;
 	}
 
-	// Remove and destroy the floor
-	body_interface->RemoveBody(floor_id);
-	body_interface->DestroyBody(floor_id);
+	// Back to the world of the last response. The sleep / wake and contact events of the rolled back step go with it
+	// (the last response consumed the ones before).
+	PipelinedStepStartState.BeginRead();
+	if(!physics_system->RestoreState(PipelinedStepStartState))
+	{
+		std::cout << "Error on rolling back the step simulated ahead: the state doesn't match the bodies of the world\n";
+	}
+	body_activation_listener->ClearActivationEvents();
+	contact_listener->ClearContactEvents();
+	return false;
+}
 
-	// Unregisters all types with the factory and cleans up the default material
-	UnregisterTypes();
+void BodyStateSnapshot::Resize(size_t bodyCount)
+{
+	BodyIds.resize(bodyCount);
+	Positions.resize(bodyCount);
+	Rotations.resize(bodyCount);
+	LinearVelocities.resize(bodyCount);
+	AngularVelocities.resize(bodyCount);
+}
 
-	// Destroy the factory
-	delete Factory::sInstance;
-	Factory::sInstance = nullptr;
+void PhysicsServiceImpl::SnapshotBodyStates(const BodyID* bodyIds, size_t bodyCount, BodyStateSnapshot& outSnapshot)
+{
+	// The bodies may still be moving on the pipeline thread
+	FinishPipelinedStep();
+
+	outSnapshot.Resize(bodyCount);
+	std::copy(bodyIds, bodyIds + bodyCount, outSnapshot.BodyIds.begin());
+
+	const size_t jobCount = std::min<size_t>(bodyCount / cMinBodiesPerSnapshotJob, (size_t)job_system->GetMaxConcurrency());
+	if(jobCount <= 1)
+	{
+		SnapshotBodyStateRange(outSnapshot, 0, bodyCount);
+		return;
+	}
+
+	// Every job reads its own contiguous range of the snapshot
+	const size_t bodiesPerJob = (bodyCount + jobCount - 1) / jobCount;
+	JobSystem::Barrier* snapshotBarrier = job_system->CreateBarrier();
+	for(size_t firstBodyIndex = 0; firstBodyIndex < bodyCount; firstBodyIndex += bodiesPerJob)
+	{
+		const size_t endBodyIndex = std::min(firstBodyIndex + bodiesPerJob, bodyCount);
+		JobSystem::JobHandle snapshotJob = job_system->CreateJob("SnapshotBodyStates", Color::sCyan, [this, &outSnapshot, firstBodyIndex, endBodyIndex]()
+		{
+			SnapshotBodyStateRange(outSnapshot, firstBodyIndex, endBodyIndex);
+		});
+		snapshotBarrier->AddJob(snapshotJob);
+	}
+	job_system->WaitForJobs(snapshotBarrier);
+	job_system->DestroyBarrier(snapshotBarrier);
+}
+
+void PhysicsServiceImpl::SnapshotBodyStateRange(BodyStateSnapshot& ioSnapshot, size_t firstBodyIndex, size_t endBodyIndex) const
+{
+	const BodyLockInterfaceNoLock& bodyLockInterface = physics_system->GetBodyLockInterfaceNoLock();
+
+	for(size_t i = firstBodyIndex; i < endBodyIndex; ++i)
+	{
+		// A single body lookup for the whole state, the no lock interface doesn't take the body mutex
+		BodyLockRead bodyLock(bodyLockInterface, ioSnapshot.BodyIds[i]);
+		if(!bodyLock.Succeeded())
+		{
+			ioSnapshot.Positions[i] = RVec3::sZero();
+			ioSnapshot.Rotations[i] = Quat::sIdentity();
+			ioSnapshot.LinearVelocities[i] = Vec3::sZero();
+			ioSnapshot.AngularVelocities[i] = Vec3::sZero();
+			continue;
+		}
+
+		const Body& body = bodyLock.GetBody();
+		ioSnapshot.Positions[i] = body.GetCenterOfMassPosition();
+		ioSnapshot.Rotations[i] = body.GetRotation();
+		ioSnapshot.LinearVelocities[i] = body.GetLinearVelocity();
+		ioSnapshot.AngularVelocities[i] = body.GetAngularVelocity();
+	}
+}
+
+bool PhysicsServiceImpl::SetStepResponseMode(EStepResponseMode newStepResponseMode, float positionThreshold, float rotationThreshold)
+{
+	if(!std::isfinite(positionThreshold) || !std::isfinite(rotationThreshold) || positionThreshold < 0.f || rotationThreshold < 0.f)
+	{
+		return false;
+	}
+
+	StepResponseMode = newStepResponseMode;
+	DeltaPositionThresholdSq = positionThreshold * positionThreshold;
+
+	// Two unit quaternions are within angle "a" of each other when |q1 . q2| >= cos(a / 2)
+	DeltaRotationThresholdCos = std::cos(0.5f * rotationThreshold);
+
+	bNeedsFullStepResponse = true;
+	return true;
+}
+
+bool PhysicsServiceImpl::HasBodyTransformChanged(const SentBodyTransform& lastSentTransform, RVec3Arg position, QuatArg rotation) const
+{
+	if((position - lastSentTransform.Position).LengthSq() > DeltaPositionThresholdSq)
+	{
+		return true;
+	}
+
+	return std::abs(rotation.Dot(lastSentTransform.Rotation)) < DeltaRotationThresholdCos;
+}
+
+bool InterestRegion::IsValid() const
+{
+	if(Shape == EInterestRegionShape::Sphere)
+	{
+		return std::isfinite(SphereCenter[0]) && std::isfinite(SphereCenter[1]) && std::isfinite(SphereCenter[2])
+			&& std::isfinite(SphereRadius) && SphereRadius > 0.f;
+	}
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		if(!std::isfinite(BoxMin[axis]) || !std::isfinite(BoxMax[axis]) || BoxMin[axis] > BoxMax[axis])
+		{
+			return false;
+		}
+	}
+	return Shape == EInterestRegionShape::Box;
+}
+
+bool PhysicsServiceImpl::SetInterestRegions(const std::vector<InterestRegion>& newInterestRegions)
+{
+	if(newInterestRegions.size() > cMaxInterestRegions)
+	{
+		return false;
+	}
+	for(const InterestRegion& interestRegion : newInterestRegions)
+	{
+		if(!interestRegion.IsValid())
+		{
+			return false;
+		}
+	}
+
+	// The game didn't get the bodies outside the regions in a while: send it the complete state again
+	if(newInterestRegions.empty() && !InterestRegions.empty())
+	{
+		bNeedsFullStepResponse = true;
+		InterestRegionBodyIds.clear();
+	}
+
+	// The regions are only read when the step response is gathered, a step simulated ahead doesn't mind
+	InterestRegions = newInterestRegions;
+	return true;
+}
+
+void PhysicsServiceImpl::UpdateInterestRegionBodies()
+{
+	JPH_PROFILE_FUNCTION();
+
+	InterestRegionBodyIds.swap(PreviousInterestRegionBodyIds);
+	InterestRegionBodyIds.clear();
+
+	// The broadphase trees only visit the nodes overlapping the regions, however many actors the world has
+	BodyIdVectorCollector interestRegionCollector(InterestRegionBodyIds);
+	const BroadPhaseQuery& broadPhaseQuery = physics_system->GetBroadPhaseQuery();
+	for(const InterestRegion& interestRegion : InterestRegions)
+	{
+		if(interestRegion.Shape == EInterestRegionShape::Sphere)
+		{
+			const Vec3 sphereCenter(interestRegion.SphereCenter[0], interestRegion.SphereCenter[1], interestRegion.SphereCenter[2]);
+			broadPhaseQuery.CollideSphere(sphereCenter, interestRegion.SphereRadius, interestRegionCollector);
+		}
+		else
+		{
+			const AABox regionBox(Vec3(interestRegion.BoxMin[0], interestRegion.BoxMin[1], interestRegion.BoxMin[2]), Vec3(interestRegion.BoxMax[0], interestRegion.BoxMax[1], interestRegion.BoxMax[2]));
+			broadPhaseQuery.CollideAABox(regionBox, interestRegionCollector);
+		}
+	}
+
+	// Only the actors (not the floor), once each even where regions overlap, sorted by index like the previous ones
+	InterestRegionBodyIds.erase(
+		std::remove_if(InterestRegionBodyIds.begin(), InterestRegionBodyIds.end(), [this](const BodyID& bodyId)
+		{
+			return bodyId.GetIndex() >= LastSentBodyTransforms.size() || !LastSentBodyTransforms[bodyId.GetIndex()].bIsActor;
+		}),
+		InterestRegionBodyIds.end());
+	std::sort(InterestRegionBodyIds.begin(), InterestRegionBodyIds.end(), IsBodyIndexLess);
+	InterestRegionBodyIds.erase(std::unique(InterestRegionBodyIds.begin(), InterestRegionBodyIds.end()), InterestRegionBodyIds.end());
+
+	// The game doesn't follow the bodies outside the regions, their sleep / wake events don't concern it
+	StepResponseActivationEvents.erase(
+		std::remove_if(StepResponseActivationEvents.begin(), StepResponseActivationEvents.end(), [this](const BodyActivationEvent& activationEvent)
+		{
+			return !std::binary_search(InterestRegionBodyIds.begin(), InterestRegionBodyIds.end(), activationEvent.Body, IsBodyIndexLess);
+		}),
+		StepResponseActivationEvents.end());
+
+	EnteredInterestRegionBodyIds.clear();
+	std::set_difference(InterestRegionBodyIds.begin(), InterestRegionBodyIds.end(), PreviousInterestRegionBodyIds.begin(), PreviousInterestRegionBodyIds.end(),
+		std::back_inserter(EnteredInterestRegionBodyIds), IsBodyIndexLess);
+	for(const BodyID& bodyId : EnteredInterestRegionBodyIds)
+	{
+		StepResponseActivationEvents.push_back({ bodyId, EBodyActivationEventType::EnterInterestRegion });
+	}
+
+	// Previous bodies that aren't in the regions anymore
+	for(const BodyID& bodyId : PreviousInterestRegionBodyIds)
+	{
+		if(!std::binary_search(InterestRegionBodyIds.begin(), InterestRegionBodyIds.end(), bodyId, IsBodyIndexLess))
+		{
+			StepResponseActivationEvents.push_back({ bodyId, EBodyActivationEventType::LeaveInterestRegion });
+		}
+	}
+}
+
+void PhysicsServiceImpl::GatherStepResponseBodies()
+{
+	JPH_PROFILE_FUNCTION();
+
+	// Sleep / wake events of the actors, sorted so the response doesn't depend on job scheduling
+	body_activation_listener->ConsumeActivationEvents(StepResponseActivationEvents);
+	StepResponseActivationEvents.erase(
+		std::remove_if(StepResponseActivationEvents.begin(), StepResponseActivationEvents.end(), [this](const BodyActivationEvent& activationEvent)
+		{
+			const uint32 bodyIndex = activationEvent.Body.GetIndex();
+			return bodyIndex >= LastSentBodyTransforms.size() || !LastSentBodyTransforms[bodyIndex].bIsActor;
+		}),
+		StepResponseActivationEvents.end());
+
+	// With interest regions, the response only covers the actors inside them
+	const bool bHasInterestRegions = !InterestRegions.empty();
+	if(bHasInterestRegions)
+	{
+		UpdateInterestRegionBodies();
+	}
+
+	std::stable_sort(StepResponseActivationEvents.begin(), StepResponseActivationEvents.end(), [](const BodyActivationEvent& a, const BodyActivationEvent& b)
+	{
+		return a.Body.GetIndex() < b.Body.GetIndex();
+	});
+
+	// Contact events of the steps since the last response, merged from the buffers of the job threads
+	if(ContactEventConfiguration.bIsEnabled)
+	{
+		contact_listener->ConsumeContactEvents(StepResponseContactEvents, StepResponseDroppedContactEventCount);
+	}
+
+	if(StepResponseMode == EStepResponseMode::Full || bNeedsFullStepResponse)
+	{
+		if(bHasInterestRegions)
+		{
+			SnapshotBodyStates(InterestRegionBodyIds.data(), InterestRegionBodyIds.size(), StepResponseSnapshot);
+		}
+		else
+		{
+			SnapshotBodyStates(BodyIdList.data(), BodyIdList.size(), StepResponseSnapshot);
+		}
+
+		// In delta mode, this full response is the baseline the next deltas are compared against
+		if(StepResponseMode == EStepResponseMode::Delta)
+		{
+			for(size_t i = 0; i < StepResponseSnapshot.GetBodyCount(); ++i)
+			{
+				SentBodyTransform& lastSentTransform = LastSentBodyTransforms[StepResponseSnapshot.BodyIds[i].GetIndex()];
+				lastSentTransform.Position = StepResponseSnapshot.Positions[i];
+				lastSentTransform.Rotation = StepResponseSnapshot.Rotations[i];
+			}
+		}
+
+		bNeedsFullStepResponse = false;
+		SpawnedActorBodyIds.clear();
+		return;
+	}
+
+	// Without interest regions the spawned actors are sent below, whether they moved or not. With regions, the ones inside entered them.
+	const bool bSendsSpawnedActors = !bHasInterestRegions && !SpawnedActorBodyIds.empty();
+
+	// A body is gathered once, even if it's awake and fell asleep since the last response (it woke up again), or fell asleep twice
+	++StepResponseGeneration;
+	auto gatherStepResponseBody = [this](const BodyID& bodyId)
+	{
+		SentBodyTransform& lastSentTransform = LastSentBodyTransforms[bodyId.GetIndex()];
+		if(lastSentTransform.GatheredStepResponse != StepResponseGeneration)
+		{
+			lastSentTransform.GatheredStepResponse = StepResponseGeneration;
+			StepResponseBodyIds.push_back(bodyId);
+		}
+	};
+
+	// Sleeping bodies don't move, so only the awake actors can have changed
+	StepResponseBodyIds.clear();
+	physics_system->GetActiveBodies(ActiveBodyIds);
+	for(const BodyID& bodyId : ActiveBodyIds)
+	{
+		const uint32 bodyIndex = bodyId.GetIndex();
+		if(bodyIndex >= LastSentBodyTransforms.size() || !LastSentBodyTransforms[bodyIndex].bIsActor)
+		{
+			continue;
+		}
+
+		// Actors that entered the regions are sent below, whether they moved or not
+		if(bHasInterestRegions && (!std::binary_search(InterestRegionBodyIds.begin(), InterestRegionBodyIds.end(), bodyId, IsBodyIndexLess)
+			|| std::binary_search(EnteredInterestRegionBodyIds.begin(), EnteredInterestRegionBodyIds.end(), bodyId, IsBodyIndexLess)))
+		{
+			continue;
+		}
+		if(bSendsSpawnedActors && std::binary_search(SpawnedActorBodyIds.begin(), SpawnedActorBodyIds.end(), bodyId, IsBodyIndexLess))
+		{
+			continue;
+		}
+
+		gatherStepResponseBody(bodyId);
+	}
+	const size_t activeBodyCount = StepResponseBodyIds.size();
+
+	// Bodies that just went to sleep left the active list. Always send their resting transform
+	// so the game doesn't keep them at a pose that was within the threshold.
+	// The actors that entered the regions are sent as well: the game doesn't know where they are.
+	for(const BodyActivationEvent& activationEvent : StepResponseActivationEvents)
+	{
+		if(activationEvent.Type == EBodyActivationEventType::EnterInterestRegion
+			|| (activationEvent.Type == EBodyActivationEventType::Sleep && (!bHasInterestRegions
+				|| !std::binary_search(EnteredInterestRegionBodyIds.begin(), EnteredInterestRegionBodyIds.end(), activationEvent.Body, IsBodyIndexLess))
+				&& (!bSendsSpawnedActors || !std::binary_search(SpawnedActorBodyIds.begin(), SpawnedActorBodyIds.end(), activationEvent.Body, IsBodyIndexLess))))
+		{
+			gatherStepResponseBody(activationEvent.Body);
+		}
+	}
+	if(bSendsSpawnedActors)
+	{
+		for(const BodyID& bodyId : SpawnedActorBodyIds)
+		{
+			gatherStepResponseBody(bodyId);
+		}
+	}
+	SpawnedActorBodyIds.clear();
+
+	SnapshotBodyStates(StepResponseBodyIds.data(), StepResponseBodyIds.size(), StepResponseSnapshot);
+
+	// Keep the bodies that moved / rotated past the thresholds (and the ones that fell asleep), compacting the snapshot in place
+	size_t keptBodyCount = 0;
+	for(size_t i = 0; i < StepResponseSnapshot.GetBodyCount(); ++i)
+	{
+		SentBodyTransform& lastSentTransform = LastSentBodyTransforms[StepResponseSnapshot.BodyIds[i].GetIndex()];
+		if(i < activeBodyCount && !HasBodyTransformChanged(lastSentTransform, StepResponseSnapshot.Positions[i], StepResponseSnapshot.Rotations[i]))
+		{
+			continue;
+		}
+
+		lastSentTransform.Position = StepResponseSnapshot.Positions[i];
+		lastSentTransform.Rotation = StepResponseSnapshot.Rotations[i];
+
+		StepResponseSnapshot.BodyIds[keptBodyCount] = StepResponseSnapshot.BodyIds[i];
+		StepResponseSnapshot.Positions[keptBodyCount] = StepResponseSnapshot.Positions[i];
+		StepResponseSnapshot.Rotations[keptBodyCount] = StepResponseSnapshot.Rotations[i];
+		StepResponseSnapshot.LinearVelocities[keptBodyCount] = StepResponseSnapshot.LinearVelocities[i];
+		StepResponseSnapshot.AngularVelocities[keptBodyCount] = StepResponseSnapshot.AngularVelocities[i];
+		++keptBodyCount;
+	}
+	StepResponseSnapshot.Resize(keptBodyCount);
+}
+
+void PhysicsServiceImpl::StepPhysicsSimulation(std::vector<char>& outStepResult)
+{
+	AdvanceStep();
+
+	const std::chrono::steady_clock::time_point preSerializeTime = std::chrono::steady_clock::now();
+	WriteTextStepResponse(outStepResult);
+	LastStepPhaseDurations.Serialize = std::chrono::steady_clock::now() - preSerializeTime;
+}
+
+void PhysicsServiceImpl::StepPhysicsSimulationBinary(std::vector<char>& outStepResult)
+{
+	AdvanceStep();
+
+	const std::chrono::steady_clock::time_point preSerializeTime = std::chrono::steady_clock::now();
+	WriteBinaryStepResponse(outStepResult);
+	LastStepPhaseDurations.Serialize = std::chrono::steady_clock::now() - preSerializeTime;
+}
+
+bool PhysicsServiceImpl::StepPhysicsSimulationMulti(const StepCommand& stepCommand, std::vector<char>& outStepResult)
+{
+	if(!bIsInitialized || !stepCommand.IsValid())
+	{
+		return false;
+	}
+
+	// "Frame;<completed steps>\n" followed by the lines of a Step response, per frame
+	RunStepCommand(stepCommand, [this, &outStepResult](uint32 completedStepCount)
+	{
+		constexpr char cFramePrefix[] = "Frame;";
+		const size_t frameOffset = outStepResult.size();
+		outStepResult.resize(frameOffset + sizeof(cFramePrefix) + 10 + 1);
+		std::memcpy(outStepResult.data() + frameOffset, cFramePrefix, sizeof(cFramePrefix) - 1);
+		char* frameHeaderEnd = std::to_chars(outStepResult.data() + frameOffset + sizeof(cFramePrefix) - 1, outStepResult.data() + outStepResult.size(), completedStepCount).ptr;
+		*frameHeaderEnd++ = '\n';
+		outStepResult.resize(frameHeaderEnd - outStepResult.data());
+
+		WriteTextStepResponse(outStepResult);
+	});
+	return true;
+}
+
+bool PhysicsServiceImpl::StepPhysicsSimulationMultiBinary(const StepCommand& stepCommand, std::vector<char>& outStepResult)
+{
+	using namespace PhysicsServiceProtocol;
+
+	if(!bIsInitialized || !stepCommand.IsValid())
+	{
+		return false;
+	}
+
+	// uint32 frame count, then per frame: uint32 completed steps followed by a Step response
+	AppendLittleEndian<uint32_t>(outStepResult, stepCommand.GetFrameCount());
+	RunStepCommand(stepCommand, [this, &outStepResult](uint32 completedStepCount)
+	{
+		AppendLittleEndian<uint32_t>(outStepResult, completedStepCount);
+		WriteBinaryStepResponse(outStepResult);
+	});
+	return true;
+}
+
+template <class FrameWriter>
+void PhysicsServiceImpl::RunStepCommand(const StepCommand& stepCommand, const FrameWriter& writeFrame)
+{
+	// With pipelined stepping, the first step may already be simulated (see TakePipelinedStep)
+	const bool bIsFirstStepSimulated = TakePipelinedStep(stepCommand);
+
+	ApplyBodyCommands();
+
+	LastStepPhaseDurations = StepPhaseDurations();
+
+	for(uint32 completedStepCount = 1; completedStepCount <= stepCommand.StepCount; ++completedStepCount)
+	{
+		if(completedStepCount > 1 || !bIsFirstStepSimulated)
+		{
+			UpdatePhysicsWorld(stepCommand);
+		}
+		LastStepPhaseDurations.Update += LastUpdateDuration;
+
+		if(completedStepCount == stepCommand.StepCount || (stepCommand.FrameInterval > 0 && completedStepCount % stepCommand.FrameInterval == 0))
+		{
+			const std::chrono::steady_clock::time_point preSnapshotTime = std::chrono::steady_clock::now();
+			GatherStepResponseBodies();
+			const std::chrono::steady_clock::time_point preSerializeTime = std::chrono::steady_clock::now();
+			writeFrame(completedStepCount);
+
+			LastStepPhaseDurations.Snapshot += preSerializeTime - preSnapshotTime;
+			LastStepPhaseDurations.Serialize += std::chrono::steady_clock::now() - preSerializeTime;
+		}
+	}
+
+	// The next request is most likely another command with the same settings
+	if(bIsPipelinedStepping)
+	{
+		StartPipelinedStep(stepCommand);
+	}
+}
+
+void PhysicsServiceImpl::WriteTextStepResponse(std::vector<char>& outStepResult)
+{
+	JPH_PROFILE_FUNCTION();
+
+	// Make room for the worst case and give back what wasn't used. The buffer is reused between steps, so this doesn't allocate once it has grown.
+	const size_t stepResultOffset = outStepResult.size();
+	outStepResult.resize(stepResultOffset + StepResponseSnapshot.GetBodyCount() * cMaxTextBodyRecordLength + StepResponseActivationEvents.size() * cMaxTextActivationEventLength
+		+ StepResponseContactEvents.size() * cMaxTextContactEventLength + cMaxTextDroppedContactEventsLength);
+
+	char* stepResult = outStepResult.data() + stepResultOffset;
+	char* const stepResultEnd = outStepResult.data() + outStepResult.size();
+
+	// Convert every rotation at once, 8 at a time when built with AVX2
+	const size_t bodyCount = StepResponseSnapshot.GetBodyCount();
+	StepResponseEulerAnglesX.resize(bodyCount);
+	StepResponseEulerAnglesY.resize(bodyCount);
+	StepResponseEulerAnglesZ.resize(bodyCount);
+	ConvertRotationsToEulerAngles(StepResponseSnapshot.Rotations.data(), bodyCount, StepResponseEulerAnglesX.data(), StepResponseEulerAnglesY.data(), StepResponseEulerAnglesZ.data());
+
+	// Foreach body: "id;x;y;z;rx;ry;rz\n", positions and euler angles with 6 decimals (as std::to_string wrote them)
+	for(size_t i = 0; i < bodyCount; ++i)
+	{
+		// Output current position of the sphere
+		const RVec3& position = StepResponseSnapshot.Positions[i];
+
+		stepResult = std::to_chars(stepResult, stepResultEnd, StepResponseSnapshot.BodyIds[i].GetIndex()).ptr;
+		*stepResult++ = ';';
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)position.GetX(), ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)position.GetY(), ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)position.GetZ(), ';');
+
+		// Output current rotation of the sphere
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)StepResponseEulerAnglesX[i], ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)StepResponseEulerAnglesY[i], ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)StepResponseEulerAnglesZ[i], '\n');
+	}
+
+	// Body events are only part of the delta response and of interest region subscriptions, the legacy full response stays unchanged
+	if(StepResponseMode == EStepResponseMode::Delta || !InterestRegions.empty())
+	{
+		// By EBodyActivationEventType
+		static constexpr const char* cActivationEventNames[] = { "Wake;", "Sleep;", "Enter;", "Leave;" };
+
+		for(const BodyActivationEvent& activationEvent : StepResponseActivationEvents)
+		{
+			const char* activationEventName = cActivationEventNames[(size_t)activationEvent.Type];
+			const size_t activationEventNameLength = strlen(activationEventName);
+			std::memcpy(stepResult, activationEventName, activationEventNameLength);
+			stepResult = std::to_chars(stepResult + activationEventNameLength, stepResultEnd, activationEvent.Body.GetIndex()).ptr;
+			*stepResult++ = '\n';
+		}
+	}
+
+	// Contact events only when the game asked for them, so the other responses stay unchanged
+	if(ContactEventConfiguration.bIsEnabled)
+	{
+		stepResult = WriteTextContactEvents(stepResult, stepResultEnd);
+	}
+
+	outStepResult.resize(stepResult - outStepResult.data());
+}
+
+char* PhysicsServiceImpl::WriteTextContactEvents(char* stepResult, char* stepResultEnd) const
+{
+	// "Contact<Added|Persisted|Removed>;id1;id2[;impulse;x;y;z;nx;ny;nz]\n" per event
+	for(const ContactEvent& contactEvent : StepResponseContactEvents)
+	{
+		const char* contactEventName = "ContactAdded;";
+		if(contactEvent.Type == EContactEventType::Persisted)
+		{
+			contactEventName = "ContactPersisted;";
+		}
+		else if(contactEvent.Type == EContactEventType::Removed)
+		{
+			contactEventName = "ContactRemoved;";
+		}
+		const size_t contactEventNameLength = strlen(contactEventName);
+		std::memcpy(stepResult, contactEventName, contactEventNameLength);
+		stepResult = std::to_chars(stepResult + contactEventNameLength, stepResultEnd, contactEvent.Body1.GetIndex()).ptr;
+		*stepResult++ = ';';
+		stepResult = std::to_chars(stepResult, stepResultEnd, contactEvent.Body2.GetIndex()).ptr;
+		if(contactEvent.Type == EContactEventType::Removed)
+		{
+			*stepResult++ = '\n';
+			continue;
+		}
+
+		*stepResult++ = ';';
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)contactEvent.ImpactImpulse, ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)contactEvent.Position.GetX(), ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)contactEvent.Position.GetY(), ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)contactEvent.Position.GetZ(), ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)contactEvent.Normal.GetX(), ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)contactEvent.Normal.GetY(), ';');
+		stepResult = WriteTextFloat(stepResult, stepResultEnd, (double)contactEvent.Normal.GetZ(), '\n');
+	}
+
+	// Tells the game the response is missing the weakest impacts
+	if(StepResponseDroppedContactEventCount > 0)
+	{
+		constexpr char cDroppedPrefix[] = "ContactsDropped;";
+		std::memcpy(stepResult, cDroppedPrefix, sizeof(cDroppedPrefix) - 1);
+		stepResult = std::to_chars(stepResult + sizeof(cDroppedPrefix) - 1, stepResultEnd, StepResponseDroppedContactEventCount).ptr;
+		*stepResult++ = '\n';
+	}
+
+	return stepResult;
+}
+
+char* PhysicsServiceImpl::WriteTextFloat(char* textOutput, char* textOutputEnd, double value, char separator)
+{
+	// Fixed notation, 6 decimals, like "%f". The text protocol carries floats: clamping keeps double precision
+	// positions within cMaxTextFloatLength characters.
+	value = std::clamp(value, (double)-FLT_MAX, (double)FLT_MAX);
+	textOutput = std::to_chars(textOutput, textOutputEnd, value, std::chars_format::fixed, 6).ptr;
+	*textOutput++ = separator;
+	return textOutput;
+}
+
+void PhysicsServiceImpl::WriteBinaryStepResponse(std::vector<char>& outStepResult)
+{
+	JPH_PROFILE_FUNCTION();
+
+	using namespace PhysicsServiceProtocol;
+
+	// Body section: body count (+ measured quantization error) followed by one fixed size record per body
+	size_t bodySectionSize = sizeof(uint32_t) + StepResponseSnapshot.GetBodyCount() * BodyTransformRecordSize;
+	if(StepEncoding == EStepEncoding::Quantized)
+	{
+		const size_t quantizedRecordSize = sizeof(uint32_t) + StepTransformQuantizer.GetPositionBytes() + StepTransformQuantizer.GetRotationBytes();
+		bodySectionSize = sizeof(uint32_t) + 2 * sizeof(float) + StepResponseSnapshot.GetBodyCount() * quantizedRecordSize;
+	}
+
+	// Then the activation events, and the contact events if the game asked for them
+	size_t contactEventSectionSize = 0;
+	if(ContactEventConfiguration.bIsEnabled)
+	{
+		contactEventSectionSize = 2 * sizeof(uint32_t) + StepResponseContactEvents.size() * ContactEventRecordSize;
+	}
+
+	const size_t stepResultOffset = outStepResult.size();
+	outStepResult.resize(stepResultOffset + bodySectionSize + sizeof(uint32_t) + StepResponseActivationEvents.size() * ActivationEventRecordSize + contactEventSectionSize);
+	WriteLittleEndian<uint32_t>(outStepResult.data() + stepResultOffset, (uint32_t)StepResponseSnapshot.GetBodyCount());
+
+	char* bodyRecord = outStepResult.data() + stepResultOffset + sizeof(uint32_t);
+	bodyRecord = (StepEncoding == EStepEncoding::Quantized) ? WriteQuantizedBodyRecords(bodyRecord) : WriteFloatBodyRecords(bodyRecord);
+
+	WriteLittleEndian<uint32_t>(bodyRecord, (uint32_t)StepResponseActivationEvents.size());
+
+	char* activationEventRecord = bodyRecord + sizeof(uint32_t);
+	for(const BodyActivationEvent& activationEvent : StepResponseActivationEvents)
+	{
+		WriteLittleEndian<uint32_t>(activationEventRecord, activationEvent.Body.GetIndex());
+		activationEventRecord[4] = static_cast<char>(activationEvent.Type);
+
+		activationEventRecord += ActivationEventRecordSize;
+	}
+
+	if(ContactEventConfiguration.bIsEnabled)
+	{
+		WriteBinaryContactEvents(activationEventRecord);
+	}
+}
+
+void PhysicsServiceImpl::WriteBinaryContactEvents(char* contactEventSection) const
+{
+	using namespace PhysicsServiceProtocol;
+
+	WriteLittleEndian<uint32_t>(contactEventSection, (uint32_t)StepResponseContactEvents.size());
+	WriteLittleEndian<uint32_t>(contactEventSection + 4, StepResponseDroppedContactEventCount);
+
+	char* contactEventRecord = contactEventSection + 2 * sizeof(uint32_t);
+	for(const ContactEvent& contactEvent : StepResponseContactEvents)
+	{
+		WriteLittleEndian<uint32_t>(contactEventRecord, contactEvent.Body1.GetIndex());
+		WriteLittleEndian<uint32_t>(contactEventRecord + 4, contactEvent.Body2.GetIndex());
+		contactEventRecord[8] = static_cast<char>(contactEvent.Type);
+		WriteLittleEndian<float>(contactEventRecord + 9, contactEvent.ImpactImpulse);
+		WriteLittleEndian<float>(contactEventRecord + 13, (float)contactEvent.Position.GetX());
+		WriteLittleEndian<float>(contactEventRecord + 17, (float)contactEvent.Position.GetY());
+		WriteLittleEndian<float>(contactEventRecord + 21, (float)contactEvent.Position.GetZ());
+		WriteLittleEndian<float>(contactEventRecord + 25, contactEvent.Normal.GetX());
+		WriteLittleEndian<float>(contactEventRecord + 29, contactEvent.Normal.GetY());
+		WriteLittleEndian<float>(contactEventRecord + 33, contactEvent.Normal.GetZ());
+
+		contactEventRecord += ContactEventRecordSize;
+	}
+}
+
+char* PhysicsServiceImpl::WriteFloatBodyRecords(char* bodyRecord) const
+{
+	using namespace PhysicsServiceProtocol;
+
+	for(size_t i = 0; i < StepResponseSnapshot.GetBodyCount(); ++i)
+	{
+		// Output current position (center of mass, same as the text protocol) and rotation of the body
+		const RVec3& position = StepResponseSnapshot.Positions[i];
+		const Quat& rotation = StepResponseSnapshot.Rotations[i];
+
+		WriteLittleEndian<uint32_t>(bodyRecord, StepResponseSnapshot.BodyIds[i].GetIndex());
+		WriteLittleEndian<float>(bodyRecord + 4, (float)position.GetX());
+		WriteLittleEndian<float>(bodyRecord + 8, (float)position.GetY());
+		WriteLittleEndian<float>(bodyRecord + 12, (float)position.GetZ());
+		WriteLittleEndian<float>(bodyRecord + 16, rotation.GetX());
+		WriteLittleEndian<float>(bodyRecord + 20, rotation.GetY());
+		WriteLittleEndian<float>(bodyRecord + 24, rotation.GetZ());
+		WriteLittleEndian<float>(bodyRecord + 28, rotation.GetW());
+
+		bodyRecord += BodyTransformRecordSize;
+	}
+
+	return bodyRecord;
+}
+
+char* PhysicsServiceImpl::WriteQuantizedBodyRecords(char* bodyRecord) const
+{
+	using namespace PhysicsServiceProtocol;
+
+	// The measured error is written before the records, once we know it
+	char* measuredErrorRecord = bodyRecord;
+	bodyRecord += 2 * sizeof(float);
+
+	float maxPositionError = 0.f;
+	float maxRotationError = 0.f;
+	for(size_t i = 0; i < StepResponseSnapshot.GetBodyCount(); ++i)
+	{
+		WriteLittleEndian<uint32_t>(bodyRecord, StepResponseSnapshot.BodyIds[i].GetIndex());
+		bodyRecord += sizeof(uint32_t);
+
+		maxPositionError = std::max(maxPositionError, StepTransformQuantizer.EncodePosition(StepResponseSnapshot.Positions[i], bodyRecord));
+		bodyRecord += StepTransformQuantizer.GetPositionBytes();
+
+		maxRotationError = std::max(maxRotationError, StepTransformQuantizer.EncodeRotation(StepResponseSnapshot.Rotations[i], bodyRecord));
+		bodyRecord += StepTransformQuantizer.GetRotationBytes();
+	}
+
+	WriteLittleEndian<float>(measuredErrorRecord, maxPositionError);
+	WriteLittleEndian<float>(measuredErrorRecord + sizeof(float), maxRotationError);
+
+	return bodyRecord;
+}
+
+bool PhysicsServiceImpl::SetStepEncoding(EStepEncoding newStepEncoding, const TransformQuantizationSettings& quantizationSettings)
+{
+	if(newStepEncoding == EStepEncoding::Quantized && !StepTransformQuantizer.Configure(quantizationSettings))
+	{
+		return false;
+	}
+
+	StepEncoding = newStepEncoding;
+	return true;
+}
+
+bool PhysicsServiceImpl::SaveWorldState(uint32 stateSlot)
+{
+	JPH_PROFILE_FUNCTION();
+
+	if(!bIsInitialized || stateSlot >= cMaxWorldStateSlots)
+	{
+		return false;
+	}
+
+	// The bodies may still be moving on the pipeline thread
+	FinishPipelinedStep();
+
+	SavedWorldState& savedWorldState = SavedWorldStates[stateSlot];
+	if(bIsNextStepSimulated)
+	{
+		// The world the game saw is the one before the step simulated ahead. That step's settings may not be
+		// the ones of the step after the restore, so it isn't saved.
+		savedWorldState.StateBuffer.CopyFrom(PipelinedStepStartState);
+	}
+	else
+	{
+		savedWorldState.StateBuffer.BeginWrite();
+		savedWorldState.StateBuffer.Reserve((BodyIdList.size() + 1) * cEstimatedStateBytesPerBody);
+		physics_system->SaveState(savedWorldState.StateBuffer);
+	}
+
+	savedWorldState.bIsValid = true;
+	return true;
+}
+
+bool PhysicsServiceImpl::RestoreWorldState(uint32 stateSlot)
+{
+	JPH_PROFILE_FUNCTION();
+
+	if(!bIsInitialized || stateSlot >= cMaxWorldStateSlots || !SavedWorldStates[stateSlot].bIsValid)
+	{
+		return false;
+	}
+
+	FinishPipelinedStep();
+
+	SavedWorldState& savedWorldState = SavedWorldStates[stateSlot];
+	savedWorldState.StateBuffer.BeginRead();
+	if(!physics_system->RestoreState(savedWorldState.StateBuffer))
+	{
+		std::cout << "Error on restoring the world state of slot " << stateSlot << ": it doesn't match the bodies of the world\n";
+		return false;
+	}
+
+	// A step simulated ahead of the current world is obsolete
+	bIsNextStepSimulated = false;
+
+	// The sleep / wake and contact events of the steps that were rewound don't apply anymore, and the game needs the whole restored world
+	body_activation_listener->ClearActivationEvents();
+	contact_listener->ClearContactEvents();
+	bNeedsFullStepResponse = true;
+	return true;
+}
+
+size_t PhysicsServiceImpl::GetSavedWorldStateSize(uint32 stateSlot) const
+{
+	return stateSlot < cMaxWorldStateSlots && SavedWorldStates[stateSlot].bIsValid ? SavedWorldStates[stateSlot].StateBuffer.GetSize() : 0;
+}
+
+bool PhysicsServiceImpl::QueueSpawnBodies(std::vector<ActorInitializationInfo>& spawnActors)
+{
+	return bIsInitialized && BodyCommands.QueueSpawns(spawnActors);
+}
+
+bool PhysicsServiceImpl::QueueDespawnBodies(const std::vector<uint32>& actorIds)
+{
+	return bIsInitialized && BodyCommands.QueueDespawns(actorIds);
+}
+
+bool PhysicsServiceImpl::QueueSetBodyVelocities(const std::vector<BodyVelocityCommand>& velocityCommands)
+{
+	return bIsInitialized && BodyCommands.QueueVelocities(velocityCommands);
+}
+
+bool PhysicsServiceImpl::QueueAddBodyImpulses(const std::vector<BodyImpulseCommand>& impulseCommands)
+{
+	return bIsInitialized && BodyCommands.QueueImpulses(impulseCommands);
+}
+
+void PhysicsServiceImpl::ApplyBodyCommands()
+{
+	if(BodyCommands.IsEmpty())
+	{
+		return;
+	}
+
+	JPH_PROFILE_FUNCTION();
+
+	// Despawns first (their ids are still reserved, no spawn of the batch uses them), the whole batch in one broadphase removal
+	const bool bChangesBodies = !BodyCommands.GetDespawns().empty() || !BodyCommands.GetSpawns().empty();
+	if(!BodyCommands.GetDespawns().empty())
+	{
+		// RemoveBodies reorders the ids it's given
+		DespawnBodyIds.assign(BodyCommands.GetDespawns().begin(), BodyCommands.GetDespawns().end());
+		body_interface->RemoveBodies(DespawnBodyIds.data(), (int)DespawnBodyIds.size());
+		body_interface->DestroyBodies(DespawnBodyIds.data(), (int)DespawnBodyIds.size());
+
+		for(const BodyID& bodyId : DespawnBodyIds)
+		{
+			LastSentBodyTransforms[bodyId.GetIndex()].bIsActor = false;
+		}
+		BodyIdList.erase(
+			std::remove_if(BodyIdList.begin(), BodyIdList.end(), [this](const BodyID& bodyId)
+			{
+				return !LastSentBodyTransforms[bodyId.GetIndex()].bIsActor;
+			}),
+			BodyIdList.end());
+	}
+
+	// Created on the job system and inserted in prepared batches like the actors of the Init. The broadphase isn't optimized again:
+	// the new nodes go into its trees, which the following updates rebuild in the background.
+	const std::vector<ActorInitializationInfo>& spawnActors = BodyCommands.GetSpawns();
+	if(!spawnActors.empty())
+	{
+		const size_t firstSpawnedActorIndex = BodyIdList.size();
+		AddActorBodies(spawnActors);
+
+		for(size_t i = firstSpawnedActorIndex; i < BodyIdList.size(); ++i)
+		{
+			const BodyID& bodyId = BodyIdList[i];
+			if(bodyId.GetIndex() >= LastSentBodyTransforms.size())
+			{
+				LastSentBodyTransforms.resize(bodyId.GetIndex() + 1);
+			}
+			LastSentBodyTransforms[bodyId.GetIndex()] = SentBodyTransform();
+			LastSentBodyTransforms[bodyId.GetIndex()].bIsActor = true;
+			SpawnedActorBodyIds.push_back(bodyId);
+		}
+		std::sort(SpawnedActorBodyIds.begin(), SpawnedActorBodyIds.end(), IsBodyIndexLess);
+
+		// The ids of the bodies that couldn't be created (e.g. an unknown cached shape) are free again
+		for(const ActorInitializationInfo& spawnActor : spawnActors)
+		{
+			const uint32 actorIndex = (uint32)spawnActor.ActorId;
+			if(actorIndex >= LastSentBodyTransforms.size() || !LastSentBodyTransforms[actorIndex].bIsActor)
+			{
+				BodyCommands.ReleaseFailedSpawn(spawnActor.ActorId);
+			}
+		}
+		BodyCommands.DropOrphanedCommands();
+	}
+
+	// Nothing else touches the bodies between two steps, no need to lock them (see SnapshotBodyStates).
+	// The queue dropped the commands of the actors that are gone, but a command without a body is skipped rather than trusted:
+	// the body interface asserts on (and dereferences) a missing body.
+	const BodyLockInterfaceNoLock& bodyLockInterfaceNoLock = physics_system->GetBodyLockInterfaceNoLock();
+	BodyInterface& bodyInterfaceNoLock = physics_system->GetBodyInterfaceNoLock();
+	for(const BodyVelocityCommand& velocityCommand : BodyCommands.GetVelocities())
+	{
+		const BodyID bodyId(velocityCommand.ActorId);
+		{
+			BodyLockWrite bodyLock(bodyLockInterfaceNoLock, bodyId);
+			if(!bodyLock.Succeeded())
+			{
+				continue;
+			}
+		}
+
+		// Wakes the body up, static bodies are left alone
+		bodyInterfaceNoLock.SetLinearAndAngularVelocity(bodyId,
+			Vec3(velocityCommand.LinearVelocity[0], velocityCommand.LinearVelocity[1], velocityCommand.LinearVelocity[2]),
+			Vec3(velocityCommand.AngularVelocity[0], velocityCommand.AngularVelocity[1], velocityCommand.AngularVelocity[2]));
+	}
+	for(const BodyImpulseCommand& impulseCommand : BodyCommands.GetImpulses())
+	{
+		// Only dynamic bodies have a mass to push (Body::AddImpulse asserts on the others)
+		const BodyID bodyId(impulseCommand.ActorId);
+		{
+			BodyLockWrite bodyLock(bodyLockInterfaceNoLock, bodyId);
+			if(!bodyLock.Succeeded() || !bodyLock.GetBody().IsDynamic())
+			{
+				continue;
+			}
+
+			Body& body = bodyLock.GetBody();
+			body.AddImpulse(Vec3(impulseCommand.Impulse[0], impulseCommand.Impulse[1], impulseCommand.Impulse[2]));
+			body.AddAngularImpulse(Vec3(impulseCommand.AngularImpulse[0], impulseCommand.AngularImpulse[1], impulseCommand.AngularImpulse[2]));
+		}
+
+		// Outside of the lock: activating takes it again
+		bodyInterfaceNoLock.ActivateBody(bodyId);
+	}
+
+	// A saved state only restores the bodies it was saved with
+	if(bChangesBodies)
+	{
+		for(SavedWorldState& savedWorldState : SavedWorldStates)
+		{
+			savedWorldState.bIsValid = false;
+		}
+	}
+
+	BodyCommands.EndBatch();
+}
+
+bool PhysicsServiceImpl::RunSceneQueryBatch(const std::vector<SceneQuery>& sceneQueries)
+{
+	JPH_PROFILE_FUNCTION();
+
+	if(!bIsInitialized || sceneQueries.size() > cMaxSceneQueries)
+	{
+		return false;
+	}
+	for(const SceneQuery& sceneQuery : sceneQueries)
+	{
+		if(!sceneQuery.IsValid())
+		{
+			return false;
+		}
+	}
+
+	// The bodies may still be moving on the pipeline thread
+	FinishPipelinedStep();
+
+	SceneQueries.Run(*physics_system, *job_system, sceneQueries);
+	return true;
+}
+
+bool PhysicsServiceImpl::RunSceneQueries(const std::vector<SceneQuery>& sceneQueries, std::vector<char>& outQueryResult)
+{
+	if(!RunSceneQueryBatch(sceneQueries))
+	{
+		return false;
+	}
+
+	// Make room for the worst case and give back what wasn't used, like the step responses
+	const size_t queryResultOffset = outQueryResult.size();
+	outQueryResult.resize(queryResultOffset + SceneQueries.GetTotalHitCount() * cMaxTextSceneQueryHitLength);
+	char* queryResult = outQueryResult.data() + queryResultOffset;
+	char* const queryResultEnd = outQueryResult.data() + outQueryResult.size();
+
+	// "Hit;<query index>;id;fraction;x;y;z;nx;ny;nz\n" per hit, queries without hits have no line
+	for(size_t queryIndex = 0; queryIndex < SceneQueries.GetQueryCount(); ++queryIndex)
+	{
+		const SceneQueryHit* queryHits = SceneQueries.GetHits(queryIndex);
+		for(uint32 i = 0; i < SceneQueries.GetHitCount(queryIndex); ++i)
+		{
+			const SceneQueryHit& queryHit = queryHits[i];
+			std::memcpy(queryResult, "Hit;", 4);
+			queryResult = std::to_chars(queryResult + 4, queryResultEnd, queryIndex).ptr;
+			*queryResult++ = ';';
+			queryResult = std::to_chars(queryResult, queryResultEnd, queryHit.Body.GetIndex()).ptr;
+			*queryResult++ = ';';
+			queryResult = WriteTextFloat(queryResult, queryResultEnd, (double)queryHit.Fraction, ';');
+			queryResult = WriteTextFloat(queryResult, queryResultEnd, (double)queryHit.Position.GetX(), ';');
+			queryResult = WriteTextFloat(queryResult, queryResultEnd, (double)queryHit.Position.GetY(), ';');
+			queryResult = WriteTextFloat(queryResult, queryResultEnd, (double)queryHit.Position.GetZ(), ';');
+			queryResult = WriteTextFloat(queryResult, queryResultEnd, (double)queryHit.Normal.GetX(), ';');
+			queryResult = WriteTextFloat(queryResult, queryResultEnd, (double)queryHit.Normal.GetY(), ';');
+			queryResult = WriteTextFloat(queryResult, queryResultEnd, (double)queryHit.Normal.GetZ(), '\n');
+		}
+	}
+
+	outQueryResult.resize(queryResult - outQueryResult.data());
+	return true;
+}
+
+bool PhysicsServiceImpl::RunSceneQueriesBinary(const std::vector<SceneQuery>& sceneQueries, std::vector<char>& outQueryResult)
+{
+	using namespace PhysicsServiceProtocol;
+
+	if(!RunSceneQueryBatch(sceneQueries))
+	{
+		return false;
+	}
+
+	// uint32 query count, then per query: uint8 hit count followed by its hit records
+	const size_t queryResultOffset = outQueryResult.size();
+	outQueryResult.resize(queryResultOffset + sizeof(uint32_t) + SceneQueries.GetQueryCount() + SceneQueries.GetTotalHitCount() * SceneQueryHitRecordSize);
+	WriteLittleEndian<uint32_t>(outQueryResult.data() + queryResultOffset, (uint32_t)SceneQueries.GetQueryCount());
+
+	char* queryHitRecord = outQueryResult.data() + queryResultOffset + sizeof(uint32_t);
+	for(size_t queryIndex = 0; queryIndex < SceneQueries.GetQueryCount(); ++queryIndex)
+	{
+		const uint32 hitCount = SceneQueries.GetHitCount(queryIndex);
+		*queryHitRecord++ = (char)hitCount;
+
+		const SceneQueryHit* queryHits = SceneQueries.GetHits(queryIndex);
+		for(uint32 i = 0; i < hitCount; ++i)
+		{
+			const SceneQueryHit& queryHit = queryHits[i];
+			WriteLittleEndian<uint32_t>(queryHitRecord, queryHit.Body.GetIndex());
+			WriteLittleEndian<float>(queryHitRecord + 4, queryHit.Fraction);
+			WriteLittleEndian<float>(queryHitRecord + 8, (float)queryHit.Position.GetX());
+			WriteLittleEndian<float>(queryHitRecord + 12, (float)queryHit.Position.GetY());
+			WriteLittleEndian<float>(queryHitRecord + 16, (float)queryHit.Position.GetZ());
+			WriteLittleEndian<float>(queryHitRecord + 20, queryHit.Normal.GetX());
+			WriteLittleEndian<float>(queryHitRecord + 24, queryHit.Normal.GetY());
+			WriteLittleEndian<float>(queryHitRecord + 28, queryHit.Normal.GetZ());
+
+			queryHitRecord += SceneQueryHitRecordSize;
+		}
+	}
+	return true;
+}
+
+bool PhysicsServiceImpl::SetContactEventSettings(const ContactEventSettings& newContactEventSettings)
+{
+	if(!newContactEventSettings.IsValid())
+	{
+		return false;
+	}
+
+	ContactEventConfiguration = newContactEventSettings;
+	if(bIsInitialized)
+	{
+		ConfigureContactListener();
+	}
+	return true;
+}
+
+void PhysicsServiceImpl::ConfigureContactListener()
+{
+	// The callbacks read the settings while a step is simulated ahead
+	FinishPipelinedStep();
+
+	// A buffer per job system thread, plus one: with pipelined stepping the steps of a response may have been updated from two different threads
+	contact_listener->Configure(ContactEventConfiguration, (uint)job_system->GetMaxConcurrency() + 1);
+
+	// Without a listener, Jolt doesn't call back for every contact
+	physics_system->SetContactListener(ContactEventConfiguration.bIsEnabled ? contact_listener : nullptr);
+
+	StepResponseContactEvents.clear();
+	StepResponseDroppedContactEventCount = 0;
+}
+
+void PhysicsServiceImpl::ClearPhysicsSystem()
+{
+    std::cout << "Cleaing physics system...\n";
+
+	FinishPipelinedStep();
+	bIsNextStepSimulated = false;
+
+	for(auto& bodyId : BodyIdList)
+	{
+    	// Remove the sphere from the physics system. Note that the sphere itself keeps all of its state and can be re-added at any time.
+		body_interface->RemoveBody(bodyId);
+
+		// Destroy the sphere. After this the sphere ID is no longer valid.
+		body_interface->DestroyBody(bodyId);
+	}
+
+	// Remove and destroy the floor
+	body_interface->RemoveBody(floor_id);
+	body_interface->DestroyBody(floor_id);
+
+	BodyIdList.clear();
 
-	if(contact_listener) delete contact_listener;
 	if(physics_system) delete physics_system;
+	physics_system = nullptr;
+	body_interface = nullptr;
 
 	bIsInitialized = false;
 
-    std::cout << "Physics system was cleared. Exiting process...\n";
+    std::cout << "Physics system was cleared.\n";
 }
@@ -1,13 +1,26 @@
 #ifndef PHYSICSSERVICEIMPL_H
 #define PHYSICSSERVICEIMPL_H
 
+#include <array>
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <mutex>
 
+#include "ActorInitializationParser.h"
+#include "BodyCommandQueue.h"
 #include "BPLayerInterfaceImpl.h"
 #include "MyBodyActivationListener.h"
 #include "MyContactListener.h"
 #include "ObjectLayerPairFilterImpl.h"
 #include "ObjectVsBroadPhaseLayerFilterImpl.h"
+#include "PhysicsStepPipeline.h"
+#include "RotationConversion.h"
+#include "SceneQueryBatch.h"
+#include "ShapeCache.h"
+#include "TransformQuantization.h"
+#include "WorkStealingJobSystem.h"
+#include "WorldStateBuffer.h"
 
 #include <Jolt/RegisterTypes.h>
 #include <Jolt/Core/Factory.h>
@@ -17,23 +30,353 @@
 #include <Jolt/Physics/PhysicsSystem.h>
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
 #include <Jolt/Physics/Collision/Shape/SphereShape.h>
+#include <Jolt/Physics/Collision/Shape/ConvexHullShape.h>
+#include <Jolt/Physics/Collision/Shape/MeshShape.h>
 #include <Jolt/Physics/Body/BodyCreationSettings.h>
 #include <Jolt/Physics/Body/BodyActivationListener.h>
 
 // Disable common warnings triggered by Jolt, you can use JPH_SUPPRESS_WARNING_PUSH / JPH_SUPPRESS_WARNING_POP to store and restore the warning state
 JPH_SUPPRESS_WARNINGS
 
+// Which bodies a step response contains
+enum class EStepResponseMode : uint8
+{
+	// Every body, every step (default)
+	Full = 0,
+
+	// Only awake bodies that moved or rotated past a threshold since they were last sent, plus sleep / wake events
+	Delta = 1
+};
+
+// How body transforms are encoded in binary step responses
+enum class EStepEncoding : uint8
+{
+	// Floats: position + rotation quaternion (default)
+	Float = 0,
+
+	// Fixed point position relative to the world bounds + smallest-three rotation (see TransformQuantizer)
+	Quantized = 1
+};
+
+// Several steps in one command (MultiStep), e.g. to catch up after a stall or to replay on the server
+struct StepCommand
+{
+	// We simulate the physics world in discrete time steps. 60 Hz is a good rate to update the physics system.
+	float DeltaTime = 1.0f / 60.f;
+	uint32 StepCount = 1;
+
+	// Collision steps per step, 0 = one per 1 / 60th of a second of DeltaTime (rounded up)
+	uint32 CollisionSteps = 0;
+
+	// Integration sub steps per collision step
+	uint32 IntegrationSubSteps = 1;
+
+	// Also respond with the state after every FrameInterval steps. 0 = only the state after the last step.
+	uint32 FrameInterval = 0;
+
+	static constexpr float cMaxDeltaTime = 1.f;
+	static constexpr uint32 cMaxStepCount = 3600;
+	static constexpr uint32 cMaxCollisionSteps = 64;
+
+	// Jolt's limit (PhysicsUpdateContext::cMaxSubSteps)
+	static constexpr uint32 cMaxIntegrationSubSteps = 4;
+
+	bool IsValid() const;
+
+	// Frames of the response: one per FrameInterval steps, plus the final state
+	uint32 GetFrameCount() const;
+};
+
+enum class EInterestRegionShape : uint8
+{
+	Box = 0,
+	Sphere = 1
+};
+
+// Part of the world a client subscribed to (see PhysicsServiceImpl::SetInterestRegions), e.g. around the player camera
+struct InterestRegion
+{
+	EInterestRegionShape Shape = EInterestRegionShape::Box;
+
+	// Box corners, in world units
+	float BoxMin[3] = { 0.f, 0.f, 0.f };
+	float BoxMax[3] = { 0.f, 0.f, 0.f };
+
+	float SphereCenter[3] = { 0.f, 0.f, 0.f };
+	float SphereRadius = 0.f;
+
+	bool IsValid() const;
+};
+
+// Time the last Step / MultiStep spent in each of its phases (summed over the steps and frames of a MultiStep)
+struct StepPhaseDurations
+{
+	// PhysicsSystem::Update. With pipelined stepping, the step that was simulated ahead.
+	std::chrono::steady_clock::duration Update = std::chrono::steady_clock::duration::zero();
+
+	// Gathering the step response bodies into StepResponseSnapshot
+	std::chrono::steady_clock::duration Snapshot = std::chrono::steady_clock::duration::zero();
+
+	// Writing the step response
+	std::chrono::steady_clock::duration Serialize = std::chrono::steady_clock::duration::zero();
+};
+
+// Transform of a body as it was last sent to the game (delta response mode)
+struct SentBodyTransform
+{
+	RVec3 Position = RVec3::sZero();
+	Quat Rotation = Quat::sIdentity();
+	bool bIsActor = false;
+
+	// Last delta response the body was gathered into (see PhysicsServiceImpl::StepResponseGeneration)
+	uint32 GatheredStepResponse = 0;
+};
+
+// State of a set of bodies, copied out of the physics system in one go (structure of arrays: entry i of
+// every array belongs to BodyIds[i]). Step responses are serialized from it, so they can be written
+// while the next step is simulated.
+struct BodyStateSnapshot
+{
+	std::vector<BodyID> BodyIds;
+	std::vector<RVec3> Positions;
+	std::vector<Quat> Rotations;
+	std::vector<Vec3> LinearVelocities;
+	std::vector<Vec3> AngularVelocities;
+
+	size_t GetBodyCount() const { return BodyIds.size(); }
+
+	// Resizes every array. Doesn't allocate once the snapshot held bodyCount bodies before.
+	void Resize(size_t bodyCount);
+};
+
+// World saved by PhysicsServiceImpl::SaveWorldState
+struct SavedWorldState
+{
+	// PhysicsSystem::SaveState: bodies (transforms, velocities, sleep timers), contact cache and constraints
+	WorldStateBuffer StateBuffer;
+
+	// Saved since the last Init
+	bool bIsValid = false;
+};
+
 // Logic and data behind the server's behavior.
 class PhysicsServiceImpl
 {
 
 public:
-    void InitPhysicsSystem(const std::string initializationActorsInfo);
-    std::string StepPhysicsSimulation();
+	// Jolt's allocator, factory and registered types are process wide. Initialize them once before
+	// creating any PhysicsServiceImpl and shut them down after the last one was destroyed.
+	static void InitializeJoltRuntime();
+	static void ShutdownJoltRuntime();
+
+	// Shapes shared by the bodies of every session (created by InitializeJoltRuntime)
+	static ShapeCache& GetShapeCache() { return *SharedShapeCache; }
+
+	~PhysicsServiceImpl();
+
+	// Text protocol: "Init\n" followed by one "id;x;y;z[;key=value...]" line per actor and a final "EndMessage" line
+	// (see ActorInitializationParser to parse the message as it arrives)
+    void InitPhysicsSystem(const std::string& initializationActorsInfo);
+
+	// Binary protocol: uint32 actor count followed by packed InitActorRecords (see PhysicsServiceProtocol.h)
+	// Returns false if the payload is malformed
+	bool InitPhysicsSystemFromBinary(const char* initializationPayload, uint32 initializationPayloadLength);
+
+	// Binary protocol: shape name table followed by packed InitDescribedActorRecords (see PhysicsServiceProtocol.h)
+	// Returns false if the payload is malformed
+	bool InitPhysicsSystemFromDescribedBinary(const char* initializationPayload, uint32 initializationPayloadLength);
+
+	// Binary protocol: shape name table followed by packed InitDescribedActorRecords, the payload of InitDescribed and SpawnBodies
+	// (see PhysicsServiceProtocol.h). Returns false if the payload is malformed or an actor is invalid (see ActorInitializationParser::ValidateActor).
+	static bool ParseDescribedActorsFromBinary(const char* actorsPayload, uint32 actorsPayloadLength, std::vector<ActorInitializationInfo>& outActors);
+
+	// Binary protocol: builds a convex hull or triangle mesh (see PhysicsServiceProtocol::EOpcode::DefineShape) and registers it
+	// under its name for this service only (see DefinedShapes). Returns false if the payload is malformed or the shape can't be built.
+	bool DefineShapeFromBinary(const char* shapePayload, uint32 shapePayloadLength, uint32& outShapeMemorySize);
+
+	// Creates the world (floor + one body per actor)
+	void InitPhysicsSystem(const std::vector<ActorInitializationInfo>& initializationActors);
+
+	// Text protocol: one "id;x;y;z;rx;ry;rz" line per body. Appended to outStepResult.
+    void StepPhysicsSimulation(std::vector<char>& outStepResult);
+
+	// Binary protocol: uint32 body count followed by packed BodyTransformRecords, then uint32 activation
+	// event count followed by packed ActivationEventRecords (see PhysicsServiceProtocol.h). Appended to outStepResult.
+	// Both steps end with the contact events when they are enabled (see SetContactEventSettings).
+	// Neither step allocates once outStepResult has grown to the size of a response.
+	void StepPhysicsSimulationBinary(std::vector<char>& outStepResult);
+
+	// Runs stepCommand.StepCount steps and appends the frames of the command (see StepCommand::FrameInterval).
+	// Text: per frame "Frame;<completed steps>\n" followed by the lines of a Step response.
+	// Binary: uint32 frame count, then per frame uint32 completed steps followed by a binary Step response.
+	// With pipelined stepping the step simulated ahead is the first step if it was simulated with the command's delta time,
+	// collision steps and sub steps (the ones of the previous Step / MultiStep). Otherwise it is rolled back and simulated again.
+	// Returns false (without stepping) before Init or if the command is out of range.
+	bool StepPhysicsSimulationMulti(const StepCommand& stepCommand, std::vector<char>& outStepResult);
+	bool StepPhysicsSimulationMultiBinary(const StepCommand& stepCommand, std::vector<char>& outStepResult);
+
+	// Selects which bodies the following step responses contain. Switching modes makes the next
+	// response contain every body, so the game starts from a complete state.
+	// positionThreshold is in world units, rotationThreshold in radians. Returns false (keeping the current mode)
+	// if a threshold is negative or not finite.
+	bool SetStepResponseMode(EStepResponseMode newStepResponseMode, float positionThreshold, float rotationThreshold);
+
+	// Selects how binary step responses encode body transforms. Returns false if the quantization settings are invalid.
+	bool SetStepEncoding(EStepEncoding newStepEncoding, const TransformQuantizationSettings& quantizationSettings);
+
+	const TransformQuantizer& GetTransformQuantizer() const { return StepTransformQuantizer; }
+
+	// Copies the center of mass position, rotation and velocities of the bodies into outSnapshot (resized to bodyCount).
+	// Bodies are read through the non locking interface: the service only touches the physics system from one thread
+	// at a time, so taking a body mutex per read only costs time. Large counts are split across the job system.
+	// Bodies that don't exist keep their id with a zero state.
+	void SnapshotBodyStates(const BodyID* bodyIds, size_t bodyCount, BodyStateSnapshot& outSnapshot);
+
+	// Bodies of the last step response
+	const BodyStateSnapshot& GetStepResponseSnapshot() const { return StepResponseSnapshot; }
+
+	// Pipelined stepping (off by default): once a step response was gathered, the next step is simulated on a
+	// background thread while the response is serialized and sent, and the next Step only waits for it to finish.
+	// Trade-off: the world is always one step ahead of the last response, so anything the game changes between
+	// two Steps takes effect one step later than with sequential stepping.
+	void SetPipelinedStepping(bool bEnablePipelinedStepping) { bIsPipelinedStepping = bEnablePipelinedStepping; }
+	bool IsPipelinedStepping() const { return bIsPipelinedStepping; }
+
+	const StepPhaseDurations& GetLastStepPhaseDurations() const { return LastStepPhaseDurations; }
+
+	// Job system of the worlds created by the following Inits (the current world keeps its job system)
+	void SetJobSystemSettings(const JobSystemSettings& newJobSystemSettings);
+	const JobSystemSettings& GetJobSystemSettings() const { return JobSystemConfiguration; }
+
+	// Selects the contact events the following step responses end with (none by default). Text: one
+	// "Contact<Added|Persisted|Removed>;id1;id2;impulse;x;y;z;nx;ny;nz" line per event, then "ContactsDropped;count" if some didn't fit.
+	// Binary: uint32 event count, uint32 dropped event count, packed ContactEventRecords (see PhysicsServiceProtocol.h).
+	// Applies from the next simulated step. Returns false if the settings are out of range.
+	bool SetContactEventSettings(const ContactEventSettings& newContactEventSettings);
+	const ContactEventSettings& GetContactEventSettings() const { return ContactEventConfiguration; }
+
+	// Subscribes the step responses to the actors inside newInterestRegions (at most cMaxInterestRegions), found through a broadphase
+	// query: the responses (Full or Delta mode) only contain those, and the body events tell which actors entered or left the regions
+	// ("Enter;id" / "Leave;id" text lines, EBodyActivationEventType::EnterInterestRegion / LeaveInterestRegion records), in either
+	// response mode. An empty list ends the subscription: the next response contains every body again.
+	// Returns false if a region is invalid or there are too many.
+	bool SetInterestRegions(const std::vector<InterestRegion>& newInterestRegions);
+	const std::vector<InterestRegion>& GetInterestRegions() const { return InterestRegions; }
+
+	static constexpr uint32 cMaxInterestRegions = 16;
+
+	// Runs a batch of gameplay traces (raycasts, shape casts, overlaps, see SceneQuery) against the world, spread over the job system.
+	// Text: one "Hit;<query index>;id;fraction;x;y;z;nx;ny;nz" line per hit. Binary: uint32 query count, then per query
+	// uint8 hit count followed by hit count SceneQueryHitRecords (see PhysicsServiceProtocol.h). Appended to outQueryResult.
+	// The queries see the world of the last step response. With pipelined stepping they wait for the step simulated ahead and see that one.
+	// Returns false (without running any query) before Init, if a query is invalid or if there are more than cMaxSceneQueries.
+	bool RunSceneQueries(const std::vector<SceneQuery>& sceneQueries, std::vector<char>& outQueryResult);
+	bool RunSceneQueriesBinary(const std::vector<SceneQuery>& sceneQueries, std::vector<char>& outQueryResult);
+
+	static constexpr uint32 cMaxSceneQueries = 4096;
+
+	// Saves the world into stateSlot (0 - cMaxWorldStateSlots - 1), e.g. at the start of a round. The slot's buffer is kept:
+	// saving the same world again doesn't allocate. Returns false if there's no world or the slot is out of range.
+	bool SaveWorldState(uint32 stateSlot);
+
+	// Rewinds the world to the state saved into stateSlot. Keeps everything else (physics system, job system, temp allocator,
+	// shapes): a round restarts in a few milliseconds instead of a new Init. The next step response contains every body.
+	// Returns false if nothing was saved into the slot since the last Init or the state doesn't fit the world.
+	bool RestoreWorldState(uint32 stateSlot);
+
+	// Size of the state saved into stateSlot in bytes, 0 if there is none
+	size_t GetSavedWorldStateSize(uint32 stateSlot) const;
+
+	static constexpr uint32 cMaxWorldStateSlots = 4;
+
+	// Spawn / despawn actors and push them around during the match (see BodyCommandQueue). The commands are only queued: they are
+	// applied in one batch right before the next Step / MultiStep simulates, or with pipelined stepping on top of the step simulated ahead
+	// (whose response then shows the spawned and despawned actors, the velocities and impulses acting from the step after).
+	// Spawned actors are inserted in bulk without optimizing the broadphase again, and the next response contains them in either response
+	// mode. Spawning or despawning invalidates the saved states: a state only restores the bodies it was saved with.
+	// QueueSpawnBodies gives the actors with BodyCommandQueue::cAutoActorId a free id, recycling the ids of despawned actors.
+	// Return false (queueing nothing) before Init or if a command is invalid (see BodyCommandQueue).
+	bool QueueSpawnBodies(std::vector<ActorInitializationInfo>& spawnActors);
+	bool QueueDespawnBodies(const std::vector<uint32>& actorIds);
+	bool QueueSetBodyVelocities(const std::vector<BodyVelocityCommand>& velocityCommands);
+	bool QueueAddBodyImpulses(const std::vector<BodyImpulseCommand>& impulseCommands);
 
     void ClearPhysicsSystem();
 
 private:
+	JobSystem* CreateJobSystem() const;
+
+	// Applies ContactEventConfiguration to contact_listener, registering it only while contact events are enabled
+	void ConfigureContactListener();
+
+	// Creates the actor bodies in parallel on the job system and inserts them in batches. Fills BodyIdList.
+	void AddActorBodies(const std::vector<ActorInitializationInfo>& initializationActors);
+
+	// True if both actors describe the same shape
+	static bool HasSameShape(const ActorInitializationInfo& actorInfo, const ActorInitializationInfo& otherActorInfo);
+
+	// Shared shape of the actor's description, nullptr if it's invalid (e.g. an unknown cached shape).
+	// Named shapes are looked up in DefinedShapes first, then in the shape cache.
+	ShapeRefC GetActorShape(const ActorInitializationInfo& actorInfo);
+
+	// Advances the world by one step (one fixed 1 / 60 s step by default)
+	void UpdatePhysicsWorld(const StepCommand& stepCommand = StepCommand());
+
+	// Runs the steps of stepCommand, gathering the step response and calling writeFrame(completed steps) for every frame
+	template <class FrameWriter>
+	void RunStepCommand(const StepCommand& stepCommand, const FrameWriter& writeFrame);
+
+	// Appends the response of the gathered step bodies (see StepPhysicsSimulation / StepPhysicsSimulationBinary)
+	void WriteTextStepResponse(std::vector<char>& outStepResult);
+	void WriteBinaryStepResponse(std::vector<char>& outStepResult);
+
+	// Advances the world (or takes the step simulated ahead of time) and gathers the step response
+	void AdvanceStep();
+
+	// Applies the queued body commands (see QueueSpawnBodies). Only call at a step boundary, with no step simulated in the background.
+	void ApplyBodyCommands();
+
+	// Waits for the step simulated in the background, if any, before touching the physics system.
+	// The step is kept: the next step response uses it.
+	void FinishPipelinedStep();
+
+	// Simulates the next step with the settings of stepCommand on the pipeline thread
+	void StartPipelinedStep(const StepCommand& stepCommand);
+
+	// Step function of StepPipeline: saves the world into PipelinedStepStartState, then simulates a step with PipelinedStepSettings
+	void SimulatePipelinedStep();
+
+	// Waits for the step simulated in the background, if any. Returns true if it was simulated with the delta time, collision steps
+	// and sub steps of stepCommand: the caller takes it as its step. A step simulated with other settings is rolled back.
+	bool TakePipelinedStep(const StepCommand& stepCommand);
+
+	// Reads the bodies [firstBodyIndex, endBodyIndex) of the snapshot (its BodyIds are already set)
+	void SnapshotBodyStateRange(BodyStateSnapshot& ioSnapshot, size_t firstBodyIndex, size_t endBodyIndex) const;
+
+	// Fills StepResponseSnapshot, StepResponseActivationEvents and StepResponseContactEvents according to the current response mode
+	void GatherStepResponseBodies();
+
+	// Queries the actors inside the interest regions into InterestRegionBodyIds and adds their enter / leave events to
+	// StepResponseActivationEvents. The sleep / wake events of actors outside the regions are dropped.
+	void UpdateInterestRegionBodies();
+
+	// Returns true if the body moved / rotated past the delta thresholds since it was last sent
+	bool HasBodyTransformChanged(const SentBodyTransform& lastSentTransform, RVec3Arg position, QuatArg rotation) const;
+
+	// Writes value like "%f" followed by separator, returns the position after the separator
+	static char* WriteTextFloat(char* textOutput, char* textOutputEnd, double value, char separator);
+
+	// Writes the body records of StepResponseSnapshot, returns the position after the last written byte
+	char* WriteFloatBodyRecords(char* bodyRecord) const;
+	char* WriteQuantizedBodyRecords(char* bodyRecord) const;
+
+	// Validates and runs the batch into SceneQueries
+	bool RunSceneQueryBatch(const std::vector<SceneQuery>& sceneQueries);
+
+	// Writes the contact event lines / section of StepResponseContactEvents (see SetContactEventSettings)
+	char* WriteTextContactEvents(char* stepResult, char* stepResultEnd) const;
+	void WriteBinaryContactEvents(char* contactEventSection) const;
+
     // Callback for traces, connect this to your own trace function if you have one
     static void TraceImpl(const char *inFMT, ...)
     { 
@@ -61,6 +404,26 @@ private:
 
 #endif // JPH_ENABLE_ASSERTS
 
+private:
+	static ShapeCache* SharedShapeCache;
+
+	// Actors created per job on Init, below this creating the bodies costs less than scheduling the job
+	static constexpr size_t cMinActorsPerCreationJob = 256;
+
+	// Bodies read per job by SnapshotBodyStates, smaller snapshots are read on the calling thread
+	static constexpr size_t cMinBodiesPerSnapshotJob = 4096;
+
+	// First guess of the saved state size per body, so the first save doesn't grow the buffer step by step
+	static constexpr size_t cEstimatedStateBytesPerBody = 160;
+
+	// Longest text step response lines: "%f" of +-FLT_MAX is 47 characters, a body index at most 10
+	static constexpr size_t cMaxTextFloatLength = 48;
+	static constexpr size_t cMaxTextBodyRecordLength = 10 + 6 * (cMaxTextFloatLength + 1) + 1;
+	static constexpr size_t cMaxTextActivationEventLength = 6 + 10 + 1;
+	static constexpr size_t cMaxTextContactEventLength = 17 + 2 * (10 + 1) + 7 * (cMaxTextFloatLength + 1);
+	static constexpr size_t cMaxTextDroppedContactEventsLength = 16 + 10 + 1;
+	static constexpr size_t cMaxTextSceneQueryHitLength = 4 + 2 * (10 + 1) + 7 * (cMaxTextFloatLength + 1);
+
 public:
 	TempAllocator* temp_allocator = nullptr;
 	JobSystem* job_system = nullptr;
@@ -89,6 +452,87 @@ public:
     std::vector<BodyID> BodyIdList;
 
     bool bIsInitialized = false;
+
+private:
+	EStepResponseMode StepResponseMode = EStepResponseMode::Full;
+	float DeltaPositionThresholdSq = 0.1f * 0.1f;
+	float DeltaRotationThresholdCos = 0.9999969f; // cos(0.005 rad / 2)
+
+	EStepEncoding StepEncoding = EStepEncoding::Float;
+	TransformQuantizer StepTransformQuantizer;
+
+	// Set when the next response needs to contain every body (after Init or a mode switch)
+	bool bNeedsFullStepResponse = true;
+
+	// Indexed by BodyID::GetIndex()
+	std::vector<SentBodyTransform> LastSentBodyTransforms;
+
+	// Counts the gathered delta responses, so a body that is both awake and in an activation event is only sent once
+	uint32 StepResponseGeneration = 0;
+
+	std::vector<InterestRegion> InterestRegions;
+
+	// Actors inside the interest regions at the last / previous step response and the ones that just entered, sorted by index
+	std::vector<BodyID> InterestRegionBodyIds;
+	std::vector<BodyID> PreviousInterestRegionBodyIds;
+	std::vector<BodyID> EnteredInterestRegionBodyIds;
+
+	// Reused between steps
+	BodyIDVector ActiveBodyIds;
+	std::vector<BodyID> StepResponseBodyIds;
+	BodyStateSnapshot StepResponseSnapshot;
+	std::vector<BodyActivationEvent> StepResponseActivationEvents;
+	std::vector<ContactEvent> StepResponseContactEvents;
+	uint32 StepResponseDroppedContactEventCount = 0;
+
+	// Euler angles of StepResponseSnapshot.Rotations for the text protocol, converted in one batch (see ConvertRotationsToEulerAngles)
+	std::vector<float> StepResponseEulerAnglesX;
+	std::vector<float> StepResponseEulerAnglesY;
+	std::vector<float> StepResponseEulerAnglesZ;
+
+	JobSystemSettings JobSystemConfiguration;
+	bool bIsJobSystemOutdated = false;
+
+	ContactEventSettings ContactEventConfiguration;
+
+	StepPhaseDurations LastStepPhaseDurations;
+
+	std::array<SavedWorldState, cMaxWorldStateSlots> SavedWorldStates;
+
+	BodyCommandQueue BodyCommands;
+
+	// Actors spawned since the last step response, sorted by index: the next response sends them whether they moved or not
+	std::vector<BodyID> SpawnedActorBodyIds;
+
+	// Ids of the applied despawns, reused between batches
+	BodyIDVector DespawnBodyIds;
+
+	// Shapes of the DefineShape messages, by name. Kept per service rather than in the shared shape cache, so a session
+	// can't replace the shapes of another one (and a recording replays with the shapes it defined itself).
+	// Locked: spawns may look them up on the pipeline thread while the session defines new ones.
+	std::map<std::string, ShapeRefC> DefinedShapes;
+	mutable std::mutex DefinedShapesMutex;
+
+	// Results of the last scene query batch, reused between batches
+	SceneQueryBatch SceneQueries;
+
+	// Duration of the last UpdatePhysicsWorld. Written by the StepPipeline thread while a step is simulated ahead:
+	// only read once that step finished.
+	std::chrono::steady_clock::duration LastUpdateDuration = std::chrono::steady_clock::duration::zero();
+
+	bool bIsPipelinedStepping = false;
+
+	// Set while the step of the next response was already simulated (or is being simulated) by StepPipeline
+	bool bIsNextStepSimulated = false;
+
+	// Settings of the step simulated ahead: the ones of the last Step / MultiStep, which a client usually keeps
+	StepCommand PipelinedStepSettings;
+
+	// World before the step simulated ahead, to roll it back when the next request steps with other settings.
+	// Written on the pipeline thread, only read once that step finished.
+	WorldStateBuffer PipelinedStepStartState;
+
+	PhysicsStepPipeline StepPipeline { [this]() { SimulatePipelinedStep(); } };
 };
 
 #endif
@@ -0,0 +1,82 @@
+#include "PhysicsStepPipeline.h"
+#include "TraceProfiler.h"
+
+PhysicsStepPipeline::PhysicsStepPipeline(std::function<void()> inStepFunction)
+	: StepFunction(std::move(inStepFunction))
+{
+}
+
+PhysicsStepPipeline::~PhysicsStepPipeline()
+{
+	if(!PipelineThread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> pipelineLock(PipelineMutex);
+		bIsStopRequested = true;
+	}
+	PipelineCondition.notify_all();
+
+	// The thread finishes the step in flight (if any) before leaving
+	PipelineThread.join();
+}
+
+void PhysicsStepPipeline::StartStep()
+{
+	WaitForStep();
+
+	if(!PipelineThread.joinable())
+	{
+		PipelineThread = std::thread(&PhysicsStepPipeline::RunPipelineThread, this);
+	}
+
+	{
+		std::lock_guard<std::mutex> pipelineLock(PipelineMutex);
+		bIsStepRequested = true;
+	}
+	PipelineCondition.notify_all();
+
+	bIsStepInFlight = true;
+}
+
+bool PhysicsStepPipeline::WaitForStep()
+{
+	if(!bIsStepInFlight)
+	{
+		return false;
+	}
+
+	std::unique_lock<std::mutex> pipelineLock(PipelineMutex);
+	PipelineCondition.wait(pipelineLock, [this]() { return !bIsStepRequested && !bIsStepRunning; });
+
+	bIsStepInFlight = false;
+	return true;
+}
+
+void PhysicsStepPipeline::RunPipelineThread()
+{
+	TraceProfiler::SetThreadName("Step Pipeline");
+
+	std::unique_lock<std::mutex> pipelineLock(PipelineMutex);
+	while(true)
+	{
+		PipelineCondition.wait(pipelineLock, [this]() { return bIsStepRequested || bIsStopRequested; });
+		if(!bIsStepRequested)
+		{
+			return;
+		}
+
+		bIsStepRequested = false;
+		bIsStepRunning = true;
+
+		// Step without holding the lock, WaitForStep only blocks until we are done
+		pipelineLock.unlock();
+		StepFunction();
+		pipelineLock.lock();
+
+		bIsStepRunning = false;
+		PipelineCondition.notify_all();
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef PHYSICSSTEPPIPELINE_H
+#define PHYSICSSTEPPIPELINE_H
+
+// STL includes
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs the physics update of the next step on a background thread, so it overlaps with serializing
+// and sending the response of the current step (pipelined stepping).
+// Only one step is in flight at a time. The thread is created on the first StartStep.
+class PhysicsStepPipeline
+{
+public:
+	explicit PhysicsStepPipeline(std::function<void()> inStepFunction);
+	~PhysicsStepPipeline();
+
+	PhysicsStepPipeline(const PhysicsStepPipeline&) = delete;
+	PhysicsStepPipeline& operator=(const PhysicsStepPipeline&) = delete;
+
+	// Runs the step function on the pipeline thread. A step that is still in flight is waited for first.
+	void StartStep();
+
+	// Blocks until the step started by StartStep finished. Returns false if no step was in flight.
+	bool WaitForStep();
+
+	// True between StartStep and the WaitForStep that follows it
+	bool IsStepInFlight() const { return bIsStepInFlight; }
+
+private:
+	void RunPipelineThread();
+
+private:
+	std::function<void()> StepFunction;
+
+	std::thread PipelineThread;
+	std::mutex PipelineMutex;
+	std::condition_variable PipelineCondition;
+
+	// Guarded by PipelineMutex
+	bool bIsStepRequested = false;
+	bool bIsStepRunning = false;
+	bool bIsStopRequested = false;
+
+	// Only touched by the owning thread
+	bool bIsStepInFlight = false;
+};
+
+#endif
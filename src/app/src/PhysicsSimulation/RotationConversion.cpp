@@ -0,0 +1,143 @@
+#include "RotationConversion.h"
+
+#if defined(JPH_USE_AVX2) && defined(JPH_USE_FMADD)
+	#define ROTATION_CONVERSION_AVX2
+	#include <immintrin.h>
+	#include <cfloat>
+#endif
+
+#ifdef ROTATION_CONVERSION_AVX2
+namespace
+{
+	constexpr float cPi = 3.14159265358979323846f;
+
+	// atan2 of 8 lanes, same range reduction and polynomial as Jolt's Vec4::sATan2
+	__m256 ATan2(__m256 inY, __m256 inX)
+	{
+		const __m256 signMask = _mm256_set1_ps(-0.f);
+		const __m256 ySign = _mm256_and_ps(inY, signMask);
+		const __m256 yAbs = _mm256_andnot_ps(signMask, inY);
+		const __m256 xSign = _mm256_and_ps(inX, signMask);
+		const __m256 xAbs = _mm256_andnot_ps(signMask, inX);
+
+		// Always divide the smallest by the largest, so the ratio is in [0, 1]. atan2(0, 0) is 0.
+		const __m256 xIsNumerator = _mm256_cmp_ps(xAbs, yAbs, _CMP_LT_OQ);
+		const __m256 numerator = _mm256_blendv_ps(yAbs, xAbs, xIsNumerator);
+		const __m256 denominator = _mm256_max_ps(_mm256_blendv_ps(xAbs, yAbs, xIsNumerator), _mm256_set1_ps(FLT_MIN));
+		__m256 ratio = _mm256_div_ps(numerator, denominator);
+
+		// Above tan(pi / 8): atan(r) = pi / 4 + atan((r - 1) / (r + 1))
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 isReduced = _mm256_cmp_ps(ratio, _mm256_set1_ps(0.4142135623730950f), _CMP_GT_OQ);
+		ratio = _mm256_blendv_ps(ratio, _mm256_div_ps(_mm256_sub_ps(ratio, one), _mm256_add_ps(ratio, one)), isReduced);
+		const __m256 offset = _mm256_and_ps(isReduced, _mm256_set1_ps(0.25f * cPi));
+
+		const __m256 ratioSq = _mm256_mul_ps(ratio, ratio);
+		__m256 polynomial = _mm256_fmsub_ps(_mm256_set1_ps(8.05374449538e-2f), ratioSq, _mm256_set1_ps(1.38776856032e-1f));
+		polynomial = _mm256_fmadd_ps(polynomial, ratioSq, _mm256_set1_ps(1.99777106478e-1f));
+		polynomial = _mm256_fmsub_ps(polynomial, ratioSq, _mm256_set1_ps(3.33329491539e-1f));
+		__m256 atan = _mm256_add_ps(offset, _mm256_fmadd_ps(_mm256_mul_ps(polynomial, ratioSq), ratio, ratio));
+
+		// We calculated x / y instead of y / x: the result is pi / 2 - atan
+		atan = _mm256_blendv_ps(atan, _mm256_sub_ps(_mm256_set1_ps(0.5f * cPi), atan), xIsNumerator);
+
+		// Map to the quadrant: x_sign * y_sign * (atan - (x < 0 ? pi : 0))
+		atan = _mm256_sub_ps(atan, _mm256_blendv_ps(_mm256_setzero_ps(), _mm256_set1_ps(cPi), xSign));
+		return _mm256_xor_ps(atan, _mm256_xor_ps(xSign, ySign));
+	}
+
+	// asin of 8 lanes in [-1, 1], same approximation as Jolt's Vec4::ASin
+	__m256 ASin(__m256 inValue)
+	{
+		const __m256 signMask = _mm256_set1_ps(-0.f);
+		const __m256 sign = _mm256_and_ps(inValue, signMask);
+		const __m256 valueAbs = _mm256_min_ps(_mm256_andnot_ps(signMask, inValue), _mm256_set1_ps(1.f));
+
+		// Above 0.5: asin(x) = pi / 2 - 2 * asin(sqrt((1 - x) / 2))
+		const __m256 isReduced = _mm256_cmp_ps(valueAbs, _mm256_set1_ps(0.5f), _CMP_GT_OQ);
+		const __m256 reducedSq = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(_mm256_set1_ps(1.f), valueAbs));
+		const __m256 z = _mm256_blendv_ps(_mm256_mul_ps(valueAbs, valueAbs), reducedSq, isReduced);
+		const __m256 x = _mm256_blendv_ps(valueAbs, _mm256_sqrt_ps(reducedSq), isReduced);
+
+		__m256 polynomial = _mm256_fmadd_ps(_mm256_set1_ps(4.2163199048e-2f), z, _mm256_set1_ps(2.4181311049e-2f));
+		polynomial = _mm256_fmadd_ps(polynomial, z, _mm256_set1_ps(4.5470025998e-2f));
+		polynomial = _mm256_fmadd_ps(polynomial, z, _mm256_set1_ps(7.4953002686e-2f));
+		polynomial = _mm256_fmadd_ps(polynomial, z, _mm256_set1_ps(1.6666752422e-1f));
+		__m256 asin = _mm256_fmadd_ps(_mm256_mul_ps(polynomial, z), x, x);
+
+		asin = _mm256_blendv_ps(asin, _mm256_sub_ps(_mm256_set1_ps(0.5f * cPi), _mm256_add_ps(asin, asin)), isReduced);
+		return _mm256_xor_ps(asin, sign);
+	}
+
+	// Converts inRotations[0, 8)
+	void ConvertEightRotationsToEulerAngles(const Quat* inRotations, float* outAnglesX, float* outAnglesY, float* outAnglesZ)
+	{
+		// Transpose to one register per component: rotations i and i + 4 share a register, so each 128 bit half
+		// transposes to 4 consecutive rotations
+		const __m256 r0 = _mm256_set_m128(inRotations[4].mValue.mValue, inRotations[0].mValue.mValue);
+		const __m256 r1 = _mm256_set_m128(inRotations[5].mValue.mValue, inRotations[1].mValue.mValue);
+		const __m256 r2 = _mm256_set_m128(inRotations[6].mValue.mValue, inRotations[2].mValue.mValue);
+		const __m256 r3 = _mm256_set_m128(inRotations[7].mValue.mValue, inRotations[3].mValue.mValue);
+		const __m256 xy01 = _mm256_unpacklo_ps(r0, r1);
+		const __m256 zw01 = _mm256_unpackhi_ps(r0, r1);
+		const __m256 xy23 = _mm256_unpacklo_ps(r2, r3);
+		const __m256 zw23 = _mm256_unpackhi_ps(r2, r3);
+		const __m256 x = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m256 y = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(3, 2, 3, 2));
+		const __m256 z = _mm256_shuffle_ps(zw01, zw23, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m256 w = _mm256_shuffle_ps(zw01, zw23, _MM_SHUFFLE(3, 2, 3, 2));
+
+		// Same terms as Quat::GetEulerAngles
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 two = _mm256_set1_ps(2.f);
+		const __m256 ySq = _mm256_mul_ps(y, y);
+
+		const __m256 t0 = _mm256_mul_ps(two, _mm256_fmadd_ps(w, x, _mm256_mul_ps(y, z)));
+		const __m256 t1 = _mm256_fnmadd_ps(two, _mm256_fmadd_ps(x, x, ySq), one);
+
+		__m256 t2 = _mm256_mul_ps(two, _mm256_fmsub_ps(w, y, _mm256_mul_ps(z, x)));
+		t2 = _mm256_max_ps(_mm256_min_ps(t2, one), _mm256_set1_ps(-1.f));
+
+		const __m256 t3 = _mm256_mul_ps(two, _mm256_fmadd_ps(w, z, _mm256_mul_ps(x, y)));
+		const __m256 t4 = _mm256_fnmadd_ps(two, _mm256_fmadd_ps(z, z, ySq), one);
+
+		_mm256_storeu_ps(outAnglesX, ATan2(t0, t1));
+		_mm256_storeu_ps(outAnglesY, ASin(t2));
+		_mm256_storeu_ps(outAnglesZ, ATan2(t3, t4));
+	}
+}
+#endif
+
+void ConvertRotationsToEulerAngles(const Quat* inRotations, size_t inCount, float* outAnglesX, float* outAnglesY, float* outAnglesZ)
+{
+	size_t i = 0;
+
+#ifdef ROTATION_CONVERSION_AVX2
+	for(; i + 8 <= inCount; i += 8)
+	{
+		ConvertEightRotationsToEulerAngles(inRotations + i, outAnglesX + i, outAnglesY + i, outAnglesZ + i);
+	}
+#endif
+
+	ConvertRotationsToEulerAnglesScalar(inRotations + i, inCount - i, outAnglesX + i, outAnglesY + i, outAnglesZ + i);
+}
+
+void ConvertRotationsToEulerAnglesScalar(const Quat* inRotations, size_t inCount, float* outAnglesX, float* outAnglesY, float* outAnglesZ)
+{
+	for(size_t i = 0; i < inCount; ++i)
+	{
+		const Vec3 eulerAngles = inRotations[i].GetEulerAngles();
+		outAnglesX[i] = eulerAngles.GetX();
+		outAnglesY[i] = eulerAngles.GetY();
+		outAnglesZ[i] = eulerAngles.GetZ();
+	}
+}
+
+bool IsRotationConversionVectorized()
+{
+#ifdef ROTATION_CONVERSION_AVX2
+	return true;
+#else
+	return false;
+#endif
+}
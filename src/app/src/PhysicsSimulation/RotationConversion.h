@@ -0,0 +1,27 @@
+#ifndef ROTATIONCONVERSION_H
+#define ROTATIONCONVERSION_H
+
+// The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
+// You can use Jolt.h in your precompiled header to speed up compilation.
+#include <Jolt/Jolt.h>
+
+// STL includes
+#include <cstddef>
+
+// All Jolt symbols are in the JPH namespace
+using namespace JPH;
+
+// Converts the rotations of a step response to the euler angles of the text protocol (same convention as
+// Quat::GetEulerAngles), writing them as three separate arrays of inCount floats.
+// With AVX2 + FMA (USE_AVX2 / USE_FMADD in CMakeLists.txt) 8 rotations are converted at a time, using polynomial
+// approximations of atan2 / asin that are within a few float ulps of the scalar version. Otherwise, and for the
+// remaining rotations, falls back to ConvertRotationsToEulerAnglesScalar.
+void ConvertRotationsToEulerAngles(const Quat* inRotations, size_t inCount, float* outAnglesX, float* outAnglesY, float* outAnglesZ);
+
+// One rotation at a time through Quat::GetEulerAngles
+void ConvertRotationsToEulerAnglesScalar(const Quat* inRotations, size_t inCount, float* outAnglesX, float* outAnglesY, float* outAnglesZ);
+
+// True if ConvertRotationsToEulerAngles was compiled with the 8 wide kernel
+bool IsRotationConversionVectorized();
+
+#endif
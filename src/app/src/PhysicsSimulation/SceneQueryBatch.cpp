@@ -0,0 +1,217 @@
+#include "SceneQueryBatch.h"
+
+// Jolt includes
+#include <Jolt/Core/Profiler.h>
+#include <Jolt/Physics/Body/BodyLock.h>
+#include <Jolt/Physics/Collision/CastResult.h>
+#include <Jolt/Physics/Collision/CollideShape.h>
+#include <Jolt/Physics/Collision/CollisionCollectorImpl.h>
+#include <Jolt/Physics/Collision/NarrowPhaseQuery.h>
+#include <Jolt/Physics/Collision/RayCast.h>
+#include <Jolt/Physics/Collision/ShapeCast.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <Jolt/Physics/Collision/Shape/SphereShape.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Surface normal of the hit body from the direction that pushes it out of the query shape (magnitude is meaningless)
+	Vec3 GetHitNormal(Vec3Arg inPenetrationAxis)
+	{
+		const float penetrationAxisLength = inPenetrationAxis.Length();
+		return penetrationAxisLength > 0.f ? inPenetrationAxis / -penetrationAxisLength : Vec3::sZero();
+	}
+
+	// Overlap collector reporting each body once, up to the capacity of the query
+	class OverlapBodyCollector final : public CollideShapeCollector
+	{
+	public:
+		OverlapBodyCollector(SceneQueryHit* outHits, uint32 inMaxHits, RVec3Arg inBaseOffset) : Hits(outHits), MaxHits(inMaxHits), BaseOffset(inBaseOffset) {}
+
+		virtual void AddHit(const CollideShapeResult& inResult) override
+		{
+			// A body can overlap with several of its sub shapes
+			for(uint32 i = 0; i < HitCount; ++i)
+			{
+				if(Hits[i].Body == inResult.mBodyID2)
+				{
+					return;
+				}
+			}
+
+			SceneQueryHit& hit = Hits[HitCount++];
+			hit.Body = inResult.mBodyID2;
+			hit.Fraction = 0.f;
+			hit.Position = BaseOffset + inResult.mContactPointOn2;
+			hit.Normal = GetHitNormal(inResult.mPenetrationAxis);
+
+			if(HitCount == MaxHits)
+			{
+				ForceEarlyOut();
+			}
+		}
+
+		uint32 GetHitCount() const { return HitCount; }
+
+	private:
+		SceneQueryHit* Hits;
+		uint32 MaxHits;
+		uint32 HitCount = 0;
+		RVec3 BaseOffset;
+	};
+}
+
+bool SceneQuery::IsValid() const
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		if(!std::isfinite(Origin[axis]) || !std::isfinite(Direction[axis]) || !std::isfinite(Extents[axis]))
+		{
+			return false;
+		}
+	}
+
+	switch(Type)
+	{
+		case ESceneQueryType::RayCast:
+			return true;
+
+		case ESceneQueryType::SphereCast:
+		case ESceneQueryType::SphereOverlap:
+			return Extents[0] > 0.f && (Type == ESceneQueryType::SphereCast || (MaxHits >= 1 && MaxHits <= cMaxHits));
+
+		case ESceneQueryType::BoxCast:
+		case ESceneQueryType::BoxOverlap:
+			return Extents[0] > 0.f && Extents[1] > 0.f && Extents[2] > 0.f && (Type == ESceneQueryType::BoxCast || (MaxHits >= 1 && MaxHits <= cMaxHits));
+	}
+
+	return false;
+}
+
+uint32 SceneQuery::GetHitCapacity() const
+{
+	return (Type == ESceneQueryType::SphereOverlap || Type == ESceneQueryType::BoxOverlap) ? MaxHits : 1;
+}
+
+void SceneQueryBatch::Run(const PhysicsSystem& inPhysicsSystem, JobSystem& inJobSystem, const std::vector<SceneQuery>& inQueries)
+{
+	JPH_PROFILE_FUNCTION();
+
+	// Reserve the hit slots of every query up front, so the jobs only write to their own
+	const size_t queryCount = inQueries.size();
+	HitOffsets.resize(queryCount);
+	HitCounts.resize(queryCount);
+	size_t hitCapacity = 0;
+	for(size_t i = 0; i < queryCount; ++i)
+	{
+		HitOffsets[i] = hitCapacity;
+		hitCapacity += inQueries[i].GetHitCapacity();
+	}
+	Hits.resize(hitCapacity);
+
+	const size_t jobCount = std::min<size_t>(queryCount / cMinQueriesPerJob, (size_t)inJobSystem.GetMaxConcurrency());
+	if(jobCount <= 1)
+	{
+		RunQueryRange(inPhysicsSystem, inQueries, 0, queryCount);
+	}
+	else
+	{
+		// Every job runs its own contiguous range of the batch
+		const size_t queriesPerJob = (queryCount + jobCount - 1) / jobCount;
+		JobSystem::Barrier* queryBarrier = inJobSystem.CreateBarrier();
+		for(size_t firstQueryIndex = 0; firstQueryIndex < queryCount; firstQueryIndex += queriesPerJob)
+		{
+			const size_t endQueryIndex = std::min(firstQueryIndex + queriesPerJob, queryCount);
+			JobSystem::JobHandle queryJob = inJobSystem.CreateJob("SceneQueryBatch", Color::sOrange, [this, &inPhysicsSystem, &inQueries, firstQueryIndex, endQueryIndex]()
+			{
+				RunQueryRange(inPhysicsSystem, inQueries, firstQueryIndex, endQueryIndex);
+			});
+			queryBarrier->AddJob(queryJob);
+		}
+		inJobSystem.WaitForJobs(queryBarrier);
+		inJobSystem.DestroyBarrier(queryBarrier);
+	}
+
+	TotalHitCount = 0;
+	for(uint32 hitCount : HitCounts)
+	{
+		TotalHitCount += hitCount;
+	}
+}
+
+void SceneQueryBatch::RunQueryRange(const PhysicsSystem& inPhysicsSystem, const std::vector<SceneQuery>& inQueries, size_t inFirstQueryIndex, size_t inEndQueryIndex)
+{
+	for(size_t i = inFirstQueryIndex; i < inEndQueryIndex; ++i)
+	{
+		HitCounts[i] = RunQuery(inPhysicsSystem, inQueries[i], Hits.data() + HitOffsets[i]);
+	}
+}
+
+uint32 SceneQueryBatch::RunQuery(const PhysicsSystem& inPhysicsSystem, const SceneQuery& inQuery, SceneQueryHit* outHits)
+{
+	// Nothing moves while the batch runs, no need to lock the bodies
+	const NarrowPhaseQuery& narrowPhaseQuery = inPhysicsSystem.GetNarrowPhaseQueryNoLock();
+
+	const RVec3 origin(inQuery.Origin[0], inQuery.Origin[1], inQuery.Origin[2]);
+	const Vec3 direction(inQuery.Direction[0], inQuery.Direction[1], inQuery.Direction[2]);
+	const Vec3 extents(inQuery.Extents[0], inQuery.Extents[1], inQuery.Extents[2]);
+
+	if(inQuery.Type == ESceneQueryType::RayCast)
+	{
+		const RRayCast ray { origin, direction };
+		RayCastResult rayHit;
+		if(!narrowPhaseQuery.CastRay(ray, rayHit))
+		{
+			return 0;
+		}
+
+		outHits->Body = rayHit.mBodyID;
+		outHits->Fraction = rayHit.mFraction;
+		outHits->Position = ray.GetPointOnRay(rayHit.mFraction);
+
+		// Only the body knows the normal at the hit sub shape
+		BodyLockRead bodyLock(inPhysicsSystem.GetBodyLockInterfaceNoLock(), rayHit.mBodyID);
+		outHits->Normal = bodyLock.Succeeded() ? bodyLock.GetBody().GetWorldSpaceSurfaceNormal(rayHit.mSubShapeID2, outHits->Position) : Vec3::sZero();
+		return 1;
+	}
+
+	// Query shapes on the stack (embedded: not reference counted), a batch doesn't allocate a shape per query
+	const bool bIsSphereQuery = inQuery.Type == ESceneQueryType::SphereCast || inQuery.Type == ESceneQueryType::SphereOverlap;
+	SphereShape sphereShape(bIsSphereQuery ? extents.GetX() : 1.f);
+	sphereShape.SetEmbedded();
+	BoxShape boxShape(bIsSphereQuery ? Vec3::sReplicate(1.f) : extents, bIsSphereQuery ? 0.f : std::min(cDefaultConvexRadius, extents.ReduceMin()));
+	boxShape.SetEmbedded();
+	const Shape* queryShape = bIsSphereQuery ? static_cast<const Shape*>(&sphereShape) : static_cast<const Shape*>(&boxShape);
+
+	// Results relative to the origin, so they keep their precision far from the world origin
+	if(inQuery.Type == ESceneQueryType::SphereCast || inQuery.Type == ESceneQueryType::BoxCast)
+	{
+		const RShapeCast shapeCast(queryShape, Vec3::sReplicate(1.f), RMat44::sTranslation(origin), direction);
+		ClosestHitCollisionCollector<CastShapeCollector> castCollector;
+		narrowPhaseQuery.CastShape(shapeCast, ShapeCastSettings(), origin, castCollector);
+		if(!castCollector.HadHit())
+		{
+			return 0;
+		}
+
+		const ShapeCastResult& castHit = castCollector.mHit;
+		outHits->Body = castHit.mBodyID2;
+		outHits->Fraction = castHit.mFraction;
+		outHits->Position = origin + castHit.mContactPointOn2;
+		outHits->Normal = GetHitNormal(castHit.mPenetrationAxis);
+		return 1;
+	}
+
+	OverlapBodyCollector overlapCollector(outHits, inQuery.MaxHits, origin);
+	narrowPhaseQuery.CollideShape(queryShape, Vec3::sReplicate(1.f), RMat44::sTranslation(origin), CollideShapeSettings(), origin, overlapCollector);
+
+	// The bodies the broadphase visited first were kept, report them in a stable order
+	std::sort(outHits, outHits + overlapCollector.GetHitCount(), [](const SceneQueryHit& a, const SceneQueryHit& b)
+	{
+		return a.Body.GetIndex() < b.Body.GetIndex();
+	});
+	return overlapCollector.GetHitCount();
+}
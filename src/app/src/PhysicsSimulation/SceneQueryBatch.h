@@ -0,0 +1,103 @@
+#ifndef SCENEQUERYBATCH_H
+#define SCENEQUERYBATCH_H
+
+// The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
+// You can use Jolt.h in your precompiled header to speed up compilation.
+#include <Jolt/Jolt.h>
+
+// Jolt includes
+#include <Jolt/Core/JobSystem.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+
+// STL includes
+#include <vector>
+
+// All Jolt symbols are in the JPH namespace
+using namespace JPH;
+
+enum class ESceneQueryType : uint8
+{
+	RayCast = 0,
+
+	// Sphere / axis aligned box swept from Origin along Direction
+	SphereCast = 1,
+	BoxCast = 2,
+
+	// Bodies overlapping a sphere / axis aligned box at Origin
+	SphereOverlap = 3,
+	BoxOverlap = 4
+};
+
+// A gameplay trace (bullet, line of sight, ground check, ...) resolved against the world
+struct SceneQuery
+{
+	ESceneQueryType Type = ESceneQueryType::RayCast;
+
+	// Start of the ray / cast, center of the overlap
+	float Origin[3] = { 0.f, 0.f, 0.f };
+
+	// Rays and casts: from the origin to the end of the trace, the hit fraction is relative to it
+	float Direction[3] = { 0.f, 0.f, 0.f };
+
+	// Spheres: radius in Extents[0]. Boxes: half extents.
+	float Extents[3] = { 0.f, 0.f, 0.f };
+
+	// Overlaps: most bodies reported (1 - cMaxHits). Rays and casts report the closest hit.
+	uint32 MaxHits = 1;
+
+	static constexpr uint32 cMaxHits = 64;
+
+	bool IsValid() const;
+
+	// Hits the query can report
+	uint32 GetHitCapacity() const;
+};
+
+struct SceneQueryHit
+{
+	BodyID Body;
+
+	// Rays and casts: fraction of Direction travelled before the hit. Overlaps: 0.
+	float Fraction = 0.f;
+
+	// Hit point and surface normal of the hit body (pointing out of it)
+	RVec3 Position = RVec3::sZero();
+	Vec3 Normal = Vec3::sZero();
+};
+
+// Runs a batch of scene queries through the narrow phase, spread over the job system. Queries don't allocate: every query
+// writes its hits to slots reserved for it, and the shapes of the casts / overlaps live on the stack of the job.
+// The results are kept until the next Run, the buffers are reused.
+class SceneQueryBatch
+{
+public:
+	// Runs inQueries (all valid) against the bodies of inPhysicsSystem. Only call while the physics system isn't updating:
+	// the bodies are read without locking them.
+	void Run(const PhysicsSystem& inPhysicsSystem, JobSystem& inJobSystem, const std::vector<SceneQuery>& inQueries);
+
+	size_t GetQueryCount() const { return HitCounts.size(); }
+	size_t GetTotalHitCount() const { return TotalHitCount; }
+
+	// Hits of a query: the closest one for rays and casts, one per body (sorted by body index) for overlaps
+	uint32 GetHitCount(size_t inQueryIndex) const { return HitCounts[inQueryIndex]; }
+	const SceneQueryHit* GetHits(size_t inQueryIndex) const { return Hits.data() + HitOffsets[inQueryIndex]; }
+
+private:
+	// Runs the queries [inFirstQueryIndex, inEndQueryIndex)
+	void RunQueryRange(const PhysicsSystem& inPhysicsSystem, const std::vector<SceneQuery>& inQueries, size_t inFirstQueryIndex, size_t inEndQueryIndex);
+
+	// Writes the hits of inQuery to outHits (room for inQuery.GetHitCapacity() hits), returns their count
+	static uint32 RunQuery(const PhysicsSystem& inPhysicsSystem, const SceneQuery& inQuery, SceneQueryHit* outHits);
+
+private:
+	// Queries run per job, smaller batches are run on the calling thread
+	static constexpr size_t cMinQueriesPerJob = 32;
+
+	// Slots of query i: [HitOffsets[i], HitOffsets[i] + GetHitCapacity()), HitCounts[i] of them used
+	std::vector<SceneQueryHit> Hits;
+	std::vector<size_t> HitOffsets;
+	std::vector<uint32> HitCounts;
+	size_t TotalHitCount = 0;
+};
+
+#endif
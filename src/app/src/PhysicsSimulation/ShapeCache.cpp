@@ -0,0 +1,287 @@
+#include "ShapeCache.h"
+
+#include <Jolt/Core/StreamWrapper.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <Jolt/Physics/Collision/Shape/CapsuleShape.h>
+#include <Jolt/Physics/Collision/Shape/SphereShape.h>
+
+// STL includes
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	constexpr uint32 cCookedShapeFileMagic = 0x4353534A; // "JSSC" little-endian
+	constexpr uint32 cCookedShapeFileVersion = 1;
+}
+
+ShapeRefC ShapeCache::GetSphere(float inRadius)
+{
+	return GetOrCreateShape(EShapeSubType::Sphere, { inRadius, 0.f, 0.f, 0.f }, [](const ShapeParameters& inParameters)
+	{
+		return SphereShapeSettings(inParameters[0]).Create();
+	});
+}
+
+ShapeRefC ShapeCache::GetBox(Vec3Arg inHalfExtent, float inConvexRadius)
+{
+	return GetOrCreateShape(EShapeSubType::Box, { inHalfExtent.GetX(), inHalfExtent.GetY(), inHalfExtent.GetZ(), inConvexRadius }, [](const ShapeParameters& inParameters)
+	{
+		return BoxShapeSettings(Vec3(inParameters[0], inParameters[1], inParameters[2]), inParameters[3]).Create();
+	});
+}
+
+ShapeRefC ShapeCache::GetCapsule(float inHalfHeightOfCylinder, float inRadius)
+{
+	return GetOrCreateShape(EShapeSubType::Capsule, { inHalfHeightOfCylinder, inRadius, 0.f, 0.f }, [](const ShapeParameters& inParameters)
+	{
+		return CapsuleShapeSettings(inParameters[0], inParameters[1]).Create();
+	});
+}
+
+bool ShapeCache::MakeShapeKey(EShapeSubType inSubType, const ShapeParameters& inParameters, ShapeKey& outKey)
+{
+	// Far beyond any body size, and the steps still fit in the key
+	constexpr float cMaxShapeParameter = 1.0e12f;
+
+	outKey.first = inSubType;
+	for(size_t i = 0; i < inParameters.size(); ++i)
+	{
+		// A NaN would also break the ordering of the map
+		if(!std::isfinite(inParameters[i]) || std::abs(inParameters[i]) > cMaxShapeParameter)
+		{
+			return false;
+		}
+		outKey.second[i] = std::llround((double)inParameters[i] / cShapeParameterQuantum);
+	}
+	return true;
+}
+
+ShapeCache::ShapeParameters ShapeCache::GetKeyParameters(const ShapeKey& inKey)
+{
+	ShapeParameters parameters;
+	for(size_t i = 0; i < parameters.size(); ++i)
+	{
+		parameters[i] = (float)(inKey.second[i] * (double)cShapeParameterQuantum);
+	}
+	return parameters;
+}
+
+template <class CreateShapeFunction>
+ShapeRefC ShapeCache::GetOrCreateShape(EShapeSubType inSubType, const ShapeParameters& inParameters, const CreateShapeFunction& inCreateShape)
+{
+	ShapeKey shapeKey;
+	if(!MakeShapeKey(inSubType, inParameters, shapeKey))
+	{
+		std::cout << "Error on creating shape: invalid parameters\n";
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> cacheLock(CacheMutex);
+
+	const auto cachedShape = PrimitiveShapes.find(shapeKey);
+	if(cachedShape != PrimitiveShapes.end())
+	{
+		return cachedShape->second;
+	}
+
+	const ShapeSettings::ShapeResult shapeResult = inCreateShape(GetKeyParameters(shapeKey));
+	if(shapeResult.HasError())
+	{
+		std::cout << "Error on creating shape: " << shapeResult.GetError() << "\n";
+		return nullptr;
+	}
+
+	ShapeRefC newShape = shapeResult.Get();
+	if(PrimitiveShapes.size() >= cMaxPrimitiveShapes)
+	{
+		PruneUnreferencedPrimitiveShapes();
+	}
+
+	// Every cached shape is still used by a body: this one isn't shared
+	if(PrimitiveShapes.size() < cMaxPrimitiveShapes)
+	{
+		PrimitiveShapes.emplace(shapeKey, newShape);
+	}
+	return newShape;
+}
+
+void ShapeCache::PruneUnreferencedPrimitiveShapes()
+{
+	// Nobody can take a new reference without CacheMutex, so a shape only the map references stays unreferenced
+	for(auto primitiveShape = PrimitiveShapes.begin(); primitiveShape != PrimitiveShapes.end();)
+	{
+		if(primitiveShape->second->GetRefCount() == 1)
+		{
+			primitiveShape = PrimitiveShapes.erase(primitiveShape);
+		}
+		else
+		{
+			++primitiveShape;
+		}
+	}
+}
+
+ShapeRefC ShapeCache::FindNamedShape(const std::string& inName) const
+{
+	std::lock_guard<std::mutex> cacheLock(CacheMutex);
+
+	const auto namedShape = NamedShapes.find(inName);
+	return namedShape != NamedShapes.end() ? namedShape->second : nullptr;
+}
+
+void ShapeCache::AddNamedShape(const std::string& inName, const Shape* inShape)
+{
+	std::lock_guard<std::mutex> cacheLock(CacheMutex);
+
+	NamedShapes[inName] = inShape;
+	AddPrimitiveShape(inShape);
+}
+
+void ShapeCache::AddPrimitiveShape(const Shape* inShape)
+{
+	// Only untransformed primitives are found by their parameters, anything else is only known by name
+	ShapeParameters shapeParameters = { 0.f, 0.f, 0.f, 0.f };
+	if(inShape->GetSubType() == EShapeSubType::Sphere)
+	{
+		const SphereShape* sphereShape = static_cast<const SphereShape*>(inShape);
+		shapeParameters[0] = sphereShape->GetRadius();
+	}
+	else if(inShape->GetSubType() == EShapeSubType::Box)
+	{
+		const BoxShape* boxShape = static_cast<const BoxShape*>(inShape);
+		const Vec3 halfExtent = boxShape->GetHalfExtent();
+		shapeParameters = { halfExtent.GetX(), halfExtent.GetY(), halfExtent.GetZ(), boxShape->GetConvexRadius() };
+	}
+	else if(inShape->GetSubType() == EShapeSubType::Capsule)
+	{
+		const CapsuleShape* capsuleShape = static_cast<const CapsuleShape*>(inShape);
+		shapeParameters[0] = capsuleShape->GetHalfHeightOfCylinder();
+		shapeParameters[1] = capsuleShape->GetRadius();
+	}
+	else
+	{
+		return;
+	}
+
+	ShapeKey shapeKey;
+	if(MakeShapeKey(inShape->GetSubType(), shapeParameters, shapeKey) && GetKeyParameters(shapeKey) == shapeParameters)
+	{
+		PrimitiveShapes[shapeKey] = inShape;
+	}
+}
+
+bool ShapeCache::LoadNamedShapes(const std::string& inFilePath)
+{
+	std::ifstream cookedFile(inFilePath, std::ios::binary);
+	if(!cookedFile)
+	{
+		std::cout << "Error on loading cooked shapes: can't open " << inFilePath << "\n";
+		return false;
+	}
+
+	StreamInWrapper cookedStream(cookedFile);
+
+	uint32 fileMagic = 0, fileVersion = 0, shapeCount = 0;
+	cookedStream.Read(fileMagic);
+	cookedStream.Read(fileVersion);
+	cookedStream.Read(shapeCount);
+	if(cookedStream.IsFailed() || fileMagic != cCookedShapeFileMagic || fileVersion != cCookedShapeFileVersion)
+	{
+		std::cout << "Error on loading cooked shapes: " << inFilePath << " is not a cooked shape file (version " << cCookedShapeFileVersion << ")\n";
+		return false;
+	}
+
+	// Shared between the shapes of the file: children and materials that were saved once are restored once
+	Shape::IDToShapeMap shapeMap;
+	Shape::IDToMaterialMap materialMap;
+
+	for(uint32 i = 0; i < shapeCount; ++i)
+	{
+		std::string shapeName;
+		cookedStream.Read(shapeName);
+
+		const Shape::ShapeResult shapeResult = Shape::sRestoreWithChildren(cookedStream, shapeMap, materialMap);
+		if(cookedStream.IsFailed() || shapeResult.HasError())
+		{
+			std::cout << "Error on loading cooked shape " << i << " of " << inFilePath << ": " << (shapeResult.HasError() ? shapeResult.GetError().c_str() : "unexpected end of file") << "\n";
+			return false;
+		}
+
+		AddNamedShape(shapeName, shapeResult.Get());
+	}
+
+	std::cout << "Loaded " << shapeCount << " cooked shapes from " << inFilePath << "\n";
+	return true;
+}
+
+bool ShapeCache::SaveNamedShapes(const std::string& inFilePath) const
+{
+	std::ofstream cookedFile(inFilePath, std::ios::binary | std::ios::trunc);
+	if(!cookedFile)
+	{
+		std::cout << "Error on saving cooked shapes: can't open " << inFilePath << "\n";
+		return false;
+	}
+
+	StreamOutWrapper cookedStream(cookedFile);
+
+	std::lock_guard<std::mutex> cacheLock(CacheMutex);
+
+	cookedStream.Write(cCookedShapeFileMagic);
+	cookedStream.Write(cCookedShapeFileVersion);
+	cookedStream.Write((uint32)NamedShapes.size());
+
+	Shape::ShapeToIDMap shapeMap;
+	Shape::MaterialToIDMap materialMap;
+	for(const auto& [shapeName, namedShape] : NamedShapes)
+	{
+		cookedStream.Write(shapeName);
+		namedShape->SaveWithChildren(cookedStream, shapeMap, materialMap);
+	}
+
+	return !cookedStream.IsFailed();
+}
+
+void ShapeCache::Clear()
+{
+	std::lock_guard<std::mutex> cacheLock(CacheMutex);
+
+	PrimitiveShapes.clear();
+	NamedShapes.clear();
+}
+
+size_t ShapeCache::GetShapeCount() const
+{
+	std::lock_guard<std::mutex> cacheLock(CacheMutex);
+
+	Shape::VisitedShapes visitedShapes;
+	for(const auto& [shapeKey, primitiveShape] : PrimitiveShapes)
+	{
+		visitedShapes.insert(primitiveShape.GetPtr());
+	}
+	for(const auto& [shapeName, namedShape] : NamedShapes)
+	{
+		visitedShapes.insert(namedShape.GetPtr());
+	}
+	return visitedShapes.size();
+}
+
+size_t ShapeCache::GetShapeMemorySize() const
+{
+	std::lock_guard<std::mutex> cacheLock(CacheMutex);
+
+	// Shapes can be both primitive and named, and share children: count every shape once
+	Shape::VisitedShapes visitedShapes;
+	size_t shapeMemorySize = 0;
+	for(const auto& [shapeKey, primitiveShape] : PrimitiveShapes)
+	{
+		shapeMemorySize += primitiveShape->GetStatsRecursive(visitedShapes).mSizeBytes;
+	}
+	for(const auto& [shapeName, namedShape] : NamedShapes)
+	{
+		shapeMemorySize += namedShape->GetStatsRecursive(visitedShapes).mSizeBytes;
+	}
+	return shapeMemorySize;
+}
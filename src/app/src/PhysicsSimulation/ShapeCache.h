@@ -0,0 +1,98 @@
+#ifndef SHAPECACHE_H
+#define SHAPECACHE_H
+
+// The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
+// You can use Jolt.h in your precompiled header to speed up compilation.
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/PhysicsSettings.h>
+#include <Jolt/Physics/Collision/Shape/Shape.h>
+
+// STL includes
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// All Jolt symbols are in the JPH namespace
+using namespace JPH;
+
+// Hands out shared, immutable shapes so identical bodies (every actor sphere, the floor of every session)
+// reference one shape instead of each allocating their own.
+// Primitive shapes are keyed by their type and rounded parameters (see cShapeParameterQuantum). The ones no body uses
+// anymore are dropped once there are cMaxPrimitiveShapes, so a client sending ever different sizes can't grow the cache.
+// Cooked (complex / prebuilt) shapes are keyed by name and can be preloaded from a file written by SaveNamedShapes,
+// so they aren't rebuilt on every Init.
+// Cooked file: "JSSC", uint32 version, uint32 shape count, then per shape its name followed by Shape::SaveWithChildren
+// (SaveBinaryState of the shape and its children / materials, shared between the shapes of the file).
+// Thread safe: sessions and jobs may request shapes concurrently.
+class ShapeCache
+{
+public:
+	// Parameters are rounded to this step: requests that differ by less share one shape, which is created from the rounded
+	// parameters so it doesn't depend on which request came first.
+	static constexpr float cShapeParameterQuantum = 1.f / 1024.f;
+
+	// Above this many primitive shapes, the ones nothing but the cache references are dropped before adding another
+	static constexpr size_t cMaxPrimitiveShapes = 4096;
+
+	// Sphere of the given radius. Returns nullptr if the shape can't be created.
+	ShapeRefC GetSphere(float inRadius);
+
+	// Box of the given half extent. Returns nullptr if the shape can't be created.
+	ShapeRefC GetBox(Vec3Arg inHalfExtent, float inConvexRadius = cDefaultConvexRadius);
+
+	// Capsule along the y axis. Returns nullptr if the shape can't be created.
+	ShapeRefC GetCapsule(float inHalfHeightOfCylinder, float inRadius);
+
+	// Cooked shape registered under inName (see AddNamedShape / LoadNamedShapes), nullptr if there is none
+	ShapeRefC FindNamedShape(const std::string& inName) const;
+
+	// Registers (or replaces) a cooked shape. Spheres, boxes and capsules are also handed out by GetSphere / GetBox / GetCapsule.
+	void AddNamedShape(const std::string& inName, const Shape* inShape);
+
+	// Adds the shapes of a cooked file. Returns false (keeping the shapes read so far) if the file can't be read.
+	bool LoadNamedShapes(const std::string& inFilePath);
+
+	// Writes every named shape to a cooked file. Returns false if the file can't be written.
+	bool SaveNamedShapes(const std::string& inFilePath) const;
+
+	// Drops every shape. Bodies keep the shapes they reference alive.
+	void Clear();
+
+	// Number of distinct shapes and their memory (Shape::GetStats, children included)
+	size_t GetShapeCount() const;
+	size_t GetShapeMemorySize() const;
+
+private:
+	using ShapeParameters = std::array<float, 4>;
+
+	// Shape sub type + up to 4 parameters in cShapeParameterQuantum steps (unused parameters are 0)
+	using ShapeKey = std::pair<EShapeSubType, std::array<int64_t, 4>>;
+
+	// Rounds inParameters to the key's steps. Returns false if a parameter isn't finite or is out of the key's range.
+	static bool MakeShapeKey(EShapeSubType inSubType, const ShapeParameters& inParameters, ShapeKey& outKey);
+
+	static ShapeParameters GetKeyParameters(const ShapeKey& inKey);
+
+	// Returns the cached shape of the rounded parameters, or creates it with inCreateShape(rounded parameters) and caches it.
+	template <class CreateShapeFunction>
+	ShapeRefC GetOrCreateShape(EShapeSubType inSubType, const ShapeParameters& inParameters, const CreateShapeFunction& inCreateShape);
+
+	// Drops the primitive shapes only the cache references. Requires CacheMutex.
+	void PruneUnreferencedPrimitiveShapes();
+
+	// Makes a sphere / box / capsule handed out by GetSphere / GetBox / GetCapsule, if its parameters are exact steps of the key
+	// (the cache hands out the shape of the rounded parameters). Requires CacheMutex.
+	void AddPrimitiveShape(const Shape* inShape);
+
+private:
+	mutable std::mutex CacheMutex;
+
+	// Guarded by CacheMutex
+	std::map<ShapeKey, ShapeRefC> PrimitiveShapes;
+	std::map<std::string, ShapeRefC> NamedShapes;
+};
+
+#endif
@@ -0,0 +1,305 @@
+#include "TraceProfiler.h"
+
+#include <Jolt/Core/Profiler.h>
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef JPH_EXTERNAL_PROFILE
+
+namespace
+{
+	// A thread stops recording after this many events per capture (about 24 MB), in case the capture never ends
+	constexpr size_t cMaxEventsPerThread = 1 << 20;
+
+	struct TraceEvent
+	{
+		const char* Name;
+
+		// steady_clock nanoseconds
+		uint64 StartTime;
+		uint64 EndTime;
+	};
+
+	// Events of one thread. Appended by the thread, read when the trace is written: both under EventsMutex.
+	struct ThreadTrace
+	{
+		std::mutex EventsMutex;
+		std::vector<TraceEvent> Events;
+
+		// Guarded by TraceCapture::CaptureMutex
+		std::string ThreadName;
+		uint ThreadId = 0;
+	};
+
+	struct TraceCapture
+	{
+		std::mutex CaptureMutex;
+
+		// Guarded by CaptureMutex
+		std::vector<std::shared_ptr<ThreadTrace>> ThreadTraces;
+		uint NextThreadId = 1;
+		const void* Owner = nullptr;
+		uint RemainingFrameCount = 0;
+		uint64 StartTime = 0;
+		std::vector<uint64> FrameEndTimes;
+		std::string FilePath;
+	};
+
+	// Read by every profile scope: only this flag is touched outside of a capture
+	std::atomic<bool> gIsCapturing { false };
+
+	thread_local std::shared_ptr<ThreadTrace> tThreadTrace;
+
+	// Layout of ExternalProfileMeasurement::mUserData
+	struct MeasurementData
+	{
+		const char* Name;
+		uint64 StartTime;
+		bool bIsRecording;
+	};
+
+	TraceCapture& GetTraceCapture()
+	{
+		static TraceCapture sTraceCapture;
+		return sTraceCapture;
+	}
+
+	uint64 GetTraceTime()
+	{
+		return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// The calling thread's trace, registered on first use
+	ThreadTrace& GetThreadTrace()
+	{
+		if(!tThreadTrace)
+		{
+			tThreadTrace = std::make_shared<ThreadTrace>();
+
+			TraceCapture& traceCapture = GetTraceCapture();
+			std::lock_guard<std::mutex> captureLock(traceCapture.CaptureMutex);
+			tThreadTrace->ThreadId = traceCapture.NextThreadId++;
+			tThreadTrace->ThreadName = "Thread " + std::to_string(tThreadTrace->ThreadId);
+			traceCapture.ThreadTraces.push_back(tThreadTrace);
+		}
+		return *tThreadTrace;
+	}
+
+	void WriteJsonString(std::ofstream& ioTraceFile, const char* inText)
+	{
+		ioTraceFile << '"';
+		for(const char* textChar = inText; *textChar != '\0'; ++textChar)
+		{
+			if(*textChar == '"' || *textChar == '\\')
+			{
+				ioTraceFile << '\\' << *textChar;
+			}
+			else if((unsigned char)*textChar >= 0x20)
+			{
+				ioTraceFile << *textChar;
+			}
+		}
+		ioTraceFile << '"';
+	}
+
+	// Ends the capture and writes the trace file. Requires CaptureMutex.
+	void FinishCapture(TraceCapture& ioTraceCapture)
+	{
+		gIsCapturing.store(false, std::memory_order_relaxed);
+		ioTraceCapture.Owner = nullptr;
+
+		std::ofstream traceFile(ioTraceCapture.FilePath, std::ios::trunc);
+		if(!traceFile)
+		{
+			std::cout << "Error on writing the profile trace: can't open " << ioTraceCapture.FilePath << "\n";
+			return;
+		}
+
+		// Chrome trace_event format: complete ("X") events in microseconds, thread names as metadata events
+		char eventTimes[96];
+		size_t eventCount = 0;
+		traceFile << "{\"traceEvents\":[\n";
+		traceFile << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"JoltService\"}}";
+		for(const std::shared_ptr<ThreadTrace>& threadTrace : ioTraceCapture.ThreadTraces)
+		{
+			std::lock_guard<std::mutex> eventsLock(threadTrace->EventsMutex);
+			if(threadTrace->Events.empty())
+			{
+				continue;
+			}
+
+			traceFile << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadTrace->ThreadId << ",\"args\":{\"name\":";
+			WriteJsonString(traceFile, threadTrace->ThreadName.c_str());
+			traceFile << "}}";
+
+			for(const TraceEvent& traceEvent : threadTrace->Events)
+			{
+				// Scopes that started before the capture are cut off: leave them out
+				if(traceEvent.StartTime < ioTraceCapture.StartTime)
+				{
+					continue;
+				}
+
+				traceFile << ",\n{\"name\":";
+				WriteJsonString(traceFile, traceEvent.Name);
+				snprintf(eventTimes, sizeof(eventTimes), ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", threadTrace->ThreadId,
+					(traceEvent.StartTime - ioTraceCapture.StartTime) / 1000.0, (traceEvent.EndTime - traceEvent.StartTime) / 1000.0);
+				traceFile << eventTimes;
+				++eventCount;
+			}
+			threadTrace->Events.clear();
+		}
+
+		// Frame boundaries as global instant events
+		for(size_t frameIndex = 0; frameIndex < ioTraceCapture.FrameEndTimes.size(); ++frameIndex)
+		{
+			snprintf(eventTimes, sizeof(eventTimes), ",\n{\"name\":\"Frame %zu\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}", frameIndex + 1,
+				(ioTraceCapture.FrameEndTimes[frameIndex] - ioTraceCapture.StartTime) / 1000.0);
+			traceFile << eventTimes;
+		}
+		traceFile << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+		std::cout << "Profile of " << ioTraceCapture.FrameEndTimes.size() << " frames (" << eventCount << " events) written to " << ioTraceCapture.FilePath << "\n";
+	}
+}
+
+JPH_NAMESPACE_BEGIN
+
+ExternalProfileMeasurement::ExternalProfileMeasurement(const char* inName, uint32 inColor)
+{
+	static_assert(sizeof(MeasurementData) <= sizeof(mUserData), "Measurement doesn't fit in the user data");
+
+	const bool bIsRecording = gIsCapturing.load(std::memory_order_relaxed);
+	new (mUserData) MeasurementData { inName, bIsRecording ? GetTraceTime() : 0, bIsRecording };
+}
+
+ExternalProfileMeasurement::~ExternalProfileMeasurement()
+{
+	const MeasurementData& measurementData = *std::launder(reinterpret_cast<const MeasurementData*>(mUserData));
+	if(!measurementData.bIsRecording)
+	{
+		return;
+	}
+
+	const uint64 endTime = GetTraceTime();
+	ThreadTrace& threadTrace = GetThreadTrace();
+
+	std::lock_guard<std::mutex> eventsLock(threadTrace.EventsMutex);
+	if(threadTrace.Events.size() < cMaxEventsPerThread)
+	{
+		threadTrace.Events.push_back({ measurementData.Name, measurementData.StartTime, endTime });
+	}
+}
+
+JPH_NAMESPACE_END
+
+bool TraceProfiler::IsAvailable()
+{
+	return true;
+}
+
+bool TraceProfiler::StartCapture(const void* inOwner, uint inFrameCount, const std::string& inFilePath)
+{
+	TraceCapture& traceCapture = GetTraceCapture();
+	std::lock_guard<std::mutex> captureLock(traceCapture.CaptureMutex);
+
+	if(inFrameCount == 0 || gIsCapturing.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+
+	// Drop the threads that exited since the last capture, and the late events of the last capture
+	traceCapture.ThreadTraces.erase(std::remove_if(traceCapture.ThreadTraces.begin(), traceCapture.ThreadTraces.end(),
+		[](const std::shared_ptr<ThreadTrace>& threadTrace) { return threadTrace.use_count() == 1; }), traceCapture.ThreadTraces.end());
+	for(const std::shared_ptr<ThreadTrace>& threadTrace : traceCapture.ThreadTraces)
+	{
+		std::lock_guard<std::mutex> eventsLock(threadTrace->EventsMutex);
+		threadTrace->Events.clear();
+	}
+
+	traceCapture.Owner = inOwner;
+	traceCapture.RemainingFrameCount = inFrameCount;
+	traceCapture.FrameEndTimes.clear();
+	traceCapture.FilePath = inFilePath;
+	traceCapture.StartTime = GetTraceTime();
+
+	gIsCapturing.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+void TraceProfiler::NextFrame(const void* inOwner)
+{
+	if(!gIsCapturing.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	TraceCapture& traceCapture = GetTraceCapture();
+	std::lock_guard<std::mutex> captureLock(traceCapture.CaptureMutex);
+	if(traceCapture.Owner != inOwner || !gIsCapturing.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	traceCapture.FrameEndTimes.push_back(GetTraceTime());
+	if(--traceCapture.RemainingFrameCount == 0)
+	{
+		FinishCapture(traceCapture);
+	}
+}
+
+void TraceProfiler::StopCapture(const void* inOwner)
+{
+	TraceCapture& traceCapture = GetTraceCapture();
+	std::lock_guard<std::mutex> captureLock(traceCapture.CaptureMutex);
+	if(traceCapture.Owner == inOwner && gIsCapturing.load(std::memory_order_relaxed))
+	{
+		FinishCapture(traceCapture);
+	}
+}
+
+void TraceProfiler::SetThreadName(const char* inThreadName)
+{
+	ThreadTrace& threadTrace = GetThreadTrace();
+
+	TraceCapture& traceCapture = GetTraceCapture();
+	std::lock_guard<std::mutex> captureLock(traceCapture.CaptureMutex);
+	threadTrace.ThreadName = inThreadName;
+}
+
+#else
+
+bool TraceProfiler::IsAvailable()
+{
+	return false;
+}
+
+bool TraceProfiler::StartCapture(const void* inOwner, uint inFrameCount, const std::string& inFilePath)
+{
+	return false;
+}
+
+void TraceProfiler::NextFrame(const void* inOwner)
+{
+}
+
+void TraceProfiler::StopCapture(const void* inOwner)
+{
+}
+
+void TraceProfiler::SetThreadName(const char* inThreadName)
+{
+}
+
+#endif // JPH_EXTERNAL_PROFILE
@@ -0,0 +1,40 @@
+#ifndef TRACEPROFILER_H
+#define TRACEPROFILER_H
+
+// The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
+// You can use Jolt.h in your precompiled header to speed up compilation.
+#include <Jolt/Jolt.h>
+
+// STL includes
+#include <string>
+
+// All Jolt symbols are in the JPH namespace
+using namespace JPH;
+
+// Captures the JPH_PROFILE scopes of a few frames into a Chrome trace_event JSON file (chrome://tracing, ui.perfetto.dev):
+// every job of Jolt's physics update (broadphase, island solver, ...) on every thread, and the service's own phase
+// markers (JPH_PROFILE in the service code). A frame ends with every step request of the capturing session.
+// Only records in profiling builds (JOLT_SERVICE_PROFILING=ON, which builds Jolt with JPH_EXTERNAL_PROFILE: this file
+// implements Jolt's ExternalProfileMeasurement). Outside of a capture a profile scope only checks a flag.
+// One capture at a time, process wide: the trace has the threads of every session.
+class TraceProfiler
+{
+public:
+	// True if the service was built with profiling
+	static bool IsAvailable();
+
+	// Starts capturing the next inFrameCount frames of inOwner (the session asking for it) into inFilePath.
+	// Returns false if profiling isn't available or another capture is running.
+	static bool StartCapture(const void* inOwner, uint inFrameCount, const std::string& inFilePath);
+
+	// Ends a frame of inOwner. Writes the trace file once the requested frames were captured.
+	static void NextFrame(const void* inOwner);
+
+	// Writes what inOwner captured so far, e.g. when its session closes
+	static void StopCapture(const void* inOwner);
+
+	// Name of the calling thread in the traces
+	static void SetThreadName(const char* inThreadName);
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include "TransformQuantization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	// Range of the three smallest components of a unit quaternion
+	constexpr float cSmallestThreeRange = 0.70710678f; // 1 / sqrt(2)
+
+	void WritePackedBits(uint64 inPackedBits, uint32 inByteCount, char* outBytes)
+	{
+		for(uint32 i = 0; i < inByteCount; ++i)
+		{
+			outBytes[i] = static_cast<char>((inPackedBits >> (8 * i)) & 0xFF);
+		}
+	}
+
+	uint64 ReadPackedBits(const char* inBytes, uint32 inByteCount)
+	{
+		uint64 packedBits = 0;
+		for(uint32 i = 0; i < inByteCount; ++i)
+		{
+			packedBits |= uint64(static_cast<uint8>(inBytes[i])) << (8 * i);
+		}
+		return packedBits;
+	}
+
+	uint64 QuantizeUnitFloat(float inNormalizedValue, uint64 inMaxQuantizedValue)
+	{
+		const float clampedValue = std::clamp(inNormalizedValue, 0.f, 1.f);
+		return static_cast<uint64>(std::lround(clampedValue * float(inMaxQuantizedValue)));
+	}
+}
+
+bool TransformQuantizer::Configure(const TransformQuantizationSettings& inSettings)
+{
+	if(inSettings.PositionBits < 1 || inSettings.PositionBits > 21 || inSettings.RotationBits < 1 || inSettings.RotationBits > 10)
+	{
+		return false;
+	}
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		if(!(inSettings.WorldBoundsMax[axis] > inSettings.WorldBoundsMin[axis]))
+		{
+			return false;
+		}
+	}
+
+	Settings = inSettings;
+	PositionBytes = (3 * Settings.PositionBits + 7) / 8;
+	RotationBytes = (2 + 3 * Settings.RotationBits + 7) / 8;
+
+	// Positions are rounded to the nearest step, so each axis is off by at most half a step. With many bits the
+	// float rounding of the decoded value (a couple of ulps at the largest bound) is no longer negligible.
+	const float maxQuantizedPosition = float((uint64(1) << Settings.PositionBits) - 1);
+	float positionErrorSq = 0.f;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float halfStep = 0.5f * (Settings.WorldBoundsMax[axis] - Settings.WorldBoundsMin[axis]) / maxQuantizedPosition;
+		const float maxAbsBound = std::max(std::abs(Settings.WorldBoundsMin[axis]), std::abs(Settings.WorldBoundsMax[axis]));
+		const float axisError = halfStep + 2.f * maxAbsBound * std::numeric_limits<float>::epsilon();
+		positionErrorSq += axisError * axisError;
+	}
+	MaxPositionError = std::sqrt(positionErrorSq);
+
+	// Each stored component is off by at most half a step. The reconstructed largest component is at least 1/2,
+	// which amplifies the error of the stored ones by at most 2. The angle between two close unit quaternions
+	// is about twice the length of their difference.
+	const float maxQuantizedRotation = float((uint32(1) << Settings.RotationBits) - 1);
+	const float rotationComponentError = cSmallestThreeRange / maxQuantizedRotation;
+	MaxRotationError = 2.f * 2.f * std::sqrt(3.f) * rotationComponentError;
+
+	return true;
+}
+
+float TransformQuantizer::EncodePosition(RVec3Arg inPosition, char* outBytes) const
+{
+	const float position[3] = { float(inPosition.GetX()), float(inPosition.GetY()), float(inPosition.GetZ()) };
+	const uint64 maxQuantizedValue = (uint64(1) << Settings.PositionBits) - 1;
+
+	uint64 packedBits = 0;
+	float errorSq = 0.f;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float boundsMin = Settings.WorldBoundsMin[axis];
+		const float boundsExtent = Settings.WorldBoundsMax[axis] - boundsMin;
+
+		const uint64 quantizedValue = QuantizeUnitFloat((position[axis] - boundsMin) / boundsExtent, maxQuantizedValue);
+		packedBits |= quantizedValue << (axis * Settings.PositionBits);
+
+		const float decodedValue = boundsMin + boundsExtent * float(quantizedValue) / float(maxQuantizedValue);
+		errorSq += (decodedValue - position[axis]) * (decodedValue - position[axis]);
+	}
+
+	WritePackedBits(packedBits, PositionBytes, outBytes);
+	return std::sqrt(errorSq);
+}
+
+float TransformQuantizer::EncodeRotation(QuatArg inRotation, char* outBytes) const
+{
+	const float rotation[4] = { inRotation.GetX(), inRotation.GetY(), inRotation.GetZ(), inRotation.GetW() };
+
+	// Drop the largest component, it can be reconstructed from the other three
+	int largestComponent = 0;
+	for(int i = 1; i < 4; ++i)
+	{
+		if(std::abs(rotation[i]) > std::abs(rotation[largestComponent]))
+		{
+			largestComponent = i;
+		}
+	}
+
+	// q and -q are the same rotation, flip so the dropped component is positive
+	const float sign = rotation[largestComponent] < 0.f ? -1.f : 1.f;
+	const uint64 maxQuantizedValue = (uint64(1) << Settings.RotationBits) - 1;
+
+	uint64 packedBits = uint64(largestComponent);
+	uint32 bitOffset = 2;
+	float decodedRotation[4];
+	float decodedLengthSq = 0.f;
+	for(int i = 0; i < 4; ++i)
+	{
+		if(i == largestComponent)
+		{
+			continue;
+		}
+
+		const float component = sign * rotation[i];
+		const uint64 quantizedValue = QuantizeUnitFloat((component + cSmallestThreeRange) / (2.f * cSmallestThreeRange), maxQuantizedValue);
+		packedBits |= quantizedValue << bitOffset;
+		bitOffset += Settings.RotationBits;
+
+		decodedRotation[i] = float(quantizedValue) / float(maxQuantizedValue) * 2.f * cSmallestThreeRange - cSmallestThreeRange;
+		decodedLengthSq += decodedRotation[i] * decodedRotation[i];
+	}
+	decodedRotation[largestComponent] = std::sqrt(std::max(0.f, 1.f - decodedLengthSq));
+
+	WritePackedBits(packedBits, RotationBytes, outBytes);
+
+	// Angle between the original and the decoded rotation
+	float dot = 0.f;
+	const float decodedNormSq = decodedLengthSq + decodedRotation[largestComponent] * decodedRotation[largestComponent];
+	for(int i = 0; i < 4; ++i)
+	{
+		dot += sign * rotation[i] * decodedRotation[i];
+	}
+	dot /= std::sqrt(decodedNormSq);
+	return 2.f * std::acos(std::min(1.f, std::abs(dot)));
+}
+
+RVec3 TransformQuantizer::DecodePosition(const char* inBytes) const
+{
+	const uint64 packedBits = ReadPackedBits(inBytes, PositionBytes);
+	const uint64 maxQuantizedValue = (uint64(1) << Settings.PositionBits) - 1;
+
+	float position[3];
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const uint64 quantizedValue = (packedBits >> (axis * Settings.PositionBits)) & maxQuantizedValue;
+		const float boundsMin = Settings.WorldBoundsMin[axis];
+		position[axis] = boundsMin + (Settings.WorldBoundsMax[axis] - boundsMin) * float(quantizedValue) / float(maxQuantizedValue);
+	}
+
+	return RVec3(position[0], position[1], position[2]);
+}
+
+Quat TransformQuantizer::DecodeRotation(const char* inBytes) const
+{
+	const uint64 packedBits = ReadPackedBits(inBytes, RotationBytes);
+	const uint64 maxQuantizedValue = (uint64(1) << Settings.RotationBits) - 1;
+	const int largestComponent = int(packedBits & 0x3);
+
+	float rotation[4];
+	float lengthSq = 0.f;
+	uint32 bitOffset = 2;
+	for(int i = 0; i < 4; ++i)
+	{
+		if(i == largestComponent)
+		{
+			continue;
+		}
+
+		const uint64 quantizedValue = (packedBits >> bitOffset) & maxQuantizedValue;
+		bitOffset += Settings.RotationBits;
+
+		rotation[i] = float(quantizedValue) / float(maxQuantizedValue) * 2.f * cSmallestThreeRange - cSmallestThreeRange;
+		lengthSq += rotation[i] * rotation[i];
+	}
+	rotation[largestComponent] = std::sqrt(std::max(0.f, 1.f - lengthSq));
+
+	return Quat(rotation[0], rotation[1], rotation[2], rotation[3]).Normalized();
+}
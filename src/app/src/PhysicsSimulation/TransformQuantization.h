@@ -0,0 +1,66 @@
+#ifndef TRANSFORMQUANTIZATION_H
+#define TRANSFORMQUANTIZATION_H
+
+// The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
+// You can use Jolt.h in your precompiled header to speed up compilation.
+#include <Jolt/Jolt.h>
+
+// All Jolt symbols are in the JPH namespace
+using namespace JPH;
+
+// Settings of the quantized step encoding
+struct TransformQuantizationSettings
+{
+	// Positions are stored as fixed point values relative to this box. Positions outside of it are clamped.
+	float WorldBoundsMin[3] = { -100000.f, -100000.f, -100000.f };
+	float WorldBoundsMax[3] = { 100000.f, 100000.f, 100000.f };
+
+	// Bits per position axis (1 - 21, the three axes are packed in at most 8 bytes)
+	uint32 PositionBits = 16;
+
+	// Bits per smallest-three quaternion component (1 - 10, the 2 bit index + 3 components are packed in at most 4 bytes)
+	uint32 RotationBits = 10;
+};
+
+// Encodes body transforms into compact fixed point records:
+// - Position: 3 * PositionBits bits, relative to the world bounds, packed little-endian in ceil(3 * PositionBits / 8) bytes
+// - Rotation: smallest-three quaternion. 2 bits with the index of the dropped (largest) component followed by the other
+//   three components, each RotationBits bits in [-1/sqrt(2), 1/sqrt(2)], packed little-endian in ceil((2 + 3 * RotationBits) / 8) bytes
+//   The dropped component is always made positive, so it can be reconstructed as sqrt(1 - a^2 - b^2 - c^2).
+class TransformQuantizer
+{
+public:
+	// Validates and applies the settings. Returns false (keeping the previous settings) if they are invalid.
+	bool Configure(const TransformQuantizationSettings& inSettings);
+
+	const TransformQuantizationSettings& GetSettings() const { return Settings; }
+
+	uint32 GetPositionBytes() const { return PositionBytes; }
+	uint32 GetRotationBytes() const { return RotationBytes; }
+
+	// Worst case error for positions inside the world bounds, in world units (length of the error vector)
+	float GetMaxPositionError() const { return MaxPositionError; }
+
+	// Worst case rotation error, in radians
+	float GetMaxRotationError() const { return MaxRotationError; }
+
+	// Writes GetPositionBytes() bytes to outBytes. Returns the error introduced (distance to the decoded position).
+	float EncodePosition(RVec3Arg inPosition, char* outBytes) const;
+
+	// Writes GetRotationBytes() bytes to outBytes. Returns the error introduced (angle to the decoded rotation, in radians).
+	float EncodeRotation(QuatArg inRotation, char* outBytes) const;
+
+	RVec3 DecodePosition(const char* inBytes) const;
+	Quat DecodeRotation(const char* inBytes) const;
+
+private:
+	TransformQuantizationSettings Settings;
+
+	uint32 PositionBytes = 6;
+	uint32 RotationBytes = 4;
+
+	float MaxPositionError = 0.f;
+	float MaxRotationError = 0.f;
+};
+
+#endif
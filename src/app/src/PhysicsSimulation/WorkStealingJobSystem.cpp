@@ -0,0 +1,430 @@
+#include "WorkStealingJobSystem.h"
+#include "TraceProfiler.h"
+
+#include <Jolt/Core/Profiler.h>
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#ifdef __linux__
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+namespace
+{
+	// Worker the current thread is, if it is one: lets QueueJob push to the worker's own deque
+	thread_local const WorkStealingJobSystem* tCurrentJobSystem = nullptr;
+	thread_local uint tCurrentWorkerIndex = 0;
+
+	uint RoundUpToPowerOfTwo(uint inValue)
+	{
+		uint powerOfTwo = 1;
+		while(powerOfTwo < inValue)
+		{
+			powerOfTwo <<= 1;
+		}
+		return powerOfTwo;
+	}
+
+	// "0-3,8,10-11" -> 0 1 2 3 8 10 11
+	std::vector<int> ParseCpuList(const std::string& inCpuList)
+	{
+		std::vector<int> cpus;
+		size_t rangeBegin = 0;
+		while(rangeBegin < inCpuList.size())
+		{
+			size_t rangeEnd = inCpuList.find(',', rangeBegin);
+			if(rangeEnd == std::string::npos)
+			{
+				rangeEnd = inCpuList.size();
+			}
+
+			const std::string range = inCpuList.substr(rangeBegin, rangeEnd - rangeBegin);
+			int firstCpu = 0, lastCpu = 0;
+			const int parsedCount = std::sscanf(range.c_str(), "%d-%d", &firstCpu, &lastCpu);
+			if(parsedCount >= 1)
+			{
+				for(int cpu = firstCpu; cpu <= (parsedCount == 2 ? lastCpu : firstCpu); ++cpu)
+				{
+					cpus.push_back(cpu);
+				}
+			}
+			rangeBegin = rangeEnd + 1;
+		}
+		return cpus;
+	}
+
+	// NUMA node of every CPU (from sysfs), 0 if unknown
+	std::vector<int> GetCpuNumaNodes()
+	{
+		std::vector<int> cpuNumaNodes;
+		for(int numaNode = 0; ; ++numaNode)
+		{
+			std::ifstream cpuListFile("/sys/devices/system/node/node" + std::to_string(numaNode) + "/cpulist");
+			std::string cpuList;
+			if(!cpuListFile || !std::getline(cpuListFile, cpuList))
+			{
+				break;
+			}
+
+			for(int cpu : ParseCpuList(cpuList))
+			{
+				if(cpu >= (int)cpuNumaNodes.size())
+				{
+					cpuNumaNodes.resize(cpu + 1, 0);
+				}
+				cpuNumaNodes[cpu] = numaNode;
+			}
+		}
+		return cpuNumaNodes;
+	}
+}
+
+WorkStealingJobSystem::JobDeque::JobDeque(uint inCapacity)
+{
+	const uint capacity = RoundUpToPowerOfTwo(std::max(inCapacity, 2u));
+	Slots = std::make_unique<std::atomic<Job*>[]>(capacity);
+	CapacityMask = int64_t(capacity) - 1;
+}
+
+bool WorkStealingJobSystem::JobDeque::Push(Job* inJob)
+{
+	const int64_t bottom = Bottom.load(std::memory_order_relaxed);
+	const int64_t top = Top.load(std::memory_order_acquire);
+	if(bottom - top > CapacityMask)
+	{
+		return false;
+	}
+
+	Slots[bottom & CapacityMask].store(inJob, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	Bottom.store(bottom + 1, std::memory_order_relaxed);
+	return true;
+}
+
+WorkStealingJobSystem::Job* WorkStealingJobSystem::JobDeque::Pop()
+{
+	const int64_t bottom = Bottom.load(std::memory_order_relaxed) - 1;
+	Bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = Top.load(std::memory_order_relaxed);
+
+	if(top > bottom)
+	{
+		// Empty
+		Bottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = Slots[bottom & CapacityMask].load(std::memory_order_relaxed);
+	if(top == bottom)
+	{
+		// Last job: race the thieves for it
+		if(!Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+		Bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+WorkStealingJobSystem::Job* WorkStealingJobSystem::JobDeque::Steal()
+{
+	int64_t top = Top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const int64_t bottom = Bottom.load(std::memory_order_acquire);
+	if(top >= bottom)
+	{
+		return nullptr;
+	}
+
+	Job* job = Slots[top & CapacityMask].load(std::memory_order_relaxed);
+	if(!Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+	return job;
+}
+
+WorkStealingJobSystem::WorkStealingJobSystem(uint inMaxJobs, uint inMaxBarriers, const JobSystemSettings& inSettings) :
+	JobSystemWithBarrier(inMaxBarriers)
+{
+	Jobs.Init(inMaxJobs, inMaxJobs);
+
+	// Every job fits in any queue: pushing never fails
+	SharedJobs.resize(inMaxJobs);
+
+	const int workerCount = inSettings.WorkerCount >= 0 ? inSettings.WorkerCount : std::max((int)std::thread::hardware_concurrency() - 1, 0);
+	Workers.reserve(workerCount);
+	for(int i = 0; i < workerCount; ++i)
+	{
+		Workers.push_back(std::make_unique<Worker>(inMaxJobs));
+	}
+
+	PlaceWorkers(inSettings.bPinWorkers);
+
+	for(uint workerIndex = 0; workerIndex < Workers.size(); ++workerIndex)
+	{
+		Workers[workerIndex]->Thread = std::thread([this, workerIndex]() { RunWorker(workerIndex); });
+	}
+}
+
+WorkStealingJobSystem::~WorkStealingJobSystem()
+{
+	bIsQuitting = true;
+	WakeSemaphore.Release((uint)Workers.size());
+
+	for(std::unique_ptr<Worker>& worker : Workers)
+	{
+		worker->Thread.join();
+	}
+}
+
+void WorkStealingJobSystem::PlaceWorkers(bool inPinWorkers)
+{
+	std::vector<int> cpuNumaNodes;
+	std::vector<int> workerCpus;
+
+#ifdef __linux__
+	cpu_set_t allowedCpus;
+	CPU_ZERO(&allowedCpus);
+	if(inPinWorkers && sched_getaffinity(0, sizeof(allowedCpus), &allowedCpus) == 0)
+	{
+		cpuNumaNodes = GetCpuNumaNodes();
+		const auto getNumaNode = [&cpuNumaNodes](int cpu) { return cpu < (int)cpuNumaNodes.size() ? cpuNumaNodes[cpu] : 0; };
+
+		// The creating thread's node first, its own CPU last (it works on the jobs too)
+		const int callingCpu = sched_getcpu();
+		const int callingNumaNode = callingCpu >= 0 ? getNumaNode(callingCpu) : 0;
+
+		std::vector<int> orderedCpus;
+		for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if(CPU_ISSET(cpu, &allowedCpus) && cpu != callingCpu)
+			{
+				orderedCpus.push_back(cpu);
+			}
+		}
+		std::stable_sort(orderedCpus.begin(), orderedCpus.end(), [&](int cpu, int otherCpu)
+		{
+			return std::make_pair(getNumaNode(cpu) != callingNumaNode, getNumaNode(cpu)) < std::make_pair(getNumaNode(otherCpu) != callingNumaNode, getNumaNode(otherCpu));
+		});
+		if(callingCpu >= 0 && CPU_ISSET(callingCpu, &allowedCpus))
+		{
+			orderedCpus.push_back(callingCpu);
+		}
+
+		for(size_t i = 0; i < Workers.size() && !orderedCpus.empty(); ++i)
+		{
+			workerCpus.push_back(orderedCpus[i % orderedCpus.size()]);
+		}
+	}
+#else
+	(void)inPinWorkers;
+#endif
+
+	for(uint workerIndex = 0; workerIndex < Workers.size(); ++workerIndex)
+	{
+		Worker& worker = *Workers[workerIndex];
+		worker.Cpu = workerIndex < workerCpus.size() ? workerCpus[workerIndex] : -1;
+	}
+
+	// Steal from the next workers first (spreads the thieves), and from the workers on the same node before the others
+	const auto getWorkerNumaNode = [this, &cpuNumaNodes](uint workerIndex)
+	{
+		const int cpu = Workers[workerIndex]->Cpu;
+		return (cpu >= 0 && cpu < (int)cpuNumaNodes.size()) ? cpuNumaNodes[cpu] : 0;
+	};
+	for(uint workerIndex = 0; workerIndex < Workers.size(); ++workerIndex)
+	{
+		std::vector<uint>& stealOrder = Workers[workerIndex]->StealOrder;
+		for(uint offset = 1; offset < Workers.size(); ++offset)
+		{
+			stealOrder.push_back((workerIndex + offset) % (uint)Workers.size());
+		}
+		std::stable_sort(stealOrder.begin(), stealOrder.end(), [&](uint victimIndex, uint otherVictimIndex)
+		{
+			return (getWorkerNumaNode(victimIndex) != getWorkerNumaNode(workerIndex)) < (getWorkerNumaNode(otherVictimIndex) != getWorkerNumaNode(workerIndex));
+		});
+	}
+}
+
+std::vector<int> WorkStealingJobSystem::GetWorkerCpus() const
+{
+	std::vector<int> workerCpus;
+	for(const std::unique_ptr<Worker>& worker : Workers)
+	{
+		workerCpus.push_back(worker->Cpu);
+	}
+	return workerCpus;
+}
+
+JobSystem::JobHandle WorkStealingJobSystem::CreateJob(const char* inName, ColorArg inColor, const JobFunction& inJobFunction, uint32 inNumDependencies)
+{
+	// Loop until we can get a job from the free list
+	uint32 jobIndex;
+	for(;;)
+	{
+		jobIndex = Jobs.ConstructObject(inName, inColor, this, inJobFunction, inNumDependencies);
+		if(jobIndex != FixedSizeFreeList<Job>::cInvalidObjectIndex)
+		{
+			break;
+		}
+		JPH_ASSERT(false, "No jobs available!");
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	Job* job = &Jobs.Get(jobIndex);
+
+	// The handle keeps a reference: the job is queued below and may complete right away
+	JobHandle jobHandle(job);
+
+	if(inNumDependencies == 0)
+	{
+		QueueJob(job);
+	}
+
+	return jobHandle;
+}
+
+void WorkStealingJobSystem::FreeJob(Job* inJob)
+{
+	Jobs.DestructObject(inJob);
+}
+
+void WorkStealingJobSystem::QueueJob(Job* inJob)
+{
+	QueueJobs(&inJob, 1);
+}
+
+void WorkStealingJobSystem::QueueJobs(Job** inJobs, uint inNumJobs)
+{
+	for(uint i = 0; i < inNumJobs; ++i)
+	{
+		// The queue holds a reference until the job was executed
+		inJobs[i]->AddRef();
+
+		if(tCurrentJobSystem != this || !Workers[tCurrentWorkerIndex]->Deque.Push(inJobs[i]))
+		{
+			PushSharedJob(inJobs[i]);
+		}
+	}
+
+	WakeWorkers(inNumJobs);
+}
+
+void WorkStealingJobSystem::PushSharedJob(Job* inJob)
+{
+	std::lock_guard<std::mutex> sharedJobsLock(SharedJobsMutex);
+
+	JPH_ASSERT(SharedJobsCount < SharedJobs.size());
+	SharedJobs[(SharedJobsHead + SharedJobsCount) % SharedJobs.size()] = inJob;
+	++SharedJobsCount;
+	SharedJobsAvailable.store((uint)SharedJobsCount, std::memory_order_release);
+}
+
+WorkStealingJobSystem::Job* WorkStealingJobSystem::PopSharedJob()
+{
+	// Don't take the lock just to find the queue empty
+	if(SharedJobsAvailable.load(std::memory_order_acquire) == 0)
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> sharedJobsLock(SharedJobsMutex);
+	if(SharedJobsCount == 0)
+	{
+		return nullptr;
+	}
+
+	Job* job = SharedJobs[SharedJobsHead];
+	SharedJobsHead = (SharedJobsHead + 1) % SharedJobs.size();
+	--SharedJobsCount;
+	SharedJobsAvailable.store((uint)SharedJobsCount, std::memory_order_release);
+	return job;
+}
+
+void WorkStealingJobSystem::WakeWorkers(uint inJobCount)
+{
+	// Pairs with the seq_cst increment in RunWorker: either the worker sees the job or we see the worker idle
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const uint idleWorkerCount = IdleWorkerCount.load(std::memory_order_relaxed);
+	if(idleWorkerCount > 0)
+	{
+		WakeSemaphore.Release(std::min(idleWorkerCount, inJobCount));
+	}
+}
+
+WorkStealingJobSystem::Job* WorkStealingJobSystem::FindJob(uint inWorkerIndex)
+{
+	Worker& worker = *Workers[inWorkerIndex];
+	if(Job* job = worker.Deque.Pop())
+	{
+		return job;
+	}
+
+	for(uint victimIndex : worker.StealOrder)
+	{
+		if(Job* job = Workers[victimIndex]->Deque.Steal())
+		{
+			return job;
+		}
+	}
+
+	return PopSharedJob();
+}
+
+void WorkStealingJobSystem::RunWorker(uint inWorkerIndex)
+{
+	tCurrentJobSystem = this;
+	tCurrentWorkerIndex = inWorkerIndex;
+
+#ifdef __linux__
+	const int workerCpu = Workers[inWorkerIndex]->Cpu;
+	if(workerCpu >= 0)
+	{
+		cpu_set_t workerCpuSet;
+		CPU_ZERO(&workerCpuSet);
+		CPU_SET(workerCpu, &workerCpuSet);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(workerCpuSet), &workerCpuSet) != 0)
+		{
+			printf("Could not pin job worker %u to CPU %d\n", inWorkerIndex, workerCpu);
+		}
+	}
+#endif
+
+	char workerName[32];
+	snprintf(workerName, sizeof(workerName), "Job Worker %u", inWorkerIndex);
+	JPH_PROFILE_THREAD_START(workerName);
+	TraceProfiler::SetThreadName(workerName);
+
+	while(!bIsQuitting.load(std::memory_order_relaxed))
+	{
+		Job* job = FindJob(inWorkerIndex);
+		if(!job)
+		{
+			// Announce that we're going to sleep, then look once more: a job queued in between woke us or is found now
+			IdleWorkerCount.fetch_add(1, std::memory_order_seq_cst);
+			job = FindJob(inWorkerIndex);
+			if(!job)
+			{
+				WakeSemaphore.Acquire();
+				IdleWorkerCount.fetch_sub(1, std::memory_order_relaxed);
+				continue;
+			}
+			IdleWorkerCount.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		// A job can be in a deque and executed by a barrier at the same time: Execute only runs it once
+		job->Execute();
+		job->Release();
+	}
+
+	JPH_PROFILE_THREAD_END();
+}
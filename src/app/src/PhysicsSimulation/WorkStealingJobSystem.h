@@ -0,0 +1,142 @@
+#ifndef WORKSTEALINGJOBSYSTEM_H
+#define WORKSTEALINGJOBSYSTEM_H
+
+// The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
+// You can use Jolt.h in your precompiled header to speed up compilation.
+#include <Jolt/Jolt.h>
+
+// Jolt includes
+#include <Jolt/Core/FixedSizeFreeList.h>
+#include <Jolt/Core/JobSystemWithBarrier.h>
+#include <Jolt/Core/Semaphore.h>
+
+// STL includes
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// All Jolt symbols are in the JPH namespace
+using namespace JPH;
+
+// Which JobSystem implementation a world runs its physics jobs on
+enum class EJobSystemType : uint8
+{
+	// WorkStealingJobSystem (default)
+	WorkStealing = 0,
+
+	// Jolt's JobSystemThreadPool: one shared queue, every worker woken per queued job
+	ThreadPool = 1
+};
+
+struct JobSystemSettings
+{
+	EJobSystemType Type = EJobSystemType::WorkStealing;
+
+	// Worker threads. The thread that waits for the jobs (e.g. the one calling PhysicsSystem::Update) works as well.
+	// -1 = one less than the hardware threads.
+	int WorkerCount = -1;
+
+	// Pins each worker to one CPU, filling the NUMA node of the creating thread first (work stealing job system only)
+	bool bPinWorkers = false;
+};
+
+// JobSystem with a lock-free work-stealing deque (Chase-Lev) per worker:
+// - A job queued by a worker goes to the bottom of the worker's own deque, and the worker takes its newest job first.
+//   The dependent jobs of the physics update run on the thread that finished their dependency, while their data is in its cache.
+// - An idle worker steals the oldest job of another worker, trying the workers of its own NUMA node first.
+// - Jobs queued by any other thread go to a shared queue all workers take from.
+// - A thread waiting on a barrier executes the barrier's jobs itself (see JobSystemWithBarrier), so with 0 workers
+//   everything runs on the calling thread.
+// Idle workers sleep on a semaphore and are only woken for as many jobs as were queued.
+class WorkStealingJobSystem final : public JobSystemWithBarrier
+{
+public:
+	WorkStealingJobSystem(uint inMaxJobs, uint inMaxBarriers, const JobSystemSettings& inSettings);
+	virtual ~WorkStealingJobSystem() override;
+
+	// See JobSystem
+	virtual int GetMaxConcurrency() const override { return int(Workers.size()) + 1; }
+	virtual JobHandle CreateJob(const char* inName, ColorArg inColor, const JobFunction& inJobFunction, uint32 inNumDependencies = 0) override;
+
+	// CPU every worker was pinned to, -1 for workers that aren't pinned
+	std::vector<int> GetWorkerCpus() const;
+
+protected:
+	// See JobSystem
+	virtual void QueueJob(Job* inJob) override;
+	virtual void QueueJobs(Job** inJobs, uint inNumJobs) override;
+	virtual void FreeJob(Job* inJob) override;
+
+private:
+	// Fixed capacity Chase-Lev deque. Push and Pop only from the owning worker, Steal from any thread.
+	class JobDeque
+	{
+	public:
+		explicit JobDeque(uint inCapacity);
+
+		// Returns false if the deque is full
+		bool Push(Job* inJob);
+
+		// Newest job, nullptr if empty
+		Job* Pop();
+
+		// Oldest job, nullptr if empty or another thread took it first
+		Job* Steal();
+
+	private:
+		std::unique_ptr<std::atomic<Job*>[]> Slots;
+		int64_t CapacityMask = 0;
+
+		// Separate cache lines: thieves hammer Top, the owner Bottom
+		alignas(JPH_CACHE_LINE_SIZE) std::atomic<int64_t> Top { 0 };
+		alignas(JPH_CACHE_LINE_SIZE) std::atomic<int64_t> Bottom { 0 };
+	};
+
+	struct Worker
+	{
+		explicit Worker(uint inDequeCapacity) : Deque(inDequeCapacity) { }
+
+		JobDeque Deque;
+		std::thread Thread;
+
+		// Other workers, in the order this worker tries to steal from them (same NUMA node first)
+		std::vector<uint> StealOrder;
+
+		int Cpu = -1;
+	};
+
+	void RunWorker(uint inWorkerIndex);
+
+	// Own deque, then the other workers' deques, then the shared queue. nullptr if there is no work.
+	Job* FindJob(uint inWorkerIndex);
+
+	// Shared queue for jobs queued outside the workers
+	void PushSharedJob(Job* inJob);
+	Job* PopSharedJob();
+
+	// Wakes up to inJobCount sleeping workers
+	void WakeWorkers(uint inJobCount);
+
+	// Picks the worker CPUs and steal orders from the process affinity and the NUMA topology
+	void PlaceWorkers(bool inPinWorkers);
+
+private:
+	FixedSizeFreeList<Job> Jobs;
+
+	std::vector<std::unique_ptr<Worker>> Workers;
+
+	std::mutex SharedJobsMutex;
+	std::vector<Job*> SharedJobs;
+	size_t SharedJobsHead = 0;
+	size_t SharedJobsCount = 0;
+	std::atomic<uint> SharedJobsAvailable { 0 };
+
+	Semaphore WakeSemaphore;
+	std::atomic<uint> IdleWorkerCount { 0 };
+	std::atomic<bool> bIsQuitting { false };
+};
+
+#endif
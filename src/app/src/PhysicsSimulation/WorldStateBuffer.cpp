@@ -0,0 +1,57 @@
+#include "WorldStateBuffer.h"
+
+// STL includes
+#include <algorithm>
+#include <cstring>
+
+void WorldStateBuffer::BeginWrite()
+{
+	Size = 0;
+	ReadOffset = 0;
+	bIsFailed = false;
+}
+
+void WorldStateBuffer::BeginRead()
+{
+	ReadOffset = 0;
+	bIsFailed = false;
+}
+
+void WorldStateBuffer::Reserve(size_t inSize)
+{
+	if(Data.size() < inSize)
+	{
+		Data.resize(inSize);
+	}
+}
+
+void WorldStateBuffer::CopyFrom(const WorldStateBuffer& inOther)
+{
+	BeginWrite();
+	WriteBytes(inOther.Data.data(), inOther.Size);
+}
+
+void WorldStateBuffer::WriteBytes(const void* inData, size_t inNumBytes)
+{
+	if(Size + inNumBytes > Data.size())
+	{
+		Data.resize(std::max(Size + inNumBytes, 2 * Data.size()));
+	}
+
+	std::memcpy(Data.data() + Size, inData, inNumBytes);
+	Size += inNumBytes;
+}
+
+void WorldStateBuffer::ReadBytes(void* outData, size_t inNumBytes)
+{
+	if(inNumBytes > Size - ReadOffset)
+	{
+		std::memset(outData, 0, inNumBytes);
+		ReadOffset = Size;
+		bIsFailed = true;
+		return;
+	}
+
+	std::memcpy(outData, Data.data() + ReadOffset, inNumBytes);
+	ReadOffset += inNumBytes;
+}
@@ -0,0 +1,52 @@
+#ifndef WORLDSTATEBUFFER_H
+#define WORLDSTATEBUFFER_H
+
+// The Jolt headers don't include Jolt.h. Always include Jolt.h before including any other Jolt header.
+// You can use Jolt.h in your precompiled header to speed up compilation.
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/StateRecorder.h>
+
+// STL includes
+#include <vector>
+
+// All Jolt symbols are in the JPH namespace
+using namespace JPH;
+
+// StateRecorder writing into a byte buffer that is kept between saves: once the buffer held the state of a world,
+// saving that world again doesn't allocate (Jolt's StateRecorderImpl writes into a new stringstream every time).
+// Filled by PhysicsSystem::SaveState, then read back by PhysicsSystem::RestoreState as many times as needed.
+class WorldStateBuffer final : public StateRecorder
+{
+public:
+	// Starts a new state, keeping the memory of the previous one
+	void BeginWrite();
+
+	// Rewinds to the start of the state, for a RestoreState
+	void BeginRead();
+
+	// Makes room for a state of inSize bytes
+	void Reserve(size_t inSize);
+
+	// Replaces the state with a copy of inOther's. Keeps the memory like BeginWrite.
+	void CopyFrom(const WorldStateBuffer& inOther);
+
+	// See StreamOut / StreamIn
+	virtual void WriteBytes(const void* inData, size_t inNumBytes) override;
+	virtual void ReadBytes(void* outData, size_t inNumBytes) override;
+	virtual bool IsEOF() const override { return ReadOffset >= Size; }
+
+	// True if a read went past the end of the state
+	virtual bool IsFailed() const override { return bIsFailed; }
+
+	size_t GetSize() const { return Size; }
+	size_t GetCapacity() const { return Data.size(); }
+
+private:
+	// Data.size() is the capacity, [0, Size) the state: growing the state doesn't zero the bytes it overwrites anyway
+	std::vector<uint8> Data;
+	size_t Size = 0;
+	size_t ReadOffset = 0;
+	bool bIsFailed = false;
+};
+
+#endif
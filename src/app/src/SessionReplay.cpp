@@ -0,0 +1,216 @@
+#include "Communication/PhysicsServiceSession.h"
+#include "Communication/SessionRecording.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct ReplayConfig
+    {
+        std::string RecordingFilePath;
+
+        // Waits until each input's recorded arrival time instead of feeding the inputs back to back
+        bool bRecordedPacing = false;
+
+        std::string ShapeCacheFile;
+
+        // Overrides of the recorded job system, to compare the same session on other settings. -2 = as recorded.
+        int JobWorkerCount = -2;
+        int JobSystemType = -1;
+    };
+
+    constexpr uint64_t MaxReportedMismatches = 10;
+
+    bool ParseArguments(int argc, char** argv, ReplayConfig& outConfig)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            if(argument.rfind("--", 0) != 0)
+            {
+                outConfig.RecordingFilePath = argument;
+                continue;
+            }
+
+            const size_t equalsPosition = argument.find('=');
+            const std::string optionName = argument.substr(2, equalsPosition == std::string::npos ? std::string::npos : equalsPosition - 2);
+            const std::string optionValue = equalsPosition == std::string::npos ? "" : argument.substr(equalsPosition + 1);
+            if(optionName == "pacing" && (optionValue == "full" || optionValue == "recorded"))
+            {
+                outConfig.bRecordedPacing = optionValue == "recorded";
+            }
+            else if(optionName == "shape-cache-file" && !optionValue.empty())
+            {
+                outConfig.ShapeCacheFile = optionValue;
+            }
+            else if(optionName == "job-workers" && !optionValue.empty())
+            {
+                outConfig.JobWorkerCount = std::atoi(optionValue.c_str());
+            }
+            else if(optionName == "job-system" && (optionValue == "stealing" || optionValue == "pool"))
+            {
+                outConfig.JobSystemType = optionValue == "stealing" ? (int)EJobSystemType::WorkStealing : (int)EJobSystemType::ThreadPool;
+            }
+            else
+            {
+                printf("Invalid argument \"%s\"\n", argument.c_str());
+                return false;
+            }
+        }
+
+        if(outConfig.RecordingFilePath.empty())
+        {
+            printf("No recording given\n");
+            return false;
+        }
+        return true;
+    }
+}
+
+// Replays a session recorded by the service (--record-dir, see SessionRecording.h) through a new session, with no client:
+// the same bytes, in the same chunks, as the transport received them. Checks that every response matches the recorded
+// digest, and leaves the session's latency measures in StepPhysicsMeasure like the service does.
+// Usage: SessionReplay <recording.jsrec> [--pacing=full|recorded] [--shape-cache-file=path] [--job-workers=count] [--job-system=stealing|pool]
+// Shapes the recorded session used without defining them (DefineShape) must come from the shape cache file.
+// Returns 0 if every response matched, 1 on a mismatch, 2 if the recording couldn't be read.
+int main(int argc, char** argv)
+{
+    using namespace SessionRecording;
+
+    ReplayConfig replayConfig;
+    if(!ParseArguments(argc, argv, replayConfig))
+    {
+        printf("Usage: SessionReplay <recording.jsrec> [--pacing=full|recorded] [--shape-cache-file=path] [--job-workers=count] [--job-system=stealing|pool]\n");
+        return 2;
+    }
+
+    SessionRecordingReader recordingReader;
+    if(!recordingReader.Open(replayConfig.RecordingFilePath))
+    {
+        return 2;
+    }
+
+    const FileHeader& recordingHeader = recordingReader.GetFileHeader();
+    const std::time_t recordingStartTime = (std::time_t)(recordingHeader.StartTime / 1000000000ull);
+    char recordingStartTimeText[64];
+    std::strftime(recordingStartTimeText, sizeof(recordingStartTimeText), "%Y-%m-%d %H:%M:%S", std::localtime(&recordingStartTime));
+    printf("Replaying session %d recorded on %s (%zu bytes), %s pacing\n", recordingHeader.SessionId, recordingStartTimeText,
+        recordingReader.GetFileSize(), replayConfig.bRecordedPacing ? "recorded" : "full speed");
+
+    PhysicsServiceImpl::InitializeJoltRuntime();
+    if(!replayConfig.ShapeCacheFile.empty())
+    {
+        PhysicsServiceImpl::GetShapeCache().LoadNamedShapes(replayConfig.ShapeCacheFile);
+    }
+
+    uint64_t mismatchCount = 0;
+    {
+        PhysicsServiceSession replaySession(recordingHeader.SessionId);
+        if(recordingHeader.bIsProtocolModeNegotiated)
+        {
+            replaySession.SetProtocolMode(recordingHeader.ProtocolMode);
+        }
+        replaySession.SetPipelinedStepping(recordingHeader.bPipelinedStepping);
+
+        JobSystemSettings jobSettings = recordingHeader.JobSettings;
+        if(replayConfig.JobWorkerCount != -2)
+        {
+            jobSettings.WorkerCount = replayConfig.JobWorkerCount;
+        }
+        if(replayConfig.JobSystemType != -1)
+        {
+            jobSettings.Type = (EJobSystemType)replayConfig.JobSystemType;
+        }
+        replaySession.SetJobSystemSettings(jobSettings);
+
+        // Responses to the last input, taken out of the session as a transport would send them
+        std::vector<char> replayOutput;
+        bool bHasReplayOutput = false;
+
+        uint64_t inputCount = 0;
+        uint64_t inputBytes = 0;
+        uint64_t comparedOutputCount = 0;
+        uint64_t timingDependentOutputCount = 0;
+        RecordHeader recordHeader;
+        const char* recordPayload = nullptr;
+
+        const std::chrono::steady_clock::time_point replayStartTime = std::chrono::steady_clock::now();
+        while(recordingReader.ReadNextRecord(recordHeader, recordPayload))
+        {
+            if(recordHeader.Type == ERecordType::Input)
+            {
+                if(replayConfig.bRecordedPacing)
+                {
+                    std::this_thread::sleep_until(replayStartTime + std::chrono::nanoseconds(recordHeader.Time));
+                }
+
+                replaySession.ProcessReceivedData(recordPayload, recordHeader.PayloadLength);
+
+                iovec outputSegments[2];
+                const int outputSegmentCount = replaySession.GetPendingOutputSegments(outputSegments);
+                replayOutput.clear();
+                for(int i = 0; i < outputSegmentCount; ++i)
+                {
+                    const char* outputSegment = static_cast<const char*>(outputSegments[i].iov_base);
+                    replayOutput.insert(replayOutput.end(), outputSegment, outputSegment + outputSegments[i].iov_len);
+                }
+                replaySession.ConsumePendingOutput(replaySession.GetPendingOutputSize());
+
+                bHasReplayOutput = true;
+                ++inputCount;
+                inputBytes += recordHeader.PayloadLength;
+                continue;
+            }
+
+            if(recordHeader.Type != ERecordType::Output || recordHeader.PayloadLength != OutputRecordPayloadSize || !bHasReplayOutput)
+            {
+                continue;
+            }
+            bHasReplayOutput = false;
+
+            if(recordHeader.Flags & OutputTimingDependentFlag)
+            {
+                ++timingDependentOutputCount;
+                continue;
+            }
+
+            ++comparedOutputCount;
+            const uint64_t recordedOutputSize = PhysicsServiceProtocol::ReadLittleEndian<uint64_t>(recordPayload);
+            const uint64_t recordedOutputDigest = PhysicsServiceProtocol::ReadLittleEndian<uint64_t>(recordPayload + 8);
+            if(recordedOutputSize == replayOutput.size() && recordedOutputDigest == ComputeOutputDigest(replayOutput.data(), replayOutput.size()))
+            {
+                continue;
+            }
+
+            ++mismatchCount;
+            if(mismatchCount <= MaxReportedMismatches)
+            {
+                printf("Mismatch: responses to input %llu (%.3f s into the recording) are %zu bytes, recorded %llu bytes%s\n",
+                    (unsigned long long)inputCount, recordHeader.Time / 1e9, replayOutput.size(), (unsigned long long)recordedOutputSize,
+                    recordedOutputSize == replayOutput.size() ? " with other contents" : "");
+            }
+        }
+        const double replaySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStartTime).count();
+
+        if(recordingReader.IsTruncated())
+        {
+            printf("The recording ends with an incomplete record (service killed while recording?): replayed up to it\n");
+        }
+
+        printf("Replayed %llu inputs (%llu bytes) in %.3f s. %llu responses compared, %llu mismatched, %llu not comparable (measures)\n",
+            (unsigned long long)inputCount, (unsigned long long)inputBytes, replaySeconds, (unsigned long long)comparedOutputCount,
+            (unsigned long long)mismatchCount, (unsigned long long)timingDependentOutputCount);
+
+        // Step latency percentiles and measure files, as for a served session
+        replaySession.CloseSession();
+    }
+
+    PhysicsServiceImpl::ShutdownJoltRuntime();
+
+    return mismatchCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include "../PhysicsSimulation/PhysicsServiceImpl.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	int FailedCheckCount = 0;
+
+	void Check(bool bCondition, const char* description)
+	{
+		if(!bCondition)
+		{
+			printf("FAILED: %s\n", description);
+			++FailedCheckCount;
+		}
+	}
+
+	// Dynamic spheres with the ids 1 to actorCount, side by side above the floor
+	std::vector<ActorInitializationInfo> CreateActors(int actorCount)
+	{
+		std::vector<ActorInitializationInfo> actors(actorCount);
+		for(int i = 0; i < actorCount; ++i)
+		{
+			actors[i].ActorId = i + 1;
+			actors[i].InitialPosX = i * 200.0;
+			actors[i].InitialPosZ = 500.0;
+		}
+		return actors;
+	}
+
+	bool IsActorBody(const PhysicsServiceImpl& physicsService, uint32 actorId)
+	{
+		return std::find(physicsService.BodyIdList.begin(), physicsService.BodyIdList.end(), BodyID(actorId)) != physicsService.BodyIdList.end();
+	}
+
+	BodyImpulseCommand CreateImpulse(uint32 actorId)
+	{
+		BodyImpulseCommand impulseCommand;
+		impulseCommand.ActorId = actorId;
+		impulseCommand.Impulse[2] = 1000.f;
+		impulseCommand.AngularImpulse[0] = 10.f;
+		return impulseCommand;
+	}
+
+	BodyVelocityCommand CreateVelocity(uint32 actorId)
+	{
+		BodyVelocityCommand velocityCommand;
+		velocityCommand.ActorId = actorId;
+		velocityCommand.LinearVelocity[0] = 100.f;
+		return velocityCommand;
+	}
+
+	// An impulse and a velocity queued for an actor, then its despawn in the same batch: the step must not touch the destroyed body
+	void TestDespawnAfterBodyCommands()
+	{
+		PhysicsServiceImpl physicsService;
+		physicsService.InitPhysicsSystem(CreateActors(4));
+
+		Check(physicsService.QueueAddBodyImpulses({ CreateImpulse(3) }), "impulse on an actor is queued");
+		Check(physicsService.QueueSetBodyVelocities({ CreateVelocity(3) }), "velocity on an actor is queued");
+		Check(physicsService.QueueDespawnBodies({ 3 }), "despawn of an actor is queued");
+
+		// Once despawned in the batch, the id isn't an actor anymore
+		Check(!physicsService.QueueAddBodyImpulses({ CreateImpulse(3) }), "impulse after the despawn is rejected");
+
+		std::vector<char> stepResponse;
+		physicsService.StepPhysicsSimulationBinary(stepResponse);
+		Check(physicsService.BodyIdList.size() == 3 && !IsActorBody(physicsService, 3), "despawned actor is gone");
+
+		// The other actors still take commands, and the id can be spawned again
+		Check(physicsService.QueueAddBodyImpulses({ CreateImpulse(2) }), "impulse on a remaining actor is queued");
+		std::vector<ActorInitializationInfo> spawnActors(1, CreateActors(3)[2]);
+		Check(physicsService.QueueSpawnBodies(spawnActors), "spawn of the despawned id is queued");
+		stepResponse.clear();
+		physicsService.StepPhysicsSimulationBinary(stepResponse);
+		Check(physicsService.BodyIdList.size() == 4 && IsActorBody(physicsService, 3), "despawned id is spawned again");
+	}
+
+	// An impulse and a velocity queued for a spawn whose body can't be created (unknown cached shape)
+	void TestBodyCommandsOfFailedSpawn()
+	{
+		PhysicsServiceImpl physicsService;
+		physicsService.InitPhysicsSystem(CreateActors(2));
+
+		std::vector<ActorInitializationInfo> spawnActors(1);
+		spawnActors[0].ActorId = 7;
+		spawnActors[0].InitialPosZ = 500.0;
+		spawnActors[0].ShapeType = EActorShapeType::Cached;
+		spawnActors[0].ShapeName = "UnknownShape";
+		Check(physicsService.QueueSpawnBodies(spawnActors), "spawn with an unknown shape is queued");
+		Check(physicsService.QueueAddBodyImpulses({ CreateImpulse(7) }), "impulse on a queued spawn is queued");
+		Check(physicsService.QueueSetBodyVelocities({ CreateVelocity(7) }), "velocity on a queued spawn is queued");
+
+		std::vector<char> stepResponse;
+		physicsService.StepPhysicsSimulationBinary(stepResponse);
+		Check(physicsService.BodyIdList.size() == 2 && !IsActorBody(physicsService, 7), "failed spawn has no body");
+
+		// The id of the failed spawn is free again
+		spawnActors[0].ShapeType = EActorShapeType::Sphere;
+		Check(physicsService.QueueSpawnBodies(spawnActors), "id of the failed spawn is spawned again");
+		stepResponse.clear();
+		physicsService.StepPhysicsSimulationBinary(stepResponse);
+		Check(physicsService.BodyIdList.size() == 3 && IsActorBody(physicsService, 7), "spawn after the failed one has a body");
+	}
+}
+
+// Regression tests of the body commands (see BodyCommandQueue and PhysicsServiceImpl::ApplyBodyCommands).
+// Run by ctest, fails (exit code 1) if a check failed.
+int main()
+{
+	PhysicsServiceImpl::InitializeJoltRuntime();
+
+	TestDespawnAfterBodyCommands();
+	TestBodyCommandsOfFailedSpawn();
+
+	PhysicsServiceImpl::ShutdownJoltRuntime();
+
+	if(FailedCheckCount > 0)
+	{
+		printf("%d check(s) failed\n", FailedCheckCount);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,192 @@
+#include "../PhysicsSimulation/PhysicsServiceImpl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace
+{
+	// Every operator new of the process and every allocation of Jolt (JPH::Allocate / AlignedAllocate, also behind
+	// TempAllocatorMalloc when the temp allocator isn't preallocated), on any thread: the test's and the job system's
+	std::atomic<uint64_t> AllocationCount { 0 };
+
+	void* AllocateCounted(std::size_t size)
+	{
+		AllocationCount.fetch_add(1, std::memory_order_relaxed);
+		if(void* memory = std::malloc(size > 0 ? size : 1))
+		{
+			return memory;
+		}
+		throw std::bad_alloc();
+	}
+
+	void* AllocateCountedAligned(std::size_t size, std::align_val_t alignment)
+	{
+		AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+		// aligned_alloc wants a multiple of the alignment
+		const std::size_t alignmentBytes = static_cast<std::size_t>(alignment);
+		const std::size_t alignedSize = std::max((size + alignmentBytes - 1) / alignmentBytes * alignmentBytes, alignmentBytes);
+		if(void* memory = std::aligned_alloc(alignmentBytes, alignedSize))
+		{
+			return memory;
+		}
+		throw std::bad_alloc();
+	}
+}
+
+// Counting replacements of the global allocation functions
+void* operator new(std::size_t size) { return AllocateCounted(size); }
+void* operator new[](std::size_t size) { return AllocateCounted(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return AllocateCountedAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return AllocateCountedAligned(size, alignment); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace
+{
+	// Counts the calls of one of Jolt's allocation function pointers, then calls the function it replaced
+	template <int HookIndex, class Function>
+	struct CountedJoltFunction;
+
+	template <int HookIndex, class Result, class... Arguments>
+	struct CountedJoltFunction<HookIndex, Result (*)(Arguments...)>
+	{
+		static inline Result (*ReplacedFunction)(Arguments...) = nullptr;
+
+		static Result Call(Arguments... arguments)
+		{
+			AllocationCount.fetch_add(1, std::memory_order_relaxed);
+			return ReplacedFunction(arguments...);
+		}
+	};
+
+	template <int HookIndex, class Function>
+	void HookJoltFunction(Function& ioFunction)
+	{
+		CountedJoltFunction<HookIndex, Function>::ReplacedFunction = ioFunction;
+		ioFunction = &CountedJoltFunction<HookIndex, Function>::Call;
+	}
+
+	// After RegisterDefaultAllocator (PhysicsServiceImpl::InitializeJoltRuntime). The frees aren't counted.
+	void HookJoltAllocator()
+	{
+		HookJoltFunction<0>(JPH::Allocate);
+		HookJoltFunction<1>(JPH::AlignedAllocate);
+
+		// Jolt's own containers reallocate from version 4 on, version 3 uses std::vector over Allocate
+#if defined(JPH_VERSION_MAJOR) && JPH_VERSION_MAJOR >= 4
+		HookJoltFunction<2>(JPH::Reallocate);
+#endif
+	}
+
+	struct StepAllocationConfig
+	{
+		const char* Name = "";
+		EJobSystemType JobSystemType = EJobSystemType::WorkStealing;
+		EStepResponseMode StepResponseMode = EStepResponseMode::Full;
+	};
+
+	constexpr int cActorsPerRow = 15;
+	constexpr int cActorCount = cActorsPerRow * cActorsPerRow * 2;
+
+	// Long enough for the actors to land on the floor and most of them to fall asleep: the responses and events
+	// reached their largest size, so the buffers reused between steps are grown
+	constexpr int cWarmUpStepCount = 600;
+	constexpr int cMeasuredStepCount = 300;
+
+	// Two layers of spheres over the floor, falling onto each other
+	std::vector<ActorInitializationInfo> CreateActors()
+	{
+		std::vector<ActorInitializationInfo> actors(cActorCount);
+		for(int i = 0; i < cActorCount; ++i)
+		{
+			actors[i].ActorId = i + 1;
+			actors[i].InitialPosX = (i % cActorsPerRow - cActorsPerRow / 2) * 120.0 + (i / (cActorsPerRow * cActorsPerRow)) * 30.0;
+			actors[i].InitialPosY = (i / cActorsPerRow % cActorsPerRow - cActorsPerRow / 2) * 120.0;
+			actors[i].InitialPosZ = 300.0 + (i / (cActorsPerRow * cActorsPerRow)) * 150.0;
+		}
+		return actors;
+	}
+
+	// Returns the amount of allocations during the measured steps
+	uint64_t RunSteps(const StepAllocationConfig& config)
+	{
+		PhysicsServiceImpl physicsService;
+		physicsService.SetJobSystemSettings({ config.JobSystemType, 3, false });
+		physicsService.SetStepResponseMode(config.StepResponseMode, 0.1f, 0.005f);
+		physicsService.InitPhysicsSystem(CreateActors());
+
+		std::vector<char> stepResponse;
+		std::vector<BodyImpulseCommand> impulseCommands(1);
+		impulseCommands[0].Impulse[2] = 50000.f;
+
+		// One actor gets an impulse (and wakes up) every step, so the measured steps don't just idle
+		const auto runStep = [&](int stepIndex)
+		{
+			impulseCommands[0].ActorId = (uint32)(stepIndex * 7 % cActorCount + 1);
+			physicsService.QueueAddBodyImpulses(impulseCommands);
+
+			stepResponse.clear();
+			physicsService.StepPhysicsSimulationBinary(stepResponse);
+		};
+
+		for(int i = 0; i < cWarmUpStepCount; ++i)
+		{
+			runStep(i);
+		}
+
+		const uint64_t preStepsAllocationCount = AllocationCount.load(std::memory_order_relaxed);
+		for(int i = 0; i < cMeasuredStepCount; ++i)
+		{
+			runStep(cWarmUpStepCount + i);
+		}
+		return AllocationCount.load(std::memory_order_relaxed) - preStepsAllocationCount;
+	}
+}
+
+// Checks that a warmed up step doesn't allocate: no operator new and no Jolt allocation, on any thread.
+// Run by ctest, fails (exit code 1) if a configuration allocated. Pipelined stepping isn't covered: it saves the world before
+// every step it simulates ahead (to roll it back, see PhysicsServiceImpl::TakePipelinedStep), and Jolt's SaveState
+// sorts the contact cache into a temporary array.
+int main()
+{
+	PhysicsServiceImpl::InitializeJoltRuntime();
+	HookJoltAllocator();
+
+	const StepAllocationConfig configs[] =
+	{
+		{ "work stealing, full responses", EJobSystemType::WorkStealing, EStepResponseMode::Full },
+		{ "work stealing, delta responses", EJobSystemType::WorkStealing, EStepResponseMode::Delta },
+		{ "thread pool, full responses", EJobSystemType::ThreadPool, EStepResponseMode::Full }
+	};
+
+	int failedConfigCount = 0;
+	for(const StepAllocationConfig& config : configs)
+	{
+		const uint64_t allocationCount = RunSteps(config);
+		printf("%s: %llu allocations in %d steps\n", config.Name, (unsigned long long)allocationCount, cMeasuredStepCount);
+		if(allocationCount > 0)
+		{
+			++failedConfigCount;
+		}
+	}
+
+	PhysicsServiceImpl::ShutdownJoltRuntime();
+
+	if(failedConfigCount > 0)
+	{
+		printf("FAILED: %d configuration(s) allocated after the warm-up\n", failedConfigCount);
+		return 1;
+	}
+	return 0;
+}